@@ -0,0 +1,53 @@
+#
+# Copyright 2025 The Propeller Authors.
+#
+# Licensed under the Apache License, Version 2.0 (the "License");
+# you may not use this file except in compliance with the License.
+# You may obtain a copy of the License at
+#
+#      https://www.apache.org/licenses/LICENSE-2.0
+#
+# Unless required by applicable law or agreed to in writing, software
+# distributed under the License is distributed on an "AS IS" BASIS,
+# WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+# See the License for the specific language governing permissions and
+# limitations under the License.
+#
+# Integrates Google Benchmark into the build.
+
+# LINT.IfChange(version)
+set(_BENCHMARK_VERSION 1.9.1)
+# LINT.ThenChange(../../MODULE.bazel:benchmark_version)
+
+set(propeller_benchmark_build_dir ${CMAKE_BINARY_DIR}/benchmark-build)
+set(propeller_benchmark_download_url https://github.com/google/benchmark/archive/refs/tags/v${_BENCHMARK_VERSION}.zip)
+set(propeller_benchmark_src_dir ${CMAKE_BINARY_DIR}/benchmark-src)
+
+# Configure the external benchmark project.
+configure_file(
+  ${CMAKE_CURRENT_LIST_DIR}/CMakeLists.txt.in
+  ${CMAKE_BINARY_DIR}/benchmark-external/CMakeLists.txt
+)
+
+# Benchmark's own tests are not needed.
+set(BENCHMARK_ENABLE_TESTING OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_GTEST_TESTS OFF CACHE BOOL "" FORCE)
+set(BENCHMARK_ENABLE_INSTALL OFF CACHE BOOL "" FORCE)
+
+# Build the external benchmark project.
+execute_process(COMMAND ${CMAKE_COMMAND} -G "${CMAKE_GENERATOR}" .
+  RESULT_VARIABLE result
+  WORKING_DIRECTORY ${CMAKE_BINARY_DIR}/benchmark-external )
+if(result)
+  message(FATAL_ERROR "CMake step for benchmark failed: ${result}")
+endif()
+
+execute_process(COMMAND ${CMAKE_COMMAND} --build .
+  RESULT_VARIABLE result
+  WORKING_DIRECTORY ${CMAKE_BINARY_DIR}/benchmark-external)
+if(result)
+  message(FATAL_ERROR "Build step for benchmark failed: ${result}")
+endif()
+
+# Add the external benchmark project to the build.
+add_subdirectory(${propeller_benchmark_src_dir} ${propeller_benchmark_build_dir} EXCLUDE_FROM_ALL)
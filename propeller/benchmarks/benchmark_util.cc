@@ -0,0 +1,127 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/benchmarks/benchmark_util.h"
+
+#include <cstdint>
+#include <cstdlib>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_set.h"
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/branch_aggregation.h"
+#include "propeller/file_perf_data_provider.h"
+#include "propeller/lbr_branch_aggregator.h"
+#include "propeller/path_node.h"
+#include "propeller/perf_data_path_profile_aggregator.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/perf_lbr_aggregator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/program_cfg_builder.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+namespace {
+constexpr absl::string_view kBinaryName = "bimodal_sample_v2.bin";
+constexpr absl::string_view kPerfDataNames[] = {"bimodal_sample_v2.perfdata.1",
+                                                "bimodal_sample_v2.perfdata.2"};
+}  // namespace
+
+std::string GetTestDataFilePath(absl::string_view file_name) {
+  if (const char *testdata_dir = std::getenv("PROPELLER_TESTDATA_DIR"))
+    return absl::StrCat(testdata_dir, "/", file_name);
+  if (const char *runfiles_dir = std::getenv("TEST_SRCDIR"))
+    return absl::StrCat(runfiles_dir, "/_main/propeller/testdata/", file_name);
+  return absl::StrCat("propeller/testdata/", file_name);
+}
+
+PropellerOptions GetBenchmarkOptions(absl::string_view output_dir) {
+  PropellerOptions options;
+  options.set_binary_name(GetTestDataFilePath(kBinaryName));
+  for (absl::string_view perf_data_name : kPerfDataNames) {
+    InputProfile &input_profile = *options.add_input_profiles();
+    input_profile.set_name(GetTestDataFilePath(perf_data_name));
+    input_profile.set_type(PERF_LBR);
+  }
+  if (!output_dir.empty()) {
+    options.set_cluster_out_name(absl::StrCat(output_dir, "/cc_profile.txt"));
+    options.set_symbol_order_out_name(
+        absl::StrCat(output_dir, "/ld_profile.txt"));
+  }
+  options.mutable_path_profile_options()->set_enable_cloning(true);
+  return options;
+}
+
+std::unique_ptr<PerfDataProvider> GetPerfDataProvider(
+    const PropellerOptions &options) {
+  std::vector<std::string> file_names;
+  for (const InputProfile &input_profile : options.input_profiles())
+    file_names.push_back(input_profile.name());
+  return std::make_unique<GenericFilePerfDataProvider>(std::move(file_names));
+}
+
+std::unique_ptr<PipelineState> RunPipeline(PipelineStage last_stage) {
+  auto state = std::make_unique<PipelineState>();
+  state->options = GetBenchmarkOptions();
+
+  absl::StatusOr<std::unique_ptr<BinaryContent>> binary_content =
+      GetBinaryContent(state->options.binary_name());
+  CHECK_OK(binary_content);
+  state->binary_content = *std::move(binary_content);
+  if (last_stage == PipelineStage::kBinaryLoad) return state;
+
+  LbrBranchAggregator branch_aggregator(
+      std::make_unique<PerfLbrAggregator>(GetPerfDataProvider(state->options)),
+      state->options, *state->binary_content);
+  absl::StatusOr<absl::flat_hash_set<uint64_t>> hot_addresses =
+      branch_aggregator.GetBranchEndpointAddresses();
+  CHECK_OK(hot_addresses);
+  absl::StatusOr<std::unique_ptr<BinaryAddressMapper>> binary_address_mapper =
+      BuildBinaryAddressMapper(state->options, *state->binary_content,
+                               state->stats, &*hot_addresses);
+  CHECK_OK(binary_address_mapper);
+  state->binary_address_mapper = *std::move(binary_address_mapper);
+  if (last_stage == PipelineStage::kAddressMapping) return state;
+
+  absl::StatusOr<BranchAggregation> branch_aggregation =
+      branch_aggregator.Aggregate(*state->binary_address_mapper, state->stats);
+  CHECK_OK(branch_aggregation);
+  state->branch_aggregation = *std::move(branch_aggregation);
+  if (last_stage == PipelineStage::kBranchAggregation) return state;
+
+  absl::StatusOr<std::unique_ptr<ProgramCfg>> program_cfg =
+      ProgramCfgBuilder(state->binary_address_mapper.get(), state->stats)
+          .Build(state->branch_aggregation);
+  CHECK_OK(program_cfg);
+  state->program_cfg = *std::move(program_cfg);
+  if (last_stage == PipelineStage::kCfgBuild) return state;
+
+  absl::StatusOr<ProgramPathProfile> program_path_profile =
+      PerfDataPathProfileAggregator(state->options,
+                                    GetPerfDataProvider(state->options))
+          .Aggregate(*state->binary_content, *state->binary_address_mapper,
+                     *state->program_cfg);
+  CHECK_OK(program_path_profile);
+  state->program_path_profile = *std::move(program_path_profile);
+  return state;
+}
+}  // namespace propeller
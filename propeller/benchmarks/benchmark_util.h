@@ -0,0 +1,77 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_BENCHMARKS_BENCHMARK_UTIL_H_
+#define PROPELLER_BENCHMARKS_BENCHMARK_UTIL_H_
+
+#include <memory>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/branch_aggregation.h"
+#include "propeller/path_node.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+
+// Returns the path of `file_name` in the Propeller testdata directory. The
+// directory is taken from `$PROPELLER_TESTDATA_DIR` if set, and from the Bazel
+// runfiles tree (`$TEST_SRCDIR`) otherwise. As a last resort, the path is
+// relative to the working directory, which works under `bazel run` and when
+// running from the source root.
+std::string GetTestDataFilePath(absl::string_view file_name);
+
+// Returns the options for generating the profile of the benchmark binary
+// (bimodal_sample_v2.bin) from its LBR perf data files, with path cloning
+// enabled. Output profiles are written to `output_dir`.
+PropellerOptions GetBenchmarkOptions(absl::string_view output_dir = "");
+
+// Returns a provider of the perf data files in `options.input_profiles()`.
+std::unique_ptr<PerfDataProvider> GetPerfDataProvider(
+    const PropellerOptions &options);
+
+// Stages of the profile generation pipeline, in the order in which they run.
+enum class PipelineStage {
+  kBinaryLoad,
+  kAddressMapping,
+  kBranchAggregation,
+  kCfgBuild,
+  kPathProfiling,
+};
+
+// Intermediate results of the profile generation pipeline on the benchmark
+// binary. Benchmarks compute the stages preceding the measured stage once,
+// outside of the timed loop.
+struct PipelineState {
+  PropellerOptions options;
+  std::unique_ptr<BinaryContent> binary_content;
+  PropellerStats stats;
+  std::unique_ptr<BinaryAddressMapper> binary_address_mapper;
+  BranchAggregation branch_aggregation;
+  std::unique_ptr<ProgramCfg> program_cfg;
+  ProgramPathProfile program_path_profile;
+};
+
+// Runs the pipeline with `GetBenchmarkOptions()` up to and including
+// `last_stage`. Dies if any stage fails, since no measurement is meaningful
+// then.
+std::unique_ptr<PipelineState> RunPipeline(PipelineStage last_stage);
+}  // namespace propeller
+
+#endif  // PROPELLER_BENCHMARKS_BENCHMARK_UTIL_H_
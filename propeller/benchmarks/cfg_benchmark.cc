@@ -0,0 +1,126 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of mapping binary addresses to basic blocks, of building the
+// program cfg from the branch aggregation, and of the `CfgBuilder` operations
+// used for applying clonings.
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "benchmark/benchmark.h"
+#include "propeller/benchmarks/benchmark_util.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/branch_aggregation.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_testutil.h"
+#include "propeller/program_cfg.h"
+#include "propeller/program_cfg_builder.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+
+void BM_FindBbHandleIndexUsingBinaryAddress(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBranchAggregation);
+  // Look up both endpoints of every aggregated branch, like the cfg builder.
+  std::vector<std::pair<uint64_t, BranchDirection>> lookups;
+  for (const auto &[branch, count] :
+       pipeline_state->branch_aggregation.branch_counters) {
+    lookups.emplace_back(branch.from, BranchDirection::kFrom);
+    lookups.emplace_back(branch.to, BranchDirection::kTo);
+  }
+  const BinaryAddressMapper &binary_address_mapper =
+      *pipeline_state->binary_address_mapper;
+  for (auto _ : state) {
+    for (const auto &[address, direction] : lookups) {
+      benchmark::DoNotOptimize(
+          binary_address_mapper.FindBbHandleIndexUsingBinaryAddress(address,
+                                                                    direction));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * lookups.size());
+}
+BENCHMARK(BM_FindBbHandleIndexUsingBinaryAddress);
+
+void BM_ColumnarBranchAggregation(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBranchAggregation);
+  for (auto _ : state) {
+    benchmark::DoNotOptimize(
+        ColumnarBranchAggregation(pipeline_state->branch_aggregation));
+  }
+}
+BENCHMARK(BM_ColumnarBranchAggregation);
+
+void BM_ProgramCfgBuilderBuild(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBranchAggregation);
+  const ColumnarBranchAggregation branch_aggregation(
+      pipeline_state->branch_aggregation);
+  for (auto _ : state) {
+    PropellerStats stats;
+    absl::StatusOr<std::unique_ptr<ProgramCfg>> program_cfg =
+        ProgramCfgBuilder(pipeline_state->binary_address_mapper.get(), stats)
+            .Build(branch_aggregation);
+    CHECK_OK(program_cfg);
+    benchmark::DoNotOptimize(*program_cfg);
+  }
+}
+BENCHMARK(BM_ProgramCfgBuilderBuild)->Unit(benchmark::kMicrosecond);
+
+// Benchmarks cloning a `CfgBuilder` with `state.range(0)` changes, each
+// committed on its own as when applying the clonings of a function one by one.
+// The time should not depend on the number of committed changes.
+void BM_CfgBuilderClone(benchmark::State &state) {
+  const int num_changes = state.range(0);
+  std::unique_ptr<ControlFlowGraph> cfg =
+      BuildChainCfg(/*num_blocks=*/3 * num_changes + 1, /*weight=*/100);
+  CfgBuilder cfg_builder(cfg.get());
+  for (int i = 0; i < num_changes; ++i) {
+    cfg_builder.AddCfgChange(GetChainCfgChange(i, /*weight=*/10));
+    cfg_builder.CommitCfgChanges();
+  }
+  for (auto _ : state) benchmark::DoNotOptimize(cfg_builder.Clone());
+}
+BENCHMARK(BM_CfgBuilderClone)->Range(16, 4096);
+
+// Benchmarks adding and committing `state.range(0)` changes one by one.
+void BM_CfgBuilderCommitCfgChanges(benchmark::State &state) {
+  const int num_changes = state.range(0);
+  std::unique_ptr<ControlFlowGraph> cfg =
+      BuildChainCfg(/*num_blocks=*/3 * num_changes + 1, /*weight=*/100);
+  std::vector<CfgChangeFromPathCloning> cfg_changes;
+  for (int i = 0; i < num_changes; ++i)
+    cfg_changes.push_back(GetChainCfgChange(i, /*weight=*/10));
+  for (auto _ : state) {
+    CfgBuilder cfg_builder(cfg.get());
+    for (const CfgChangeFromPathCloning &cfg_change : cfg_changes) {
+      cfg_builder.AddCfgChange(cfg_change);
+      cfg_builder.CommitCfgChanges();
+    }
+    benchmark::DoNotOptimize(cfg_builder);
+  }
+  state.SetItemsProcessed(state.iterations() * num_changes);
+}
+BENCHMARK(BM_CfgBuilderCommitCfgChanges)
+    ->Range(16, 4096)
+    ->Unit(benchmark::kMicrosecond);
+}  // namespace
+}  // namespace propeller
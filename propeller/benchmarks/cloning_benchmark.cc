@@ -0,0 +1,96 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmark of evaluating the path clonings of all hot functions.
+
+#include <cmath>
+#include <memory>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "benchmark/benchmark.h"
+#include "propeller/benchmarks/benchmark_util.h"
+#include "propeller/path_clone_evaluator.h"
+#include "propeller/path_profile_options.pb.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+
+// Evaluates the clonings with `local_clone_relayout` set to `state.range(0)`.
+// For local relayout, also reports the clonings which are only accepted by one
+// of the two relayout modes and the mean absolute difference between the local
+// and the full relayout scores of the clonings accepted by both.
+void BM_EvaluateAllClonings(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kPathProfiling);
+  PathProfileOptions path_profile_options =
+      pipeline_state->options.path_profile_options();
+  path_profile_options.set_local_clone_relayout(state.range(0));
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings;
+  for (auto _ : state) {
+    PropellerStats::CloningStats cloning_stats;
+    clonings = EvaluateAllClonings(
+        pipeline_state->program_cfg.get(),
+        &pipeline_state->program_path_profile,
+        pipeline_state->options.code_layout_params(), path_profile_options,
+        &cloning_stats);
+    benchmark::DoNotOptimize(clonings);
+  }
+  int num_evaluated_clonings = 0;
+  for (const auto &[function_index, function_clonings] : clonings)
+    num_evaluated_clonings += function_clonings.size();
+  state.counters["clonings"] = num_evaluated_clonings;
+  if (!path_profile_options.local_clone_relayout()) return;
+
+  path_profile_options.set_local_clone_relayout(false);
+  const absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      full_relayout_clonings = EvaluateAllClonings(
+          pipeline_state->program_cfg.get(),
+          &pipeline_state->program_path_profile,
+          pipeline_state->options.code_layout_params(), path_profile_options);
+  int num_common_clonings = 0;
+  double total_score_delta = 0;
+  for (const auto &[function_index, function_clonings] : clonings) {
+    auto it = full_relayout_clonings.find(function_index);
+    if (it == full_relayout_clonings.end()) continue;
+    for (const EvaluatedPathCloning &cloning : function_clonings) {
+      auto full_it = absl::c_find_if(
+          it->second, [&](const EvaluatedPathCloning &full_cloning) {
+            return full_cloning.path_cloning == cloning.path_cloning;
+          });
+      if (full_it == it->second.end()) continue;
+      ++num_common_clonings;
+      total_score_delta += std::abs(*cloning.score - *full_it->score);
+    }
+  }
+  int num_full_relayout_clonings = 0;
+  for (const auto &[function_index, function_clonings] :
+       full_relayout_clonings)
+    num_full_relayout_clonings += function_clonings.size();
+  state.counters["local_only_clonings"] =
+      num_evaluated_clonings - num_common_clonings;
+  state.counters["full_only_clonings"] =
+      num_full_relayout_clonings - num_common_clonings;
+  state.counters["mean_score_delta"] =
+      num_common_clonings == 0 ? 0 : total_score_delta / num_common_clonings;
+}
+BENCHMARK(BM_EvaluateAllClonings)
+    ->ArgName("local_relayout")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+}  // namespace
+}  // namespace propeller
@@ -0,0 +1,159 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of the code layout stage: building the chains of basic blocks,
+// clustering the chains, and the complete layout of all sections of the
+// testdata binary and of synthetic programs.
+
+#include <iterator>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "benchmark/benchmark.h"
+#include "propeller/benchmarks/benchmark_util.h"
+#include "propeller/cfg.h"
+#include "propeller/chain_cluster_builder.h"
+#include "propeller/code_layout.h"
+#include "propeller/code_layout_scorer.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/mock_program_cfg_builder.h"
+#include "propeller/node_chain.h"
+#include "propeller/node_chain_builder.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/synthetic_program_cfg.h"
+
+namespace propeller {
+namespace {
+
+// Builds the chains of `cfgs` the way `CodeLayout` does: all cfgs together when
+// `code_layout_params.inter_function_reordering()` is set, or one cfg at a
+// time otherwise.
+std::vector<std::unique_ptr<const NodeChain>> BuildChains(
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const std::vector<const ControlFlowGraph *> &cfgs) {
+  const PropellerCodeLayoutScorer scorer(code_layout_params);
+  const absl::flat_hash_map<int, std::vector<FunctionChainInfo::BbChain>>
+      initial_chains;
+  PropellerStats::CodeLayoutStats stats;
+  std::vector<std::unique_ptr<const NodeChain>> built_chains;
+  if (code_layout_params.inter_function_reordering()) {
+    absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
+                     NodeChainAssemblyBalancedTreeQueue>(scorer, cfgs,
+                                                         initial_chains, stats)
+                     .BuildChains(),
+                 std::back_inserter(built_chains));
+    return built_chains;
+  }
+  for (const ControlFlowGraph *cfg : cfgs) {
+    absl::c_move(
+        NodeChainBuilder::CreateNodeChainBuilder<
+            NodeChainAssemblyIterativeQueue>(scorer, {cfg}, initial_chains,
+                                             stats)
+            .BuildChains(),
+        std::back_inserter(built_chains));
+  }
+  return built_chains;
+}
+
+// Returns the code layout parameters for the benchmark argument: inter-function
+// reordering is enabled iff `state.range(0)` is nonzero.
+PropellerCodeLayoutParameters GetCodeLayoutParams(
+    const benchmark::State &state) {
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_inter_function_reordering(state.range(0) != 0);
+  return code_layout_params;
+}
+
+void BM_BuildChains(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kCfgBuild);
+  const PropellerCodeLayoutParameters code_layout_params =
+      GetCodeLayoutParams(state);
+  const std::vector<const ControlFlowGraph *> cfgs =
+      pipeline_state->program_cfg->GetCfgs();
+  for (auto _ : state)
+    benchmark::DoNotOptimize(BuildChains(code_layout_params, cfgs));
+  state.counters["cfgs"] = cfgs.size();
+}
+BENCHMARK(BM_BuildChains)
+    ->ArgName("inter_function_reordering")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_BuildClusters(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kCfgBuild);
+  const PropellerCodeLayoutParameters code_layout_params =
+      GetCodeLayoutParams(state);
+  const std::vector<const ControlFlowGraph *> cfgs =
+      pipeline_state->program_cfg->GetCfgs();
+  for (auto _ : state) {
+    // Clustering consumes the chains, so rebuild them outside of the timing.
+    state.PauseTiming();
+    std::vector<std::unique_ptr<const NodeChain>> chains =
+        BuildChains(code_layout_params, cfgs);
+    state.ResumeTiming();
+    benchmark::DoNotOptimize(
+        ChainClusterBuilder(code_layout_params, std::move(chains))
+            .BuildClusters());
+  }
+}
+BENCHMARK(BM_BuildClusters)
+    ->ArgName("inter_function_reordering")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+
+void BM_GenerateLayoutBySection(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kCfgBuild);
+  const PropellerCodeLayoutParameters code_layout_params =
+      GetCodeLayoutParams(state);
+  for (auto _ : state) {
+    PropellerStats::CodeLayoutStats stats;
+    benchmark::DoNotOptimize(GenerateLayoutBySection(
+        *pipeline_state->program_cfg, code_layout_params, stats));
+  }
+}
+BENCHMARK(BM_GenerateLayoutBySection)
+    ->ArgName("inter_function_reordering")
+    ->Arg(0)
+    ->Arg(1)
+    ->Unit(benchmark::kMicrosecond);
+// Measures the complete layout of a synthetic program with `state.range(0)`
+// functions, which is closer to the scale of production binaries than the
+// testdata binary.
+void BM_GenerateLayoutBySectionSynthetic(benchmark::State &state) {
+  const std::unique_ptr<ProtoProgramCfg> proto_program_cfg =
+      BuildFromCfgProto(GenerateSyntheticProgramCfg(
+          {.num_functions = static_cast<int>(state.range(0))}));
+  const PropellerCodeLayoutParameters code_layout_params;
+  for (auto _ : state) {
+    PropellerStats::CodeLayoutStats stats;
+    benchmark::DoNotOptimize(GenerateLayoutBySection(
+        proto_program_cfg->program_cfg(), code_layout_params, stats));
+  }
+}
+BENCHMARK(BM_GenerateLayoutBySectionSynthetic)
+    ->ArgName("functions")
+    ->Arg(1000)
+    ->Arg(10000)
+    ->Unit(benchmark::kMillisecond);
+}  // namespace
+}  // namespace propeller
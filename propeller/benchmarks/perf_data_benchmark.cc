@@ -0,0 +1,123 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of reading perf data: LBR aggregation and the translation of
+// runtime addresses to binary addresses. LBR aggregation also runs on
+// synthetic perf data of production size.
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "benchmark/benchmark.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "propeller/benchmarks/benchmark_util.h"
+#include "propeller/binary_content.h"
+#include "propeller/lbr_aggregation.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/perfdata_reader.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/resolve_mmap_name.h"
+#include "propeller/synthetic_perf_data.h"
+#include "src/quipper/perf_data.pb.h"
+
+namespace propeller {
+namespace {
+
+// Returns the reader of the first perf data file of the benchmark binary.
+PerfDataReader GetPerfDataReader(const PropellerOptions &options,
+                                 const BinaryContent &binary_content) {
+  absl::StatusOr<std::optional<PerfDataProvider::BufferHandle>> perf_data =
+      GetPerfDataProvider(options)->GetNext();
+  CHECK_OK(perf_data);
+  CHECK(perf_data->has_value());
+  absl::StatusOr<PerfDataReader> perf_data_reader = BuildPerfDataReader(
+      std::move(**perf_data), &binary_content, ResolveMmapName(options));
+  CHECK_OK(perf_data_reader);
+  return *std::move(perf_data_reader);
+}
+
+void BM_AggregateLbr(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBinaryLoad);
+  const PerfDataReader perf_data_reader = GetPerfDataReader(
+      pipeline_state->options, *pipeline_state->binary_content);
+  int64_t num_branches = 0;
+  for (auto _ : state) {
+    LbrAggregation lbr_aggregation;
+    perf_data_reader.AggregateLBR(&lbr_aggregation);
+    num_branches = lbr_aggregation.GetNumberOfBranchCounters();
+    benchmark::DoNotOptimize(lbr_aggregation);
+  }
+  state.counters["branches"] = num_branches;
+}
+BENCHMARK(BM_AggregateLbr)->Unit(benchmark::kMillisecond);
+
+// Aggregates synthetic perf data of the benchmark binary with `state.range(0)`
+// samples, spread over 4 processes.
+void BM_AggregateLbrSynthetic(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBinaryLoad);
+  absl::StatusOr<std::string> perf_data = GenerateSyntheticPerfData(
+      *pipeline_state->binary_content,
+      {.num_samples = static_cast<int>(state.range(0)), .num_processes = 4});
+  CHECK_OK(perf_data);
+  absl::StatusOr<PerfDataReader> perf_data_reader = BuildPerfDataReader(
+      {.description = "synthetic",
+       .buffer = llvm::MemoryBuffer::getMemBuffer(*perf_data)},
+      pipeline_state->binary_content.get(), /*match_mmap_name=*/"");
+  CHECK_OK(perf_data_reader);
+  for (auto _ : state) {
+    LbrAggregation lbr_aggregation;
+    perf_data_reader->AggregateLBR(&lbr_aggregation);
+    benchmark::DoNotOptimize(lbr_aggregation);
+  }
+  state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+BENCHMARK(BM_AggregateLbrSynthetic)
+    ->Arg(100000)
+    ->Arg(1000000)
+    ->Unit(benchmark::kMillisecond);
+
+void BM_RuntimeAddressToBinaryAddress(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBinaryLoad);
+  const PerfDataReader perf_data_reader = GetPerfDataReader(
+      pipeline_state->options, *pipeline_state->binary_content);
+  // The branch endpoints of all samples, in the order they appear in the perf
+  // data.
+  std::vector<std::pair<uint32_t, uint64_t>> runtime_addresses;
+  perf_data_reader.ReadWithSampleCallBack(
+      [&](const quipper::PerfDataProto_SampleEvent &event) {
+        for (const auto &branch : event.branch_stack()) {
+          runtime_addresses.emplace_back(event.pid(), branch.from_ip());
+          runtime_addresses.emplace_back(event.pid(), branch.to_ip());
+        }
+      });
+  for (auto _ : state) {
+    for (const auto &[pid, address] : runtime_addresses) {
+      benchmark::DoNotOptimize(
+          perf_data_reader.RuntimeAddressToBinaryAddress(pid, address));
+    }
+  }
+  state.SetItemsProcessed(state.iterations() * runtime_addresses.size());
+}
+BENCHMARK(BM_RuntimeAddressToBinaryAddress);
+}  // namespace
+}  // namespace propeller
@@ -0,0 +1,69 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// Benchmarks of writing the profiles and of the complete profile computation.
+
+#include <filesystem>
+#include <memory>
+#include <string>
+#include <utility>
+
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "benchmark/benchmark.h"
+#include "propeller/benchmarks/benchmark_util.h"
+#include "propeller/code_layout.h"
+#include "propeller/profile.h"
+#include "propeller/profile_computer.h"
+#include "propeller/profile_writer.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+
+void BM_PropellerProfileWriterWrite(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kCfgBuild);
+  const PropellerOptions options =
+      GetBenchmarkOptions(std::filesystem::temp_directory_path().string());
+  PropellerProfile profile = {.program_cfg =
+                                  std::move(pipeline_state->program_cfg)};
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  profile.functions_chain_info_by_section_name = GenerateLayoutBySection(
+      *profile.program_cfg, options.code_layout_params(), code_layout_stats);
+  const PropellerProfileWriter profile_writer(options);
+  for (auto _ : state) CHECK_OK(profile_writer.Write(profile));
+}
+BENCHMARK(BM_PropellerProfileWriterWrite)->Unit(benchmark::kMicrosecond);
+
+// Measures all stages from reading the perf data to the code layout, on the
+// binary which is loaded once.
+void BM_ComputeProfile(benchmark::State &state) {
+  std::unique_ptr<PipelineState> pipeline_state =
+      RunPipeline(PipelineStage::kBinaryLoad);
+  for (auto _ : state) {
+    absl::StatusOr<std::unique_ptr<PropellerProfileComputer>> profile_computer =
+        PropellerProfileComputer::Create(pipeline_state->options,
+                                         pipeline_state->binary_content.get());
+    CHECK_OK(profile_computer);
+    absl::StatusOr<PropellerProfile> profile =
+        std::move(**profile_computer).ComputeProfile();
+    CHECK_OK(profile);
+    benchmark::DoNotOptimize(*profile);
+  }
+}
+BENCHMARK(BM_ComputeProfile)->Unit(benchmark::kMillisecond);
+}  // namespace
+}  // namespace propeller
@@ -554,8 +554,28 @@ std::optional<int> BinaryAddressMapper::FindBbHandleIndexUsingBinaryAddress(
       bb_handles_, address, [this](uint64_t addr, const BbHandle &bb_handle) {
         return addr < GetAddress(bb_handle);
       });
-  if (it == bb_handles_.begin()) return std::nullopt;
-  it = std::prev(it);
+  return FindBbHandleIndexBefore(it - bb_handles_.begin(), address, direction);
+}
+
+std::optional<int> BinaryAddressMapper::BbHandleIndexCursor::Find(
+    uint64_t address) {
+  DCHECK_GE(address, last_address_);
+  last_address_ = address;
+  const std::vector<BbHandle> &bb_handles = binary_address_mapper_.bb_handles_;
+  while (upper_bound_ < bb_handles.size() &&
+         binary_address_mapper_.GetAddress(bb_handles[upper_bound_]) <=
+             address) {
+    ++upper_bound_;
+  }
+  return binary_address_mapper_.FindBbHandleIndexBefore(upper_bound_, address,
+                                                        direction_);
+}
+
+std::optional<int> BinaryAddressMapper::FindBbHandleIndexBefore(
+    int upper_bound, uint64_t address, BranchDirection direction) const {
+  if (upper_bound == 0) return std::nullopt;
+  std::vector<BbHandle>::const_iterator it =
+      bb_handles_.begin() + (upper_bound - 1);
   if (address > GetAddress(*it)) {
     uint64_t bb_end_address = GetAddress(*it) + GetBBEntry(*it).Size;
     if (address < bb_end_address ||
@@ -640,17 +660,26 @@ bool BinaryAddressMapper::CanFallThrough(int from, int to) const {
 // and add function1/2's index into the returned set.
 absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
     const absl::flat_hash_set<uint64_t> &hot_addresses) {
+  auto get_base_address = [this](const BbRangeHandle &bb_range_handle) {
+    return bb_addr_map_[bb_range_handle.function_index]
+        .getBBRanges()[bb_range_handle.range_index]
+        .BaseAddress;
+  };
+  // Visit the addresses in increasing order, so that the bb ranges containing
+  // them are found by a single forward scan over `bb_range_handles_`.
+  std::vector<uint64_t> sorted_hot_addresses(hot_addresses.begin(),
+                                             hot_addresses.end());
+  absl::c_sort(sorted_hot_addresses);
   absl::btree_set<int> hot_functions;
-  auto add_to_hot_functions = [this, &hot_functions](uint64_t binary_address) {
-    auto it = absl::c_upper_bound(
-        bb_range_handles_, binary_address,
-        [this](uint64_t addr, const BbRangeHandle &bb_range_handle) {
-          return addr < bb_addr_map_[bb_range_handle.function_index]
-                            .getBBRanges()[bb_range_handle.range_index]
-                            .BaseAddress;
-        });
-    if (it == bb_range_handles_.begin()) return;
-    it = std::prev(it);
+  // The first bb range which starts after the current address.
+  auto next_it = bb_range_handles_.begin();
+  for (uint64_t binary_address : sorted_hot_addresses) {
+    while (next_it != bb_range_handles_.end() &&
+           get_base_address(*next_it) <= binary_address) {
+      ++next_it;
+    }
+    if (next_it == bb_range_handles_.begin()) continue;
+    auto it = std::prev(next_it);
     const auto &bb_range =
         bb_addr_map_[it->function_index].getBBRanges()[it->range_index];
     // We know the address is bigger than or equal to the function address.
@@ -658,10 +687,9 @@ absl::btree_set<int> BinaryAddressMapperBuilder::CalculateHotFunctions(
     if (binary_address >= bb_range.BaseAddress +
                               bb_range.BBEntries.back().Offset +
                               bb_range.BBEntries.back().Size)
-      return;
+      continue;
     hot_functions.insert(it->function_index);
-  };
-  for (uint64_t address : hot_addresses) add_to_hot_functions(address);
+  }
   stats_->bbaddrmap_stats.hot_functions = hot_functions.size();
   return hot_functions;
 }
@@ -21,6 +21,7 @@
 #include <string>
 #include <vector>
 
+#include "absl/base/attributes.h"
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
@@ -180,6 +181,30 @@ class BinaryAddressMapper {
   std::optional<int> FindBbHandleIndexUsingBinaryAddress(
       uint64_t address, BranchDirection direction) const;
 
+  // Finds the `bb_handles_` indices of a non-decreasing sequence of addresses,
+  // like `FindBbHandleIndexUsingBinaryAddress`, by advancing through
+  // `bb_handles_` instead of searching it for every address.
+  class BbHandleIndexCursor {
+   public:
+    BbHandleIndexCursor(const BinaryAddressMapper &binary_address_mapper
+                            ABSL_ATTRIBUTE_LIFETIME_BOUND,
+                        BranchDirection direction)
+        : binary_address_mapper_(binary_address_mapper),
+          direction_(direction) {}
+
+    // Returns the `bb_handles_` index associated with `address`, which must
+    // not be smaller than the address of the previous call.
+    std::optional<int> Find(uint64_t address);
+
+   private:
+    const BinaryAddressMapper &binary_address_mapper_;
+    const BranchDirection direction_;
+    // Index of the first bb handle with an address greater than the last
+    // address.
+    int upper_bound_ = 0;
+    uint64_t last_address_ = 0;
+  };
+
   // Returns the `bb_handles_` element associated with the binary address
   // `address` given a branch from/to this address based on `direction`. It
   // returns nullopt if the no `bb_handles_` element can be mapped.
@@ -277,18 +302,25 @@ class BinaryAddressMapper {
       const BinaryAddressBranchPath &address_path) const;
 
  private:
+  // Returns the `bb_handles_` index associated with `address` (see
+  // `FindBbHandleIndexUsingBinaryAddress`), given the index `upper_bound` of
+  // the first bb handle with an address greater than `address`.
+  std::optional<int> FindBbHandleIndexBefore(int upper_bound, uint64_t address,
+                                             BranchDirection direction) const;
+
   absl::btree_set<int> selected_functions_;
 
   // BB handles for all basic blocks of the selected functions. BB handles are
-  // ordered in increasing order of their addresses. Thus every function's
-  // BB handles are consecutive and in the order of their addresses. e.g.,
-  // <func_idx_1, 0>
-  // <func_idx_1, 1>
+  // ordered in increasing order of their addresses. Thus the BB handles of
+  // every BB range are consecutive and in the order of their addresses, but
+  // the BB ranges of a function may be apart. e.g.,
+  // <func_idx_1, range_0, 0>
   // ...
-  // <func_idx_1, n_1>
-  // <func_idx_2, 0>
+  // <func_idx_1, range_0, n_1>
+  // <func_idx_2, range_0, 0>
   // ...
-  // <func_idx_2, n_2>
+  // <func_idx_2, range_0, n_2>
+  // <func_idx_1, range_1, 0>
   // ...
   std::vector<BbHandle> bb_handles_;
 
@@ -22,6 +22,7 @@
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/strings/str_cat.h"
@@ -47,6 +48,7 @@ using ::testing::Contains;
 using ::testing::ElementsAre;
 using ::testing::Eq;
 using ::testing::FieldsAre;
+using ::testing::Gt;
 using ::testing::IsEmpty;
 using ::testing::Key;
 using ::testing::Not;
@@ -494,6 +496,42 @@ TEST(BinaryAddressMapper, CheckNoHotFunctions) {
 //               Eq(std::nullopt));
 // }
 
+TEST(BinaryAddressMapper, BbHandleIndexCursorMatchesBinarySearch) {
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryContent> binary_content,
+      GetBinaryContent(GetPropellerTestDataFilePath("bimodal_sample.bin")));
+  PropellerStats stats;
+  PropellerOptions options;
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<BinaryAddressMapper> binary_address_mapper,
+      BuildBinaryAddressMapper(options, *binary_content, stats,
+                               /*hot_addresses=*/nullptr));
+  // The start and end addresses of every block, the addresses around them and
+  // repeated addresses, in increasing order.
+  std::vector<uint64_t> addresses = {0};
+  for (const BbHandle &bb_handle : binary_address_mapper->bb_handles()) {
+    const uint64_t address = binary_address_mapper->GetAddress(bb_handle);
+    const uint64_t end_address =
+        binary_address_mapper->GetEndAddress(bb_handle);
+    addresses.insert(addresses.end(), {address - 1, address, address,
+                                       address + 1, end_address});
+  }
+  absl::c_sort(addresses);
+  ASSERT_THAT(addresses, SizeIs(Gt(1)));
+
+  for (BranchDirection direction :
+       {BranchDirection::kFrom, BranchDirection::kTo}) {
+    BinaryAddressMapper::BbHandleIndexCursor cursor(*binary_address_mapper,
+                                                    direction);
+    for (uint64_t address : addresses) {
+      EXPECT_EQ(cursor.Find(address),
+                binary_address_mapper->FindBbHandleIndexUsingBinaryAddress(
+                    address, direction))
+          << "address: " << address;
+    }
+  }
+}
+
 TEST(BinaryAddressMapper, ExtractsIntraFunctionPaths) {
   BinaryAddressBranchPath path({.pid = 2080799,
                                 .sample_time = absl::FromUnixSeconds(123456),
@@ -15,10 +15,39 @@
 #include "propeller/branch_aggregation.h"
 
 #include <cstdint>
+#include <tuple>
+#include <vector>
 
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
+#include "propeller/binary_address_branch.h"
 
 namespace propeller {
+namespace {
+// Returns the columns of `counters`, sorted by `(from, to)`.
+template <typename AddressPair>
+ColumnarBranchAggregation::Columns GetSortedColumns(
+    const absl::flat_hash_map<AddressPair, int64_t> &counters) {
+  std::vector<std::tuple<uint64_t, uint64_t, int64_t>> rows;
+  rows.reserve(counters.size());
+  for (const auto &[address_pair, count] : counters)
+    rows.emplace_back(address_pair.from, address_pair.to, count);
+  absl::c_sort(rows);
+
+  ColumnarBranchAggregation::Columns columns;
+  columns.from.reserve(rows.size());
+  columns.to.reserve(rows.size());
+  columns.counts.reserve(rows.size());
+  for (const auto &[from, to, count] : rows) {
+    columns.from.push_back(from);
+    columns.to.push_back(to);
+    columns.counts.push_back(count);
+  }
+  return columns;
+}
+}  // namespace
+
 absl::flat_hash_set<uint64_t> BranchAggregation::GetUniqueAddresses() const {
   absl::flat_hash_set<uint64_t> unique_addresses;
   for (const auto &[branch, _] : branch_counters) {
@@ -32,4 +61,10 @@ absl::flat_hash_set<uint64_t> BranchAggregation::GetUniqueAddresses() const {
   return unique_addresses;
 }
 
+ColumnarBranchAggregation::ColumnarBranchAggregation(
+    const BranchAggregation &branch_aggregation)
+    : branches_(GetSortedColumns(branch_aggregation.branch_counters)),
+      fallthroughs_(GetSortedColumns(branch_aggregation.fallthrough_counters)) {
+}
+
 }  // namespace propeller
@@ -16,6 +16,7 @@
 #define PROPELLER_BRANCH_AGGREGATION_H_
 
 #include <cstdint>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
@@ -50,6 +51,38 @@ struct BranchAggregation {
   absl::flat_hash_map<BinaryAddressFallthrough, int64_t> fallthrough_counters;
 };
 
+// A frozen, columnar form of `BranchAggregation`, built once after
+// aggregation. Branches and fallthroughs are stored as parallel arrays sorted
+// by address, so that consumers mapping them to basic blocks stream over them
+// in address order instead of in hash order.
+class ColumnarBranchAggregation {
+ public:
+  // Parallel arrays of address pairs and their counts, sorted by `(from, to)`.
+  struct Columns {
+    int64_t size() const { return counts.size(); }
+
+    std::vector<uint64_t> from;
+    std::vector<uint64_t> to;
+    std::vector<int64_t> counts;
+  };
+
+  explicit ColumnarBranchAggregation(
+      const BranchAggregation &branch_aggregation);
+
+  ColumnarBranchAggregation(const ColumnarBranchAggregation &) = delete;
+  ColumnarBranchAggregation &operator=(const ColumnarBranchAggregation &) =
+      delete;
+  ColumnarBranchAggregation(ColumnarBranchAggregation &&) = default;
+  ColumnarBranchAggregation &operator=(ColumnarBranchAggregation &&) = default;
+
+  const Columns &branches() const { return branches_; }
+  const Columns &fallthroughs() const { return fallthroughs_; }
+
+ private:
+  Columns branches_;
+  Columns fallthroughs_;
+};
+
 }  // namespace propeller
 
 #endif  // PROPELLER_BRANCH_AGGREGATION_H_
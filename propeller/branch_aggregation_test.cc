@@ -21,6 +21,7 @@
 namespace propeller {
 namespace {
 
+using ::testing::ElementsAre;
 using ::testing::UnorderedElementsAre;
 
 TEST(BranchAggregation, GetNumberOfBranchCounters) {
@@ -40,5 +41,26 @@ TEST(BranchAggregation, GetUniqueAddresses) {
       UnorderedElementsAre(1, 2, 3, 4, 5));
 }
 
+TEST(ColumnarBranchAggregation, SortsColumnsByAddress) {
+  ColumnarBranchAggregation columnar_aggregation(
+      BranchAggregation{.branch_counters = {{{.from = 9, .to = 2}, 1},
+                                            {{.from = 3, .to = 7}, 2},
+                                            {{.from = 3, .to = 4}, 3}},
+                        .fallthrough_counters = {{{.from = 4, .to = 5}, 4},
+                                                 {{.from = 2, .to = 3}, 5}}});
+  EXPECT_THAT(columnar_aggregation.branches().from, ElementsAre(3, 3, 9));
+  EXPECT_THAT(columnar_aggregation.branches().to, ElementsAre(4, 7, 2));
+  EXPECT_THAT(columnar_aggregation.branches().counts, ElementsAre(3, 2, 1));
+  EXPECT_THAT(columnar_aggregation.fallthroughs().from, ElementsAre(2, 4));
+  EXPECT_THAT(columnar_aggregation.fallthroughs().to, ElementsAre(3, 5));
+  EXPECT_THAT(columnar_aggregation.fallthroughs().counts, ElementsAre(5, 4));
+}
+
+TEST(ColumnarBranchAggregation, HandlesEmptyAggregation) {
+  ColumnarBranchAggregation columnar_aggregation((BranchAggregation()));
+  EXPECT_EQ(columnar_aggregation.branches().size(), 0);
+  EXPECT_EQ(columnar_aggregation.fallthroughs().size(), 0);
+}
+
 }  // namespace
 }  // namespace propeller
@@ -15,11 +15,13 @@
 #include "propeller/cfg.h"
 
 #include <algorithm>
+#include <iterator>
 #include <memory>
 #include <ostream>
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
@@ -154,41 +156,189 @@ std::ostream &operator<<(std::ostream &out, const CFGEdge &edge) {
 }
 
 void CfgBuilder::AddCfgChange(const CfgChangeFromPathCloning &cfg_change) {
+  if (original_edge_indices_ == nullptr) {
+    auto original_edge_indices =
+        std::make_shared<absl::flat_hash_map<ConflictEdges::IntraEdge, int>>();
+    for (int i = 0; i < cfg_->intra_edges().size(); ++i) {
+      const CFGEdge &edge = *cfg_->intra_edges()[i];
+      CHECK_EQ(edge.src()->function_index(), edge.sink()->function_index())
+          << edge;
+      if (!edge.src()->is_cloned() && !edge.sink()->is_cloned() &&
+          edge.kind() == CFGEdgeKind::kBranchOrFallthough) {
+        original_edge_indices->emplace(
+            ConflictEdges::IntraEdge{.from_bb_index = edge.src()->bb_index(),
+                                     .to_bb_index = edge.sink()->bb_index()},
+            i);
+      }
+    }
+    original_edge_indices_ = std::move(original_edge_indices);
+  }
   for (const CfgChangeFromPathCloning::IntraEdgeReroute &edge_reroute :
        cfg_change.intra_edge_reroutes) {
     // Update the set of affected original edges.
-    conflict_edges_.affected_edges.insert(
+    uncommitted_.conflict_edges.affected_edges.insert(
         {.from_bb_index = edge_reroute.src_bb_index,
          .to_bb_index = edge_reroute.sink_bb_index});
     // If the source is not cloned, it means this is the path predecessor
     // edge. Update the set of path predecessor edges now.
     if (!edge_reroute.src_is_cloned) {
-      conflict_edges_.path_pred_edges.insert(
+      uncommitted_.conflict_edges.path_pred_edges.insert(
           {.from_bb_index = edge_reroute.src_bb_index,
            .to_bb_index = edge_reroute.sink_bb_index});
     }
   }
   ClonePath(cfg_change.path_pred_bb_index, cfg_change.path_to_clone);
-  cfg_changes_.push_back(cfg_change);
+  uncommitted_.cfg_changes.push_back(cfg_change);
+  ++uncommitted_.n_cfg_changes;
+}
+
+CfgBuilder CfgBuilder::Clone() const {
+  CfgBuilder cfg_builder(cfg_);
+  cfg_builder.original_edge_indices_ = original_edge_indices_;
+  cfg_builder.uncommitted_ = uncommitted_;
+  return cfg_builder;
+}
+
+void CfgBuilder::CommitCfgChanges() {
+  if (uncommitted_.cfg_changes.empty()) return;
+  auto layer = std::make_shared<ChangeLayer>(std::move(uncommitted_));
+  if (!ApplyIntraCfgChanges(*layer)) *layer = FlattenLayers(*layer);
+  // Merge the new layer with the layers below which have no more changes, as
+  // in a binary counter.
+  while (layer->parent != nullptr &&
+         layer->parent->cfg_changes.size() <= layer->cfg_changes.size()) {
+    auto merged_layer = std::make_shared<ChangeLayer>(*layer->parent);
+    AppendLayer(*merged_layer, std::move(*layer));
+    layer = std::move(merged_layer);
+  }
+  uncommitted_ = GetEmptyLayer(std::move(layer));
 }
 
 std::unique_ptr<ControlFlowGraph> CfgBuilder::Build() && {
+  if (!ApplyIntraCfgChanges(uncommitted_))
+    uncommitted_ = FlattenLayers(uncommitted_);
+  // All layers, starting from the bottom one.
+  std::vector<const ChangeLayer *> layers;
+  for (const ChangeLayer *layer = &uncommitted_; layer != nullptr;
+       layer = layer->parent.get()) {
+    layers.push_back(layer);
+  }
+  absl::c_reverse(layers);
+
+  std::vector<std::unique_ptr<CFGNode>> nodes;
+  nodes.reserve(uncommitted_.n_nodes);
+  for (const std::unique_ptr<CFGNode> &node : cfg_->nodes())
+    nodes.push_back(node->Clone(node->clone_number(), nodes.size()));
+  std::vector<std::vector<int>> clone_paths = cfg_->clone_paths();
+  std::vector<int> original_edge_weights;
+  original_edge_weights.reserve(cfg_->intra_edges().size());
+  for (const std::unique_ptr<CFGEdge> &edge : cfg_->intra_edges())
+    original_edge_weights.push_back(edge->weight());
+  int n_new_edges = 0;
+  for (const ChangeLayer *layer : layers) {
+    for (const ClonedNode &cloned_node : layer->cloned_nodes) {
+      nodes.push_back(cfg_->nodes()
+                          .at(cloned_node.bb_index)
+                          ->Clone(cloned_node.clone_number, nodes.size()));
+    }
+    absl::c_copy(layer->clone_paths, std::back_inserter(clone_paths));
+    for (const auto &[edge_index, weight] :
+         layer->edge_delta.original_edge_weights) {
+      original_edge_weights[edge_index] = weight;
+    }
+    n_new_edges += layer->edge_delta.new_edges.size();
+  }
+
   std::vector<std::unique_ptr<CFGEdge>> intra_edges;
-  intra_edges.reserve(cfg_->intra_edges().size());
-  // Now copy the intra-function edges.
-  for (const std::unique_ptr<CFGEdge> &edge : cfg_->intra_edges()) {
-    CHECK_EQ(edge->src()->function_index(), edge->sink()->function_index())
-        << *edge;
+  intra_edges.reserve(cfg_->intra_edges().size() + n_new_edges);
+  for (int i = 0; i < cfg_->intra_edges().size(); ++i) {
+    const CFGEdge &edge = *cfg_->intra_edges()[i];
+    CHECK_EQ(edge.src()->function_index(), edge.sink()->function_index())
+        << edge;
     intra_edges.push_back(std::make_unique<CFGEdge>(
-        nodes_.at(edge->src()->node_index()).get(),
-        nodes_.at(edge->sink()->node_index()).get(), edge->weight(),
-        edge->kind(), edge->inter_section()));
+        nodes.at(edge.src()->node_index()).get(),
+        nodes.at(edge.sink()->node_index()).get(), original_edge_weights[i],
+        edge.kind(), edge.inter_section()));
+  }
+  for (const ChangeLayer *layer : layers) {
+    for (const EdgeSpec &edge : layer->edge_delta.new_edges) {
+      intra_edges.push_back(std::make_unique<CFGEdge>(
+          nodes.at(edge.src_node_index).get(),
+          nodes.at(edge.sink_node_index).get(), edge.weight, edge.kind,
+          edge.inter_section));
+    }
   }
-  ApplyIntraCfgChanges(intra_edges);
   return std::make_unique<ControlFlowGraph>(
       cfg_->section_name(), cfg_->function_index(), cfg_->module_name(),
-      cfg_->names(), std::move(nodes_), std::move(intra_edges),
-      std::move(clone_paths_));
+      cfg_->names(), std::move(nodes), std::move(intra_edges),
+      std::move(clone_paths));
+}
+
+CfgBuilder::ChangeLayer CfgBuilder::GetEmptyLayer(
+    std::shared_ptr<const ChangeLayer> parent) const {
+  ChangeLayer layer;
+  if (parent != nullptr) {
+    layer.n_cfg_changes = parent->n_cfg_changes;
+    layer.n_nodes = parent->n_nodes;
+    // Share the conflict edges of `parent` through its ownership.
+    layer.conflict_edges.base =
+        std::shared_ptr<const ConflictEdges>(parent, &parent->conflict_edges);
+  } else {
+    layer.n_nodes = cfg_->nodes().size();
+  }
+  layer.parent = std::move(parent);
+  return layer;
+}
+
+void CfgBuilder::AppendLayer(ChangeLayer &lower, ChangeLayer upper) {
+  CHECK_EQ(upper.n_cfg_changes - upper.cfg_changes.size(),
+           lower.n_cfg_changes);
+  absl::c_move(upper.cfg_changes, std::back_inserter(lower.cfg_changes));
+  lower.n_cfg_changes = upper.n_cfg_changes;
+  absl::c_copy(upper.cloned_nodes, std::back_inserter(lower.cloned_nodes));
+  lower.n_nodes = upper.n_nodes;
+  absl::c_move(upper.clone_paths, std::back_inserter(lower.clone_paths));
+  for (const auto &[bb_index, clone_number] : upper.clone_numbers)
+    lower.clone_numbers[bb_index] = clone_number;
+  lower.conflict_edges.path_pred_edges.insert(
+      upper.conflict_edges.path_pred_edges.begin(),
+      upper.conflict_edges.path_pred_edges.end());
+  lower.conflict_edges.affected_edges.insert(
+      upper.conflict_edges.affected_edges.begin(),
+      upper.conflict_edges.affected_edges.end());
+  for (const auto &[edge_index, weight] :
+       upper.edge_delta.original_edge_weights) {
+    lower.edge_delta.original_edge_weights[edge_index] = weight;
+  }
+  absl::c_copy(upper.edge_delta.new_edges,
+               std::back_inserter(lower.edge_delta.new_edges));
+  lower.edge_delta.dropped_paths.insert(upper.edge_delta.dropped_paths.begin(),
+                                        upper.edge_delta.dropped_paths.end());
+  lower.edge_delta.dropped_edges.insert(upper.edge_delta.dropped_edges.begin(),
+                                        upper.edge_delta.dropped_edges.end());
+}
+
+CfgBuilder::ChangeLayer CfgBuilder::FlattenLayers(
+    const ChangeLayer &layer) const {
+  std::vector<const ChangeLayer *> layers;
+  for (const ChangeLayer *l = &layer; l != nullptr; l = l->parent.get())
+    layers.push_back(l);
+  ChangeLayer flat_layer = GetEmptyLayer(/*parent=*/nullptr);
+  for (auto it = layers.rbegin(); it != layers.rend(); ++it)
+    AppendLayer(flat_layer, **it);
+  CHECK(ApplyIntraCfgChanges(flat_layer));
+  return flat_layer;
+}
+
+int CfgBuilder::GetCloneNumber(int bb_index) const {
+  for (const ChangeLayer *layer = &uncommitted_; layer != nullptr;
+       layer = layer->parent.get()) {
+    auto it = layer->clone_numbers.find(bb_index);
+    if (it != layer->clone_numbers.end()) return it->second;
+  }
+  auto it = cfg_->clones_by_bb_index().find(bb_index);
+  if (it == cfg_->clones_by_bb_index().end()) return 0;
+  return it->second.size();
 }
 
 // Clones the basic blocks along the path `path_to_clone` given path
@@ -202,43 +352,82 @@ void CfgBuilder::ClonePath(int path_pred_bb_index,
 
   for (int bb_index : path_to_clone) {
     // Get the next available clone number for `bb_index`.
-    int clone_number = ++current_clone_numbers_[bb_index];
-    int new_node_index = nodes_.size();
-    // Create and insert the clone node.
-    nodes_.push_back(nodes_.at(bb_index)->Clone(clone_number, new_node_index));
-    clone_path.push_back(new_node_index);
+    int clone_number = GetCloneNumber(bb_index) + 1;
+    uncommitted_.clone_numbers[bb_index] = clone_number;
+    // Record the clone node. It is created by `Build`.
+    uncommitted_.cloned_nodes.push_back(
+        {.bb_index = bb_index, .clone_number = clone_number});
+    clone_path.push_back(uncommitted_.n_nodes++);
   }
-  // Add this path to `clone_paths_`.
-  clone_paths_.push_back(std::move(clone_path));
+  // Add this path to the clone paths.
+  uncommitted_.clone_paths.push_back(std::move(clone_path));
 }
 
-void CfgBuilder::ApplyIntraCfgChanges(
-    std::vector<std::unique_ptr<CFGEdge>> &intra_edges) {
-  absl::flat_hash_map<int, std::vector<CFGEdge *>>
-      original_edges_by_src_bb_index;
-  for (const std::unique_ptr<CFGEdge> &edge : intra_edges) {
-    if (!edge->src()->is_cloned() && !edge->sink()->is_cloned() &&
-        edge->kind() == CFGEdgeKind::kBranchOrFallthough) {
-      original_edges_by_src_bb_index[edge->src()->bb_index()].push_back(
-          edge.get());
+bool CfgBuilder::ApplyIntraCfgChanges(ChangeLayer &layer) const {
+  layer.edge_delta = {};
+  if (layer.cfg_changes.empty()) return true;
+  CHECK_NE(original_edge_indices_, nullptr);
+  // The weights of the path predecessor edges are never dropped as they will
+  // be rerouted to the clones. So we can't build on the layers below if they
+  // have dropped the weight of a path predecessor edge of a new change.
+  for (const ChangeLayer *l = layer.parent.get(); l != nullptr;
+       l = l->parent.get()) {
+    for (const CfgChangeFromPathCloning &cfg_change : layer.cfg_changes) {
+      for (const CfgChangeFromPathCloning::IntraEdgeReroute &edge_reroute :
+           cfg_change.intra_edge_reroutes) {
+        if (!edge_reroute.src_is_cloned &&
+            l->edge_delta.dropped_edges.contains(
+                {.from_bb_index = edge_reroute.src_bb_index,
+                 .to_bb_index = edge_reroute.sink_bb_index})) {
+          return false;
+        }
+      }
     }
   }
-  // Helper for finding the original intra-function edge from `src_bb_index`
-  // to `sink_bb_index`.
-  auto find_original_edge = [&](int src_bb_index,
-                                int sink_bb_index) -> CFGEdge & {
-    auto it = original_edges_by_src_bb_index.find(src_bb_index);
-    if (it != original_edges_by_src_bb_index.end()) {
-      for (CFGEdge *edge : it->second) {
-        if (edge->sink()->bb_index() == sink_bb_index) {
-          return *edge;
-        }
+
+  // Decrements the weight of the original intra-function edge from
+  // `src_bb_index` to `sink_bb_index` by the minimum of `value` and its
+  // weight, similar to `CFGEdge::DecrementWeight`. Since weights are only
+  // decremented here, the resulting weights do not depend on the order of the
+  // changes.
+  auto decrement_original_edge_weight = [&](int src_bb_index,
+                                            int sink_bb_index, int value) {
+    auto it = original_edge_indices_->find(
+        {.from_bb_index = src_bb_index, .to_bb_index = sink_bb_index});
+    if (it == original_edge_indices_->end()) {
+      LOG(FATAL) << "No edge from block with index " << src_bb_index
+                 << " to block with index" << sink_bb_index << " in function "
+                 << cfg_->GetPrimaryName().str()
+                 << " [function index: " << cfg_->function_index() << "]";
+    }
+    int edge_index = it->second;
+    auto [weight_it, inserted] =
+        layer.edge_delta.original_edge_weights.try_emplace(edge_index);
+    int &weight = weight_it->second;
+    if (inserted) {
+      // Find the current weight of the edge in the layers below.
+      weight = cfg_->intra_edges()[edge_index]->weight();
+      for (const ChangeLayer *l = layer.parent.get(); l != nullptr;
+           l = l->parent.get()) {
+        auto parent_it = l->edge_delta.original_edge_weights.find(edge_index);
+        if (parent_it == l->edge_delta.original_edge_weights.end()) continue;
+        weight = parent_it->second;
+        break;
       }
     }
-    LOG(FATAL) << "No edge from block with index " << src_bb_index
-               << " to block with index" << sink_bb_index << " in function "
-               << cfg_->GetPrimaryName().str()
-               << " [function index: " << cfg_->function_index() << "]";
+    if (weight < value) {
+      LOG(ERROR) << "Edge weight is lower than value (" << value
+                 << ") for edge from block with index " << src_bb_index
+                 << " to block with index " << sink_bb_index << " in function "
+                 << cfg_->GetPrimaryName().str();
+    }
+    weight -= std::min(value, weight);
+  };
+  // Returns whether `path_node` has been dropped in `layer` or below.
+  auto is_dropped = [&](const PathNode *path_node) {
+    for (const ChangeLayer *l = &layer; l != nullptr; l = l->parent.get())
+      if (l->edge_delta.dropped_paths.contains(path_node)) return true;
+    return false;
   };
 
   // Path profiles are not continuous (due to the limited LBR stack depth).
@@ -251,63 +440,63 @@ void CfgBuilder::ApplyIntraCfgChanges(
   // warrants that we don't leave any residual edge weights in the edges that
   // are rerouted to the clones, thereby enabling us to determine if a branch
   // will be **never-taken** (which can be used in PropellerCodeLayoutScorer).
-  absl::flat_hash_set<const PathNode *> all_paths_to_drop;
-  for (const CfgChangeFromPathCloning &cfg_change : cfg_changes_) {
-    all_paths_to_drop.insert(cfg_change.paths_to_drop.begin(),
-                             cfg_change.paths_to_drop.end());
-  }
-  for (const PathNode *path_node : all_paths_to_drop) {
-    for (const auto &[child_bb_index, child] : path_node->children()) {
-      // We don't drop the weights of the path predecessor edges since they will
-      // be rerouted to the clones.
-      // Note that we don't need to check the affected edges here. Affected
-      // edges of other paths cannot overlap these weights, because if they do,
-      // their path predecessor would have overlapped with the edges along a
-      // path. This cannot happen because we don't clone a path when its path
-      // predecessor is in the affected edges of another path.
-      if (conflict_edges_.path_pred_edges.contains(
-              {.from_bb_index = path_node->node_bb_index(),
-               .to_bb_index = child_bb_index})) {
-        continue;
+  for (const CfgChangeFromPathCloning &cfg_change : layer.cfg_changes) {
+    for (const PathNode *path_node : cfg_change.paths_to_drop) {
+      // Each path is dropped at most once.
+      if (is_dropped(path_node)) continue;
+      layer.edge_delta.dropped_paths.insert(path_node);
+      for (const auto &[child_bb_index, child] : path_node->children()) {
+        // We don't drop the weights of the path predecessor edges since they
+        // will be rerouted to the clones.
+        // Note that we don't need to check the affected edges here. Affected
+        // edges of other paths cannot overlap these weights, because if they
+        // do, their path predecessor would have overlapped with the edges
+        // along a path. This cannot happen because we don't clone a path when
+        // its path predecessor is in the affected edges of another path.
+        ConflictEdges::IntraEdge intra_edge = {
+            .from_bb_index = path_node->node_bb_index(),
+            .to_bb_index = child_bb_index};
+        if (layer.conflict_edges.IsPathPredEdge(intra_edge)) continue;
+        decrement_original_edge_weight(
+            intra_edge.from_bb_index, intra_edge.to_bb_index,
+            child->path_pred_info().missing_pred_entry.freq);
+        layer.edge_delta.dropped_edges.insert(intra_edge);
       }
-      CFGEdge &edge = find_original_edge(path_node->node_bb_index(),
-                                         child->node_bb_index());
-      edge.DecrementWeight(child->path_pred_info().missing_pred_entry.freq);
     }
   }
 
-  for (int i = 0; i < cfg_changes_.size(); ++i) {
-    int clone_path_index = clone_paths_.size() - cfg_changes_.size() + i;
-    const CfgChangeFromPathCloning &cfg_change = cfg_changes_[i];
-    absl::flat_hash_map<int, CFGNode *> clones;
+  for (int i = 0; i < layer.cfg_changes.size(); ++i) {
+    const CfgChangeFromPathCloning &cfg_change = layer.cfg_changes[i];
+    // Node indices of the clones, keyed by their bb indices.
+    absl::flat_hash_map<int, int> clones;
     for (int j = 0; j < cfg_change.path_to_clone.size(); ++j) {
       int bb_index = cfg_change.path_to_clone[j];
-      clones[bb_index] =
-          nodes_.at(clone_paths_.at(clone_path_index).at(j + 1)).get();
+      clones[bb_index] = layer.clone_paths.at(i).at(j + 1);
     }
     // Apply all intra-procedural edge weight reroutes. The inter-procedural
     // edge reroutes will be applied in `CloneApplicator` after all clonings
     // have been applied.
     for (const CfgChangeFromPathCloning::IntraEdgeReroute &edge_reroute :
          cfg_change.intra_edge_reroutes) {
-      CFGNode &from_src_node = *nodes_[edge_reroute.src_bb_index];
-      CFGNode &from_sink_node = *nodes_[edge_reroute.sink_bb_index];
       if (edge_reroute.kind != CFGEdgeKind::kBranchOrFallthough) continue;
-      CFGEdge &edge = find_original_edge(edge_reroute.src_bb_index,
-                                         edge_reroute.sink_bb_index);
       // Find and decrement the weight of the original edge.
-      edge.DecrementWeight(edge_reroute.weight);
-      CFGNode *to_src_node = edge_reroute.src_is_cloned
+      decrement_original_edge_weight(edge_reroute.src_bb_index,
+                                     edge_reroute.sink_bb_index,
+                                     edge_reroute.weight);
+      // Create the edge to reroute the control flow to. Original nodes are
+      // indexed by their bb indices.
+      layer.edge_delta.new_edges.push_back(
+          {.src_node_index = edge_reroute.src_is_cloned
                                  ? clones[edge_reroute.src_bb_index]
-                                 : &from_src_node;
-      CFGNode *to_sink_node = edge_reroute.sink_is_cloned
+                                 : edge_reroute.src_bb_index,
+           .sink_node_index = edge_reroute.sink_is_cloned
                                   ? clones[edge_reroute.sink_bb_index]
-                                  : &from_sink_node;
-      // Create the edge to reroute the control flow to.
-      intra_edges.push_back(std::make_unique<CFGEdge>(
-          to_src_node, to_sink_node, edge_reroute.weight, edge_reroute.kind,
-          /*inter_section=*/false));
+                                  : edge_reroute.sink_bb_index,
+           .weight = edge_reroute.weight,
+           .kind = edge_reroute.kind,
+           .inter_section = false});
     }
   }
+  return true;
 }
 }  // namespace propeller
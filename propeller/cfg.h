@@ -47,9 +47,9 @@ namespace propeller {
 // path predecessor edges of all paths cloned so far, along with all the
 // original edges whose frequency has been reduced due to the applied clonings.
 // A new path cloning conflicts with prior clonings if either its path
-// predecessor edge is in `affected_edges` or if it results in reducing the edge
-// frequency of any edges in `path_pred_edges`.
-// Every edge in `path_pred_edges` should also be in `affected_edges`.
+// predecessor edge is an affected edge or if it results in reducing the edge
+// frequency of any path predecessor edge.
+// Every path predecessor edge should also be an affected edge.
 struct ConflictEdges {
   // Structure representing an original (non-cloned) intra-procedural edge in
   // the CFG.
@@ -65,11 +65,33 @@ struct ConflictEdges {
       return H::combine(std::move(h), edge.from_bb_index, edge.to_bb_index);
     }
   };
-  // All path predecessor edges for the already-applied cloning.
+
+  // Returns whether `edge` is the path predecessor edge of an applied cloning.
+  bool IsPathPredEdge(const IntraEdge &edge) const {
+    for (const ConflictEdges *conflict_edges = this; conflict_edges != nullptr;
+         conflict_edges = conflict_edges->base.get()) {
+      if (conflict_edges->path_pred_edges.contains(edge)) return true;
+    }
+    return false;
+  }
+
+  // Returns whether `edge` has been modified by an applied cloning.
+  bool IsAffectedEdge(const IntraEdge &edge) const {
+    for (const ConflictEdges *conflict_edges = this; conflict_edges != nullptr;
+         conflict_edges = conflict_edges->base.get()) {
+      if (conflict_edges->affected_edges.contains(edge)) return true;
+    }
+    return false;
+  }
+
+  // Path predecessor edges of the clonings applied after those of `base`.
   absl::flat_hash_set<IntraEdge> path_pred_edges;
-  // All original intra-function edges which have been modified by the
-  // already-applied clonings.
+  // Original intra-function edges which have been modified by the clonings
+  // applied after those of `base`.
   absl::flat_hash_set<IntraEdge> affected_edges;
+  // Conflict edges of the clonings applied earlier, or null if there are none.
+  // These are immutable and may be shared with other `ConflictEdges`.
+  std::shared_ptr<const ConflictEdges> base;
 };
 
 // Represents a CFG change from applying a single `PathCloning`.
@@ -386,56 +408,132 @@ std::unique_ptr<ControlFlowGraph> CloneCfg(const ControlFlowGraph &cfg);
 // cfg_builder.RecordCfgChange(cfg_change);
 // std::unique_ptr<ControlFlowGraph> clone_cfg = std::move(cfg_builder).Build();
 //
-// The CFG edges are only constructed at `Build()` and after all nodes are
-// created.
+// The CFG nodes and edges are only constructed at `Build()`. Until then, the
+// changes are kept in immutable layers which are shared by a builder and all
+// its clones, and each layer only stores what its changes add to the layers
+// below. So cloning a builder only copies the changes added since its last
+// `CommitCfgChanges()`.
 class CfgBuilder {
  public:
   explicit CfgBuilder(
       ABSL_ATTRIBUTE_LIFETIME_BOUND const ControlFlowGraph *absl_nonnull cfg)
-      : cfg_(cfg), clone_paths_(cfg->clone_paths()) {
-    for (const auto &node : cfg_->nodes()) {
-      nodes_.push_back(node->Clone(node->clone_number(), nodes_.size()));
-    }
-    for (const auto &[bb_index, clones] : cfg_->clones_by_bb_index())
-      current_clone_numbers_[bb_index] = clones.size();
-  }
+      : cfg_(cfg), uncommitted_(GetEmptyLayer(/*parent=*/nullptr)) {}
 
   CfgBuilder(const CfgBuilder &) = delete;
   CfgBuilder &operator=(const CfgBuilder &) = delete;
   CfgBuilder(CfgBuilder &&) = default;
   CfgBuilder &operator=(CfgBuilder &&) = default;
 
-  // Returns a clone of `*this` with its `nodes_` cloned and `cfg_changes_`
-  // added.
-  CfgBuilder Clone() const {
-    CfgBuilder cfg_builder(cfg_);
-    for (const CfgChangeFromPathCloning &cfg_change : cfg_changes_) {
-      cfg_builder.AddCfgChange(cfg_change);
-    }
-    return cfg_builder;
-  }
+  // Returns a clone of `*this` with the same changes. The clone shares the
+  // committed changes of `*this` and only copies the uncommitted ones.
+  CfgBuilder Clone() const;
 
-  // Adds the path cloning `cfg_change` to `cfg_changes_` and clondes the nodes
-  // in the path accordingly. Also updates `conflict_edges_` based on
+  // Adds the path cloning `cfg_change` to the changes and clones the nodes in
+  // the path accordingly. Also updates the conflict edges based on
   // `cfg_change`.
   void AddCfgChange(const CfgChangeFromPathCloning &cfg_change);
 
-  int GetNodeSize(int bb_index) const { return nodes_.at(bb_index)->size(); }
+  // Commits the changes added since the last commit into an immutable layer,
+  // along with their resulting intra-function edges. The layer is shared with
+  // all subsequent clones of this builder, so that their `Build` only needs to
+  // apply the changes added after this call. Layers are merged with the layers
+  // below them which have no more changes, so a builder has a logarithmic
+  // number of layers and every change is copied a logarithmic number of times
+  // (amortized).
+  void CommitCfgChanges();
+
+  int GetNodeSize(int bb_index) const {
+    return cfg_->nodes().at(bb_index)->size();
+  }
 
-  // Builds the `ControlFlowGraph` by cloning the intra-function edges from
-  // the original cfg and then applying the path cloning changes in
-  // `cfg_changes_`.
+  // Builds the `ControlFlowGraph` by cloning the nodes and intra-function
+  // edges of the original cfg and then applying the committed and uncommitted
+  // changes.
   std::unique_ptr<ControlFlowGraph> Build() &&;
 
-  absl::Span<const CfgChangeFromPathCloning> cfg_changes() const {
-    return cfg_changes_;
+  // Returns the number of changes added so far.
+  int num_cfg_changes() const { return uncommitted_.n_cfg_changes; }
+  const ConflictEdges &conflict_edges() const {
+    return uncommitted_.conflict_edges;
   }
-  const ConflictEdges &conflict_edges() const { return conflict_edges_; }
   const ControlFlowGraph &cfg() const { return *cfg_; }
 
  private:
-  // Applies the intra-function changes from `cfg_changes_` to `intra_edges`.
-  void ApplyIntraCfgChanges(std::vector<std::unique_ptr<CFGEdge>> &intra_edges);
+  // Intra-function edge of the CFG being built, specified by the node indices
+  // of its source and sink.
+  struct EdgeSpec {
+    int src_node_index, sink_node_index;
+    int weight;
+    CFGEdgeKind kind;
+    bool inter_section;
+  };
+
+  // A node cloned from the original node with bb index `bb_index`.
+  struct ClonedNode {
+    int bb_index;
+    int clone_number;
+  };
+
+  // Changes to the intra-function edges by a sequence of path clonings,
+  // relative to the edges before them.
+  struct EdgeDelta {
+    // Resulting weights of the original intra-function edges changed by the
+    // clonings, keyed by the edges' indices in `cfg_->intra_edges()`.
+    absl::flat_hash_map<int, int> original_edge_weights;
+    // Edges created to reroute the control flow to the clones.
+    std::vector<EdgeSpec> new_edges;
+    // Paths whose edge weights have been dropped.
+    absl::flat_hash_set<const PathNode *> dropped_paths;
+    // Original edges whose weights have been reduced due to dropped paths.
+    absl::flat_hash_set<ConflictEdges::IntraEdge> dropped_edges;
+  };
+
+  // A sequence of changes applied on top of the changes in `parent` (or on the
+  // original CFG if `parent` is null).
+  struct ChangeLayer {
+    std::shared_ptr<const ChangeLayer> parent;
+    std::vector<CfgChangeFromPathCloning> cfg_changes;
+    // Total number of changes in this layer and the layers below.
+    int n_cfg_changes = 0;
+    // Nodes cloned for `cfg_changes`, in the order of their node indices.
+    std::vector<ClonedNode> cloned_nodes;
+    // Total number of nodes in the CFG with the changes in this layer and the
+    // layers below applied.
+    int n_nodes = 0;
+    // The cloned path for every change in `cfg_changes`, as in
+    // `ControlFlowGraph::clone_paths()`.
+    std::vector<std::vector<int>> clone_paths;
+    // Highest clone numbers of the blocks cloned in this layer, keyed by their
+    // bb indices.
+    absl::flat_hash_map<int, int> clone_numbers;
+    // Conflict edges of `cfg_changes`, based on the conflict edges of
+    // `parent`.
+    ConflictEdges conflict_edges;
+    // Changes to the intra-function edges by `cfg_changes`. This is only
+    // computed when the layer is committed or built.
+    EdgeDelta edge_delta;
+  };
+
+  // Returns an empty layer on top of `parent`.
+  ChangeLayer GetEmptyLayer(std::shared_ptr<const ChangeLayer> parent) const;
+
+  // Appends the changes in `upper`, which must be on top of `lower`, to
+  // `lower`.
+  static void AppendLayer(ChangeLayer &lower, ChangeLayer upper);
+
+  // Returns a single layer with all the changes in `layer` and the layers
+  // below it, with its edges computed from the original CFG.
+  ChangeLayer FlattenLayers(const ChangeLayer &layer) const;
+
+  // Returns the highest clone number of the block with bb index `bb_index`.
+  int GetCloneNumber(int bb_index) const;
+
+  // Computes `layer.edge_delta` from its changes, on top of the edges of the
+  // layers below. Returns false if the changes can't be applied incrementally;
+  // which happens when the path predecessor edge of a change in `layer` has
+  // had its weight reduced by a path dropped in the layers below. In that case,
+  // `layer.edge_delta` is left in an unspecified state.
+  bool ApplyIntraCfgChanges(ChangeLayer &layer) const;
 
   // Clones the basic blocks along the path `path_to_clone` given path
   // predecessor block `path_pred_bb_index`. Both `path_pred_bb_index` and
@@ -443,11 +541,14 @@ class CfgBuilder {
   void ClonePath(int path_pred_bb_index, absl::Span<const int> path_to_clone);
 
   const ControlFlowGraph *cfg_;
-  std::vector<std::unique_ptr<CFGNode>> nodes_;
-  std::vector<std::vector<int>> clone_paths_;
-  absl::flat_hash_map<int, int> current_clone_numbers_;
-  std::vector<CfgChangeFromPathCloning> cfg_changes_;
-  ConflictEdges conflict_edges_;
+  // Indices (in `cfg_->intra_edges()`) of the original intra-function
+  // fallthrough and branch edges, keyed by the bb indices of their source and
+  // sink. This is computed when the first change is added, and shared with all
+  // clones.
+  std::shared_ptr<const absl::flat_hash_map<ConflictEdges::IntraEdge, int>>
+      original_edge_indices_;
+  // The changes added since the last commit, on top of the committed layers.
+  ChangeLayer uncommitted_;
 };
 
 template <typename Sink>
@@ -16,6 +16,9 @@
 
 #include <memory>
 #include <sstream>
+#include <tuple>
+#include <utility>
+#include <vector>
 
 #include "absl/container/flat_hash_map.h"
 #include "gmock/gmock.h"
@@ -218,5 +221,75 @@ TEST(LlvmPropellerCfg, GetNodeFrequencyStats) {
   ASSERT_THAT(cfgs, UnorderedElementsAre(Key(0)));
   EXPECT_THAT(cfgs.at(0)->GetNodeFrequencyStats(), FieldsAre(4, 1, 1));
 }
+
+// Returns the intra-function edges of `cfg` as tuples of their source id, sink
+// id, weight, and kind.
+std::vector<std::tuple<IntraCfgId, IntraCfgId, int, CFGEdgeKind>>
+GetIntraEdges(const ControlFlowGraph &cfg) {
+  std::vector<std::tuple<IntraCfgId, IntraCfgId, int, CFGEdgeKind>> result;
+  for (const auto &edge : cfg.intra_edges()) {
+    result.emplace_back(edge->src()->intra_cfg_id(),
+                        edge->sink()->intra_cfg_id(), edge->weight(),
+                        edge->kind());
+  }
+  return result;
+}
+
+TEST(CfgBuilderTest, BuildsFromLayersOfCommittedChanges) {
+  constexpr int kNumChanges = 100;
+  std::unique_ptr<ControlFlowGraph> cfg =
+      BuildChainCfg(/*num_blocks=*/3 * kNumChanges + 1, /*weight=*/100);
+  std::vector<CfgChangeFromPathCloning> cfg_changes;
+  for (int i = 0; i < kNumChanges; ++i)
+    cfg_changes.push_back(GetChainCfgChange(i, /*weight=*/10 + i % 50));
+
+  CfgBuilder cfg_builder(cfg.get());
+  // Clones of `cfg_builder` after every change.
+  std::vector<CfgBuilder> cfg_builder_clones;
+  for (int i = 0; i < kNumChanges; ++i) {
+    ConflictEdges::IntraEdge path_pred_edge = {.from_bb_index = 3 * i,
+                                               .to_bb_index = 3 * i + 1};
+    EXPECT_FALSE(cfg_builder.conflict_edges().IsAffectedEdge(path_pred_edge));
+    cfg_builder.AddCfgChange(cfg_changes[i]);
+    // Leave some changes uncommitted for the next layer.
+    if (i % 3 != 0) cfg_builder.CommitCfgChanges();
+    EXPECT_TRUE(cfg_builder.conflict_edges().IsPathPredEdge(path_pred_edge));
+    EXPECT_EQ(cfg_builder.num_cfg_changes(), i + 1);
+    cfg_builder_clones.push_back(cfg_builder.Clone());
+  }
+
+  // Every clone builds the same CFG as applying its changes without any
+  // commits, regardless of the changes committed after it was cloned.
+  for (int i = 0; i < kNumChanges; ++i) {
+    CfgBuilder uncommitted_cfg_builder(cfg.get());
+    for (int j = 0; j <= i; ++j)
+      uncommitted_cfg_builder.AddCfgChange(cfg_changes[j]);
+    std::unique_ptr<ControlFlowGraph> expected_cfg =
+        std::move(uncommitted_cfg_builder).Build();
+    std::unique_ptr<ControlFlowGraph> clone_cfg =
+        std::move(cfg_builder_clones[i]).Build();
+    EXPECT_EQ(GetIntraEdges(*clone_cfg), GetIntraEdges(*expected_cfg));
+    EXPECT_EQ(clone_cfg->clone_paths(), expected_cfg->clone_paths());
+    EXPECT_EQ(clone_cfg->nodes().size(), cfg->nodes().size() + i + 1);
+  }
+
+  // Every change reroutes its weight from the fallthroughs into and out of the
+  // cloned block.
+  std::unique_ptr<ControlFlowGraph> clone_cfg = std::move(cfg_builder).Build();
+  EXPECT_THAT(clone_cfg->GetNodeById({.bb_index = 0, .clone_number = 0})
+                  .intra_outs(),
+              UnorderedElementsAre(
+                  Pointee(IsCfgEdge(NodeIntraIdIs(IntraCfgId{0, 0}),
+                                    NodeIntraIdIs(IntraCfgId{1, 0}), 90,
+                                    CFGEdgeKind::kBranchOrFallthough)),
+                  Pointee(IsCfgEdge(NodeIntraIdIs(IntraCfgId{0, 0}),
+                                    NodeIntraIdIs(IntraCfgId{1, 1}), 10,
+                                    CFGEdgeKind::kBranchOrFallthough))));
+  EXPECT_THAT(
+      clone_cfg->GetNodeById({.bb_index = 1, .clone_number = 1}).intra_outs(),
+      ElementsAre(Pointee(IsCfgEdge(NodeIntraIdIs(IntraCfgId{1, 1}),
+                                    NodeIntraIdIs(IntraCfgId{2, 0}), 10,
+                                    CFGEdgeKind::kBranchOrFallthough))));
+}
 }  // namespace
 }  // namespace propeller
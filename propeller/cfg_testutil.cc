@@ -14,6 +14,7 @@
 
 #include "propeller/cfg_testutil.h"
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <utility>
@@ -25,6 +26,7 @@
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringRef.h"
 #include "propeller/cfg.h"
+#include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_node.h"
 
 namespace propeller {
@@ -93,4 +95,47 @@ TestCfgBuilder::Build() && {
   CreateInterEdges(multi_cfg_arg_.inter_edge_args);
   return std::move(cfgs_by_function_index_);
 }
+
+std::unique_ptr<ControlFlowGraph> BuildChainCfg(int num_blocks, int weight) {
+  std::vector<NodeArg> node_args;
+  std::vector<IntraEdgeArg> edge_args;
+  for (int bb_index = 0; bb_index < num_blocks; ++bb_index) {
+    uint64_t addr = 0x1000 + 0x10 * static_cast<uint64_t>(bb_index);
+    node_args.push_back({.addr = addr,
+                         .bb_index = bb_index,
+                         .size = 0x10,
+                         .metadata = {.CanFallThrough = true}});
+    if (bb_index != 0) {
+      edge_args.push_back({.from_bb_index = bb_index - 1,
+                           .to_bb_index = bb_index,
+                           .weight = weight,
+                           .kind = CFGEdgeKind::kBranchOrFallthough});
+    }
+  }
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs =
+      TestCfgBuilder({.cfg_args = {{".text", 0, "chain", std::move(node_args),
+                                    std::move(edge_args)}}})
+          .Build();
+  return std::move(cfgs.at(0));
+}
+
+CfgChangeFromPathCloning GetChainCfgChange(int i, int weight) {
+  int path_pred_bb_index = 3 * i;
+  int bb_index = path_pred_bb_index + 1;
+  return {.path_pred_bb_index = path_pred_bb_index,
+          .path_to_clone = {bb_index},
+          .intra_edge_reroutes = {
+              {.src_bb_index = path_pred_bb_index,
+               .sink_bb_index = bb_index,
+               .src_is_cloned = false,
+               .sink_is_cloned = true,
+               .kind = CFGEdgeKind::kBranchOrFallthough,
+               .weight = weight},
+              {.src_bb_index = bb_index,
+               .sink_bb_index = bb_index + 1,
+               .src_is_cloned = true,
+               .sink_is_cloned = false,
+               .kind = CFGEdgeKind::kBranchOrFallthough,
+               .weight = weight}}};
+}
 }  // namespace propeller
@@ -106,6 +106,17 @@ class TestCfgBuilder {
   absl::flat_hash_map<int, absl::flat_hash_map<int, CFGNode *>>
       nodes_by_function_and_bb_index_;
 };
+
+// Returns the CFG of a function (with function index 0) with `num_blocks`
+// blocks, where every block falls through to the next one with weight
+// `weight`.
+std::unique_ptr<ControlFlowGraph> BuildChainCfg(int num_blocks, int weight);
+
+// Returns the change for cloning block `3 * i + 1` of a CFG built by
+// `BuildChainCfg` with path predecessor `3 * i`, rerouting `weight` from the
+// fallthroughs into and out of the block. Changes for different `i` don't
+// conflict with each other.
+CfgChangeFromPathCloning GetChainCfgChange(int i, int weight);
 }  // namespace propeller
 
 #endif  // PROPELLER_CFG_TESTUTIL_H_
@@ -69,6 +69,43 @@ ChainClusterBuilder::ChainClusterBuilder(
   chains.clear();
 }
 
+absl::flat_hash_map<const NodeChain *,
+                    ChainClusterBuilder::ChainInEdgeWeights>
+ChainClusterBuilder::GetChainInEdgeWeights() const {
+  absl::flat_hash_map<const NodeChain *, ChainInEdgeWeights> result;
+  for (const auto &[chain, unused] : chain_to_cluster_map_) {
+    int64_t total_weight = 0;
+    absl::flat_hash_map<const NodeChain *, int64_t> weight_from_chain;
+    const CFGNode *entry_node = chain->GetFirstNode();
+    chain->VisitEachNodeRef([&](const CFGNode &node) {
+      node.ForEachInEdgeRef([&](const CFGEdge &edge) {
+        if (edge.weight() == 0 || edge.IsReturn() || edge.inter_section())
+          return;
+        const NodeChain *src_chain = node_to_chain_map_.at(edge.src());
+        // Omit intra-chain edges.
+        if (src_chain->id() == chain->id()) return;
+        total_weight += edge.weight();
+        if (!code_layout_params_.inter_function_reordering() &&
+            &node != entry_node) {
+          return;
+        }
+        // Omit the edge if it's cold relative to the sink.
+        if (edge.weight() * kHotEdgeRelativeFrequencyThreshold <
+            edge.sink()->CalculateFrequency()) {
+          return;
+        }
+        weight_from_chain[src_chain] += edge.weight();
+      });
+    });
+    if (total_weight == 0) continue;
+    result.emplace(chain, ChainInEdgeWeights{
+                              .total_weight = total_weight,
+                              .weight_from_chain = {weight_from_chain.begin(),
+                                                    weight_from_chain.end()}});
+  }
+  return result;
+}
+
 void ChainClusterBuilder::MergeWithBestPredecessorCluster(
     const NodeChain &chain) {
   ChainCluster *cluster = chain_to_cluster_map_.at(&chain);
@@ -77,62 +114,49 @@ void ChainClusterBuilder::MergeWithBestPredecessorCluster(
   if (cluster->size() > code_layout_params_.cluster_merge_size_threshold())
     return;
 
-  // Create a map to compute the total incoming edge weight to `cluster`
-  // from each other cluster.
-  absl::flat_hash_map<ChainCluster *, int64_t> weight_from;
-
-  // Update the `weight_from` edges by visiting all incoming edges to the given
-  // `node`.
-  auto inspect_in_edges = [&](const CFGNode &node) {
-    node.ForEachInEdgeRef([&](const CFGEdge &edge) {
-      // Omit return edges since optimizing them does not improve performance.
-      if (edge.IsReturn()) return;
-      if (edge.inter_section()) return;
-      // Omit the edge if it's cold relative to the sink.
-      if (edge.weight() == 0 ||
-          edge.weight() * kHotEdgeRelativeFrequencyThreshold <
-              edge.sink()->CalculateFrequency()) {
-        return;
-      }
-      const NodeChain &src_chain = *node_to_chain_map_.at(edge.src());
-      // Omit intra-chain edges.
-      if (src_chain.id() == chain.id()) return;
-      ChainCluster *src_cluster = chain_to_cluster_map_.at(&src_chain);
-      if (src_cluster->id() == cluster->id()) return;
-      // Ignore clusters that are larger than the threshold.
-      if (src_cluster->size() >
-          code_layout_params_.cluster_merge_size_threshold()) {
-        return;
-      }
-      // Avoid merging if the predecessor cluster's density would degrade by
-      // more than 1/kDensityDegradationThreshold by the merge.
-      if (kExecutionDensityDegradationThreshold * src_cluster->size() *
-              (cluster->freq() + src_cluster->freq()) <
-          static_cast<int64_t>(src_cluster->freq()) *
-              (cluster->size() + src_cluster->size())) {
-        return;
-      }
-      weight_from[src_cluster] += edge.weight();
-    });
-  };
-
   if (!code_layout_params_.inter_function_reordering()) {
     CHECK(chain.GetFirstNode()->is_entry())
         << "First node in the chain for function #" << *chain.function_index()
         << " is not an entry block.";
-    inspect_in_edges(*chain.GetFirstNode());
-  } else {
-    chain.VisitEachNodeRef(inspect_in_edges);
   }
 
-  if (weight_from.empty()) return;
+  auto in_edge_weights_it = chain_in_edge_weights_.find(&chain);
+  if (in_edge_weights_it == chain_in_edge_weights_.end()) return;
+
+  // Compute the total incoming edge weight to `chain` from each other cluster.
+  absl::flat_hash_map<ChainCluster *, int64_t> weight_from;
+  for (const auto &[src_chain, weight] :
+       in_edge_weights_it->second.weight_from_chain) {
+    ChainCluster *src_cluster = chain_to_cluster_map_.at(src_chain);
+    if (src_cluster->id() == cluster->id()) continue;
+    weight_from[src_cluster] += weight;
+  }
 
   // Find the predecessor cluster with the largest (total) incoming edge weight.
-  ChainCluster *best_pred_cluster =
-      absl::c_max_element(weight_from, [](const auto &p1, const auto &p2) {
-        return std::forward_as_tuple(p1.second, p1.first->id()) <
-               std::forward_as_tuple(p2.second, p2.first->id());
-      })->first;
+  ChainCluster *best_pred_cluster = nullptr;
+  int64_t best_weight = 0;
+  for (const auto &[src_cluster, weight] : weight_from) {
+    // Ignore clusters that are larger than the threshold.
+    if (src_cluster->size() >
+        code_layout_params_.cluster_merge_size_threshold()) {
+      continue;
+    }
+    // Avoid merging if the predecessor cluster's density would degrade by
+    // more than 1/kDensityDegradationThreshold by the merge.
+    if (kExecutionDensityDegradationThreshold * src_cluster->size() *
+            (cluster->freq() + src_cluster->freq()) <
+        static_cast<int64_t>(src_cluster->freq()) *
+            (cluster->size() + src_cluster->size())) {
+      continue;
+    }
+    if (best_pred_cluster == nullptr ||
+        std::forward_as_tuple(best_weight, best_pred_cluster->id()) <
+            std::forward_as_tuple(weight, src_cluster->id())) {
+      best_pred_cluster = src_cluster;
+      best_weight = weight;
+    }
+  }
+  if (best_pred_cluster == nullptr) return;
 
   MergeClusters(*best_pred_cluster, std::move(*cluster));
 }
@@ -167,33 +191,22 @@ ChainClusterBuilder::BuildClusters() && {
     return built_clusters;
   }
 
-  // Total incoming edge weight to each chain excluding return edges and
-  // intra-chain edges.
-  absl::flat_hash_map<const NodeChain *, int64_t> weight_to;
-  for (const auto &[chain, unused] : chain_to_cluster_map_) {
-    int64_t weight = 0;
-    auto chain_id = chain->id();
-    chain->VisitEachNodeRef([&](const CFGNode &node) {
-      node.ForEachInEdgeRef([&](CFGEdge &edge) {
-        if (edge.weight() == 0 || edge.IsReturn() || edge.inter_section() ||
-            node_to_chain_map_.at(edge.src())->id() == chain_id) {
-          return;
-        }
-        weight += edge.weight();
-      });
-    });
-    if (weight != 0) weight_to.insert({chain, weight});
-  }
+  chain_in_edge_weights_ = GetChainInEdgeWeights();
 
   std::vector<const NodeChain *> chains_sorted_by_incoming_weight;
-  for (const auto &[chain, unused] : weight_to)
+  for (const auto &[chain, unused] : chain_in_edge_weights_)
     chains_sorted_by_incoming_weight.push_back(chain);
 
   // Sort chains in decreasing order of their total incoming edge weights.
+  auto get_total_weight = [this](const NodeChain *chain) {
+    return chain_in_edge_weights_.at(chain).total_weight;
+  };
   absl::c_sort(chains_sorted_by_incoming_weight,
-               [&weight_to](const NodeChain *lhs, const NodeChain *rhs) {
-                 return std::forward_as_tuple(-weight_to[lhs], lhs->id()) <
-                        std::forward_as_tuple(-weight_to[rhs], rhs->id());
+               [&](const NodeChain *lhs, const NodeChain *rhs) {
+                 return std::forward_as_tuple(-get_total_weight(lhs),
+                                              lhs->id()) <
+                        std::forward_as_tuple(-get_total_weight(rhs),
+                                              rhs->id());
                });
 
   for (const NodeChain *chain : chains_sorted_by_incoming_weight) {
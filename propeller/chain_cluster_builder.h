@@ -16,6 +16,7 @@
 #define PROPELLER_CHAIN_CLUSTER_BUILDER_H_
 
 #include <algorithm>
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <utility>
@@ -119,10 +120,35 @@ class ChainClusterBuilder {
   void MergeClusters(ChainCluster &left_cluster, ChainCluster right_cluster);
 
  private:
+  // The incoming edge weights of a chain, aggregated by source chain.
+  struct ChainInEdgeWeights {
+    // Total weight of the incoming edges, excluding return, inter-section and
+    // intra-chain edges.
+    int64_t total_weight = 0;
+    // Weights of the incoming edges which may merge the chain's cluster with
+    // another cluster, by source chain. These exclude the edges which are cold
+    // relative to their sink and, unless inter-function reordering is enabled,
+    // the edges to nodes other than the chain's entry node.
+    std::vector<std::pair<const NodeChain *, int64_t>> weight_from_chain;
+  };
+
+  // Returns the incoming edge weights of every chain with nonzero total
+  // incoming weight, computed in a single pass over the edges which serves
+  // both the ordering of the chains and the merge decisions. This is only a
+  // constant-factor improvement: merge decisions still visit every source
+  // chain of a chain, but look up its current cluster in
+  // `chain_to_cluster_map_` once per source chain instead of once per edge.
+  absl::flat_hash_map<const NodeChain *, ChainInEdgeWeights>
+  GetChainInEdgeWeights() const;
+
   PropellerCodeLayoutParameters code_layout_params_;
   const absl::flat_hash_map<const CFGNode *, const NodeChain *>
       node_to_chain_map_;
 
+  // The incoming edge weights of the chains, computed by `BuildClusters`.
+  absl::flat_hash_map<const NodeChain *, ChainInEdgeWeights>
+      chain_in_edge_weights_;
+
   // All clusters currently in process.
   absl::flat_hash_map<InterCfgId, std::unique_ptr<const ChainCluster>>
       clusters_;
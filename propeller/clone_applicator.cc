@@ -14,8 +14,11 @@
 
 #include "propeller/clone_applicator.h"
 
+#include <algorithm>
+#include <cstdint>
 #include <functional>
 #include <memory>
+#include <numeric>
 #include <optional>
 #include <tuple>
 #include <utility>
@@ -27,6 +30,7 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_edge_kind.h"
@@ -227,8 +231,257 @@ void CreateInterFunctionEdges(
     }
   }
 }
+
+// Returns the bb indices of the blocks affected by `cfg_change`: the path
+// predecessor, the cloned path and the endpoints of the rerouted
+// intra-function edges.
+absl::flat_hash_set<int> GetAffectedBbIndices(
+    const CfgChangeFromPathCloning &cfg_change) {
+  absl::flat_hash_set<int> bb_indices(cfg_change.path_to_clone.begin(),
+                                      cfg_change.path_to_clone.end());
+  bb_indices.insert(cfg_change.path_pred_bb_index);
+  for (const auto &intra_edge_reroute : cfg_change.intra_edge_reroutes) {
+    bb_indices.insert(intra_edge_reroute.src_bb_index);
+    bb_indices.insert(intra_edge_reroute.sink_bb_index);
+  }
+  return bb_indices;
+}
+
+// Returns the chain info of the optimal layout of the CFG built by
+// `cfg_builder`.
+FunctionChainInfo ComputeOptimalChainInfo(
+    const CfgBuilder &cfg_builder,
+    const PropellerCodeLayoutParameters &code_layout_params) {
+  std::unique_ptr<ControlFlowGraph> clone_cfg = cfg_builder.Clone().Build();
+  std::vector<FunctionChainInfo> code_layout_result =
+      CodeLayout(code_layout_params, {clone_cfg.get()},
+                 /*initial_chains=*/{})
+          .OrderAll();
+  CHECK_EQ(code_layout_result.size(), 1);
+  return code_layout_result.front();
+}
+
+// Applies profitable clonings from `clonings` to `cfg_builder` in rounds, as
+// enabled by `PathProfileOptions::batch_clone_application`. In every round, a
+// maximal set of non-conflicting clonings is applied in decreasing order of
+// their scores. The remaining clonings conflict with some applied cloning and
+// are reevaluated in the next round, against the CFG with all the clonings of
+// the round applied. Clonings not conflicting with each other are assumed to
+// not change each other's score gain. Appends the CFG changes of the applied
+// clonings to `applied_cfg_changes` and returns their total score gain.
+// Increments `clonings_reevaluated` for every reevaluated cloning.
+double ApplyCloningsInRounds(
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const PathProfileOptions &path_profile_options,
+    std::vector<EvaluatedPathCloning> clonings,
+    const FunctionPathProfile &function_path_profile, CfgBuilder &cfg_builder,
+    BaselineLayoutCache &baseline_cache,
+    std::vector<CfgChangeFromPathCloning> &applied_cfg_changes,
+    int64_t &clonings_reevaluated) {
+  double score_gain = 0;
+  // Clonings are only reevaluated if they have not been evaluated yet, or if
+  // they were deferred by a previous round.
+  for (bool reevaluate_all = false; !clonings.empty(); reevaluate_all = true) {
+    std::vector<EvaluatedPathCloning> evaluated_clonings;
+    evaluated_clonings.reserve(clonings.size());
+    std::optional<FunctionChainInfo> optimal_chain_info;
+    for (EvaluatedPathCloning &cloning : clonings) {
+      if (!reevaluate_all && cloning.score.has_value()) {
+        evaluated_clonings.push_back(std::move(cloning));
+        continue;
+      }
+      if (!optimal_chain_info.has_value())
+        optimal_chain_info =
+            ComputeOptimalChainInfo(cfg_builder, code_layout_params);
+      ++clonings_reevaluated;
+      absl::StatusOr<EvaluatedPathCloning> evaluated_cloning = EvaluateCloning(
+          cfg_builder.Clone(), cloning.path_cloning, code_layout_params,
+          path_profile_options, path_profile_options.min_final_cloning_score(),
+          *optimal_chain_info, function_path_profile, &baseline_cache);
+      if (!evaluated_cloning.ok()) continue;
+      evaluated_clonings.push_back(*std::move(evaluated_cloning));
+    }
+    absl::c_sort(evaluated_clonings, std::greater<EvaluatedPathCloning>());
+    // Drop the clonings which are not profitable enough.
+    evaluated_clonings.erase(
+        absl::c_find_if(evaluated_clonings,
+                        [&](const EvaluatedPathCloning &cloning) {
+                          return cloning.score <
+                                 path_profile_options.min_final_cloning_score();
+                        }),
+        evaluated_clonings.end());
+
+    std::vector<int> selected_indices =
+        SelectNonConflictingClonings(evaluated_clonings);
+    clonings.clear();
+    auto next_selected_index = selected_indices.begin();
+    for (int i = 0; i < evaluated_clonings.size(); ++i) {
+      EvaluatedPathCloning &cloning = evaluated_clonings[i];
+      if (next_selected_index == selected_indices.end() ||
+          *next_selected_index != i) {
+        // Defer this cloning to the next round.
+        clonings.push_back(std::move(cloning));
+        continue;
+      }
+      ++next_selected_index;
+      score_gain += *cloning.score;
+      cfg_builder.AddCfgChange(cloning.cfg_change);
+      applied_cfg_changes.push_back(std::move(cloning.cfg_change));
+    }
+    // Share the resulting edges with the clones built for the reevaluations in
+    // the next round.
+    cfg_builder.CommitCfgChanges();
+    baseline_cache.Clear();
+  }
+  return score_gain;
+}
 }  // namespace
 
+std::vector<int> SelectNonConflictingClonings(
+    absl::Span<const EvaluatedPathCloning> clonings) {
+  std::vector<int> selected_indices;
+  absl::flat_hash_set<int> affected_bb_indices;
+  for (int i = 0; i < clonings.size(); ++i) {
+    absl::flat_hash_set<int> bb_indices =
+        GetAffectedBbIndices(clonings[i].cfg_change);
+    if (absl::c_any_of(bb_indices, [&](int bb_index) {
+          return affected_bb_indices.contains(bb_index);
+        }))
+      continue;
+    selected_indices.push_back(i);
+    affected_bb_indices.insert(bb_indices.begin(), bb_indices.end());
+  }
+  return selected_indices;
+}
+
+int64_t GetCloningSize(const EvaluatedPathCloning &cloning,
+                       const ProgramCfg &program_cfg) {
+  const ControlFlowGraph &cfg =
+      *program_cfg.GetCfgByIndex(cloning.path_cloning.function_index);
+  int64_t size = 0;
+  for (int bb_index : cloning.cfg_change.path_to_clone)
+    size += cfg.nodes().at(bb_index)->size();
+  return size;
+}
+
+absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+SelectCloningsWithinSizeBudget(
+    absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+        clonings_by_function_index,
+    const ProgramCfg &program_cfg, int64_t size_budget,
+    bool exclude_conflicting_clonings) {
+  // Maximum number of capacity units in the knapsack table. Larger budgets are
+  // divided into units of multiple bytes.
+  constexpr int64_t kMaxCapacityUnits = 1 << 12;
+  // Maximum number of clonings in the knapsack table. The remaining clonings
+  // fill the leftover budget greedily.
+  constexpr int kMaxKnapsackItems = 1 << 10;
+  CHECK_GT(size_budget, 0);
+
+  struct Item {
+    EvaluatedPathCloning *cloning;
+    int64_t size;
+  };
+  std::vector<Item> items;
+  int64_t total_size = 0;
+  for (auto &[function_index, clonings] : clonings_by_function_index) {
+    // Only the clonings which can be selected on their own are considered.
+    auto cannot_be_selected = [&](const EvaluatedPathCloning &cloning) {
+      CHECK(cloning.score.has_value());
+      return *cloning.score <= 0 ||
+             GetCloningSize(cloning, program_cfg) > size_budget;
+    };
+    clonings.erase(
+        std::remove_if(clonings.begin(), clonings.end(), cannot_be_selected),
+        clonings.end());
+    std::vector<int> candidate_indices(clonings.size());
+    std::iota(candidate_indices.begin(), candidate_indices.end(), 0);
+    if (exclude_conflicting_clonings) {
+      // Conflicting clonings are applied in batches without reevaluation, so
+      // they must not share the budget. We resolve the conflicts within each
+      // function greedily in decreasing order of scores, as done when applying
+      // clonings in batches.
+      absl::c_sort(clonings, std::greater<EvaluatedPathCloning>());
+      candidate_indices = SelectNonConflictingClonings(clonings);
+    }
+    for (int index : candidate_indices) {
+      EvaluatedPathCloning &cloning = clonings[index];
+      int64_t size = GetCloningSize(cloning, program_cfg);
+      items.push_back({.cloning = &cloning, .size = size});
+      total_size += size;
+    }
+  }
+
+  absl::flat_hash_set<const EvaluatedPathCloning *> selected_clonings;
+  if (total_size <= size_budget) {
+    for (const Item &item : items) selected_clonings.insert(item.cloning);
+  } else {
+    // Only the densest clonings are selected optimally, which bounds the
+    // knapsack table to `kMaxKnapsackItems * (kMaxCapacityUnits + 1)` bits.
+    auto get_density = [](const Item &item) {
+      return *item.cloning->score / std::max<int64_t>(item.size, 1);
+    };
+    absl::c_sort(items, [&](const Item &lhs, const Item &rhs) {
+      if (get_density(lhs) != get_density(rhs))
+        return get_density(lhs) > get_density(rhs);
+      return *lhs.cloning > *rhs.cloning;
+    });
+    const int num_knapsack_items =
+        std::min<int>(items.size(), kMaxKnapsackItems);
+    // Measuring sizes in units of their greatest common divisor keeps the
+    // knapsack table as small as the budget allows, without any rounding.
+    // Rounding sizes up to whole coarser units for large budgets still
+    // guarantees that the selected clonings fit in the budget.
+    int64_t size_gcd = 0;
+    for (int i = 0; i < num_knapsack_items; ++i)
+      size_gcd = std::gcd(size_gcd, items[i].size);
+    const int64_t units_in_budget = size_budget / size_gcd;
+    const int64_t unit_size =
+        size_gcd *
+        ((units_in_budget + kMaxCapacityUnits - 1) / kMaxCapacityUnits);
+    const int64_t capacity = size_budget / unit_size;
+    auto get_cost = [&](const Item &item) {
+      return (item.size + unit_size - 1) / unit_size;
+    };
+    // `max_score_gain[c]` is the maximum score gain achievable by the items
+    // considered so far with cost at most `c`. `is_taken[i * (capacity + 1) +
+    // c]` records whether item `i` is part of that selection when considered.
+    std::vector<double> max_score_gain(capacity + 1, 0);
+    std::vector<bool> is_taken(num_knapsack_items * (capacity + 1), false);
+    for (int i = 0; i < num_knapsack_items; ++i) {
+      const int64_t cost = get_cost(items[i]);
+      for (int64_t c = capacity; c >= cost; --c) {
+        double score_gain = max_score_gain[c - cost] + *items[i].cloning->score;
+        if (score_gain <= max_score_gain[c]) continue;
+        max_score_gain[c] = score_gain;
+        is_taken[i * (capacity + 1) + c] = true;
+      }
+    }
+    int64_t remaining_budget = size_budget;
+    int64_t c = capacity;
+    for (int i = num_knapsack_items - 1; i >= 0; --i) {
+      if (!is_taken[i * (capacity + 1) + c]) continue;
+      selected_clonings.insert(items[i].cloning);
+      c -= get_cost(items[i]);
+      remaining_budget -= items[i].size;
+    }
+    for (int i = num_knapsack_items; i < items.size(); ++i) {
+      if (items[i].size > remaining_budget) continue;
+      selected_clonings.insert(items[i].cloning);
+      remaining_budget -= items[i].size;
+    }
+  }
+
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> result;
+  for (auto &[function_index, clonings] : clonings_by_function_index) {
+    for (EvaluatedPathCloning &cloning : clonings) {
+      if (selected_clonings.contains(&cloning))
+        result[function_index].push_back(std::move(cloning));
+    }
+  }
+  return result;
+}
+
 CloneApplicatorStats ApplyClonings(
     const propeller::PropellerCodeLayoutParameters &code_layout_params,
     const PathProfileOptions &path_profile_options,
@@ -238,6 +491,9 @@ CloneApplicatorStats ApplyClonings(
     const absl::flat_hash_map<int, FunctionPathProfile>
         &path_profiles_by_function_index) {
   double total_score_gain = 0;
+  int64_t baseline_layout_cache_hits = 0;
+  int64_t baseline_layout_cache_misses = 0;
+  int64_t clonings_reevaluated = 0;
 
   LOG(INFO) << "Applying clonings...";
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
@@ -253,49 +509,59 @@ CloneApplicatorStats ApplyClonings(
 
     const ControlFlowGraph *cfg = program_cfg.GetCfgByIndex(function_index);
     CfgBuilder cfg_builder(cfg);
-    auto compute_optimal_chain_info = [&]() {
-      std::unique_ptr<ControlFlowGraph> clone_cfg = cfg_builder.Clone().Build();
-      std::vector<FunctionChainInfo> code_layout_result =
-          CodeLayout(code_layout_params, {clone_cfg.get()},
-                     /*initial_chains=*/{})
-              .OrderAll();
-      CHECK_EQ(code_layout_result.size(), 1);
-      return code_layout_result.front();
-    };
-    std::optional<propeller::FunctionChainInfo> optimal_chain_info;
+    // Baseline layouts can be shared between reevaluations as long as no
+    // cloning is applied in between.
+    BaselineLayoutCache baseline_cache;
     auto &current_cfg_changes = cfg_changes_by_function_index[function_index];
 
-    for (EvaluatedPathCloning &cloning : clonings) {
-      auto register_cloning = [&](EvaluatedPathCloning cloning) {
-        total_score_gain += *cloning.score;
-        cfg_builder.AddCfgChange(cloning.cfg_change);
-        current_cfg_changes.push_back(std::move(cloning.cfg_change));
-        // Reset `optimal_chain_info` as the CFG has changed and it must be
-        // recomputed.
-        optimal_chain_info = std::nullopt;
-      };
-      // Evaluate clonings again if any clonings have been applied as the score
-      // may have been changed.
-      if (!cfg_builder.cfg_changes().empty() || !cloning.score.has_value()) {
-        if (!optimal_chain_info.has_value())
-          optimal_chain_info = compute_optimal_chain_info();
-        absl::StatusOr<EvaluatedPathCloning> evaluated_cloning =
-            EvaluateCloning(cfg_builder.Clone(), cloning.path_cloning,
-                            code_layout_params, path_profile_options,
-                            path_profile_options.min_final_cloning_score(),
-                            optimal_chain_info.value(), function_path_profile);
-        if (!evaluated_cloning.ok()) continue;
-        register_cloning(std::move(*std::move(evaluated_cloning)));
-      } else if (cloning.score <
-                 path_profile_options.min_final_cloning_score()) {
-        // We can skip the rest of the clonings since they will have lower
-        // scores.
-        break;
-      } else {
-        register_cloning(std::move(cloning));
+    if (path_profile_options.batch_clone_application()) {
+      total_score_gain += ApplyCloningsInRounds(
+          code_layout_params, path_profile_options, std::move(clonings),
+          function_path_profile, cfg_builder, baseline_cache,
+          current_cfg_changes, clonings_reevaluated);
+    } else {
+      std::optional<propeller::FunctionChainInfo> optimal_chain_info;
+      for (EvaluatedPathCloning &cloning : clonings) {
+        auto register_cloning = [&](EvaluatedPathCloning cloning) {
+          total_score_gain += *cloning.score;
+          cfg_builder.AddCfgChange(cloning.cfg_change);
+          // Share the resulting edges with the clones built for subsequent
+          // reevaluations.
+          cfg_builder.CommitCfgChanges();
+          current_cfg_changes.push_back(std::move(cloning.cfg_change));
+          // Reset `optimal_chain_info` and the cached baselines as the CFG has
+          // changed and they must be recomputed.
+          optimal_chain_info = std::nullopt;
+          baseline_cache.Clear();
+        };
+        // Evaluate clonings again if any clonings have been applied as the
+        // score may have been changed.
+        if (cfg_builder.num_cfg_changes() != 0 || !cloning.score.has_value()) {
+          if (!optimal_chain_info.has_value())
+            optimal_chain_info =
+                ComputeOptimalChainInfo(cfg_builder, code_layout_params);
+          ++clonings_reevaluated;
+          absl::StatusOr<EvaluatedPathCloning> evaluated_cloning =
+              EvaluateCloning(cfg_builder.Clone(), cloning.path_cloning,
+                              code_layout_params, path_profile_options,
+                              path_profile_options.min_final_cloning_score(),
+                              optimal_chain_info.value(),
+                              function_path_profile, &baseline_cache);
+          if (!evaluated_cloning.ok()) continue;
+          register_cloning(std::move(*std::move(evaluated_cloning)));
+        } else if (cloning.score <
+                   path_profile_options.min_final_cloning_score()) {
+          // We can skip the rest of the clonings since they will have lower
+          // scores.
+          break;
+        } else {
+          register_cloning(std::move(cloning));
+        }
       }
     }
-    if (cfg_builder.cfg_changes().empty()) continue;
+    baseline_layout_cache_hits += baseline_cache.hits();
+    baseline_layout_cache_misses += baseline_cache.misses();
+    if (cfg_builder.num_cfg_changes() == 0) continue;
     CHECK(clone_cfgs_by_function_index
               .insert({function_index, std::move(cfg_builder).Build()})
               .second);
@@ -313,7 +579,10 @@ CloneApplicatorStats ApplyClonings(
                            clone_cfgs_by_function_index);
   return {
       .clone_cfgs_by_function_index = std::move(clone_cfgs_by_function_index),
-      .total_score_gain = total_score_gain};
+      .total_score_gain = total_score_gain,
+      .baseline_layout_cache_hits = baseline_layout_cache_hits,
+      .baseline_layout_cache_misses = baseline_layout_cache_misses,
+      .clonings_reevaluated = clonings_reevaluated};
 }
 
 std::unique_ptr<propeller::ProgramCfg> ApplyClonings(
@@ -332,7 +601,16 @@ std::unique_ptr<propeller::ProgramCfg> ApplyClonings(
   absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
       clonings_by_function_index =
           EvaluateAllClonings(program_cfg.get(), &program_path_profile,
-                              fast_code_layout_params, path_profile_options);
+                              fast_code_layout_params, path_profile_options,
+                              &cloning_stats);
+  if (path_profile_options.clone_size_budget() > 0) {
+    clonings_by_function_index = SelectCloningsWithinSizeBudget(
+        std::move(clonings_by_function_index), *program_cfg,
+        path_profile_options.clone_size_budget(),
+        /*exclude_conflicting_clonings=*/
+        path_profile_options.batch_clone_application());
+  }
+  cloning_stats.clone_size_budget = path_profile_options.clone_size_budget();
 
   CloneApplicatorStats clone_applicator_stats =
       ApplyClonings(fast_code_layout_params, path_profile_options,
@@ -340,6 +618,12 @@ std::unique_ptr<propeller::ProgramCfg> ApplyClonings(
                     program_path_profile.path_profiles_by_function_index());
 
   cloning_stats.score_gain = clone_applicator_stats.total_score_gain;
+  cloning_stats.baseline_layout_cache_hits +=
+      clone_applicator_stats.baseline_layout_cache_hits;
+  cloning_stats.baseline_layout_cache_misses +=
+      clone_applicator_stats.baseline_layout_cache_misses;
+  cloning_stats.clonings_reevaluated +=
+      clone_applicator_stats.clonings_reevaluated;
 
   for (const auto &[function_index, clone_cfg] :
        clone_applicator_stats.clone_cfgs_by_function_index) {
@@ -15,10 +15,12 @@
 #ifndef PROPELLER_CLONE_APPLICATOR_H_
 #define PROPELLER_CLONE_APPLICATOR_H_
 
+#include <cstdint>
 #include <memory>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/types/span.h"
 #include "propeller/cfg.h"
 #include "propeller/path_clone_evaluator.h"
 #include "propeller/path_node.h"
@@ -31,13 +33,51 @@ namespace propeller {
 
 // Result of applying clonings to a `ProgramCfg`. `clone_cfgs_by_function_index`
 // contains the resulting CFGs with clonings applied. `total_score_gain` is the
-// total score gain from applying the clonings.
+// total score gain from applying the clonings. `baseline_layout_cache_hits` and
+// `baseline_layout_cache_misses` count the baseline layouts shared and computed
+// when reevaluating clonings. `clonings_reevaluated` is the number of clonings
+// reevaluated against partially-cloned CFGs.
 struct CloneApplicatorStats {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>>
       clone_cfgs_by_function_index;
   double total_score_gain = 0;
+  int64_t baseline_layout_cache_hits = 0;
+  int64_t baseline_layout_cache_misses = 0;
+  int64_t clonings_reevaluated = 0;
 };
 
+// Returns the indices of a maximal set of mutually non-conflicting clonings in
+// `clonings`, selected greedily in the given order. Two clonings conflict if
+// their CFG changes affect a common block, i.e., if the path predecessors,
+// cloned paths and rerouted intra-function edges of the two clonings share a
+// block. All clonings in `clonings` must have their `cfg_change`s built.
+std::vector<int> SelectNonConflictingClonings(
+    absl::Span<const EvaluatedPathCloning> clonings);
+
+// Returns the code size (in bytes) added by `cloning`: the total size of the
+// blocks on its cloned path in `program_cfg`.
+int64_t GetCloningSize(const EvaluatedPathCloning &cloning,
+                       const ProgramCfg &program_cfg);
+
+// Selects the subset of `clonings_by_function_index` which maximizes the total
+// score gain subject to the total size of the clonings (as computed by
+// `GetCloningSize`) not exceeding `size_budget`, by solving the 0/1 knapsack
+// problem across all functions. If `exclude_conflicting_clonings` is true (as
+// needed when clonings are applied in batches without reevaluation),
+// conflicting clonings of each function are first resolved by
+// `SelectNonConflictingClonings` in decreasing order of scores, so no two
+// selected clonings conflict. Sizes are rounded up to a coarser unit for large
+// budgets, and only the clonings with the highest score per byte are selected
+// optimally while the others fill the leftover budget greedily, so the result
+// may be slightly suboptimal but never exceeds the budget. Clonings must have
+// their scores and `cfg_change`s computed.
+absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+SelectCloningsWithinSizeBudget(
+    absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+        clonings_by_function_index,
+    const ProgramCfg &program_cfg, int64_t size_budget,
+    bool exclude_conflicting_clonings);
+
 // Applies all profitable clonings in `clonings_by_function_index` to
 // clones of CFGs in `program_cfg`. Returns a `CloneApplicatorStats` struct
 // containing the resulting CFGs with clonings applied and the total score gain
@@ -52,7 +92,9 @@ CloneApplicatorStats ApplyClonings(
         &path_profiles_by_function_index);
 
 // Applies profitable clonings to `program_cfg` and returns the resulting
-// `ProgramCfg`. Updates `cloning_stats` accordingly.
+// `ProgramCfg`. If `path_profile_options.clone_size_budget()` is positive,
+// only the clonings selected by `SelectCloningsWithinSizeBudget` are applied.
+// Updates `cloning_stats` accordingly.
 std::unique_ptr<ProgramCfg> ApplyClonings(
     const PropellerCodeLayoutParameters &code_layout_params,
     const PathProfileOptions &path_profile_options,
@@ -16,20 +16,28 @@
 
 #include <memory>
 #include <string>
+#include <tuple>
+#include <utility>
 #include <vector>
 
 #include "absl/container/flat_hash_map.h"
+#include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
+#include "propeller/cfg.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_matchers.h"
 #include "propeller/cfg_testutil.h"
+#include "propeller/code_layout.h"
+#include "propeller/function_chain_info.h"
 #include "propeller/mock_program_cfg_builder.h"
 #include "propeller/multi_cfg_test_case.h"
 #include "propeller/parse_text_proto.h"
 #include "propeller/path_clone_evaluator.h"
 #include "propeller/path_node.h"
+#include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
 #include "propeller/propeller_options.pb.h"
 #include "propeller/status_testing_macros.h"
@@ -39,8 +47,15 @@ namespace {
 using ::propeller_testing::ParseTextProtoOrDie;
 using ::testing::_;
 using ::testing::Contains;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::IsEmpty;
+using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::Pointee;
+using ::testing::SizeIs;
+using ::testing::UnorderedElementsAre;
+using ::testing::UnorderedElementsAreArray;
 
 struct ApplyCloningsTestCase {
   struct PathCloningArg {
@@ -792,5 +807,319 @@ INSTANTIATE_TEST_SUITE_P(
     [](const ::testing::TestParamInfo<ApplyCloningsTest::ParamType>& info) {
       return info.param.test_name;
     });
+
+TEST(SelectNonConflictingClonings, SelectsGreedilyInOrder) {
+  std::vector<EvaluatedPathCloning> clonings(4);
+  clonings[0].cfg_change = {.path_pred_bb_index = 1, .path_to_clone = {3, 4}};
+  // Conflicts with `clonings[0]` on block 3.
+  clonings[1].cfg_change = {.path_pred_bb_index = 2, .path_to_clone = {3, 5}};
+  clonings[2].cfg_change = {.path_pred_bb_index = 6, .path_to_clone = {7}};
+  // Conflicts with `clonings[0]` on the rerouted edge from block 4.
+  clonings[3].cfg_change = {
+      .path_pred_bb_index = 9,
+      .path_to_clone = {10},
+      .intra_edge_reroutes = {{.src_bb_index = 4,
+                               .sink_bb_index = 8,
+                               .src_is_cloned = false,
+                               .sink_is_cloned = false,
+                               .kind = CFGEdgeKind::kBranchOrFallthough,
+                               .weight = 10}}};
+  EXPECT_THAT(SelectNonConflictingClonings(clonings), ElementsAre(0, 2));
+  EXPECT_THAT(SelectNonConflictingClonings(
+                  absl::MakeConstSpan(clonings).subspan(1)),
+              ElementsAre(0, 1, 2));
+}
+
+TEST(ApplyCloningsTest, BatchApplicationMatchesSequentialForSingleCloning) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings = {
+      {6,
+       {{.path_cloning = {.path_node =
+                              function_path_profile.GetPathTree(3)->GetChild(4),
+                          .function_index = 6,
+                          .path_pred_bb_index = 1}}}}};
+  PropellerOptions propeller_options = ParseTextProtoOrDie(
+      R"pb(code_layout_params { call_chain_clustering: false })pb");
+  PathProfileOptions batch_path_profile_options =
+      propeller_options.path_profile_options();
+  batch_path_profile_options.set_batch_clone_application(true);
+
+  CloneApplicatorStats sequential_stats = ApplyClonings(
+      propeller_options.code_layout_params(),
+      propeller_options.path_profile_options(), clonings, *program_cfg,
+      path_profile.path_profiles_by_function_index());
+  CloneApplicatorStats batch_stats = ApplyClonings(
+      propeller_options.code_layout_params(), batch_path_profile_options,
+      clonings, *program_cfg, path_profile.path_profiles_by_function_index());
+
+  EXPECT_EQ(batch_stats.total_score_gain, sequential_stats.total_score_gain);
+  EXPECT_EQ(batch_stats.clonings_reevaluated, 1);
+  EXPECT_THAT(batch_stats.clone_cfgs_by_function_index.at(6)->nodes(),
+              SizeIs(sequential_stats.clone_cfgs_by_function_index.at(6)
+                         ->nodes()
+                         .size()));
+}
+
+// Returns the intra-function edges of `cfg` as tuples of their source id, sink
+// id, and weight.
+std::vector<std::tuple<IntraCfgId, IntraCfgId, int>> GetIntraEdges(
+    const ControlFlowGraph& cfg) {
+  std::vector<std::tuple<IntraCfgId, IntraCfgId, int>> result;
+  for (const auto& edge : cfg.intra_edges()) {
+    result.emplace_back(edge->src()->intra_cfg_id(),
+                        edge->sink()->intra_cfg_id(), edge->weight());
+  }
+  return result;
+}
+
+// Returns a copy of `path_node_arg` with all its block indices shifted by
+// `offset`.
+PathNodeArg ShiftPathNodeArg(const PathNodeArg& path_node_arg, int offset) {
+  PathNodeArg result = {.node_bb_index = path_node_arg.node_bb_index + offset};
+  result.path_pred_info.missing_pred_entry =
+      path_node_arg.path_pred_info.missing_pred_entry;
+  for (const auto& [pred_bb_index, entry] :
+       path_node_arg.path_pred_info.entries)
+    result.path_pred_info.entries.emplace(pred_bb_index + offset, entry);
+  for (const auto& [child_bb_index, child_arg] : path_node_arg.children_args) {
+    result.children_args.emplace(child_bb_index + offset,
+                                 ShiftPathNodeArg(child_arg, offset));
+  }
+  return result;
+}
+
+// Returns a program with a single function 6 made of two disconnected copies of
+// function foo in `GetDefaultProgramCfgArg`: blocks 0-5 and blocks 6-11.
+MultiCfgArg GetTwinProgramCfgArg() {
+  MultiCfgArg default_cfg_arg = GetDefaultProgramCfgArg();
+  const CfgArg& foo_arg = default_cfg_arg.cfg_args.at(0);
+  std::vector<NodeArg> node_args = foo_arg.node_args;
+  std::vector<IntraEdgeArg> edge_args = foo_arg.edge_args;
+  for (const NodeArg& node_arg : foo_arg.node_args) {
+    node_args.push_back({node_arg.addr + 0x100, node_arg.bb_index + 6,
+                         node_arg.size, node_arg.metadata});
+  }
+  for (const IntraEdgeArg& edge_arg : foo_arg.edge_args) {
+    edge_args.push_back({edge_arg.from_bb_index + 6, edge_arg.to_bb_index + 6,
+                         edge_arg.weight, edge_arg.kind});
+  }
+  return {.cfg_args = {{foo_arg.section_name, foo_arg.function_index,
+                        foo_arg.function_name, std::move(node_args),
+                        std::move(edge_args)}}};
+}
+
+// Returns the path profile for `GetTwinProgramCfgArg`, with the path trees of
+// `GetDefaultPathProfileArg` replicated for both copies of foo.
+ProgramPathProfileArg GetTwinPathProfileArg() {
+  ProgramPathProfileArg path_profile_arg = GetDefaultPathProfileArg();
+  FunctionPathProfileArg& function_path_profile_arg =
+      path_profile_arg.GetProfileForFunctionIndex(6);
+  std::vector<PathNodeArg> shifted_path_node_args;
+  for (const auto& [bb_index, path_node_arg] :
+       function_path_profile_arg.path_node_args)
+    shifted_path_node_args.push_back(ShiftPathNodeArg(path_node_arg, 6));
+  for (PathNodeArg& path_node_arg : shifted_path_node_args) {
+    int bb_index = path_node_arg.node_bb_index;
+    function_path_profile_arg.path_node_args.emplace(bb_index,
+                                                     std::move(path_node_arg));
+  }
+  return path_profile_arg;
+}
+
+// Evaluates `clonings` of function 6 against the original CFG, as done by
+// `EvaluateAllClonings`, and applies them once sequentially and once in
+// batches. Checks that both result in the same score gain and clone CFG and
+// returns the stats of the batch application.
+CloneApplicatorStats ExpectBatchApplicationMatchesSequential(
+    const ProgramCfg& program_cfg, const ProgramPathProfile& path_profile,
+    const std::vector<PathCloning>& clonings) {
+  PropellerOptions propeller_options = ParseTextProtoOrDie(
+      R"pb(code_layout_params { call_chain_clustering: false })pb");
+  const ControlFlowGraph* cfg = program_cfg.GetCfgByIndex(6);
+  FunctionChainInfo optimal_chain_info =
+      CodeLayout(propeller_options.code_layout_params(), {cfg},
+                 /*initial_chains=*/{})
+          .OrderAll()
+          .front();
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      clonings_by_function_index;
+  for (const PathCloning& cloning : clonings) {
+    absl::StatusOr<EvaluatedPathCloning> evaluated_cloning = EvaluateCloning(
+        CfgBuilder(cfg), cloning, propeller_options.code_layout_params(),
+        propeller_options.path_profile_options(),
+        propeller_options.path_profile_options().min_initial_cloning_score(),
+        optimal_chain_info,
+        path_profile.path_profiles_by_function_index().at(6));
+    EXPECT_OK(evaluated_cloning);
+    if (evaluated_cloning.ok())
+      clonings_by_function_index[6].push_back(*std::move(evaluated_cloning));
+  }
+  PathProfileOptions batch_path_profile_options =
+      propeller_options.path_profile_options();
+  batch_path_profile_options.set_batch_clone_application(true);
+
+  CloneApplicatorStats sequential_stats = ApplyClonings(
+      propeller_options.code_layout_params(),
+      propeller_options.path_profile_options(), clonings_by_function_index,
+      program_cfg, path_profile.path_profiles_by_function_index());
+  CloneApplicatorStats batch_stats = ApplyClonings(
+      propeller_options.code_layout_params(), batch_path_profile_options,
+      clonings_by_function_index, program_cfg,
+      path_profile.path_profiles_by_function_index());
+
+  EXPECT_NEAR(batch_stats.total_score_gain, sequential_stats.total_score_gain,
+              1e-6);
+  EXPECT_THAT(
+      GetIntraEdges(*batch_stats.clone_cfgs_by_function_index.at(6)),
+      UnorderedElementsAreArray(GetIntraEdges(
+          *sequential_stats.clone_cfgs_by_function_index.at(6))));
+  return batch_stats;
+}
+
+TEST(ApplyCloningsTest, BatchApplicationMatchesSequentialForIndependentClones) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetTwinProgramCfgArg());
+  ProgramPathProfile path_profile(GetTwinPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  // The two clonings are in disconnected copies of foo, so they don't conflict
+  // and are applied in the same round.
+  CloneApplicatorStats batch_stats = ExpectBatchApplicationMatchesSequential(
+      *program_cfg, path_profile,
+      {{.path_node = function_path_profile.GetPathTree(3),
+        .function_index = 6,
+        .path_pred_bb_index = 1},
+       {.path_node = function_path_profile.GetPathTree(9),
+        .function_index = 6,
+        .path_pred_bb_index = 7}});
+  // Both clonings are applied in the first round without reevaluation.
+  EXPECT_EQ(batch_stats.clonings_reevaluated, 0);
+  EXPECT_THAT(batch_stats.clone_cfgs_by_function_index.at(6)->nodes(),
+              SizeIs(14));
+}
+
+TEST(ApplyCloningsTest, BatchApplicationMatchesSequentialForConflictingClones) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  // Both clonings clone block 3, so the one with the lower score is deferred to
+  // the next round and reevaluated after the other one is applied.
+  CloneApplicatorStats batch_stats = ExpectBatchApplicationMatchesSequential(
+      *program_cfg, path_profile,
+      {{.path_node = function_path_profile.GetPathTree(3),
+        .function_index = 6,
+        .path_pred_bb_index = 1},
+       {.path_node = function_path_profile.GetPathTree(3)->GetChild(4),
+        .function_index = 6,
+        .path_pred_bb_index = 2}});
+  EXPECT_EQ(batch_stats.clonings_reevaluated, 1);
+}
+
+// Returns an evaluated cloning of `function_index` along `path_to_clone` from
+// `path_pred_bb_index`, with score `score`.
+EvaluatedPathCloning MakeEvaluatedCloning(int function_index,
+                                          int path_pred_bb_index,
+                                          std::vector<int> path_to_clone,
+                                          double score) {
+  return EvaluatedPathCloning{
+      .path_cloning = {.function_index = function_index,
+                       .path_pred_bb_index = path_pred_bb_index},
+      .score = score,
+      .cfg_change = {.path_pred_bb_index = path_pred_bb_index,
+                     .path_to_clone = std::move(path_to_clone)}};
+}
+
+TEST(SelectCloningsWithinSizeBudget, MaximizesScoreGainWithinBudget) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  // Block sizes are 8 for foo#3, 32 for foo#4, 6 for foo#5 and 18 for bar#1.
+  // The clonings of foo along {3} and {3, 5} conflict on block 3, and the
+  // latter is dropped for its lower score.
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings = {
+      {6,
+       {MakeEvaluatedCloning(6, 1, {3}, 10),
+        MakeEvaluatedCloning(6, 2, {4}, 45),
+        MakeEvaluatedCloning(6, 1, {3, 5}, 8)}},
+      {7, {MakeEvaluatedCloning(7, 0, {1}, 25)}}};
+  EXPECT_EQ(GetCloningSize(clonings.at(6)[2], *program_cfg), 14);
+
+  EXPECT_THAT(
+      SelectCloningsWithinSizeBudget(clonings, *program_cfg,
+                                     /*size_budget=*/40,
+                                     /*exclude_conflicting_clonings=*/true),
+      UnorderedElementsAre(Pair(
+          6, UnorderedElementsAre(
+                 Field(&EvaluatedPathCloning::score, Optional(10)),
+                 Field(&EvaluatedPathCloning::score, Optional(45))))));
+  EXPECT_THAT(
+      SelectCloningsWithinSizeBudget(clonings, *program_cfg,
+                                     /*size_budget=*/31,
+                                     /*exclude_conflicting_clonings=*/true),
+      UnorderedElementsAre(
+          Pair(6, ElementsAre(
+                      Field(&EvaluatedPathCloning::score, Optional(10)))),
+          Pair(7, ElementsAre(
+                      Field(&EvaluatedPathCloning::score, Optional(25))))));
+  EXPECT_THAT(
+      SelectCloningsWithinSizeBudget(clonings, *program_cfg,
+                                     /*size_budget=*/5,
+                                     /*exclude_conflicting_clonings=*/true),
+      IsEmpty());
+}
+
+TEST(SelectCloningsWithinSizeBudget, ExcludesConflictingClonings) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  // The first two clonings both clone block 3 and together fit in the budget,
+  // but only the one with the higher score may be selected.
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> clonings = {
+      {6,
+       {MakeEvaluatedCloning(6, 1, {3}, 10),
+        MakeEvaluatedCloning(6, 2, {3, 5}, 12),
+        MakeEvaluatedCloning(6, 0, {4}, 5)}}};
+  EXPECT_THAT(
+      SelectCloningsWithinSizeBudget(clonings, *program_cfg,
+                                     /*size_budget=*/25,
+                                     /*exclude_conflicting_clonings=*/true),
+      UnorderedElementsAre(Pair(
+          6, ElementsAre(Field(&EvaluatedPathCloning::score, Optional(12))))));
+  // Clonings applied one by one are reevaluated after every application, so
+  // conflicting clonings may share the budget.
+  EXPECT_THAT(
+      SelectCloningsWithinSizeBudget(clonings, *program_cfg,
+                                     /*size_budget=*/25,
+                                     /*exclude_conflicting_clonings=*/false),
+      UnorderedElementsAre(Pair(
+          6, UnorderedElementsAre(
+                 Field(&EvaluatedPathCloning::score, Optional(10)),
+                 Field(&EvaluatedPathCloning::score, Optional(12))))));
+}
+
+TEST(SelectCloningsWithinSizeBudget, FillsLeftoverBudgetGreedily) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  // More clonings than fit in the knapsack table, all of foo#3 (8 bytes) with
+  // decreasing scores. Only every other cloning fits in the budget.
+  constexpr int kNumClonings = 3000;
+  std::vector<EvaluatedPathCloning> foo_clonings;
+  for (int i = 0; i < kNumClonings; ++i)
+    foo_clonings.push_back(MakeEvaluatedCloning(6, i, {3}, kNumClonings - i));
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> selected =
+      SelectCloningsWithinSizeBudget({{6, std::move(foo_clonings)}},
+                                     *program_cfg,
+                                     /*size_budget=*/8 * kNumClonings / 2,
+                                     /*exclude_conflicting_clonings=*/false);
+  ASSERT_THAT(selected,
+              UnorderedElementsAre(Pair(6, SizeIs(kNumClonings / 2))));
+  // The clonings with the highest scores are selected.
+  for (const EvaluatedPathCloning &cloning : selected.at(6))
+    EXPECT_GT(*cloning.score, kNumClonings / 2);
+}
 }  // namespace
 }  // namespace propeller
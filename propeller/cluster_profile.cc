@@ -0,0 +1,484 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/cluster_profile.h"
+
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/container/flat_hash_map.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/numbers.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/strings/strip.h"
+#include "absl/types/span.h"
+#include "llvm/Support/LEB128.h"
+#include "llvm/Support/raw_ostream.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+namespace {
+// Maps strings to their index in the string table.
+class StringTableBuilder {
+ public:
+  int GetOrInsert(absl::string_view str) {
+    auto [it, inserted] = indices_.try_emplace(str, strings_.size());
+    if (inserted) strings_.push_back(str);
+    return it->second;
+  }
+
+  const std::vector<absl::string_view> &strings() const { return strings_; }
+
+ private:
+  absl::flat_hash_map<absl::string_view, int> indices_;
+  std::vector<absl::string_view> strings_;
+};
+
+void WriteProfileBbId(const ProfileBbId &bb_id, llvm::raw_ostream &os) {
+  llvm::encodeULEB128(
+      (static_cast<uint64_t>(bb_id.bb_id) << 1) | (bb_id.clone_number != 0),
+      os);
+  if (bb_id.clone_number != 0) llvm::encodeULEB128(bb_id.clone_number, os);
+}
+
+void WriteFunction(const ClusterProfileFunction &function,
+                   StringTableBuilder &string_table, llvm::raw_ostream &os) {
+  llvm::encodeULEB128(function.module_name.has_value()
+                          ? string_table.GetOrInsert(*function.module_name) + 1
+                          : 0,
+                      os);
+  llvm::encodeULEB128(function.names.size(), os);
+  for (absl::string_view name : function.names)
+    llvm::encodeULEB128(string_table.GetOrInsert(name), os);
+  llvm::encodeULEB128(function.clone_paths.size(), os);
+  for (const std::vector<int> &clone_path : function.clone_paths) {
+    llvm::encodeULEB128(clone_path.size(), os);
+    for (int bb_id : clone_path) llvm::encodeULEB128(bb_id, os);
+  }
+  llvm::encodeULEB128(function.clusters.size(), os);
+  for (const std::vector<ProfileBbId> &cluster : function.clusters) {
+    llvm::encodeULEB128(cluster.size(), os);
+    for (const ProfileBbId &bb_id : cluster) WriteProfileBbId(bb_id, os);
+  }
+  if (!function.cfg_profile.has_value()) {
+    llvm::encodeULEB128(0, os);
+    return;
+  }
+  llvm::encodeULEB128(function.cfg_profile->size() + 1, os);
+  for (const CfgProfileNode &node : *function.cfg_profile) {
+    WriteProfileBbId(node.bb_id, os);
+    llvm::encodeULEB128(node.freq, os);
+    llvm::encodeULEB128(node.successors.size(), os);
+    for (const CfgProfileNode::Successor &successor : node.successors) {
+      WriteProfileBbId(successor.bb_id, os);
+      llvm::encodeULEB128(successor.weight, os);
+    }
+  }
+}
+
+absl::StatusOr<int> ParseInt(absl::string_view str) {
+  int value;
+  if (!absl::SimpleAtoi(str, &value) || value < 0)
+    return absl::InvalidArgumentError(absl::StrCat("invalid number: ", str));
+  return value;
+}
+
+absl::StatusOr<ProfileBbId> ParseProfileBbId(absl::string_view str) {
+  std::pair<absl::string_view, absl::string_view> bb_id_and_clone =
+      absl::StrSplit(str, absl::MaxSplits('.', 1));
+  ProfileBbId bb_id;
+  ASSIGN_OR_RETURN(bb_id.bb_id, ParseInt(bb_id_and_clone.first));
+  if (!bb_id_and_clone.second.empty()) {
+    ASSIGN_OR_RETURN(bb_id.clone_number, ParseInt(bb_id_and_clone.second));
+  }
+  return bb_id;
+}
+
+// Parses a "<bb>:<weight>" pair.
+absl::StatusOr<std::pair<ProfileBbId, int64_t>> ParseBbIdAndWeight(
+    absl::string_view str) {
+  std::pair<absl::string_view, absl::string_view> bb_id_and_weight =
+      absl::StrSplit(str, absl::MaxSplits(':', 1));
+  ASSIGN_OR_RETURN(ProfileBbId bb_id,
+                   ParseProfileBbId(bb_id_and_weight.first));
+  int64_t weight;
+  if (!absl::SimpleAtoi(bb_id_and_weight.second, &weight)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("invalid weight: ", bb_id_and_weight.second));
+  }
+  return std::make_pair(bb_id, weight);
+}
+
+// Parses the body of a "#cfg" line.
+absl::StatusOr<std::vector<CfgProfileNode>> ParseCfgProfile(
+    absl::string_view str) {
+  std::vector<CfgProfileNode> cfg_profile;
+  for (absl::string_view node_str :
+       absl::StrSplit(str, ' ', absl::SkipEmpty())) {
+    std::vector<absl::string_view> parts = absl::StrSplit(node_str, ',');
+    CfgProfileNode &node = cfg_profile.emplace_back();
+    ASSIGN_OR_RETURN(std::tie(node.bb_id, node.freq),
+                     ParseBbIdAndWeight(parts.front()));
+    for (absl::string_view successor_str : absl::MakeSpan(parts).subspan(1)) {
+      CfgProfileNode::Successor &successor = node.successors.emplace_back();
+      ASSIGN_OR_RETURN(std::tie(successor.bb_id, successor.weight),
+                       ParseBbIdAndWeight(successor_str));
+    }
+  }
+  return cfg_profile;
+}
+
+// Parses a space-separated list of profile bb ids.
+absl::StatusOr<std::vector<ProfileBbId>> ParseProfileBbIds(
+    absl::string_view str) {
+  std::vector<ProfileBbId> bb_ids;
+  for (absl::string_view bb_id_str :
+       absl::StrSplit(str, ' ', absl::SkipEmpty())) {
+    ASSIGN_OR_RETURN(bb_ids.emplace_back(), ParseProfileBbId(bb_id_str));
+  }
+  return bb_ids;
+}
+
+std::string ProfileBbIdToString(const ProfileBbId &bb_id) {
+  if (bb_id.clone_number == 0) return absl::StrCat(bb_id.bb_id);
+  return absl::StrCat(bb_id.bb_id, ".", bb_id.clone_number);
+}
+}  // namespace
+
+std::string EncodeBinaryClusterProfile(
+    absl::Span<const ClusterProfileFunction> functions) {
+  // Encode the sections first, since the string table must precede them.
+  StringTableBuilder string_table;
+  std::string sections;
+  llvm::raw_string_ostream sections_os(sections);
+  for (size_t begin = 0; begin < functions.size();) {
+    size_t end = begin + 1;
+    while (end < functions.size() &&
+           functions[end].section_name == functions[begin].section_name) {
+      ++end;
+    }
+    llvm::encodeULEB128(
+        string_table.GetOrInsert(functions[begin].section_name), sections_os);
+    llvm::encodeULEB128(end - begin, sections_os);
+    for (size_t i = begin; i < end; ++i)
+      WriteFunction(functions[i], string_table, sections_os);
+    begin = end;
+  }
+  sections_os.flush();
+
+  std::string profile;
+  llvm::raw_string_ostream os(profile);
+  os.write(kBinaryClusterProfileMagic.data(),
+           kBinaryClusterProfileMagic.size());
+  llvm::encodeULEB128(kBinaryClusterProfileVersion, os);
+  llvm::encodeULEB128(string_table.strings().size(), os);
+  for (absl::string_view str : string_table.strings()) {
+    llvm::encodeULEB128(str.size(), os);
+    os.write(str.data(), str.size());
+  }
+  os << sections;
+  os.flush();
+  return profile;
+}
+
+absl::StatusOr<BinaryClusterProfileReader> BinaryClusterProfileReader::Create(
+    absl::string_view data) {
+  if (!absl::StartsWith(data, kBinaryClusterProfileMagic)) {
+    return absl::InvalidArgumentError(
+        "not a binary cluster profile: bad magic");
+  }
+  BinaryClusterProfileReader reader(data);
+  reader.pos_ = kBinaryClusterProfileMagic.size();
+  ASSIGN_OR_RETURN(uint64_t version, reader.ReadVarint());
+  if (version != kBinaryClusterProfileVersion) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("unsupported binary cluster profile version: ", version));
+  }
+  ASSIGN_OR_RETURN(uint64_t num_strings,
+                   reader.ReadBoundedVarint(data.size() - reader.pos_));
+  reader.string_table_.reserve(num_strings);
+  for (uint64_t i = 0; i < num_strings; ++i) {
+    ASSIGN_OR_RETURN(uint64_t length, reader.ReadVarint());
+    if (length > data.size() - reader.pos_) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("malformed binary cluster profile at offset ",
+                       reader.pos_, ": string extends past end"));
+    }
+    reader.string_table_.push_back(data.substr(reader.pos_, length));
+    reader.pos_ += length;
+  }
+  return reader;
+}
+
+absl::StatusOr<uint64_t> BinaryClusterProfileReader::ReadVarint() {
+  unsigned length = 0;
+  const char *error = nullptr;
+  const auto *begin = reinterpret_cast<const uint8_t *>(data_.data());
+  uint64_t value = llvm::decodeULEB128(begin + pos_, &length,
+                                       begin + data_.size(), &error);
+  if (error != nullptr) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "malformed binary cluster profile at offset ", pos_, ": ", error));
+  }
+  pos_ += length;
+  return value;
+}
+
+absl::StatusOr<uint64_t> BinaryClusterProfileReader::ReadBoundedVarint(
+    uint64_t max_value) {
+  ASSIGN_OR_RETURN(uint64_t value, ReadVarint());
+  if (value > max_value) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("malformed binary cluster profile at offset ", pos_,
+                     ": value ", value, " exceeds ", max_value));
+  }
+  return value;
+}
+
+absl::StatusOr<absl::string_view> BinaryClusterProfileReader::ReadString() {
+  if (string_table_.empty()) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "malformed binary cluster profile at offset ", pos_,
+        ": reference to empty string table"));
+  }
+  ASSIGN_OR_RETURN(uint64_t index, ReadBoundedVarint(string_table_.size() - 1));
+  return string_table_[index];
+}
+
+absl::StatusOr<ProfileBbId> BinaryClusterProfileReader::ReadProfileBbId() {
+  ASSIGN_OR_RETURN(uint64_t encoded_bb_id, ReadVarint());
+  ProfileBbId bb_id = {.bb_id = static_cast<int>(encoded_bb_id >> 1)};
+  if (encoded_bb_id & 1) {
+    ASSIGN_OR_RETURN(uint64_t clone_number, ReadVarint());
+    bb_id.clone_number = static_cast<int>(clone_number);
+  }
+  return bb_id;
+}
+
+absl::StatusOr<std::optional<ClusterProfileFunction>>
+BinaryClusterProfileReader::ReadNext() {
+  while (num_remaining_section_functions_ == 0) {
+    if (pos_ == data_.size()) return std::nullopt;
+    ASSIGN_OR_RETURN(section_name_, ReadString());
+    // Every function takes at least five bytes.
+    ASSIGN_OR_RETURN(num_remaining_section_functions_,
+                     ReadBoundedVarint((data_.size() - pos_) / 5));
+  }
+  --num_remaining_section_functions_;
+  // Bound for the number of elements of any list, since every element takes
+  // at least one byte.
+  const auto max_count = [&] { return data_.size() - pos_; };
+  ClusterProfileFunction function = {.section_name = section_name_};
+  ASSIGN_OR_RETURN(uint64_t module_name_index,
+                   ReadBoundedVarint(string_table_.size()));
+  if (module_name_index != 0)
+    function.module_name = string_table_[module_name_index - 1];
+  ASSIGN_OR_RETURN(uint64_t num_names, ReadBoundedVarint(max_count()));
+  function.names.reserve(num_names);
+  for (uint64_t i = 0; i < num_names; ++i) {
+    ASSIGN_OR_RETURN(function.names.emplace_back(), ReadString());
+  }
+  ASSIGN_OR_RETURN(uint64_t num_clone_paths, ReadBoundedVarint(max_count()));
+  function.clone_paths.resize(num_clone_paths);
+  for (std::vector<int> &clone_path : function.clone_paths) {
+    ASSIGN_OR_RETURN(uint64_t path_length, ReadBoundedVarint(max_count()));
+    clone_path.reserve(path_length);
+    for (uint64_t i = 0; i < path_length; ++i) {
+      ASSIGN_OR_RETURN(uint64_t bb_id, ReadVarint());
+      clone_path.push_back(static_cast<int>(bb_id));
+    }
+  }
+  ASSIGN_OR_RETURN(uint64_t num_clusters, ReadBoundedVarint(max_count()));
+  function.clusters.resize(num_clusters);
+  for (std::vector<ProfileBbId> &cluster : function.clusters) {
+    ASSIGN_OR_RETURN(uint64_t cluster_size, ReadBoundedVarint(max_count()));
+    cluster.reserve(cluster_size);
+    for (uint64_t i = 0; i < cluster_size; ++i) {
+      ASSIGN_OR_RETURN(cluster.emplace_back(), ReadProfileBbId());
+    }
+  }
+  ASSIGN_OR_RETURN(uint64_t num_cfg_nodes, ReadBoundedVarint(max_count() + 1));
+  if (num_cfg_nodes == 0) return function;
+  std::vector<CfgProfileNode> &cfg_profile = function.cfg_profile.emplace();
+  cfg_profile.resize(num_cfg_nodes - 1);
+  for (CfgProfileNode &node : cfg_profile) {
+    ASSIGN_OR_RETURN(node.bb_id, ReadProfileBbId());
+    ASSIGN_OR_RETURN(node.freq, ReadVarint());
+    ASSIGN_OR_RETURN(uint64_t num_successors, ReadBoundedVarint(max_count()));
+    node.successors.resize(num_successors);
+    for (CfgProfileNode::Successor &successor : node.successors) {
+      ASSIGN_OR_RETURN(successor.bb_id, ReadProfileBbId());
+      ASSIGN_OR_RETURN(successor.weight, ReadVarint());
+    }
+  }
+  return function;
+}
+
+void AppendTextClusterProfile(const ClusterProfileFunction &function,
+                              absl::string_view prev_section_name,
+                              std::string &out) {
+  if (!function.section_name.empty() &&
+      function.section_name != prev_section_name) {
+    absl::StrAppend(&out, "#section ", function.section_name, "\n");
+  }
+  if (function.module_name.has_value())
+    absl::StrAppend(&out, "m ", *function.module_name, "\n");
+  absl::StrAppend(&out, "f ", absl::StrJoin(function.names, " "), "\n");
+  for (const std::vector<int> &clone_path : function.clone_paths)
+    absl::StrAppend(&out, "p", absl::StrJoin(clone_path, " "), "\n");
+  for (const std::vector<ProfileBbId> &cluster : function.clusters) {
+    absl::StrAppend(&out, "c",
+                    absl::StrJoin(cluster, " ",
+                                  [](std::string *result,
+                                     const ProfileBbId &bb_id) {
+                                    absl::StrAppend(result,
+                                                    ProfileBbIdToString(bb_id));
+                                  }),
+                    "\n");
+  }
+  if (!function.cfg_profile.has_value()) return;
+  absl::StrAppend(&out, "#cfg");
+  for (const CfgProfileNode &node : *function.cfg_profile) {
+    absl::StrAppend(&out, " ", ProfileBbIdToString(node.bb_id), ":",
+                    node.freq);
+    for (const CfgProfileNode::Successor &successor : node.successors) {
+      absl::StrAppend(&out, ",", ProfileBbIdToString(successor.bb_id), ":",
+                      successor.weight);
+    }
+  }
+  absl::StrAppend(&out, "\n");
+}
+
+absl::StatusOr<std::vector<ClusterProfileFunction>> ParseTextClusterProfile(
+    absl::string_view text) {
+  std::vector<ClusterProfileFunction> functions;
+  absl::string_view section_name;
+  std::optional<absl::string_view> module_name;
+  // Offsets of the last module line and of the text of the last function.
+  size_t module_begin = 0;
+  size_t function_begin = 0;
+  // Whether the current line belongs to the text of the last function.
+  bool in_function = false;
+  int line_number = 0;
+  for (absl::string_view line : absl::StrSplit(text, '\n')) {
+    ++line_number;
+    auto error = [&](absl::string_view message) {
+      return absl::InvalidArgumentError(
+          absl::StrCat("line ", line_number, ": ", message));
+    };
+    if (line.empty()) continue;
+    if (line_number == 1) {
+      if (line != "v1") return error("expected \"v1\" header");
+      continue;
+    }
+    const size_t line_begin = line.data() - text.data();
+    // The line's newline (if any) is part of the function's text.
+    const size_t line_end = std::min(line_begin + line.size() + 1, text.size());
+    if (absl::ConsumePrefix(&line, "#section ")) {
+      section_name = line;
+      in_function = false;
+    } else if (absl::ConsumePrefix(&line, "m ")) {
+      module_name = line;
+      module_begin = line_begin;
+      in_function = false;
+    } else if (absl::ConsumePrefix(&line, "f ")) {
+      // The text of a function starts at its module line, if any.
+      function_begin = module_name.has_value() ? module_begin : line_begin;
+      functions.push_back({.section_name = section_name,
+                           .module_name = std::exchange(module_name, {}),
+                           .names = absl::StrSplit(line, ' ')});
+      in_function = true;
+    } else if (functions.empty()) {
+      // Other directives are only allowed after a function.
+      if (!absl::StartsWith(line, "#")) return error("expected a function");
+    } else if (absl::ConsumePrefix(&line, "#cfg")) {
+      absl::StatusOr<std::vector<CfgProfileNode>> cfg_profile =
+          ParseCfgProfile(line);
+      if (!cfg_profile.ok()) return error(cfg_profile.status().message());
+      functions.back().cfg_profile = *std::move(cfg_profile);
+    } else if (absl::ConsumePrefix(&line, "p")) {
+      std::vector<int> &clone_path =
+          functions.back().clone_paths.emplace_back();
+      for (absl::string_view bb_id : absl::StrSplit(line, ' ')) {
+        absl::StatusOr<int> parsed_bb_id = ParseInt(bb_id);
+        if (!parsed_bb_id.ok()) return error(parsed_bb_id.status().message());
+        clone_path.push_back(*parsed_bb_id);
+      }
+    } else if (absl::ConsumePrefix(&line, "c")) {
+      absl::StatusOr<std::vector<ProfileBbId>> cluster =
+          ParseProfileBbIds(line);
+      if (!cluster.ok()) return error(cluster.status().message());
+      functions.back().clusters.push_back(*std::move(cluster));
+    } else if (!absl::StartsWith(line, "#")) {
+      // Lines starting with '#' (e.g., "#ext-tsp") are comments.
+      return error(absl::StrCat("unknown directive: ", line));
+    }
+    if (in_function) {
+      functions.back().text =
+          text.substr(function_begin, line_end - function_begin);
+    }
+  }
+  return functions;
+}
+
+absl::StatusOr<std::vector<ClusterProfileFunction>> ParseClusterProfile(
+    absl::string_view data) {
+  if (!absl::StartsWith(data, kBinaryClusterProfileMagic))
+    return ParseTextClusterProfile(data);
+  ASSIGN_OR_RETURN(BinaryClusterProfileReader reader,
+                   BinaryClusterProfileReader::Create(data));
+  std::vector<ClusterProfileFunction> functions;
+  while (true) {
+    ASSIGN_OR_RETURN(std::optional<ClusterProfileFunction> function,
+                     reader.ReadNext());
+    if (!function.has_value()) break;
+    functions.push_back(*std::move(function));
+  }
+  return functions;
+}
+
+absl::StatusOr<std::string> ConvertBinaryClusterProfileToText(
+    absl::string_view binary) {
+  ASSIGN_OR_RETURN(BinaryClusterProfileReader reader,
+                   BinaryClusterProfileReader::Create(binary));
+  std::string text = "v1\n";
+  absl::string_view prev_section_name;
+  while (true) {
+    ASSIGN_OR_RETURN(std::optional<ClusterProfileFunction> function,
+                     reader.ReadNext());
+    if (!function.has_value()) break;
+    AppendTextClusterProfile(*function, prev_section_name, text);
+    prev_section_name = function->section_name;
+  }
+  return text;
+}
+
+absl::StatusOr<std::string> ConvertTextClusterProfileToBinary(
+    absl::string_view text) {
+  ASSIGN_OR_RETURN(std::vector<ClusterProfileFunction> functions,
+                   ParseTextClusterProfile(text));
+  return EncodeBinaryClusterProfile(functions);
+}
+}  // namespace propeller
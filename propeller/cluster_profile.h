@@ -0,0 +1,177 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_CLUSTER_PROFILE_H_
+#define PROPELLER_CLUSTER_PROFILE_H_
+
+#include <cstddef>
+#include <cstdint>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+
+namespace propeller {
+
+// Identifies a basic block in the cluster profile: its fixed bb id and its
+// clone number (zero for an original block). Printed as "<bb_id>" or
+// "<bb_id>.<clone_number>" in the text format.
+struct ProfileBbId {
+  int bb_id = 0;
+  int clone_number = 0;
+
+  bool operator==(const ProfileBbId &other) const {
+    return bb_id == other.bb_id && clone_number == other.clone_number;
+  }
+  bool operator!=(const ProfileBbId &other) const { return !(*this == other); }
+};
+
+// Edge profile of one basic block: its frequency and the weights of its
+// outgoing branch and fallthrough edges.
+struct CfgProfileNode {
+  struct Successor {
+    ProfileBbId bb_id;
+    int64_t weight = 0;
+
+    bool operator==(const Successor &other) const {
+      return bb_id == other.bb_id && weight == other.weight;
+    }
+  };
+
+  ProfileBbId bb_id;
+  int64_t freq = 0;
+  std::vector<Successor> successors;
+
+  bool operator==(const CfgProfileNode &other) const {
+    return bb_id == other.bb_id && freq == other.freq &&
+           successors == other.successors;
+  }
+};
+
+// Cluster profile of one function, as emitted by `PropellerProfileWriter`.
+// String fields refer to storage owned by the caller (e.g., the CFGs or the
+// profile being read).
+struct ClusterProfileFunction {
+  absl::string_view section_name;
+  std::optional<absl::string_view> module_name;
+  // All alias names of the function.
+  std::vector<absl::string_view> names;
+  // Paths of cloned blocks, by their bb ids.
+  std::vector<std::vector<int>> clone_paths;
+  // Basic block clusters, in layout order.
+  std::vector<std::vector<ProfileBbId>> clusters;
+  // Intra-function edge profile of the blocks with non-zero frequency, or
+  // `std::nullopt` if it was not written.
+  std::optional<std::vector<CfgProfileNode>> cfg_profile;
+  // Lines of the function in the text profile it was parsed from, from its
+  // module (or function) line through its last directive, excluding the
+  // "#section" line. Empty if the function was not parsed from text. Not
+  // compared by `operator==`.
+  absl::string_view text;
+
+  bool operator==(const ClusterProfileFunction &other) const {
+    return section_name == other.section_name &&
+           module_name == other.module_name && names == other.names &&
+           clone_paths == other.clone_paths && clusters == other.clusters &&
+           cfg_profile == other.cfg_profile;
+  }
+};
+
+// Binary encoding of the cluster profile. All integers are unsigned LEB128
+// varints.
+//   profile       := magic version string_table section*
+//   magic         := "PCLB"
+//   version       := varint (currently 1)
+//   string_table  := count (length bytes)*
+//   section       := section_name:string num_functions function*
+//   function      := module_name names clone_paths clusters cfg_profile
+//   module_name   := 0 if missing, otherwise string index + 1
+//   names         := count string*
+//   clone_paths   := count (count bb_id*)*
+//   clusters      := count (count profile_bb_id*)*
+//   cfg_profile   := 0 if missing, otherwise count + 1 followed by
+//                    (profile_bb_id freq count (profile_bb_id weight)*)*
+//   profile_bb_id := bb_id * 2 + (clone_number != 0) [clone_number]
+// Strings are referenced by their index in the string table, so every
+// function and section name is stored once.
+inline constexpr absl::string_view kBinaryClusterProfileMagic = "PCLB";
+inline constexpr int kBinaryClusterProfileVersion = 1;
+
+// Encodes `functions` into the binary cluster profile format. Consecutive
+// functions with the same `section_name` are stored in the same section.
+std::string EncodeBinaryClusterProfile(
+    absl::Span<const ClusterProfileFunction> functions);
+
+// Streaming reader for the binary cluster profile format, which decodes one
+// function at a time. `data` must outlive the reader and the functions it
+// returns.
+class BinaryClusterProfileReader {
+ public:
+  // Returns a reader for `data`, after reading its header and string table.
+  static absl::StatusOr<BinaryClusterProfileReader> Create(
+      absl::string_view data);
+
+  // Returns the next function in the profile, or `std::nullopt` at the end of
+  // the profile.
+  absl::StatusOr<std::optional<ClusterProfileFunction>> ReadNext();
+
+ private:
+  explicit BinaryClusterProfileReader(absl::string_view data) : data_(data) {}
+
+  absl::StatusOr<uint64_t> ReadVarint();
+  // Reads a varint which must not exceed `max_value`.
+  absl::StatusOr<uint64_t> ReadBoundedVarint(uint64_t max_value);
+  absl::StatusOr<absl::string_view> ReadString();
+  absl::StatusOr<ProfileBbId> ReadProfileBbId();
+
+  absl::string_view data_;
+  // Position of the next byte to read in `data_`.
+  size_t pos_ = 0;
+  std::vector<absl::string_view> string_table_;
+  absl::string_view section_name_;
+  // Number of functions not yet read from the current section.
+  uint64_t num_remaining_section_functions_ = 0;
+};
+
+// Appends the cluster profile of `function` to `out` in the text format of
+// `ClusterEncodingVersion::VERSION_1` (without the "v1" header line). A
+// "#section" line is emitted if `function` starts a new non-empty section,
+// i.e., if its section name differs from `prev_section_name`.
+void AppendTextClusterProfile(const ClusterProfileFunction &function,
+                              absl::string_view prev_section_name,
+                              std::string &out);
+
+// Parses a text cluster profile of `ClusterEncodingVersion::VERSION_1`. The
+// returned functions refer to `text`. "#ext-tsp" score lines are ignored,
+// except that they are kept in the `text` of their function.
+absl::StatusOr<std::vector<ClusterProfileFunction>> ParseTextClusterProfile(
+    absl::string_view text);
+
+// Parses a cluster profile in either the binary or the `VERSION_1` text
+// encoding, detected from its contents. The returned functions refer to
+// `data`.
+absl::StatusOr<std::vector<ClusterProfileFunction>> ParseClusterProfile(
+    absl::string_view data);
+
+// Converts between the binary cluster profile and the `VERSION_1` text
+// format.
+absl::StatusOr<std::string> ConvertBinaryClusterProfileToText(
+    absl::string_view binary);
+absl::StatusOr<std::string> ConvertTextClusterProfileToBinary(
+    absl::string_view text);
+}  // namespace propeller
+#endif  // PROPELLER_CLUSTER_PROFILE_H_
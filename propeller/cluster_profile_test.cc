@@ -0,0 +1,227 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/cluster_profile.h"
+
+#include <cstddef>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOk;
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::ElementsAre;
+using ::testing::Eq;
+using ::testing::Field;
+using ::testing::Optional;
+
+constexpr absl::string_view kClusterProfile =
+    "v1\n"
+    "#section .text\n"
+    "f compute_flag\n"
+    "p2 3\n"
+    "c0 2 3.1 1 3\n"
+    "#cfg 0:260824,1:102034,2:147684 1:104380,3:104380 "
+    "2:147684,3:0,3.1:145909 3:108610 3.1:145909\n"
+    "m foo.o\n"
+    "f main main2\n"
+    "c0 4 6 7 1 2 3\n"
+    "c9 10\n"
+    "#section .text.hot\n"
+    "f hot\n"
+    "c0\n";
+
+std::vector<ClusterProfileFunction> GetFunctions() {
+  return {
+      {.section_name = ".text",
+       .names = {"foo"},
+       .clone_paths = {{2, 3}, {1, 2, 300}},
+       .clusters = {{{.bb_id = 0},
+                     {.bb_id = 2},
+                     {.bb_id = 3, .clone_number = 1}},
+                    {{.bb_id = 200}}},
+       .cfg_profile = std::vector<CfgProfileNode>{
+           {.bb_id = {.bb_id = 0},
+            .freq = 1000000,
+            .successors = {{.bb_id = {.bb_id = 2}, .weight = 999999},
+                           {.bb_id = {.bb_id = 3, .clone_number = 1},
+                            .weight = 1}}},
+           {.bb_id = {.bb_id = 3, .clone_number = 1}, .freq = 1}}},
+      {.section_name = ".text",
+       .module_name = "bar.o",
+       .names = {"bar", "bar2"},
+       .clusters = {{{.bb_id = 0}}}},
+      {.section_name = ".text.split", .names = {"baz"}},
+      {.section_name = ".text", .names = {"foo"}}};
+}
+
+TEST(BinaryClusterProfileTest, EncodesAndReadsFunctions) {
+  const std::vector<ClusterProfileFunction> functions = GetFunctions();
+  const std::string binary = EncodeBinaryClusterProfile(functions);
+  absl::StatusOr<BinaryClusterProfileReader> reader =
+      BinaryClusterProfileReader::Create(binary);
+  ASSERT_THAT(reader, IsOk());
+  for (const ClusterProfileFunction &function : functions)
+    EXPECT_THAT(reader->ReadNext(), IsOkAndHolds(Optional(Eq(function))));
+  EXPECT_THAT(reader->ReadNext(), IsOkAndHolds(Eq(std::nullopt)));
+}
+
+TEST(BinaryClusterProfileTest, ReadsEmptyProfile) {
+  absl::StatusOr<BinaryClusterProfileReader> reader =
+      BinaryClusterProfileReader::Create(EncodeBinaryClusterProfile({}));
+  ASSERT_THAT(reader, IsOk());
+  EXPECT_THAT(reader->ReadNext(), IsOkAndHolds(Eq(std::nullopt)));
+}
+
+TEST(BinaryClusterProfileTest, IsSmallerThanTextProfile) {
+  absl::StatusOr<std::string> binary =
+      ConvertTextClusterProfileToBinary(kClusterProfile);
+  ASSERT_THAT(binary, IsOk());
+  EXPECT_LT(binary->size(), kClusterProfile.size());
+}
+
+TEST(BinaryClusterProfileTest, RejectsBadMagic) {
+  EXPECT_THAT(BinaryClusterProfileReader::Create("v1\nf foo\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(BinaryClusterProfileTest, RejectsTruncatedProfile) {
+  const std::string binary = EncodeBinaryClusterProfile(GetFunctions());
+  // Every strict prefix must fail to read, either when creating the reader or
+  // when reading one of the functions.
+  for (size_t size = 0; size < binary.size(); ++size) {
+    absl::StatusOr<BinaryClusterProfileReader> reader =
+        BinaryClusterProfileReader::Create(
+            absl::string_view(binary).substr(0, size));
+    if (!reader.ok()) continue;
+    absl::StatusOr<std::optional<ClusterProfileFunction>> function;
+    size_t num_functions = 0;
+    while ((function = reader->ReadNext()).ok() && function->has_value())
+      ++num_functions;
+    EXPECT_FALSE(function.ok() && num_functions == GetFunctions().size())
+        << "Read all functions from a prefix of size " << size;
+  }
+}
+
+TEST(TextClusterProfileTest, ParsesFunctions) {
+  absl::StatusOr<std::vector<ClusterProfileFunction>> functions =
+      ParseTextClusterProfile(kClusterProfile);
+  ASSERT_THAT(functions, IsOk());
+  ASSERT_EQ(functions->size(), 3);
+  const ClusterProfileFunction &compute_flag = (*functions)[0];
+  EXPECT_EQ(compute_flag.section_name, ".text");
+  EXPECT_EQ(compute_flag.module_name, std::nullopt);
+  EXPECT_THAT(compute_flag.names, ElementsAre("compute_flag"));
+  EXPECT_THAT(compute_flag.clone_paths, ElementsAre(ElementsAre(2, 3)));
+  EXPECT_THAT(
+      compute_flag.clusters,
+      ElementsAre(ElementsAre(
+          ProfileBbId{.bb_id = 0}, ProfileBbId{.bb_id = 2},
+          ProfileBbId{.bb_id = 3, .clone_number = 1}, ProfileBbId{.bb_id = 1},
+          ProfileBbId{.bb_id = 3})));
+  ASSERT_TRUE(compute_flag.cfg_profile.has_value());
+  EXPECT_EQ(compute_flag.cfg_profile->size(), 5);
+  EXPECT_EQ((*compute_flag.cfg_profile)[2],
+            (CfgProfileNode{
+                .bb_id = {.bb_id = 2},
+                .freq = 147684,
+                .successors = {{.bb_id = {.bb_id = 3}, .weight = 0},
+                               {.bb_id = {.bb_id = 3, .clone_number = 1},
+                                .weight = 145909}}}));
+  const ClusterProfileFunction &main = (*functions)[1];
+  EXPECT_EQ(main.section_name, ".text");
+  EXPECT_EQ(main.module_name, "foo.o");
+  EXPECT_THAT(main.names, ElementsAre("main", "main2"));
+  EXPECT_EQ(main.clusters.size(), 2);
+  EXPECT_EQ(main.cfg_profile, std::nullopt);
+  EXPECT_EQ((*functions)[2].section_name, ".text.hot");
+}
+
+TEST(TextClusterProfileTest, KeepsTextOfFunctions) {
+  absl::StatusOr<std::vector<ClusterProfileFunction>> functions =
+      ParseTextClusterProfile(
+          "v1\n"
+          "#section .text\n"
+          "f foo\n"
+          "#ext-tsp score: [intra: 1.0 -> 2.0] [inter: 0.0 -> 0.0]\n"
+          "c0 1\n"
+          "#cfg 0:1,1:1 1:1\n"
+          "\n"
+          "m bar.o\n"
+          "f bar\n"
+          "c0\n"
+          "#section .text.hot\n"
+          "f hot\n"
+          "c0");
+  ASSERT_THAT(functions, IsOk());
+  EXPECT_THAT(
+      *functions,
+      ElementsAre(
+          Field(&ClusterProfileFunction::text,
+                "f foo\n"
+                "#ext-tsp score: [intra: 1.0 -> 2.0] [inter: 0.0 -> 0.0]\n"
+                "c0 1\n"
+                "#cfg 0:1,1:1 1:1\n"),
+          Field(&ClusterProfileFunction::text, "m bar.o\nf bar\nc0\n"),
+          Field(&ClusterProfileFunction::text, "f hot\nc0")));
+}
+
+TEST(TextClusterProfileTest, RejectsMalformedProfile) {
+  EXPECT_THAT(ParseTextClusterProfile("v0\nf foo\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseTextClusterProfile("v1\nc0 1\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseTextClusterProfile("v1\nf foo\nc0 x\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(ParseTextClusterProfile("v1\nf foo\n#cfg 0:1,2\n"),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(ClusterProfileConversionTest, ParsesEitherEncoding) {
+  absl::StatusOr<std::vector<ClusterProfileFunction>> functions =
+      ParseClusterProfile(kClusterProfile);
+  ASSERT_THAT(functions, IsOk());
+  EXPECT_EQ(functions->size(), 3);
+  absl::StatusOr<std::string> binary =
+      ConvertTextClusterProfileToBinary(kClusterProfile);
+  ASSERT_THAT(binary, IsOk());
+  EXPECT_THAT(ParseClusterProfile(*binary), IsOkAndHolds(Eq(*functions)));
+}
+
+TEST(ClusterProfileConversionTest, RoundTripsTextProfile) {
+  absl::StatusOr<std::string> binary =
+      ConvertTextClusterProfileToBinary(kClusterProfile);
+  ASSERT_THAT(binary, IsOk());
+  EXPECT_THAT(ConvertBinaryClusterProfileToText(*binary),
+              IsOkAndHolds(kClusterProfile));
+}
+
+TEST(ClusterProfileConversionTest, RoundTripsBinaryProfile) {
+  const std::string binary = EncodeBinaryClusterProfile(GetFunctions());
+  absl::StatusOr<std::string> text = ConvertBinaryClusterProfileToText(binary);
+  ASSERT_THAT(text, IsOk());
+  EXPECT_THAT(ConvertTextClusterProfileToBinary(*text), IsOkAndHolds(binary));
+}
+}  // namespace
+}  // namespace propeller
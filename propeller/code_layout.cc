@@ -17,6 +17,7 @@
 #include <cstdint>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -25,17 +26,22 @@
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/functional/function_ref.h"
+#include "absl/strings/string_view.h"
 #include "absl/types/span.h"
 #include "llvm/ADT/StringRef.h"
 #include "propeller/cfg.h"
+#include "propeller/cfg_edge.h"
 #include "propeller/cfg_node.h"
 #include "propeller/chain_cluster_builder.h"
+#include "propeller/code_layout_scorer.h"
 #include "propeller/function_chain_info.h"
 #include "propeller/node_chain.h"
 #include "propeller/node_chain_builder.h"
 #include "propeller/program_cfg.h"
+#include "propeller/progress_tracker.h"
 #include "propeller/propeller_options.pb.h"
 #include "propeller/propeller_statistics.h"
+#include "propeller/trace_recorder.h"
 
 namespace propeller {
 
@@ -55,6 +61,31 @@ GenerateLayoutBySection(const ProgramCfg &program_cfg,
   return chain_info_by_section_name;
 }
 
+CFGScore ComputeCfgScore(
+    const ControlFlowGraph &cfg, const PropellerCodeLayoutScorer &scorer,
+    absl::FunctionRef<std::optional<uint64_t>(const CFGNode *)> get_node_addr,
+    bool score_inter_edges) {
+  auto get_edge_score = [&](const CFGEdge &edge) -> double {
+    if (edge.weight() == 0 || edge.IsReturn() || edge.inter_section())
+      return 0;
+    std::optional<uint64_t> src_addr = get_node_addr(edge.src());
+    std::optional<uint64_t> sink_addr = get_node_addr(edge.sink());
+    if (!src_addr.has_value() || !sink_addr.has_value()) return 0;
+    // Compute the distance between the end of src and beginning of sink.
+    int64_t distance =
+        static_cast<int64_t>(*sink_addr) - *src_addr - edge.src()->size();
+    return scorer.GetEdgeScore(edge, distance);
+  };
+  CFGScore score;
+  for (const auto &edge : cfg.intra_edges())
+    score.intra_score += get_edge_score(*edge);
+  if (score_inter_edges) {
+    for (const auto &edge : cfg.inter_edges())
+      score.inter_out_score += get_edge_score(*edge);
+  }
+  return score;
+}
+
 // Returns the intra-procedural ext-tsp scores for the given CFGs given a
 // function for getting the address of each CFG node.
 // This is called by ComputeOrigLayoutScores and ComputeOptLayoutScores below.
@@ -62,27 +93,14 @@ absl::flat_hash_map<int, CFGScore> CodeLayout::ComputeCfgScores(
     absl::FunctionRef<uint64_t(const CFGNode *)> get_node_addr) {
   absl::flat_hash_map<int, CFGScore> score_map;
   for (const ControlFlowGraph *cfg : cfgs_) {
-    double intra_score = 0;
-    for (const auto &edge : cfg->intra_edges()) {
-      if (edge->weight() == 0 || edge->IsReturn()) continue;
-      // Compute the distance between the end of src and beginning of sink.
-      int64_t distance = static_cast<int64_t>(get_node_addr(edge->sink())) -
-                         get_node_addr(edge->src()) - edge->src()->size();
-      intra_score += code_layout_scorer_.GetEdgeScore(*edge, distance);
-    }
-    double inter_out_score = 0;
-    if (cfgs_.size() > 1) {
-      for (const auto &edge : cfg->inter_edges()) {
-        if (edge->weight() == 0 || edge->IsReturn() || edge->inter_section()) {
-          continue;
-        }
-        int64_t distance = static_cast<int64_t>(get_node_addr(edge->sink())) -
-                           get_node_addr(edge->src()) - edge->src()->size();
-        inter_out_score += code_layout_scorer_.GetEdgeScore(*edge, distance);
-      }
-    }
-    score_map.emplace(cfg->function_index(),
-                      CFGScore({intra_score, inter_out_score}));
+    score_map.emplace(
+        cfg->function_index(),
+        ComputeCfgScore(
+            *cfg, code_layout_scorer_,
+            [&](const CFGNode *node) -> std::optional<uint64_t> {
+              return get_node_addr(node);
+            },
+            /*score_inter_edges=*/cfgs_.size() > 1));
   }
   return score_map;
 }
@@ -116,18 +134,27 @@ std::vector<FunctionChainInfo> CodeLayout::OrderAll() {
   // Build optimal node chains for each CFG.
   std::vector<std::unique_ptr<const NodeChain>> built_chains;
   if (code_layout_scorer_.code_layout_params().inter_function_reordering()) {
+    ScopedTraceSpan trace_span("BuildChains");
     absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
                      NodeChainAssemblyBalancedTreeQueue>(
                      code_layout_scorer_, cfgs_, initial_chains_, stats_)
                      .BuildChains(),
                  std::back_inserter(built_chains));
+    ProgressTracker::Global().Increment(
+        ProgressTracker::Counter::kFunctionsLaidOut, cfgs_.size());
   } else {
     for (auto *cfg : cfgs_) {
+      llvm::StringRef name = cfg->GetPrimaryName();
+      ScopedTraceSpan trace_span("BuildChains",
+                                 absl::string_view(name.data(), name.size()),
+                                 TraceSpanFrequency::kHigh);
       absl::c_move(NodeChainBuilder::CreateNodeChainBuilder<
                        NodeChainAssemblyIterativeQueue>(
                        code_layout_scorer_, {cfg}, initial_chains_, stats_)
                        .BuildChains(),
                    std::back_inserter(built_chains));
+      ProgressTracker::Global().Increment(
+          ProgressTracker::Counter::kFunctionsLaidOut);
     }
   }
 
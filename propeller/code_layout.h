@@ -17,6 +17,7 @@
 
 #include <cstdint>
 #include <memory>
+#include <optional>
 #include <utility>
 #include <vector>
 
@@ -44,6 +45,17 @@ GenerateLayoutBySection(const ProgramCfg &program_cfg,
                         const PropellerCodeLayoutParameters &code_layout_params,
                         PropellerStats::CodeLayoutStats &code_layout_stats);
 
+// Returns the ext-tsp scores of the intra-function edges and of the outgoing
+// inter-function edges of `cfg` when every node is at the address given by
+// `get_node_addr`. Edges with zero weight, return edges, inter-section edges
+// and edges with an endpoint for which `get_node_addr` returns `std::nullopt`
+// are not scored. Inter-function edges are only scored if `score_inter_edges`
+// is true.
+CFGScore ComputeCfgScore(
+    const ControlFlowGraph &cfg, const PropellerCodeLayoutScorer &scorer,
+    absl::FunctionRef<std::optional<uint64_t>(const CFGNode *)> get_node_addr,
+    bool score_inter_edges = true);
+
 class CodeLayout {
  public:
   // `initial_chains` describes the cfg nodes that must be placed in single
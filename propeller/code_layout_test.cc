@@ -14,6 +14,7 @@
 
 #include "propeller/code_layout.h"
 
+#include <cstdint>
 #include <iterator>
 #include <memory>
 #include <optional>
@@ -24,6 +25,7 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
@@ -308,6 +310,55 @@ TEST(CodeLayoutScorerTest, GetEdgeScore) {
   }
 }
 
+TEST(CodeLayoutScorerTest, ComputeCfgScore) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<ProtoProgramCfg> proto_program_cfg,
+                       BuildFromCfgProtoPath(
+                           GetTestInputPath("_main/propeller/testdata/"
+                                            "simple_multi_function.protobuf")));
+  const ControlFlowGraph &foo_cfg =
+      *proto_program_cfg->program_cfg().GetCfgByIndex(0);
+  const ControlFlowGraph &bar_cfg =
+      *proto_program_cfg->program_cfg().GetCfgByIndex(1);
+  const PropellerCodeLayoutScorer scorer(
+      PropellerCodeLayoutParameters::default_instance());
+  auto get_original_addr = [](const CFGNode *node) -> std::optional<uint64_t> {
+    return node->addr();
+  };
+  auto get_edge_score = [&](const CFGEdge &edge) {
+    return scorer.GetEdgeScore(
+        edge, static_cast<int64_t>(edge.sink()->addr()) - edge.src()->addr() -
+                  edge.src()->size());
+  };
+
+  double foo_intra_score = 0;
+  for (const std::unique_ptr<CFGEdge> &edge : foo_cfg.intra_edges())
+    foo_intra_score += get_edge_score(*edge);
+  // The inter-function edges of foo are returns, which are not scored.
+  const CFGScore foo_score =
+      ComputeCfgScore(foo_cfg, scorer, get_original_addr);
+  EXPECT_DOUBLE_EQ(foo_score.intra_score, foo_intra_score);
+  EXPECT_EQ(foo_score.inter_out_score, 0);
+
+  ASSERT_THAT(bar_cfg.inter_edges(), SizeIs(1));
+  const CFGEdge &call_edge = *bar_cfg.inter_edges().front();
+  EXPECT_DOUBLE_EQ(
+      ComputeCfgScore(bar_cfg, scorer, get_original_addr).inter_out_score,
+      get_edge_score(call_edge));
+  EXPECT_EQ(ComputeCfgScore(bar_cfg, scorer, get_original_addr,
+                            /*score_inter_edges=*/false)
+                .inter_out_score,
+            0);
+  // Edges to nodes without an address are not scored.
+  auto get_addr_except_callee =
+      [&](const CFGNode *node) -> std::optional<uint64_t> {
+    if (node == call_edge.sink()) return std::nullopt;
+    return node->addr();
+  };
+  EXPECT_EQ(
+      ComputeCfgScore(bar_cfg, scorer, get_addr_except_callee).inter_out_score,
+      0);
+}
+
 // Type-parameterized test fixture for `NodeChainBuilder` tests. This allows
 // testing `NodeChainBuilder` with both `NodeChainAssemblyIterativeQueue` and
 // and `NodeChainAssemblyBalancedTreeQueue` implementations.
@@ -1967,6 +2018,40 @@ TEST(CodeLayoutTest, BreaksInitialChainsWithChainSplitEdgeToMiddle) {
                   _, _, _)));
 }
 
+TEST(NodeChainBuilderTest, BuildsOnlyNeighborhoodOfRelayoutBlocks) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".foo_section",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10},
+                      {0x1010, 1, 0x10},
+                      {0x1020, 2, 0x10},
+                      {0x1030, 3, 0x10},
+                      {0x1040, 4, 0x8}},
+                     {{0, 2, 100, CFGEdgeKind::kBranchOrFallthough},
+                      {1, 3, 80, CFGEdgeKind::kBranchOrFallthough},
+                      {3, 4, 50, CFGEdgeKind::kBranchOrFallthough}}}}});
+  PropellerCodeLayoutParameters params;
+  PropellerStats::CodeLayoutStats stats;
+  NodeChainBuilder node_chain_builder =
+      NodeChainBuilder::CreateNodeChainBuilder(
+          PropellerCodeLayoutScorer(params), program_cfg->GetCfgs(),
+          /*initial_chains=*/
+          {{0, ConstructBbChains({{{{0, 0}}}, {{{1, 0}}, {{2, 0}}}})}}, stats);
+  node_chain_builder.set_relayout_bb_indices({{0, {0}}});
+  // Block 2 is a neighbor of block 0, so its initial chain is built as well
+  // and split to make the edge from block 0 a fallthrough. Blocks 3 and 4 are
+  // not in the neighborhood of block 0. So their chains are neither built nor
+  // merged, and the edge from block 1 to block 3 is not scored.
+  std::vector<std::unique_ptr<NodeChain>> chains =
+      node_chain_builder.BuildChains();
+  ASSERT_THAT(chains, SizeIs(1));
+  EXPECT_THAT(GetOrderedNodeIds(*chains.front()),
+              ElementsAre(InterCfgId{0, {0, 0}}, InterCfgId{0, {2, 0}},
+                          InterCfgId{0, {1, 0}}));
+  EXPECT_THAT(chains.front()->score(), DoubleNear(1000, kEpsilon));
+}
+
 TEST(CodeLayoutTest, FailsWithDuplicateNodesInInitialChains) {
   std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
       {.cfg_args = {{".foo_section",
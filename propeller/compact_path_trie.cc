@@ -0,0 +1,194 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/compact_path_trie.h"
+
+#include <cstdint>
+#include <memory>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/log/check.h"
+#include "absl/types/span.h"
+#include "propeller/bb_handle.h"
+#include "propeller/path_node.h"
+
+namespace propeller {
+namespace {
+// Sorts `nodes` by their bb indices.
+void SortByBbIndex(absl::Span<const PathNode *> nodes) {
+  absl::c_sort(nodes, [](const PathNode *a, const PathNode *b) {
+    return a->node_bb_index() < b->node_bb_index();
+  });
+}
+
+// Returns the approximate number of heap bytes used by the flat hash map `map`.
+template <typename Map>
+int64_t GetHashMapMemoryUsage(const Map &map) {
+  return map.capacity() * (sizeof(typename Map::value_type) + 1);
+}
+
+int64_t EstimateMemoryUsage(const PathPredInfoEntry &entry) {
+  return GetHashMapMemoryUsage(entry.call_freqs) +
+         GetHashMapMemoryUsage(entry.return_to_freqs);
+}
+
+int64_t EstimateMemoryUsage(const PathNode &path_node) {
+  const PathPredInfo &path_pred_info = path_node.path_pred_info();
+  int64_t memory_usage = sizeof(PathNode) +
+                         GetHashMapMemoryUsage(path_node.children()) +
+                         GetHashMapMemoryUsage(path_pred_info.entries) +
+                         EstimateMemoryUsage(path_pred_info.missing_pred_entry);
+  for (const auto &[pred_bb_index, entry] : path_pred_info.entries)
+    memory_usage += EstimateMemoryUsage(entry);
+  for (const auto &[child_bb_index, child] : path_node.children())
+    memory_usage += EstimateMemoryUsage(*child);
+  return memory_usage;
+}
+}  // namespace
+
+CompactPathTrie::CompactPathTrie(
+    const FunctionPathProfile &function_path_profile)
+    : function_index_(function_path_profile.function_index()) {
+  // Lay out the path nodes in breadth-first order, with the roots first and
+  // the children of every node adjacent and sorted by their bb index.
+  std::vector<const PathNode *> path_nodes;
+  for (const auto &[bb_index, path_tree] :
+       function_path_profile.path_trees_by_root_bb_index()) {
+    path_nodes.push_back(path_tree.get());
+  }
+  SortByBbIndex(absl::MakeSpan(path_nodes));
+  num_path_trees_ = path_nodes.size();
+  // Index of the first child of every path node in `path_nodes`.
+  std::vector<int> first_child_indices;
+  // Index of the parent of every path node in `path_nodes`, or -1 for roots.
+  std::vector<int> parent_indices(num_path_trees_, -1);
+  int64_t num_pred_info_entries = 0, num_call_freqs = 0,
+          num_return_to_freqs = 0;
+  auto count_entry = [&](const PathPredInfoEntry &entry) {
+    ++num_pred_info_entries;
+    num_call_freqs += entry.call_freqs.size();
+    num_return_to_freqs += entry.return_to_freqs.size();
+  };
+  for (int i = 0; i < path_nodes.size(); ++i) {
+    const PathNode &path_node = *path_nodes[i];
+    first_child_indices.push_back(path_nodes.size());
+    for (const auto &[child_bb_index, child] : path_node.children()) {
+      path_nodes.push_back(child.get());
+      parent_indices.push_back(i);
+    }
+    SortByBbIndex(absl::MakeSpan(path_nodes).subspan(first_child_indices[i]));
+    for (const auto &[pred_bb_index, entry] :
+         path_node.path_pred_info().entries) {
+      count_entry(entry);
+    }
+    count_entry(path_node.path_pred_info().missing_pred_entry);
+  }
+
+  // Reserve the pools upfront, so that spans into them remain valid.
+  nodes_.resize(path_nodes.size());
+  pred_info_entries_.reserve(num_pred_info_entries);
+  call_freqs_.reserve(num_call_freqs);
+  return_to_freqs_.reserve(num_return_to_freqs);
+
+  auto add_entry = [&](int path_pred_bb_index, const PathPredInfoEntry &entry) {
+    const int call_freqs_begin = call_freqs_.size();
+    call_freqs_.insert(call_freqs_.end(), entry.call_freqs.begin(),
+                       entry.call_freqs.end());
+    const int return_to_freqs_begin = return_to_freqs_.size();
+    return_to_freqs_.insert(return_to_freqs_.end(),
+                            entry.return_to_freqs.begin(),
+                            entry.return_to_freqs.end());
+    pred_info_entries_.push_back(
+        {.path_pred_bb_index = path_pred_bb_index,
+         .freq = entry.freq,
+         .cache_pressure = entry.cache_pressure,
+         .call_freqs = absl::MakeConstSpan(call_freqs_)
+                           .subspan(call_freqs_begin, entry.call_freqs.size()),
+         .return_to_freqs = absl::MakeConstSpan(return_to_freqs_)
+                                .subspan(return_to_freqs_begin,
+                                         entry.return_to_freqs.size())});
+  };
+  for (int i = 0; i < path_nodes.size(); ++i) {
+    const PathNode &path_node = *path_nodes[i];
+    CompactPathNode &node = nodes_[i];
+    node.node_bb_index_ = path_node.node_bb_index();
+    node.path_length_ = path_node.path_length();
+    node.parent_ =
+        parent_indices[i] == -1 ? nullptr : &nodes_[parent_indices[i]];
+    node.children_ = absl::MakeConstSpan(nodes_).subspan(
+        first_child_indices[i], path_node.children().size());
+
+    std::vector<int> pred_bb_indices;
+    pred_bb_indices.reserve(path_node.path_pred_info().entries.size());
+    for (const auto &[pred_bb_index, entry] :
+         path_node.path_pred_info().entries) {
+      pred_bb_indices.push_back(pred_bb_index);
+    }
+    absl::c_sort(pred_bb_indices);
+    const int entries_begin = pred_info_entries_.size();
+    for (int pred_bb_index : pred_bb_indices) {
+      add_entry(pred_bb_index,
+                path_node.path_pred_info().entries.at(pred_bb_index));
+    }
+    add_entry(/*path_pred_bb_index=*/-1,
+              path_node.path_pred_info().missing_pred_entry);
+    node.path_pred_info_ = {
+        .entries = absl::MakeConstSpan(pred_info_entries_)
+                       .subspan(entries_begin, pred_bb_indices.size()),
+        .missing_pred_entry = &pred_info_entries_.back()};
+  }
+  CHECK_EQ(pred_info_entries_.size(), num_pred_info_entries);
+  CHECK_EQ(call_freqs_.size(), num_call_freqs);
+  CHECK_EQ(return_to_freqs_.size(), num_return_to_freqs);
+}
+
+const CompactPathNode *CompactPathTrie::GetPathTree(int bb_index) const {
+  absl::Span<const CompactPathNode> roots = path_trees();
+  auto it = absl::c_lower_bound(
+      roots, bb_index, [](const CompactPathNode &root, int bb_index) {
+        return root.node_bb_index() < bb_index;
+      });
+  if (it == roots.end() || it->node_bb_index() != bb_index) return nullptr;
+  return &*it;
+}
+
+int64_t CompactPathTrie::GetMemoryUsage() const {
+  return nodes_.capacity() * sizeof(CompactPathNode) +
+         pred_info_entries_.capacity() * sizeof(CompactPathPredInfoEntry) +
+         call_freqs_.capacity() * sizeof(call_freqs_.front()) +
+         return_to_freqs_.capacity() * sizeof(return_to_freqs_.front());
+}
+
+const PathNode *FindPathNode(const FunctionPathProfile &function_path_profile,
+                             const CompactPathNode &compact_path_node) {
+  std::vector<const CompactPathNode *> path = compact_path_node.path_from_root();
+  const PathNode *path_node =
+      function_path_profile.GetPathTree(path.front()->node_bb_index());
+  for (int i = 1; i < path.size() && path_node != nullptr; ++i)
+    path_node = path_node->GetChild(path[i]->node_bb_index());
+  return path_node;
+}
+
+int64_t EstimateMemoryUsage(const FunctionPathProfile &function_path_profile) {
+  int64_t memory_usage = GetHashMapMemoryUsage(
+      function_path_profile.path_trees_by_root_bb_index());
+  for (const auto &[bb_index, path_tree] :
+       function_path_profile.path_trees_by_root_bb_index()) {
+    memory_usage += EstimateMemoryUsage(*path_tree);
+  }
+  return memory_usage;
+}
+}  // namespace propeller
@@ -0,0 +1,187 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_COMPACT_PATH_TRIE_H_
+#define PROPELLER_COMPACT_PATH_TRIE_H_
+
+#include <cstdint>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/types/span.h"
+#include "propeller/bb_handle.h"
+#include "propeller/path_node.h"
+
+namespace propeller {
+
+// Compact counterpart of `PathPredInfoEntry`. Call and return frequencies are
+// stored in pools owned by the `CompactPathTrie`.
+struct CompactPathPredInfoEntry {
+  // Flat bb index of the path predecessor block, or -1 for the missing path
+  // predecessor entry.
+  int path_pred_bb_index = -1;
+  int freq = 0;
+  double cache_pressure = 0;
+  absl::Span<const std::pair<propeller::CallRetInfo, int>> call_freqs;
+  absl::Span<const std::pair<propeller::FlatBbHandle, int>> return_to_freqs;
+};
+
+// Compact counterpart of `PathPredInfo`. `entries` are sorted by their path
+// predecessor bb index.
+struct CompactPathPredInfo {
+  absl::Span<const CompactPathPredInfoEntry> entries;
+  const CompactPathPredInfoEntry *missing_pred_entry = nullptr;
+
+  // Returns the entry for the given path predecessor block, or `nullptr` if the
+  // path predecessor is not found.
+  const CompactPathPredInfoEntry *GetEntry(int path_pred_bb_index) const {
+    auto it = absl::c_lower_bound(
+        entries, path_pred_bb_index,
+        [](const CompactPathPredInfoEntry &entry, int bb_index) {
+          return entry.path_pred_bb_index < bb_index;
+        });
+    if (it == entries.end() || it->path_pred_bb_index != path_pred_bb_index)
+      return nullptr;
+    return &*it;
+  }
+
+  // Returns the frequency of the path from root to this path node, given a
+  // specific path predecessor block. Returns 0 if the path predecessor is not
+  // found.
+  int GetFreqForPathPred(int path_pred_bb_index) const {
+    const CompactPathPredInfoEntry *entry = GetEntry(path_pred_bb_index);
+    return entry == nullptr ? 0 : entry->freq;
+  }
+};
+
+// Compact, read-only counterpart of `PathNode`, with the same traversal API.
+// Nodes are allocated in the arena of their `CompactPathTrie` and the children
+// of every node are stored contiguously, sorted by their bb index.
+class CompactPathNode {
+ public:
+  int node_bb_index() const { return node_bb_index_; }
+
+  int path_length() const { return path_length_; }
+
+  const CompactPathPredInfo &path_pred_info() const { return path_pred_info_; }
+
+  absl::Span<const CompactPathNode> children() const { return children_; }
+
+  const CompactPathNode *parent() const { return parent_; }
+  const CompactPathNode *root() const {
+    const CompactPathNode *node = this;
+    while (node->parent_ != nullptr) node = node->parent_;
+    return node;
+  }
+
+  // Returns the path to this path node, from the root of its tree.
+  std::vector<const CompactPathNode *> path_from_root() const {
+    std::vector<const CompactPathNode *> result;
+    result.reserve(path_length_ - 1);
+    for (const CompactPathNode *node = this; node != nullptr;
+         node = node->parent_) {
+      result.push_back(node);
+    }
+    absl::c_reverse(result);
+    return result;
+  }
+
+  // Returns the total frequency of the children of this path node, for the
+  // given path predecessor block specified by its flat bb index
+  // `path_pred_bb_index`.
+  int GetTotalChildrenFreqForPathPred(int path_pred_bb_index) const {
+    int total = 0;
+    for (const CompactPathNode &child : children_)
+      total += child.path_pred_info_.GetFreqForPathPred(path_pred_bb_index);
+    return total;
+  }
+
+  // Returns the child path node with the given flat bb index `child_bb_index`,
+  // or `nullptr` if the child is not found.
+  const CompactPathNode *GetChild(int child_bb_index) const {
+    auto it = absl::c_lower_bound(
+        children_, child_bb_index,
+        [](const CompactPathNode &child, int bb_index) {
+          return child.node_bb_index_ < bb_index;
+        });
+    if (it == children_.end() || it->node_bb_index_ != child_bb_index)
+      return nullptr;
+    return &*it;
+  }
+
+ private:
+  friend class CompactPathTrie;
+
+  int node_bb_index_ = 0;
+  int path_length_ = 0;
+  const CompactPathNode *parent_ = nullptr;
+  absl::Span<const CompactPathNode> children_;
+  CompactPathPredInfo path_pred_info_;
+};
+
+// Compact, read-only representation of the path trees of a
+// `FunctionPathProfile`. All path nodes, path predecessor entries, and call and
+// return frequencies are stored in four contiguous pools, instead of the
+// per-node hash maps of `PathNode`. Path nodes are laid out in breadth-first
+// order with the roots first, so the children of each node are adjacent.
+class CompactPathTrie {
+ public:
+  explicit CompactPathTrie(const FunctionPathProfile &function_path_profile);
+
+  // The pools are referenced by pointers, so the trie can be moved but not
+  // copied.
+  CompactPathTrie(const CompactPathTrie &) = delete;
+  CompactPathTrie &operator=(const CompactPathTrie &) = delete;
+  CompactPathTrie(CompactPathTrie &&) = default;
+  CompactPathTrie &operator=(CompactPathTrie &&) = default;
+
+  int function_index() const { return function_index_; }
+
+  // Returns the roots of the path trees, sorted by their bb index.
+  absl::Span<const CompactPathNode> path_trees() const {
+    return absl::MakeConstSpan(nodes_).first(num_path_trees_);
+  }
+
+  // Returns the path tree rooted at `bb_index`, or `nullptr` if it doesn't
+  // exist.
+  const CompactPathNode *GetPathTree(int bb_index) const;
+
+  // Returns the number of path nodes in all path trees.
+  int64_t num_nodes() const { return nodes_.size(); }
+
+  // Returns the number of heap bytes used by the trie.
+  int64_t GetMemoryUsage() const;
+
+ private:
+  int function_index_;
+  int num_path_trees_ = 0;
+  std::vector<CompactPathNode> nodes_;
+  std::vector<CompactPathPredInfoEntry> pred_info_entries_;
+  std::vector<std::pair<propeller::CallRetInfo, int>> call_freqs_;
+  std::vector<std::pair<propeller::FlatBbHandle, int>> return_to_freqs_;
+};
+
+// Returns the path node of `function_path_profile` which `compact_path_node`
+// was frozen from, or `nullptr` if `function_path_profile` has no path node for
+// the same path.
+const PathNode *FindPathNode(const FunctionPathProfile &function_path_profile,
+                             const CompactPathNode &compact_path_node);
+
+// Returns an estimate of the number of heap bytes used by the path trees of
+// `function_path_profile`, for comparison with
+// `CompactPathTrie::GetMemoryUsage`.
+int64_t EstimateMemoryUsage(const FunctionPathProfile &function_path_profile);
+}  // namespace propeller
+#endif  // PROPELLER_COMPACT_PATH_TRIE_H_
@@ -0,0 +1,136 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/compact_path_trie.h"
+
+#include <utility>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/bb_handle.h"
+#include "propeller/multi_cfg_test_case.h"
+#include "propeller/path_node.h"
+
+namespace propeller {
+namespace {
+using ::testing::ElementsAre;
+using ::testing::Pair;
+using ::testing::UnorderedElementsAreArray;
+
+// Checks that `node` mirrors `path_node` and its subtree.
+void ExpectSameTree(const PathNode &path_node, const CompactPathNode &node) {
+  EXPECT_EQ(node.node_bb_index(), path_node.node_bb_index());
+  EXPECT_EQ(node.path_length(), path_node.path_length());
+  EXPECT_EQ(node.path_from_root().size(), path_node.path_from_root().size());
+
+  auto expect_same_entry = [](const PathPredInfoEntry &path_node_entry,
+                              const CompactPathPredInfoEntry &entry) {
+    EXPECT_EQ(entry.freq, path_node_entry.freq);
+    EXPECT_EQ(entry.cache_pressure, path_node_entry.cache_pressure);
+    EXPECT_THAT(
+        entry.call_freqs,
+        UnorderedElementsAreArray(std::vector<std::pair<CallRetInfo, int>>(
+            path_node_entry.call_freqs.begin(),
+            path_node_entry.call_freqs.end())));
+    EXPECT_THAT(
+        entry.return_to_freqs,
+        UnorderedElementsAreArray(std::vector<std::pair<FlatBbHandle, int>>(
+            path_node_entry.return_to_freqs.begin(),
+            path_node_entry.return_to_freqs.end())));
+  };
+  const PathPredInfo &path_pred_info = path_node.path_pred_info();
+  EXPECT_EQ(node.path_pred_info().entries.size(),
+            path_pred_info.entries.size());
+  for (const auto &[pred_bb_index, path_node_entry] : path_pred_info.entries) {
+    const CompactPathPredInfoEntry *entry =
+        node.path_pred_info().GetEntry(pred_bb_index);
+    ASSERT_NE(entry, nullptr);
+    EXPECT_EQ(entry->path_pred_bb_index, pred_bb_index);
+    expect_same_entry(path_node_entry, *entry);
+    EXPECT_EQ(node.GetTotalChildrenFreqForPathPred(pred_bb_index),
+              path_node.GetTotalChildrenFreqForPathPred(pred_bb_index));
+  }
+  ASSERT_NE(node.path_pred_info().missing_pred_entry, nullptr);
+  expect_same_entry(path_pred_info.missing_pred_entry,
+                    *node.path_pred_info().missing_pred_entry);
+
+  EXPECT_EQ(node.children().size(), path_node.children().size());
+  for (const auto &[child_bb_index, child] : path_node.children()) {
+    const CompactPathNode *compact_child = node.GetChild(child_bb_index);
+    ASSERT_NE(compact_child, nullptr);
+    EXPECT_EQ(compact_child->parent(), &node);
+    EXPECT_EQ(compact_child->root(), node.root());
+    ExpectSameTree(*child, *compact_child);
+  }
+}
+
+TEST(CompactPathTrieTest, MirrorsFunctionPathProfile) {
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile &function_path_profile =
+      program_path_profile.path_profiles_by_function_index().at(6);
+  CompactPathTrie trie(function_path_profile);
+
+  EXPECT_EQ(trie.function_index(), 6);
+  EXPECT_EQ(trie.path_trees().size(),
+            function_path_profile.path_trees_by_root_bb_index().size());
+  for (const auto &[bb_index, path_tree] :
+       function_path_profile.path_trees_by_root_bb_index()) {
+    const CompactPathNode *root = trie.GetPathTree(bb_index);
+    ASSERT_NE(root, nullptr);
+    EXPECT_EQ(root->parent(), nullptr);
+    ExpectSameTree(*path_tree, *root);
+  }
+  EXPECT_EQ(trie.GetPathTree(/*bb_index=*/0), nullptr);
+  EXPECT_LT(trie.GetMemoryUsage(), EstimateMemoryUsage(function_path_profile));
+}
+
+TEST(CompactPathTrieTest, SortsChildrenAndPathPredecessors) {
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  CompactPathTrie trie(
+      program_path_profile.path_profiles_by_function_index().at(6));
+  const CompactPathNode *root = trie.GetPathTree(3);
+  ASSERT_NE(root, nullptr);
+  std::vector<int> child_bb_indices;
+  for (const CompactPathNode &child : root->children())
+    child_bb_indices.push_back(child.node_bb_index());
+  EXPECT_THAT(child_bb_indices, ElementsAre(4, 5));
+
+  std::vector<std::pair<int, int>> freqs_by_pred;
+  for (const CompactPathPredInfoEntry &entry :
+       root->GetChild(4)->path_pred_info().entries) {
+    freqs_by_pred.emplace_back(entry.path_pred_bb_index, entry.freq);
+  }
+  EXPECT_THAT(freqs_by_pred, ElementsAre(Pair(1, 170), Pair(2, 5)));
+}
+
+TEST(CompactPathTrieTest, FindsPathNodesFrozenFrom) {
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile &function_path_profile =
+      program_path_profile.path_profiles_by_function_index().at(6);
+  CompactPathTrie trie(function_path_profile);
+  const CompactPathNode *root = trie.GetPathTree(3);
+  ASSERT_NE(root, nullptr);
+  EXPECT_EQ(FindPathNode(function_path_profile, *root),
+            function_path_profile.GetPathTree(3));
+  const CompactPathNode *child = root->GetChild(4);
+  ASSERT_NE(child, nullptr);
+  EXPECT_EQ(FindPathNode(function_path_profile, *child),
+            function_path_profile.GetPathTree(3)->GetChild(4));
+
+  FunctionPathProfile empty_function_path_profile(/*function_index=*/6);
+  EXPECT_EQ(FindPathNode(empty_function_path_profile, *child), nullptr);
+}
+}  // namespace
+}  // namespace propeller
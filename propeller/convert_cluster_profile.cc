@@ -0,0 +1,55 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A standalone tool to convert cluster profiles between the binary encoding
+// and the text encoding (`VERSION_1`). The direction of the conversion is
+// detected from the input.
+//
+// Example:
+// ```
+// convert_cluster_profile --input=cc_profile.bin --output=cc_profile.txt
+// ```
+
+#include <fstream>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/file_helpers.h"
+
+ABSL_FLAG(std::string, input, "", "Input cluster profile (binary or text).");
+ABSL_FLAG(std::string, output, "", "Output cluster profile.");
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  absl::StatusOr<std::string> input =
+      propeller_file::GetContents(absl::GetFlag(FLAGS_input));
+  QCHECK_OK(input);
+  absl::StatusOr<std::string> output =
+      absl::StartsWith(*input, propeller::kBinaryClusterProfileMagic)
+          ? propeller::ConvertBinaryClusterProfileToText(*input)
+          : propeller::ConvertTextClusterProfileToBinary(*input);
+  QCHECK_OK(output);
+
+  std::ofstream os(absl::GetFlag(FLAGS_output), std::ios::binary);
+  QCHECK(os) << "Failed to open " << absl::GetFlag(FLAGS_output);
+  os.write(output->data(), output->size());
+}
@@ -14,15 +14,22 @@
 
 #include "propeller/frequencies_branch_aggregator.h"
 
+#include <algorithm>
+#include <cstddef>
 #include <cstdint>
 #include <memory>
 #include <optional>
 #include <utility>
+#include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/base/attributes.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
 #include "llvm/TargetParser/Triple.h"
 #include "propeller/binary_address_branch.h"
 #include "propeller/binary_address_mapper.h"
@@ -35,6 +42,9 @@
 
 namespace propeller {
 namespace {
+// Number of function ranges per thread in fallthrough inference, to balance
+// the load of the threads.
+constexpr int kRangesPerThread = 4;
 
 std::optional<int> GetInstructionSize(const BinaryContent& binary_content) {
   if (binary_content.object_file != nullptr &&
@@ -108,77 +118,131 @@ FrequenciesBranchAggregator::AggregateBranchFrequencies(
   return outputs;
 }
 
-FrequenciesBranchAggregator::WeightsMap
-FrequenciesBranchAggregator::ComputeBlockWeights(
-    const BranchFrequencies& branch_frequencies,
-    const BinaryAddressMapper& binary_address_mapper) const {
-  WeightsMap weights;
-  AccumulateActualOutgoingWeights(branch_frequencies.taken_branch_counters,
-                                  branch_frequencies.not_taken_branch_counters,
-                                  binary_address_mapper, weights);
-  AccumulateBranchWeights(branch_frequencies.taken_branch_counters,
-                          binary_address_mapper, weights);
-  return weights;
+std::vector<FrequenciesBranchAggregator::BbHandleRange>
+FrequenciesBranchAggregator::PartitionBbHandles(
+    const BinaryAddressMapper& binary_address_mapper, int num_ranges) {
+  const std::vector<BbHandle>& bb_handles = binary_address_mapper.bb_handles();
+  const int num_bb_handles = bb_handles.size();
+  const int min_range_size =
+      std::max(1, num_bb_handles / std::max(1, num_ranges));
+  std::vector<BbHandleRange> bb_handle_ranges;
+  for (int begin = 0; begin < num_bb_handles;) {
+    int end = std::min(num_bb_handles, begin + min_range_size);
+    // Extend the range to the end of its last function's blocks.
+    while (end < num_bb_handles &&
+           bb_handles[end].function_index == bb_handles[end - 1].function_index)
+      ++end;
+    bb_handle_ranges.push_back({.begin = begin, .end = end});
+    begin = end;
+  }
+  return bb_handle_ranges;
 }
 
-void FrequenciesBranchAggregator::AccumulateActualOutgoingWeights(
-    const absl::flat_hash_map<BinaryAddressBranch, int64_t>& taken_branches,
-    const absl::flat_hash_map<BinaryAddressNotTakenBranch, int64_t>&
-        not_taken_branches,
+std::vector<FrequenciesBranchAggregator::WeightsMap>
+FrequenciesBranchAggregator::ComputeBlockWeights(
+    const BranchFrequencies& branch_frequencies,
     const BinaryAddressMapper& binary_address_mapper,
-    WeightsMap& weights_map) const {
-  // We can only determine if an instruction is the last in its block if we know
-  // the size of the final instruction.
-  if (!instruction_size_.has_value()) return;
-
-  auto set_outgoing_weight = [&binary_address_mapper, &weights_map, this](
-                                 uint64_t branch_address,
-                                 int64_t outgoing_weight) {
-    std::optional<int> handle_index =
-        binary_address_mapper.FindBbHandleIndexUsingBinaryAddress(
-            branch_address, BranchDirection::kFrom);
-    if (!handle_index.has_value()) return;
-
-    // If the branch is the last instruction in the block, set the weight.
-    uint64_t last_instruction_address =
-        binary_address_mapper.GetEndAddress(
-            binary_address_mapper.bb_handles()[*handle_index]) -
-        *instruction_size_;
-    if (branch_address == last_instruction_address) {
-      weights_map[*handle_index].actual_fallthrough_weight = outgoing_weight;
-    }
-  };
-
-  // Initialize the actual outgoing weight as zero for blocks that end in taken
-  // branches.
-  for (const auto& [branch, _] : taken_branches) {
-    set_outgoing_weight(branch.from, 0);
+    absl::Span<const BbHandleRange> bb_handle_ranges) const {
+  const std::vector<std::pair<BinaryAddressBranch, int64_t>> taken_branches(
+      branch_frequencies.taken_branch_counters.begin(),
+      branch_frequencies.taken_branch_counters.end());
+  const std::vector<std::pair<BinaryAddressNotTakenBranch, int64_t>>
+      not_taken_branches(branch_frequencies.not_taken_branch_counters.begin(),
+                         branch_frequencies.not_taken_branch_counters.end());
+
+  // Map the branch endpoints to blocks in parallel. The updates of the taken
+  // branches come first, so that not-taken branches override the zero actual
+  // fallthrough weights set by taken branches.
+  constexpr int kUpdatesPerTakenBranch = 3;
+  const int num_taken_branch_updates =
+      kUpdatesPerTakenBranch * taken_branches.size();
+  std::vector<WeightUpdate> updates(num_taken_branch_updates +
+                                    not_taken_branches.size());
+  llvm::parallelFor(0, taken_branches.size(), [&](size_t i) {
+    const auto& [branch, count] = taken_branches[i];
+    WeightUpdate* branch_updates = &updates[kUpdatesPerTakenBranch * i];
+    branch_updates[0] = GetActualFallthroughWeightUpdate(
+        branch.from, /*weight=*/0, binary_address_mapper);
+    branch_updates[1] = {
+        .bb_handle_index =
+            binary_address_mapper
+                .FindBbHandleIndexUsingBinaryAddress(branch.from,
+                                                     BranchDirection::kFrom)
+                .value_or(-1),
+        .kind = WeightUpdate::Kind::kOutgoingBranch,
+        .weight = count};
+    branch_updates[2] = {
+        .bb_handle_index = binary_address_mapper
+                               .FindBbHandleIndexUsingBinaryAddress(
+                                   branch.to, BranchDirection::kTo)
+                               .value_or(-1),
+        .kind = WeightUpdate::Kind::kIncoming,
+        .weight = count};
+  });
+  llvm::parallelFor(0, not_taken_branches.size(), [&](size_t i) {
+    const auto& [branch, count] = not_taken_branches[i];
+    updates[num_taken_branch_updates + i] = GetActualFallthroughWeightUpdate(
+        branch.address, count, binary_address_mapper);
+  });
+
+  std::vector<std::vector<WeightUpdate>> updates_by_range(
+      bb_handle_ranges.size());
+  for (const WeightUpdate& update : updates) {
+    if (update.bb_handle_index < 0) continue;
+    const int range_index =
+        absl::c_upper_bound(
+            bb_handle_ranges, update.bb_handle_index,
+            [](int bb_handle_index, const BbHandleRange& bb_handle_range) {
+              return bb_handle_index < bb_handle_range.begin;
+            }) -
+        bb_handle_ranges.begin() - 1;
+    updates_by_range[range_index].push_back(update);
   }
 
-  // Set the actual outgoing weight for blocks that end in not-taken branches.
-  for (const auto& [branch, count] : not_taken_branches) {
-    set_outgoing_weight(branch.address, count);
-  }
+  std::vector<WeightsMap> weights_by_range(bb_handle_ranges.size());
+  llvm::parallelFor(0, bb_handle_ranges.size(), [&](size_t range_index) {
+    WeightsMap& weights_map = weights_by_range[range_index];
+    for (const WeightUpdate& update : updates_by_range[range_index]) {
+      SampledWeights& sampled_weights = weights_map[update.bb_handle_index];
+      switch (update.kind) {
+        case WeightUpdate::Kind::kIncoming:
+          sampled_weights.incoming_weight += update.weight;
+          break;
+        case WeightUpdate::Kind::kOutgoingBranch:
+          sampled_weights.outgoing_branch_weight += update.weight;
+          break;
+        case WeightUpdate::Kind::kActualFallthrough:
+          sampled_weights.actual_fallthrough_weight = update.weight;
+          break;
+      }
+    }
+  });
+  return weights_by_range;
 }
 
-void FrequenciesBranchAggregator::AccumulateBranchWeights(
-    const absl::flat_hash_map<BinaryAddressBranch, int64_t>& taken_branches,
-    const BinaryAddressMapper& binary_address_mapper,
-    WeightsMap& weights_map) const {
-  for (const auto& [branch, count] : taken_branches) {
-    std::optional<int> from_bb_handle =
-        binary_address_mapper.FindBbHandleIndexUsingBinaryAddress(
-            branch.from, BranchDirection::kFrom);
-    if (from_bb_handle.has_value()) {
-      weights_map[*from_bb_handle].outgoing_branch_weight += count;
-    }
-    std::optional<int> to_bb_handle =
-        binary_address_mapper.FindBbHandleIndexUsingBinaryAddress(
-            branch.to, BranchDirection::kTo);
-    if (to_bb_handle.has_value()) {
-      weights_map[*to_bb_handle].incoming_weight += count;
-    }
-  }
+FrequenciesBranchAggregator::WeightUpdate
+FrequenciesBranchAggregator::GetActualFallthroughWeightUpdate(
+    uint64_t branch_address, int64_t weight,
+    const BinaryAddressMapper& binary_address_mapper) const {
+  // We can only determine if an instruction is the last in its block if we know
+  // the size of the final instruction.
+  if (!instruction_size_.has_value()) return {};
+
+  std::optional<int> handle_index =
+      binary_address_mapper.FindBbHandleIndexUsingBinaryAddress(
+          branch_address, BranchDirection::kFrom);
+  if (!handle_index.has_value()) return {};
+
+  // Only a branch which is the last instruction in its block determines the
+  // block's fallthrough weight.
+  uint64_t last_instruction_address =
+      binary_address_mapper.GetEndAddress(
+          binary_address_mapper.bb_handles()[*handle_index]) -
+      *instruction_size_;
+  if (branch_address != last_instruction_address) return {};
+  return {.bb_handle_index = *handle_index,
+          .kind = WeightUpdate::Kind::kActualFallthrough,
+          .weight = weight};
 }
 
 int64_t FrequenciesBranchAggregator::InferFallthroughWeight(
@@ -244,10 +308,42 @@ absl::flat_hash_map<BinaryAddressFallthrough, int64_t>
 FrequenciesBranchAggregator::InferFallthroughs(
     const BranchFrequencies& frequencies,
     const BinaryAddressMapper& binary_address_mapper) const {
+  // Fallthroughs never cross functions, so the fallthroughs of each range of
+  // whole functions are inferred independently, in parallel.
+  const std::vector<BbHandleRange> bb_handle_ranges = PartitionBbHandles(
+      binary_address_mapper,
+      kRangesPerThread * llvm::parallel::strategy.compute_thread_count());
+  std::vector<WeightsMap> weights_by_range = ComputeBlockWeights(
+      frequencies, binary_address_mapper, bb_handle_ranges);
+  std::vector<absl::flat_hash_map<BinaryAddressFallthrough, int64_t>>
+      fallthrough_counts_by_range(bb_handle_ranges.size());
+  llvm::parallelFor(0, bb_handle_ranges.size(), [&](size_t range_index) {
+    fallthrough_counts_by_range[range_index] = InferRangeFallthroughs(
+        weights_by_range[range_index], binary_address_mapper);
+  });
+
+  // The fallthroughs of different ranges start in different blocks, so the
+  // merged counts don't overlap.
+  absl::flat_hash_map<BinaryAddressFallthrough, int64_t> fallthrough_counts;
+  size_t num_fallthroughs = 0;
+  for (const auto& range_fallthrough_counts : fallthrough_counts_by_range)
+    num_fallthroughs += range_fallthrough_counts.size();
+  fallthrough_counts.reserve(num_fallthroughs);
+  for (auto& range_fallthrough_counts : fallthrough_counts_by_range) {
+    fallthrough_counts.insert(range_fallthrough_counts.begin(),
+                              range_fallthrough_counts.end());
+    range_fallthrough_counts.clear();
+  }
+  return fallthrough_counts;
+}
+
+absl::flat_hash_map<BinaryAddressFallthrough, int64_t>
+FrequenciesBranchAggregator::InferRangeFallthroughs(
+    WeightsMap& weights,
+    const BinaryAddressMapper& binary_address_mapper) const {
   absl::flat_hash_map<BinaryAddressFallthrough, int64_t> fallthrough_counts;
   std::optional<std::pair<int, int64_t>> fallthrough_from;
 
-  WeightsMap weights = ComputeBlockWeights(frequencies, binary_address_mapper);
   for (auto& [bb_handle_index, sampled_weights] : weights) {
     // Resolve any outstanding fallthrough before evaluating this block.
     if (fallthrough_from.has_value()) {
@@ -271,7 +367,9 @@ FrequenciesBranchAggregator::InferFallthroughs(
     }
   }
 
-  // Resolve any outstanding fallthrough.
+  // Resolve any outstanding fallthrough. The next block with sampled weights,
+  // if any, is in another function, so only the successor can be the end
+  // block.
   if (fallthrough_from.has_value()) {
     HandleFallthrough(/*from_bb_handle_index=*/fallthrough_from->first,
                       /*to_bb_handle_index=*/fallthrough_from->first + 1,
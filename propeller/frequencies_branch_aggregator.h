@@ -18,12 +18,14 @@
 #include <cstdint>
 #include <memory>
 #include <optional>
+#include <vector>
 
 #include "absl/base/attributes.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
 #include "absl/status/statusor.h"
+#include "absl/types/span.h"
 #include "propeller/binary_address_branch.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/binary_content.h"
@@ -93,27 +95,48 @@ class FrequenciesBranchAggregator : public BranchAggregator {
   // A map from basic block handle index to the block's sampled weights.
   using WeightsMap = absl::btree_map<int, SampledWeights>;
 
+  // A range `[begin, end)` of basic block handle indices which doesn't split
+  // the blocks of any function. Fallthroughs never cross functions, so the
+  // fallthroughs of each range can be inferred independently.
+  struct BbHandleRange {
+    int begin;
+    int end;
+  };
+
+  // An update of the sampled weights of a basic block from one branch.
+  struct WeightUpdate {
+    enum class Kind {
+      kIncoming,
+      kOutgoingBranch,
+      kActualFallthrough,
+    };
+
+    // The index of the updated block, or -1 if there is no update.
+    int bb_handle_index = -1;
+    Kind kind = Kind::kIncoming;
+    int64_t weight = 0;
+  };
+
+  // Splits the basic block handles of `binary_address_mapper` into up to
+  // `num_ranges` consecutive ranges of similar sizes, which don't split the
+  // blocks of any function.
+  static std::vector<BbHandleRange> PartitionBbHandles(
+      const BinaryAddressMapper& binary_address_mapper, int num_ranges);
+
   // Computes the sampled weights for each block with an address in
-  // `branch_frequencies`.
-  WeightsMap ComputeBlockWeights(
+  // `branch_frequencies`, separately for each of `bb_handle_ranges`. The
+  // branch addresses are mapped to blocks in parallel.
+  std::vector<WeightsMap> ComputeBlockWeights(
       const BranchFrequencies& branch_frequencies,
-      const BinaryAddressMapper& binary_address_mapper) const;
-
-  // Accumulates the actual outgoing weights for each block whose final
-  // instruction is in `not_taken_branches`.
-  void AccumulateActualOutgoingWeights(
-      const absl::flat_hash_map<BinaryAddressBranch, int64_t>& taken_branches,
-      const absl::flat_hash_map<BinaryAddressNotTakenBranch, int64_t>&
-          not_taken_branches,
       const BinaryAddressMapper& binary_address_mapper,
-      WeightsMap& weights_map) const;
+      absl::Span<const BbHandleRange> bb_handle_ranges) const;
 
-  // Accumulates the weights of incoming and outgoing branch edges for each
-  // block with an address in `taken_branches`.
-  void AccumulateBranchWeights(
-      const absl::flat_hash_map<BinaryAddressBranch, int64_t>& taken_branches,
-      const BinaryAddressMapper& binary_address_mapper,
-      WeightsMap& weights_map) const;
+  // Returns the update setting the actual fallthrough weight of the block
+  // ending in the branch at `branch_address` to `weight`, or no update if the
+  // branch is not the last instruction of a block.
+  WeightUpdate GetActualFallthroughWeightUpdate(
+      uint64_t branch_address, int64_t weight,
+      const BinaryAddressMapper& binary_address_mapper) const;
 
   // Infers the weight of the fallthrough off the end of a basic block.
   int64_t InferFallthroughWeight(
@@ -149,11 +172,20 @@ class FrequenciesBranchAggregator : public BranchAggregator {
                          absl::flat_hash_map<BinaryAddressFallthrough, int64_t>&
                              fallthroughs) const;
 
-  // Infers the fallthrough edges and weights from the branch frequencies.
+  // Infers the fallthrough edges and weights from the branch frequencies. The
+  // fallthroughs of ranges of whole functions are inferred in parallel and
+  // then merged.
   absl::flat_hash_map<BinaryAddressFallthrough, int64_t> InferFallthroughs(
       const BranchFrequencies& branch_frequencies,
       const BinaryAddressMapper& binary_address_mapper) const;
 
+  // Infers the fallthrough edges and weights from the sampled `weights` of the
+  // blocks of one `BbHandleRange`, propagating inferred fallthrough weights to
+  // the incoming weights of the blocks they fall through to.
+  absl::flat_hash_map<BinaryAddressFallthrough, int64_t> InferRangeFallthroughs(
+      WeightsMap& weights,
+      const BinaryAddressMapper& binary_address_mapper) const;
+
   // Performs branch frequency aggregation, converting the inputs into the
   // outputs. This is a pure function, and it lives within
   // `FrequenciesBranchAggregator` to have access to `Frequency{In,Out}puts`.
@@ -15,15 +15,20 @@
 
 #include "propeller/frequencies_branch_aggregator.h"
 
+#include <cstdint>
 #include <memory>
 #include <utility>
+#include <vector>
 
+#include "absl/container/flat_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
 #include "absl/status/statusor.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "llvm/Object/ELFTypes.h"
+#include "propeller/bb_handle.h"
+#include "propeller/binary_address_branch.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/binary_content.h"
 #include "propeller/branch_aggregation.h"
@@ -331,5 +336,52 @@ TEST(FrequenciesBranchAggregator, AggregatesBlocksEndingInBranches) {
       IsOkAndHolds(Field("fallthrough_counters",
                          &BranchAggregation::fallthrough_counters, IsEmpty())));
 }
+
+TEST(FrequenciesBranchAggregator, AggregateInfersFallthroughsOfManyFunctions) {
+  // Each function has blocks at offsets 0x0, 0x4 and 0x8, and its last block
+  // branches to the next function's entry. The fallthroughs of each function
+  // are inferred independently of the other functions.
+  constexpr int kNumFunctions = 1000;
+  std::vector<BBAddrMap> bb_addr_maps;
+  std::vector<BbHandle> bb_handles;
+  BranchFrequencies frequencies;
+  absl::flat_hash_map<BinaryAddressFallthrough, int64_t> expected_fallthroughs;
+  for (int function_index = 0; function_index < kNumFunctions;
+       ++function_index) {
+    const uint64_t address = 0x1000 + 0x100 * function_index;
+    bb_addr_maps.push_back(
+        {{{.BaseAddress = address,
+           .BBEntries = {
+               BBAddrMap::BBEntry(/*ID=*/0, /*Offset=*/0x0, /*Size=*/4,
+                                  /*Metadata=*/{.CanFallThrough = true}),
+               BBAddrMap::BBEntry(/*ID=*/1, /*Offset=*/0x4, /*Size=*/4,
+                                  /*Metadata=*/{.CanFallThrough = true}),
+               BBAddrMap::BBEntry(/*ID=*/2, /*Offset=*/0x8, /*Size=*/4,
+                                  /*Metadata=*/{}),
+           }}}});
+    for (int bb_index = 0; bb_index < 3; ++bb_index) {
+      bb_handles.push_back(
+          {.function_index = function_index, .bb_index = bb_index});
+    }
+    const uint64_t next_address =
+        0x1000 + 0x100 * ((function_index + 1) % kNumFunctions);
+    frequencies.taken_branch_counters[{.from = address + 0x8,
+                                       .to = next_address}] =
+        function_index + 1;
+    expected_fallthroughs[{.from = address, .to = address + 0x8}] =
+        function_index == 0 ? kNumFunctions : function_index;
+  }
+
+  PropellerStats stats;
+  EXPECT_THAT(FrequenciesBranchAggregator(std::move(frequencies))
+                  .Aggregate(BinaryAddressMapper(
+                                 /*selected_functions=*/{},
+                                 std::move(bb_addr_maps), std::move(bb_handles),
+                                 /*symbol_info_map=*/{}),
+                             stats),
+              IsOkAndHolds(Field("fallthrough_counters",
+                                 &BranchAggregation::fallthrough_counters,
+                                 Eq(expected_fallthroughs))));
+}
 }  // namespace
 }  // namespace propeller
@@ -0,0 +1,70 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+// A standalone tool to generate a synthetic LBR perf.data file for a binary
+// with a bb address map, for benchmarking the profile ingestion on inputs of
+// any size.
+//
+// Example:
+// ```
+// generate_synthetic_perf_data --binary=sample.bin --output=perf.data \
+//     --num_samples=1000000
+// ```
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <string>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "propeller/binary_content.h"
+#include "propeller/synthetic_perf_data.h"
+
+ABSL_FLAG(std::string, binary, "", "Binary with a bb address map.");
+ABSL_FLAG(std::string, output, "", "Output perf.data file.");
+ABSL_FLAG(uint64_t, seed, 0, "Seed of the random generator.");
+ABSL_FLAG(int, num_samples, 1000000, "Number of samples.");
+ABSL_FLAG(int, lbr_depth, 32, "Number of branches per sample.");
+ABSL_FLAG(int, num_hot_functions, 100,
+          "Number of functions the execution is spread over, or 0 for all "
+          "functions.");
+ABSL_FLAG(int, num_processes, 1, "Number of processes running the binary.");
+ABSL_FLAG(std::string, mmap_name, "",
+          "File name of the binary in the mmap events. Defaults to --binary.");
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  absl::StatusOr<std::unique_ptr<propeller::BinaryContent>> binary_content =
+      propeller::GetBinaryContent(absl::GetFlag(FLAGS_binary));
+  QCHECK_OK(binary_content);
+
+  std::ofstream os(absl::GetFlag(FLAGS_output), std::ios::binary);
+  QCHECK(os) << "Failed to open " << absl::GetFlag(FLAGS_output);
+  QCHECK_OK(propeller::WriteSyntheticPerfData(
+      **binary_content,
+      {.seed = absl::GetFlag(FLAGS_seed),
+       .num_samples = absl::GetFlag(FLAGS_num_samples),
+       .lbr_depth = absl::GetFlag(FLAGS_lbr_depth),
+       .num_hot_functions = absl::GetFlag(FLAGS_num_hot_functions),
+       .num_processes = absl::GetFlag(FLAGS_num_processes),
+       .mmap_name = absl::GetFlag(FLAGS_mmap_name)},
+      os));
+}
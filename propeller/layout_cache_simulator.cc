@@ -0,0 +1,392 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/layout_cache_simulator.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <iterator>
+#include <limits>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/functional/function_ref.h"
+#include "absl/log/check.h"
+#include "absl/numeric/bits.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/bb_handle.h"
+#include "propeller/binary_address_branch.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+namespace {
+constexpr uint64_t kInvalidLine = std::numeric_limits<uint64_t>::max();
+
+absl::string_view ToStringView(llvm::StringRef str) {
+  return absl::string_view(str.data(), str.size());
+}
+
+// Returns the report line of one counter.
+std::string FormatCounter(absl::string_view name, int64_t original,
+                          int64_t predicted) {
+  std::string line =
+      absl::StrFormat("%s: %d -> %d (%+d", name, original, predicted,
+                      predicted - original);
+  if (original != 0) {
+    absl::StrAppendFormat(&line, ", %+.2f%%",
+                          100.0 * (predicted - original) / original);
+  }
+  absl::StrAppend(&line, ")\n");
+  return line;
+}
+}  // namespace
+
+absl::StatusOr<SetAssociativeCache> SetAssociativeCache::Create(
+    const CacheConfig &config) {
+  if (config.line_size <= 0 ||
+      !absl::has_single_bit(static_cast<uint64_t>(config.line_size))) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "line size must be a power of two: ", config.line_size));
+  }
+  if (config.associativity <= 0) {
+    return absl::InvalidArgumentError(absl::StrCat(
+        "associativity must be positive: ", config.associativity));
+  }
+  const int64_t set_size = config.line_size * config.associativity;
+  if (config.size <= 0 || config.size % set_size != 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "size must be a positive multiple of line size * associativity (%d): "
+        "%d",
+        set_size, config.size));
+  }
+  return SetAssociativeCache(
+      config, absl::countr_zero(static_cast<uint64_t>(config.line_size)));
+}
+
+SetAssociativeCache::SetAssociativeCache(const CacheConfig &config,
+                                         int line_shift)
+    : config_(config),
+      line_shift_(line_shift),
+      num_sets_(config.size / (config.line_size * config.associativity)),
+      lines_(config.size / config.line_size, kInvalidLine) {}
+
+bool SetAssociativeCache::Access(uint64_t address) {
+  const uint64_t line = address >> line_shift_;
+  absl::Span<uint64_t> set = absl::MakeSpan(lines_).subspan(
+      (line % num_sets_) * config_.associativity, config_.associativity);
+  auto it = absl::c_find(set, line);
+  const bool hit = it != set.end();
+  // On a miss, evict the least recently used line.
+  if (!hit) it = std::prev(set.end());
+  std::rotate(set.begin(), it, std::next(it));
+  set.front() = line;
+  return hit;
+}
+
+absl::StatusOr<InstructionCacheSimulator> InstructionCacheSimulator::Create(
+    const InstructionCacheConfig &config) {
+  ASSIGN_OR_RETURN(SetAssociativeCache l1i,
+                   SetAssociativeCache::Create(config.l1i));
+  ASSIGN_OR_RETURN(SetAssociativeCache l2,
+                   SetAssociativeCache::Create(config.l2));
+  ASSIGN_OR_RETURN(SetAssociativeCache itlb,
+                   SetAssociativeCache::Create(config.itlb));
+  return InstructionCacheSimulator(std::move(l1i), std::move(l2),
+                                   std::move(itlb));
+}
+
+void InstructionCacheSimulator::Fetch(uint64_t begin, uint64_t end) {
+  if (begin >= end) return;
+  const uint64_t line_size = l1i_.config().line_size;
+  for (uint64_t line = begin & ~(line_size - 1); line < end;
+       line += line_size) {
+    ++stats_.l1i_accesses;
+    if (l1i_.Access(line)) continue;
+    ++stats_.l1i_misses;
+    if (!l2_.Access(line)) ++stats_.l2_misses;
+  }
+  const uint64_t page_size = itlb_.config().line_size;
+  for (uint64_t page = begin & ~(page_size - 1); page < end;
+       page += page_size) {
+    ++stats_.itlb_accesses;
+    if (!itlb_.Access(page)) ++stats_.itlb_misses;
+  }
+}
+
+LayoutAddressTranslator LayoutAddressTranslator::Create(
+    const BinaryAddressMapper *address_mapper,
+    absl::Span<const ClusterProfileFunction> functions,
+    absl::Span<const absl::string_view> symbol_order) {
+  const std::vector<BbHandle> &bb_handles = address_mapper->bb_handles();
+  absl::flat_hash_map<absl::string_view, const ClusterProfileFunction *>
+      functions_by_name;
+  for (const ClusterProfileFunction &function : functions) {
+    for (absl::string_view name : function.names)
+      functions_by_name.try_emplace(name, &function);
+  }
+
+  // Contiguous parts of the functions in the predicted layout, as indices into
+  // `bb_handles`, and the parts by their symbol names.
+  std::vector<std::vector<int>> parts;
+  absl::flat_hash_map<std::string, int> parts_by_symbol;
+  auto add_part = [&](const FunctionSymbolInfo &symbol_info,
+                      absl::string_view suffix, std::vector<int> part) {
+    for (llvm::StringRef alias : symbol_info.aliases)
+      parts_by_symbol.try_emplace(absl::StrCat(ToStringView(alias), suffix),
+                                  parts.size());
+    parts.push_back(std::move(part));
+  };
+
+  // BB handles are sorted by address, so a function with several BB ranges
+  // (e.g., one split into hot and cold parts) may have other functions' blocks
+  // between its ranges. Gather the BB handle indices of every function, in
+  // increasing address order, and order functions by their first block.
+  std::vector<int> function_order;
+  absl::flat_hash_map<int, std::vector<int>> bb_indices_by_function;
+  for (int i = 0; i < bb_handles.size(); ++i) {
+    auto [it, inserted] =
+        bb_indices_by_function.try_emplace(bb_handles[i].function_index);
+    if (inserted) function_order.push_back(bb_handles[i].function_index);
+    it->second.push_back(i);
+  }
+
+  for (int function_index : function_order) {
+    const std::vector<int> &bb_indices =
+        bb_indices_by_function.at(function_index);
+    const FunctionSymbolInfo &symbol_info =
+        address_mapper->symbol_info_map().at(function_index);
+    const ClusterProfileFunction *function = nullptr;
+    for (llvm::StringRef alias : symbol_info.aliases) {
+      auto it = functions_by_name.find(ToStringView(alias));
+      if (it == functions_by_name.end()) continue;
+      function = it->second;
+      break;
+    }
+    if (function == nullptr) {
+      // Keep every BB range as its own part. Like in the original binary, the
+      // BB ranges after the first are named with the ".cold" suffix.
+      for (int begin = 0, end = 0; begin < bb_indices.size(); begin = end) {
+        const int range_index = bb_handles[bb_indices[begin]].range_index;
+        while (end < bb_indices.size() &&
+               bb_handles[bb_indices[end]].range_index == range_index) {
+          ++end;
+        }
+        add_part(symbol_info, range_index == 0 ? "" : ".cold",
+                 std::vector<int>(bb_indices.begin() + begin,
+                                  bb_indices.begin() + end));
+      }
+      continue;
+    }
+
+    // Positions in `bb_indices` of the blocks, by their BB IDs.
+    absl::flat_hash_map<int, int> positions_by_bb_id;
+    for (int j = 0; j < bb_indices.size(); ++j) {
+      positions_by_bb_id.emplace(
+          address_mapper->GetBBEntry(bb_handles[bb_indices[j]]).ID, j);
+    }
+    std::vector<bool> in_cluster(bb_indices.size());
+    bool entry_in_clusters = false;
+    for (int cluster_index = 0; cluster_index < function->clusters.size();
+         ++cluster_index) {
+      std::vector<int> part;
+      for (const ProfileBbId &bb_id : function->clusters[cluster_index]) {
+        if (bb_id.clone_number != 0) continue;
+        auto it = positions_by_bb_id.find(bb_id.bb_id);
+        if (it == positions_by_bb_id.end() || in_cluster[it->second]) continue;
+        in_cluster[it->second] = true;
+        part.push_back(bb_indices[it->second]);
+      }
+      if (part.empty()) continue;
+      // Like in the symbol order profile, the cluster beginning with the entry
+      // block is named after the function.
+      const BbHandle &first_bb_handle = bb_handles[part.front()];
+      const bool is_entry =
+          first_bb_handle.range_index == 0 && first_bb_handle.bb_index == 0;
+      entry_in_clusters |= is_entry;
+      add_part(symbol_info,
+               is_entry ? "" : absl::StrCat(".__part.", cluster_index),
+               std::move(part));
+    }
+    std::vector<int> cold_part;
+    for (int j = 0; j < bb_indices.size(); ++j) {
+      if (!in_cluster[j]) cold_part.push_back(bb_indices[j]);
+    }
+    if (!cold_part.empty()) {
+      add_part(symbol_info, entry_in_clusters ? ".cold" : "",
+               std::move(cold_part));
+    }
+  }
+
+  std::vector<int> part_order;
+  std::vector<bool> placed(parts.size());
+  for (absl::string_view symbol : symbol_order) {
+    auto it = parts_by_symbol.find(symbol);
+    if (it == parts_by_symbol.end() || placed[it->second]) continue;
+    placed[it->second] = true;
+    part_order.push_back(it->second);
+  }
+  // The other parts keep their original order.
+  std::vector<int> other_parts;
+  std::vector<int> first_bb_indices(parts.size());
+  for (int i = 0; i < parts.size(); ++i) {
+    first_bb_indices[i] = *absl::c_min_element(parts[i]);
+    if (!placed[i]) other_parts.push_back(i);
+  }
+  absl::c_stable_sort(other_parts, [&](int a, int b) {
+    return first_bb_indices[a] < first_bb_indices[b];
+  });
+  absl::c_copy(other_parts, std::back_inserter(part_order));
+
+  std::vector<uint64_t> new_addresses(bb_handles.size());
+  uint64_t address =
+      bb_handles.empty() ? 0 : address_mapper->GetAddress(bb_handles.front());
+  for (int part_index : part_order) {
+    for (int i : parts[part_index]) {
+      new_addresses[i] = address;
+      address += address_mapper->GetBBEntry(bb_handles[i]).Size;
+    }
+  }
+  return LayoutAddressTranslator(address_mapper, std::move(new_addresses));
+}
+
+LayoutAddressTranslator LayoutAddressTranslator::Create(
+    const BinaryAddressMapper *address_mapper,
+    std::vector<uint64_t> new_addresses) {
+  CHECK_EQ(new_addresses.size(), address_mapper->bb_handles().size());
+  return LayoutAddressTranslator(address_mapper, std::move(new_addresses));
+}
+
+void LayoutAddressTranslator::ForEachTranslatedRange(
+    uint64_t begin, uint64_t end,
+    absl::FunctionRef<void(uint64_t, uint64_t)> callback) const {
+  if (begin >= end) return;
+  const std::vector<BbHandle> &bb_handles = address_mapper_->bb_handles();
+  std::optional<int> first =
+      address_mapper_->FindBbHandleIndexUsingBinaryAddress(
+          begin, BranchDirection::kTo);
+  std::optional<int> last =
+      address_mapper_->FindBbHandleIndexUsingBinaryAddress(
+          end - 1, BranchDirection::kFrom);
+  if (!first.has_value() || !last.has_value() || *first > *last ||
+      std::any_of(bb_handles.begin() + *first, bb_handles.begin() + *last + 1,
+                  [&](const BbHandle &bb_handle) {
+                    return bb_handle.function_index !=
+                           bb_handles[*first].function_index;
+                  })) {
+    callback(begin, end);
+    return;
+  }
+  // Merge the translated ranges of the blocks which stay adjacent.
+  bool has_range = false;
+  uint64_t range_begin = 0, range_end = 0;
+  for (int i = *first; i <= *last; ++i) {
+    const uint64_t address = address_mapper_->GetAddress(bb_handles[i]);
+    const uint64_t lo = std::max(begin, address);
+    const uint64_t hi =
+        std::min(end, address_mapper_->GetEndAddress(bb_handles[i]));
+    if (lo >= hi) continue;
+    const uint64_t new_begin = new_addresses_[i] + (lo - address);
+    const uint64_t new_end = new_begin + (hi - lo);
+    if (has_range && new_begin == range_end) {
+      range_end = new_end;
+      continue;
+    }
+    if (has_range) callback(range_begin, range_end);
+    has_range = true;
+    range_begin = new_begin;
+    range_end = new_end;
+  }
+  if (has_range) callback(range_begin, range_end);
+}
+
+absl::StatusOr<LayoutCacheSimulator> LayoutCacheSimulator::Create(
+    const InstructionCacheConfig &config,
+    const LayoutAddressTranslator *original_translator,
+    const LayoutAddressTranslator *translator) {
+  ASSIGN_OR_RETURN(InstructionCacheSimulator original,
+                   InstructionCacheSimulator::Create(config));
+  ASSIGN_OR_RETURN(InstructionCacheSimulator predicted,
+                   InstructionCacheSimulator::Create(config));
+  return LayoutCacheSimulator(original_translator, translator,
+                              std::move(original), std::move(predicted));
+}
+
+void LayoutCacheSimulator::Replay(const BinaryAddressBranchPath &path) {
+  for (int i = 1; i < path.branches.size(); ++i) {
+    // The code from the target of a branch up to the source of the next one is
+    // executed sequentially. Only the first byte of the last instruction is
+    // known to be executed.
+    const uint64_t begin = path.branches[i - 1].to;
+    const uint64_t last = path.branches[i].from;
+    if (begin == kInvalidBinaryAddress || last == kInvalidBinaryAddress ||
+        begin > last) {
+      ++skipped_ranges_;
+      continue;
+    }
+    ++replayed_ranges_;
+    if (original_translator_ != nullptr) {
+      original_translator_->ForEachTranslatedRange(
+          begin, last + 1, [&](uint64_t new_begin, uint64_t new_end) {
+            original_.Fetch(new_begin, new_end);
+          });
+    }
+    translator_->ForEachTranslatedRange(
+        begin, last + 1, [&](uint64_t new_begin, uint64_t new_end) {
+          predicted_.Fetch(new_begin, new_end);
+        });
+  }
+}
+
+LayoutCacheSimulationStats LayoutCacheSimulator::stats() const {
+  return {.original = original_.stats(),
+          .predicted = predicted_.stats(),
+          .replayed_ranges = replayed_ranges_,
+          .skipped_ranges = skipped_ranges_};
+}
+
+std::string FormatLayoutCacheSimulationStats(
+    const LayoutCacheSimulationStats &stats) {
+  std::string out =
+      absl::StrFormat("replayed ranges: %d (skipped %d)\n",
+                      stats.replayed_ranges, stats.skipped_ranges);
+  absl::StrAppend(
+      &out,
+      FormatCounter("l1i_accesses", stats.original.l1i_accesses,
+                    stats.predicted.l1i_accesses),
+      FormatCounter("l1i_misses", stats.original.l1i_misses,
+                    stats.predicted.l1i_misses),
+      FormatCounter("l2_misses", stats.original.l2_misses,
+                    stats.predicted.l2_misses),
+      FormatCounter("itlb_accesses", stats.original.itlb_accesses,
+                    stats.predicted.itlb_accesses),
+      FormatCounter("itlb_misses", stats.original.itlb_misses,
+                    stats.predicted.itlb_misses));
+  return out;
+}
+}  // namespace propeller
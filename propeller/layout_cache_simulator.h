@@ -0,0 +1,217 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROPELLER_LAYOUT_CACHE_SIMULATOR_H_
+#define PROPELLER_LAYOUT_CACHE_SIMULATOR_H_
+
+#include <cstdint>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/cluster_profile.h"
+
+namespace propeller {
+
+// Geometry of a set-associative cache.
+struct CacheConfig {
+  // Capacity in bytes.
+  int64_t size = 0;
+  // Size of the cached units (cache lines or, for TLBs, pages) in bytes. Must
+  // be a power of two.
+  int64_t line_size = 0;
+  int associativity = 0;
+};
+
+// A set-associative cache with least-recently-used replacement.
+class SetAssociativeCache {
+ public:
+  // Returns an empty cache with the geometry of `config`, or an error if the
+  // geometry is invalid.
+  static absl::StatusOr<SetAssociativeCache> Create(const CacheConfig &config);
+
+  // Accesses the line containing `address`, inserting it if it's not cached.
+  // Returns whether the line was cached.
+  bool Access(uint64_t address);
+
+  const CacheConfig &config() const { return config_; }
+
+ private:
+  SetAssociativeCache(const CacheConfig &config, int line_shift);
+
+  CacheConfig config_;
+  // log2 of `config_.line_size`.
+  int line_shift_;
+  int64_t num_sets_;
+  // Line numbers cached in every set, from the most to the least recently
+  // used. The i'th set occupies `[i * associativity, (i + 1) * associativity)`
+  // and its unused ways hold `kInvalidLine`.
+  std::vector<uint64_t> lines_;
+};
+
+// Configuration of the simulated instruction fetch caches. The defaults
+// resemble recent x86-64 server cores.
+struct InstructionCacheConfig {
+  CacheConfig l1i = {.size = 32 * 1024, .line_size = 64, .associativity = 8};
+  // L2 is only accessed on L1i misses and only holds instructions.
+  CacheConfig l2 = {.size = 1024 * 1024, .line_size = 64, .associativity = 16};
+  // Every iTLB entry maps one page of `line_size` bytes.
+  CacheConfig itlb = {
+      .size = 128 * 4096, .line_size = 4096, .associativity = 8};
+};
+
+struct InstructionCacheStats {
+  int64_t l1i_accesses = 0;
+  int64_t l1i_misses = 0;
+  int64_t l2_misses = 0;
+  int64_t itlb_accesses = 0;
+  int64_t itlb_misses = 0;
+};
+
+// Simulates instruction fetches through the L1i, L2 and iTLB caches.
+class InstructionCacheSimulator {
+ public:
+  static absl::StatusOr<InstructionCacheSimulator> Create(
+      const InstructionCacheConfig &config);
+
+  // Fetches the instructions in `[begin, end)`: accesses every L1i line (and
+  // the L2 on L1i misses) and every page in the range once.
+  void Fetch(uint64_t begin, uint64_t end);
+
+  const InstructionCacheStats &stats() const { return stats_; }
+
+ private:
+  InstructionCacheSimulator(SetAssociativeCache l1i, SetAssociativeCache l2,
+                            SetAssociativeCache itlb)
+      : l1i_(std::move(l1i)), l2_(std::move(l2)), itlb_(std::move(itlb)) {}
+
+  SetAssociativeCache l1i_;
+  SetAssociativeCache l2_;
+  SetAssociativeCache itlb_;
+  InstructionCacheStats stats_;
+};
+
+// Maps the code of a binary to its predicted addresses in the layout given by
+// a cluster profile and a symbol order profile (the cc and ld profiles).
+//
+// Every function in the cluster profile is split into the parts the compiler
+// emits for it: one per cluster and one for its remaining (cold) blocks. The
+// parts are named like in the symbol order profile and the linker is assumed
+// to place the ordered parts first, followed by all other parts in their
+// original order, starting at the lowest basic block address of the binary.
+// Blocks are placed back to back, ignoring alignment, output sections and
+// code size changes from branch relaxation. Cloned blocks are not in the
+// original binary and are ignored.
+class LayoutAddressTranslator {
+ public:
+  // Does not take ownership of `address_mapper`, which must outlive the
+  // returned object and map all functions of the binary.
+  static LayoutAddressTranslator Create(
+      const BinaryAddressMapper *address_mapper,
+      absl::Span<const ClusterProfileFunction> functions,
+      absl::Span<const absl::string_view> symbol_order);
+
+  // Returns the translator of the layout which moves every element of
+  // `address_mapper->bb_handles()` to the address at the same index of
+  // `new_addresses`. Does not take ownership of `address_mapper`.
+  static LayoutAddressTranslator Create(
+      const BinaryAddressMapper *address_mapper,
+      std::vector<uint64_t> new_addresses);
+
+  // Calls `callback` on every range of the predicted layout which holds code
+  // in `[begin, end)` of the original binary, in execution order. Ranges which
+  // start or end outside the mapped basic blocks, or span more than one
+  // function, are not moved.
+  void ForEachTranslatedRange(
+      uint64_t begin, uint64_t end,
+      absl::FunctionRef<void(uint64_t, uint64_t)> callback) const;
+
+ private:
+  LayoutAddressTranslator(const BinaryAddressMapper *address_mapper,
+                          std::vector<uint64_t> new_addresses)
+      : address_mapper_(address_mapper),
+        new_addresses_(std::move(new_addresses)) {}
+
+  const BinaryAddressMapper *address_mapper_;
+  // Predicted address of every element of `address_mapper_->bb_handles()`.
+  std::vector<uint64_t> new_addresses_;
+};
+
+struct LayoutCacheSimulationStats {
+  InstructionCacheStats original;
+  InstructionCacheStats predicted;
+  // Number of executed ranges between consecutive branches which were
+  // replayed, and skipped due to invalid branch addresses.
+  int64_t replayed_ranges = 0;
+  int64_t skipped_ranges = 0;
+};
+
+// Replays LBR samples over the original and the predicted layout of a binary
+// and compares their instruction cache behavior. The samples only cover short
+// windows of the execution, so the absolute miss counts are not those of the
+// real execution, but their difference between layouts is a hardware-free
+// estimate of the layout's effect.
+//
+// The original layout is simulated through `original_translator`, which should
+// be built from the same address mapper without a profile. Both layouts are
+// then packed alike by `LayoutAddressTranslator` and only differ in the order
+// of their blocks, rather than also in the alignment and gaps of the binary.
+class LayoutCacheSimulator {
+ public:
+  // Does not take ownership of the translators, which must outlive the
+  // returned object. If `original_translator` is null, the original layout is
+  // not simulated and its stats stay zero.
+  static absl::StatusOr<LayoutCacheSimulator> Create(
+      const InstructionCacheConfig &config,
+      const LayoutAddressTranslator *original_translator,
+      const LayoutAddressTranslator *translator);
+
+  // Replays the code executed between the consecutive branches of `path`,
+  // which must be in execution order and in binary addresses.
+  void Replay(const BinaryAddressBranchPath &path);
+
+  LayoutCacheSimulationStats stats() const;
+
+ private:
+  LayoutCacheSimulator(const LayoutAddressTranslator *original_translator,
+                       const LayoutAddressTranslator *translator,
+                       InstructionCacheSimulator original,
+                       InstructionCacheSimulator predicted)
+      : original_translator_(original_translator),
+        translator_(translator),
+        original_(std::move(original)),
+        predicted_(std::move(predicted)) {}
+
+  const LayoutAddressTranslator *original_translator_;
+  const LayoutAddressTranslator *translator_;
+  InstructionCacheSimulator original_;
+  InstructionCacheSimulator predicted_;
+  int64_t replayed_ranges_ = 0;
+  int64_t skipped_ranges_ = 0;
+};
+
+// Returns the report of `stats`: one line per counter with its original and
+// predicted values and their relative difference.
+std::string FormatLayoutCacheSimulationStats(
+    const LayoutCacheSimulationStats &stats);
+}  // namespace propeller
+
+#endif  // PROPELLER_LAYOUT_CACHE_SIMULATOR_H_
@@ -0,0 +1,328 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/layout_cache_simulator.h"
+
+#include <cstdint>
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/STLExtras.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Object/ELFTypes.h"
+#include "propeller/bb_handle.h"
+#include "propeller/binary_address_branch.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::StatusIs;
+using ::llvm::object::BBAddrMap;
+using ::testing::_;
+using ::testing::ElementsAre;
+using ::testing::FieldsAre;
+using ::testing::Gt;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::Pair;
+using ::testing::SizeIs;
+
+std::string GetPropellerTestDataFilePath(absl::string_view filename) {
+  return absl::StrCat(::testing::SrcDir(), "_main/propeller/testdata/",
+                      filename);
+}
+
+// Returns the indices into `address_mapper.bb_handles()` of the blocks of the
+// function named `name`.
+std::vector<int> GetFunctionBbHandleIndices(
+    const BinaryAddressMapper &address_mapper, absl::string_view name) {
+  std::vector<int> indices;
+  for (int i = 0; i < address_mapper.bb_handles().size(); ++i) {
+    const FunctionSymbolInfo &symbol_info = address_mapper.symbol_info_map().at(
+        address_mapper.bb_handles()[i].function_index);
+    if (llvm::is_contained(symbol_info.aliases,
+                           llvm::StringRef(name.data(), name.size()))) {
+      indices.push_back(i);
+    }
+  }
+  return indices;
+}
+
+// Returns the translated ranges of `[begin, end)`.
+std::vector<std::pair<uint64_t, uint64_t>> GetTranslatedRanges(
+    const LayoutAddressTranslator &translator, uint64_t begin, uint64_t end) {
+  std::vector<std::pair<uint64_t, uint64_t>> ranges;
+  translator.ForEachTranslatedRange(
+      begin, end, [&](uint64_t new_begin, uint64_t new_end) {
+        ranges.emplace_back(new_begin, new_end);
+      });
+  return ranges;
+}
+
+class LayoutAddressTranslatorTest : public ::testing::Test {
+ protected:
+  void SetUp() override {
+    ASSERT_OK_AND_ASSIGN(
+        binary_content_,
+        GetBinaryContent(GetPropellerTestDataFilePath("sample.bin")));
+    PropellerStats stats;
+    ASSERT_OK_AND_ASSIGN(
+        address_mapper_,
+        BuildBinaryAddressMapper(PropellerOptions(), *binary_content_, stats));
+    ASSERT_THAT(address_mapper_->bb_handles(), Not(IsEmpty()));
+  }
+
+  uint64_t GetAddress(int bb_handle_index) const {
+    return address_mapper_->GetAddress(
+        address_mapper_->bb_handles()[bb_handle_index]);
+  }
+  uint64_t GetEndAddress(int bb_handle_index) const {
+    return address_mapper_->GetEndAddress(
+        address_mapper_->bb_handles()[bb_handle_index]);
+  }
+
+  std::unique_ptr<BinaryContent> binary_content_;
+  std::unique_ptr<BinaryAddressMapper> address_mapper_;
+};
+
+TEST_F(LayoutAddressTranslatorTest, PlacesOrderedFunctionsFirst) {
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      address_mapper_.get(), /*functions=*/{}, /*symbol_order=*/{"main"});
+  const std::vector<int> main_indices =
+      GetFunctionBbHandleIndices(*address_mapper_, "main");
+  ASSERT_THAT(main_indices, Not(IsEmpty()));
+  const uint64_t base_address = GetAddress(0);
+  const uint64_t entry_size =
+      GetEndAddress(main_indices.front()) - GetAddress(main_indices.front());
+  EXPECT_THAT(GetTranslatedRanges(translator, GetAddress(main_indices.front()),
+                                  GetEndAddress(main_indices.front())),
+              ElementsAre(Pair(base_address, base_address + entry_size)));
+}
+
+TEST_F(LayoutAddressTranslatorTest, SplitsFunctionsIntoClusters) {
+  const std::vector<int> main_indices =
+      GetFunctionBbHandleIndices(*address_mapper_, "main");
+  ASSERT_THAT(main_indices, SizeIs(Gt(1)));
+  const int last_index = main_indices.back();
+  const int last_bb_id =
+      address_mapper_->GetBBEntry(address_mapper_->bb_handles()[last_index])
+          .ID;
+  // Only the last block of "main" is hot, in "main.__part.0". The remaining
+  // blocks are in the cold part, which keeps the function name.
+  const ClusterProfileFunction main_function = {
+      .section_name = ".text",
+      .names = {"main"},
+      .clusters = {{{.bb_id = last_bb_id}}}};
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      address_mapper_.get(), {main_function},
+      /*symbol_order=*/{"main.__part.0"});
+  const uint64_t base_address = GetAddress(0);
+  const uint64_t last_size =
+      GetEndAddress(last_index) - GetAddress(last_index);
+  EXPECT_THAT(
+      GetTranslatedRanges(translator, GetAddress(main_indices.front()),
+                          GetEndAddress(last_index)),
+      ElementsAre(Pair(Gt(base_address), _),
+                  Pair(base_address, base_address + last_size)));
+}
+
+TEST_F(LayoutAddressTranslatorTest, KeepsUnmappedCode) {
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      address_mapper_.get(), /*functions=*/{}, /*symbol_order=*/{"main"});
+  EXPECT_THAT(GetTranslatedRanges(translator, 0x10, 0x20),
+              ElementsAre(Pair(0x10, 0x20)));
+}
+
+// Returns the address mapper of a binary where "foo" has two BB ranges, at
+// 0x1000 (blocks 0 and 1) and at 0x3000 (block 2), with "bar" at 0x2000 between
+// them.
+BinaryAddressMapper GetSplitFunctionAddressMapper() {
+  return BinaryAddressMapper(
+      /*selected_functions=*/{0, 1}, /*bb_addr_map=*/
+      {{{{.BaseAddress = 0x1000,
+          .BBEntries = {BBAddrMap::BBEntry(/*ID=*/0, /*Offset=*/0,
+                                           /*Size=*/0x10,
+                                           /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/1, /*Offset=*/0x10,
+                                           /*Size=*/0x10,
+                                           /*Metadata=*/{})}},
+         {.BaseAddress = 0x3000,
+          .BBEntries = {BBAddrMap::BBEntry(/*ID=*/2, /*Offset=*/0,
+                                           /*Size=*/0x10,
+                                           /*Metadata=*/{})}}}},
+       {{{.BaseAddress = 0x2000,
+          .BBEntries = {BBAddrMap::BBEntry(/*ID=*/0, /*Offset=*/0,
+                                           /*Size=*/0x20,
+                                           /*Metadata=*/{})}}}}},
+      /*bb_handles=*/
+      {{.function_index = 0, .range_index = 0, .bb_index = 0},
+       {.function_index = 0, .range_index = 0, .bb_index = 1},
+       {.function_index = 1, .range_index = 0, .bb_index = 0},
+       {.function_index = 0, .range_index = 1, .bb_index = 0}},
+      /*symbol_info_map=*/
+      {{0, {.aliases = {"foo"}, .section_name = ".text"}},
+       {1, {.aliases = {"bar"}, .section_name = ".text"}}});
+}
+
+TEST(LayoutAddressTranslatorSplitFunctionTest, KeepsAllBbRangesOfFunctions) {
+  const BinaryAddressMapper address_mapper = GetSplitFunctionAddressMapper();
+
+  // Blocks 0 and 2 of "foo" are hot and block 1 is cold.
+  const ClusterProfileFunction foo_function = {
+      .section_name = ".text",
+      .names = {"foo"},
+      .clusters = {{{.bb_id = 0}, {.bb_id = 2}}}};
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      &address_mapper, {foo_function},
+      /*symbol_order=*/{"bar", "foo", "foo.cold"});
+  EXPECT_THAT(GetTranslatedRanges(translator, 0x2000, 0x2020),
+              ElementsAre(Pair(0x1000, 0x1020)));
+  EXPECT_THAT(GetTranslatedRanges(translator, 0x1000, 0x1020),
+              ElementsAre(Pair(0x1020, 0x1030), Pair(0x1040, 0x1050)));
+  EXPECT_THAT(GetTranslatedRanges(translator, 0x3000, 0x3010),
+              ElementsAre(Pair(0x1030, 0x1040)));
+
+  // Without a profile, the BB ranges of "foo" keep their original order.
+  const LayoutAddressTranslator original_translator =
+      LayoutAddressTranslator::Create(&address_mapper, /*functions=*/{},
+                                      /*symbol_order=*/{});
+  EXPECT_THAT(GetTranslatedRanges(original_translator, 0x2000, 0x2020),
+              ElementsAre(Pair(0x1020, 0x1040)));
+  EXPECT_THAT(GetTranslatedRanges(original_translator, 0x3000, 0x3010),
+              ElementsAre(Pair(0x1040, 0x1050)));
+}
+
+using LayoutCacheSimulatorTest = LayoutAddressTranslatorTest;
+
+TEST_F(LayoutCacheSimulatorTest, ReplaysRangesBetweenBranches) {
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      address_mapper_.get(), /*functions=*/{}, /*symbol_order=*/{});
+  ASSERT_OK_AND_ASSIGN(
+      LayoutCacheSimulator simulator,
+      LayoutCacheSimulator::Create(InstructionCacheConfig(),
+                                   /*original_translator=*/&translator,
+                                   &translator));
+  // Replays [0x200000, 0x200080] and skips the range ending at the invalid
+  // address. Neither range is in the binary, so both layouts fetch the same.
+  simulator.Replay(
+      {.branches = {{.from = 0x100000, .to = 0x200000},
+                    {.from = 0x200080, .to = 0x100000},
+                    {.from = kInvalidBinaryAddress, .to = 0x100010}}});
+  LayoutCacheSimulationStats stats = simulator.stats();
+  EXPECT_EQ(stats.replayed_ranges, 1);
+  EXPECT_EQ(stats.skipped_ranges, 1);
+  EXPECT_THAT(stats.original, FieldsAre(3, 3, 3, 1, 1));
+  EXPECT_THAT(stats.predicted, FieldsAre(3, 3, 3, 1, 1));
+}
+
+TEST(LayoutCacheSimulatorSplitFunctionTest, PacksOriginalLayoutLikePredicted) {
+  const BinaryAddressMapper address_mapper = GetSplitFunctionAddressMapper();
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      &address_mapper, /*functions=*/{}, /*symbol_order=*/{});
+  ASSERT_OK_AND_ASSIGN(
+      LayoutCacheSimulator simulator,
+      LayoutCacheSimulator::Create(InstructionCacheConfig(),
+                                   /*original_translator=*/&translator,
+                                   &translator));
+  // Executes block 0 and then block 2 of "foo", which are on different pages
+  // of the binary but on the same page once packed.
+  simulator.Replay({.branches = {{.from = 0x100000, .to = 0x1000},
+                                 {.from = 0x100f, .to = 0x3000},
+                                 {.from = 0x300f, .to = 0x100000}}});
+  LayoutCacheSimulationStats stats = simulator.stats();
+  EXPECT_EQ(stats.replayed_ranges, 2);
+  EXPECT_THAT(stats.original, FieldsAre(2, 2, 2, 2, 1));
+  EXPECT_THAT(stats.predicted, FieldsAre(2, 2, 2, 2, 1));
+}
+
+TEST(SetAssociativeCacheTest, EvictsLeastRecentlyUsedLine) {
+  ASSERT_OK_AND_ASSIGN(
+      SetAssociativeCache cache,
+      SetAssociativeCache::Create(
+          {.size = 128, .line_size = 64, .associativity = 2}));
+  EXPECT_FALSE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(64));
+  EXPECT_TRUE(cache.Access(10));
+  // Evicts the line at 64, which is the least recently used.
+  EXPECT_FALSE(cache.Access(128));
+  EXPECT_TRUE(cache.Access(0));
+  EXPECT_FALSE(cache.Access(64));
+}
+
+TEST(SetAssociativeCacheTest, RejectsInvalidConfig) {
+  EXPECT_THAT(SetAssociativeCache::Create(
+                  {.size = 144, .line_size = 48, .associativity = 3}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SetAssociativeCache::Create(
+                  {.size = 100, .line_size = 64, .associativity = 1}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+  EXPECT_THAT(SetAssociativeCache::Create(
+                  {.size = 128, .line_size = 64, .associativity = 0}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(InstructionCacheSimulatorTest, CountsMissesAtEveryLevel) {
+  ASSERT_OK_AND_ASSIGN(
+      InstructionCacheSimulator simulator,
+      InstructionCacheSimulator::Create(
+          {.l1i = {.size = 128, .line_size = 64, .associativity = 2},
+           .l2 = {.size = 256, .line_size = 64, .associativity = 4},
+           .itlb = {.size = 8192, .line_size = 4096, .associativity = 2}}));
+  simulator.Fetch(0, 130);
+  EXPECT_THAT(simulator.stats(), FieldsAre(3, 3, 3, 1, 1));
+  // The line at 0 was evicted from L1i, but not from L2.
+  simulator.Fetch(0, 64);
+  EXPECT_THAT(simulator.stats(), FieldsAre(4, 4, 3, 2, 1));
+}
+
+TEST(LayoutCacheSimulationStatsTest, FormatsStats) {
+  const LayoutCacheSimulationStats stats = {
+      .original = {.l1i_accesses = 200,
+                   .l1i_misses = 40,
+                   .l2_misses = 4,
+                   .itlb_accesses = 10,
+                   .itlb_misses = 0},
+      .predicted = {.l1i_accesses = 200,
+                    .l1i_misses = 30,
+                    .l2_misses = 5,
+                    .itlb_accesses = 8,
+                    .itlb_misses = 1},
+      .replayed_ranges = 100,
+      .skipped_ranges = 2};
+  EXPECT_EQ(FormatLayoutCacheSimulationStats(stats),
+            "replayed ranges: 100 (skipped 2)\n"
+            "l1i_accesses: 200 -> 200 (+0, +0.00%)\n"
+            "l1i_misses: 40 -> 30 (-10, -25.00%)\n"
+            "l2_misses: 4 -> 5 (+1, +25.00%)\n"
+            "itlb_accesses: 10 -> 8 (-2, -20.00%)\n"
+            "itlb_misses: 0 -> 1 (+1)\n");
+}
+}  // namespace
+}  // namespace propeller
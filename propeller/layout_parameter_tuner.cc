@@ -0,0 +1,404 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/layout_parameter_tuner.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <limits>
+#include <optional>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/Parallel.h"
+#include "propeller/bb_handle.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_node.h"
+#include "propeller/code_layout.h"
+#include "propeller/code_layout_scorer.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/layout_cache_simulator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+namespace {
+// A numeric code layout parameter which is searched by the tuner.
+struct TunableParameter {
+  absl::string_view name;
+  uint32_t (*get)(const PropellerCodeLayoutParameters &);
+  void (*set)(uint32_t, PropellerCodeLayoutParameters &);
+};
+
+constexpr TunableParameter kTunableParameters[] = {
+    {"fallthrough_weight",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.fallthrough_weight();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_fallthrough_weight(v);
+     }},
+    {"forward_jump_weight",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.forward_jump_weight();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_forward_jump_weight(v);
+     }},
+    {"backward_jump_weight",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.backward_jump_weight();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_backward_jump_weight(v);
+     }},
+    {"forward_jump_distance",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.forward_jump_distance();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_forward_jump_distance(v);
+     }},
+    {"backward_jump_distance",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.backward_jump_distance();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_backward_jump_distance(v);
+     }},
+    {"chain_split_threshold",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.chain_split_threshold();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_chain_split_threshold(v);
+     }},
+    {"cluster_merge_size_threshold",
+     [](const PropellerCodeLayoutParameters &p) {
+       return p.cluster_merge_size_threshold();
+     },
+     [](uint32_t v, PropellerCodeLayoutParameters &p) {
+       p.set_cluster_merge_size_threshold(v);
+     }},
+};
+
+// Returns `value` scaled by `factor` and rounded. Positive values stay
+// positive, and zero can only be scaled up (to one).
+uint32_t ScaleValue(uint32_t value, double factor) {
+  if (value == 0) return factor > 1 ? 1 : 0;
+  return static_cast<uint32_t>(
+      std::clamp<double>(std::round(value * factor), 1,
+                         std::numeric_limits<uint32_t>::max()));
+}
+
+// Returns the address of every node placed in `layout`, relative to the start
+// of its section, along with the index of its section.
+absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+GetLayoutAddresses(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionChainInfo>>
+        &layout) {
+  absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>> addresses;
+  int section_index = 0;
+  for (const auto &[section_name, function_chain_infos] : layout) {
+    // Hot chains by their layout indices.
+    absl::btree_map<unsigned, std::pair<const ControlFlowGraph *,
+                                        const FunctionChainInfo::BbChain *>>
+        hot_chains;
+    // Functions by the layout indices of their cold parts.
+    absl::btree_map<unsigned, const ControlFlowGraph *> cold_parts;
+    for (const FunctionChainInfo &function_chain_info : function_chain_infos) {
+      const ControlFlowGraph *cfg =
+          program_cfg.GetCfgByIndex(function_chain_info.function_index);
+      CHECK_NE(cfg, nullptr);
+      for (const FunctionChainInfo::BbChain &chain :
+           function_chain_info.bb_chains) {
+        hot_chains.emplace(chain.layout_index, std::make_pair(cfg, &chain));
+      }
+      cold_parts.emplace(function_chain_info.cold_chain_layout_index, cfg);
+    }
+
+    uint64_t address = 0;
+    for (const auto &[layout_index, cfg_and_chain] : hot_chains) {
+      const auto &[cfg, chain] = cfg_and_chain;
+      for (const FullIntraCfgId &full_bb_id : chain->GetAllBbs()) {
+        const CFGNode &node = cfg->GetNodeById(full_bb_id.intra_cfg_id);
+        addresses.emplace(&node, std::make_pair(section_index, address));
+        address += node.size();
+      }
+    }
+    for (const auto &[cold_layout_index, cfg] : cold_parts) {
+      for (const auto &node : cfg->nodes()) {
+        if (addresses.contains(node.get())) continue;
+        addresses.emplace(node.get(), std::make_pair(section_index, address));
+        address += node->size();
+      }
+    }
+    ++section_index;
+  }
+  return addresses;
+}
+
+// Returns the extended TSP score of the layout given by `addresses`, under the
+// default code layout parameters.
+double ComputeExtTspScore(
+    const ProgramCfg &program_cfg,
+    const absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+        &addresses) {
+  const PropellerCodeLayoutScorer scorer(
+      PropellerCodeLayoutParameters::default_instance());
+  double score = 0;
+  for (const ControlFlowGraph *cfg : program_cfg.GetCfgs()) {
+    // Addresses in different sections are not comparable, but inter-section
+    // edges are not scored.
+    const CFGScore cfg_score = ComputeCfgScore(
+        *cfg, scorer, [&](const CFGNode *node) -> std::optional<uint64_t> {
+          auto it = addresses.find(node);
+          if (it == addresses.end()) return std::nullopt;
+          return it->second.second;
+        });
+    score += cfg_score.intra_score + cfg_score.inter_out_score;
+  }
+  return score;
+}
+
+// Returns the fraction of the total heat (frequency times bytes) of the
+// layout given by `addresses` which falls into the `num_blocks` hottest
+// aligned blocks of `block_size` bytes.
+double ComputeHeatCoverage(
+    const absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+        &addresses,
+    int block_size, int num_blocks) {
+  CHECK_GT(block_size, 0);
+  absl::flat_hash_map<std::pair<int, uint64_t>, double> heat_by_block;
+  double total_heat = 0;
+  for (const auto &[node, section_and_address] : addresses) {
+    const auto &[section_index, address] = section_and_address;
+    int frequency = node->CalculateFrequency();
+    if (frequency == 0 || node->size() == 0) continue;
+    uint64_t end_address = address + node->size();
+    for (uint64_t block = address / block_size;
+         block * block_size < end_address; ++block) {
+      uint64_t overlap =
+          std::min<uint64_t>(end_address, (block + 1) * block_size) -
+          std::max<uint64_t>(address, block * block_size);
+      heat_by_block[{section_index, block}] +=
+          static_cast<double>(frequency) * overlap;
+    }
+    total_heat += static_cast<double>(frequency) * node->size();
+  }
+  if (total_heat == 0) return 0;
+  std::vector<double> heats;
+  heats.reserve(heat_by_block.size());
+  for (const auto &[block, heat] : heat_by_block) heats.push_back(heat);
+  size_t num_covered =
+      std::min<size_t>(std::max(num_blocks, 0), heats.size());
+  absl::c_nth_element(heats, heats.begin() + num_covered,
+                      std::greater<double>());
+  double covered_heat = 0;
+  for (size_t i = 0; i < num_covered; ++i) covered_heat += heats[i];
+  return covered_heat / total_heat;
+}
+
+// Returns the address of every element of `address_mapper.bb_handles()` in the
+// layout given by `addresses`. The sections are placed back to back from the
+// address of the first block, followed by the blocks which are not in the
+// layout in their original order.
+std::vector<uint64_t> GetBbHandleAddresses(
+    const ProgramCfg &program_cfg, const BinaryAddressMapper &address_mapper,
+    const absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+        &addresses) {
+  std::vector<uint64_t> section_sizes;
+  for (const auto &[node, section_and_address] : addresses) {
+    const auto &[section_index, address] = section_and_address;
+    if (section_index >= section_sizes.size())
+      section_sizes.resize(section_index + 1);
+    section_sizes[section_index] =
+        std::max(section_sizes[section_index], address + node->size());
+  }
+  const std::vector<BbHandle> &bb_handles = address_mapper.bb_handles();
+  uint64_t address =
+      bb_handles.empty() ? 0 : address_mapper.GetAddress(bb_handles.front());
+  std::vector<uint64_t> section_addresses;
+  for (uint64_t section_size : section_sizes) {
+    section_addresses.push_back(address);
+    address += section_size;
+  }
+
+  std::vector<uint64_t> new_addresses(bb_handles.size());
+  for (int i = 0; i < bb_handles.size(); ++i) {
+    auto it = addresses.end();
+    const ControlFlowGraph *cfg =
+        program_cfg.GetCfgByIndex(bb_handles[i].function_index);
+    std::optional<FlatBbHandle> flat_bb_handle =
+        address_mapper.GetFlatBbHandle(bb_handles[i]);
+    if (cfg != nullptr && flat_bb_handle.has_value()) {
+      it = addresses.find(
+          &cfg->GetNodeById({.bb_index = flat_bb_handle->flat_bb_index}));
+    }
+    if (it != addresses.end()) {
+      const auto &[section_index, section_address] = it->second;
+      new_addresses[i] = section_addresses[section_index] + section_address;
+      continue;
+    }
+    new_addresses[i] = address;
+    address += address_mapper.GetBBEntry(bb_handles[i]).Size;
+  }
+  return new_addresses;
+}
+
+// Returns the negated number of L1i and iTLB misses when replaying `trace`
+// over the layout given by `addresses`.
+double ComputeSimulatedCacheScore(
+    const ProgramCfg &program_cfg,
+    const absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+        &addresses,
+    const LayoutTuningTrace &trace) {
+  CHECK_NE(trace.address_mapper, nullptr);
+  const LayoutAddressTranslator translator = LayoutAddressTranslator::Create(
+      trace.address_mapper,
+      GetBbHandleAddresses(program_cfg, *trace.address_mapper, addresses));
+  absl::StatusOr<LayoutCacheSimulator> simulator =
+      LayoutCacheSimulator::Create(trace.cache_config,
+                                   /*original_translator=*/nullptr,
+                                   &translator);
+  CHECK_OK(simulator.status());
+  for (const BinaryAddressBranchPath &path : trace.paths)
+    simulator->Replay(path);
+  const InstructionCacheStats predicted = simulator->stats().predicted;
+  return -static_cast<double>(predicted.l1i_misses + predicted.itlb_misses);
+}
+}  // namespace
+
+absl::StatusOr<InstructionCacheConfig> GetLayoutTuningCacheConfig(
+    const LayoutTuningOptions &tuning_options) {
+  InstructionCacheConfig config;
+  config.l1i.line_size = tuning_options.cache_line_size();
+  config.l1i.size = static_cast<int64_t>(tuning_options.cache_line_size()) *
+                    tuning_options.cache_lines();
+  config.l2.line_size = tuning_options.cache_line_size();
+  config.itlb.line_size = tuning_options.page_size();
+  config.itlb.size = static_cast<int64_t>(tuning_options.page_size()) *
+                     tuning_options.tlb_entries();
+  RETURN_IF_ERROR(InstructionCacheSimulator::Create(config).status());
+  return config;
+}
+
+double ScoreLayout(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionChainInfo>>
+        &layout,
+    const LayoutTuningOptions &tuning_options,
+    const LayoutTuningTrace *trace) {
+  const absl::flat_hash_map<const CFGNode *, std::pair<int, uint64_t>>
+      addresses = GetLayoutAddresses(program_cfg, layout);
+  switch (tuning_options.objective()) {
+    case LayoutTuningOptions::CACHE_COVERAGE:
+    case LayoutTuningOptions::OBJECTIVE_UNSPECIFIED:
+      if (trace != nullptr)
+        return ComputeSimulatedCacheScore(program_cfg, addresses, *trace);
+      return ComputeHeatCoverage(addresses, tuning_options.cache_line_size(),
+                                 tuning_options.cache_lines()) +
+             ComputeHeatCoverage(addresses, tuning_options.page_size(),
+                                 tuning_options.tlb_entries());
+    case LayoutTuningOptions::EXT_TSP:
+      return ComputeExtTspScore(program_cfg, addresses);
+  }
+  LOG(FATAL) << "Unknown layout tuning objective: "
+             << tuning_options.objective();
+}
+
+LayoutTuningResult TuneCodeLayoutParameters(
+    const ProgramCfg &program_cfg,
+    const PropellerCodeLayoutParameters &initial_params,
+    const LayoutTuningOptions &tuning_options,
+    const LayoutTuningTrace *trace) {
+  // The layout of every candidate is released as soon as it is scored.
+  auto evaluate = [&](const PropellerCodeLayoutParameters &params) {
+    PropellerStats::CodeLayoutStats code_layout_stats;
+    return ScoreLayout(
+        program_cfg,
+        GenerateLayoutBySection(program_cfg, params, code_layout_stats),
+        tuning_options, trace);
+  };
+
+  LayoutTuningResult result = {.params = initial_params,
+                               .score = evaluate(initial_params),
+                               .num_evaluations = 1};
+  result.initial_score = result.score;
+  const int num_workers =
+      std::max(tuning_options.max_parallel_evaluations(), 1);
+  double step = tuning_options.initial_step();
+  for (int round = 0;
+       round < tuning_options.max_rounds() && step >= tuning_options.min_step();
+       ++round) {
+    std::vector<PropellerCodeLayoutParameters> candidates;
+    // Name of the parameter changed in each candidate.
+    std::vector<absl::string_view> candidate_parameter_names;
+    for (const TunableParameter &parameter : kTunableParameters) {
+      const uint32_t value = parameter.get(result.params);
+      for (double factor : {1 + step, 1 / (1 + step)}) {
+        const uint32_t scaled_value = ScaleValue(value, factor);
+        if (scaled_value == value) continue;
+        parameter.set(scaled_value, candidates.emplace_back(result.params));
+        candidate_parameter_names.push_back(parameter.name);
+      }
+    }
+    if (candidates.empty()) break;
+
+    // Lay out the candidates in parallel, with at most `num_workers` layouts
+    // in memory at a time. Ties are broken by the candidate order, so the
+    // result doesn't depend on the scheduling.
+    std::vector<double> scores(candidates.size());
+    std::atomic<size_t> next_candidate = 0;
+    llvm::parallelFor(
+        0, std::min<size_t>(num_workers, candidates.size()), [&](size_t) {
+          for (size_t i = next_candidate++; i < candidates.size();
+               i = next_candidate++) {
+            scores[i] = evaluate(candidates[i]);
+          }
+        });
+    result.num_evaluations += candidates.size();
+    const size_t best = absl::c_max_element(scores) - scores.begin();
+    if (scores[best] > result.score) {
+      LOG(INFO) << "Layout tuning round " << round << ": changing "
+                << candidate_parameter_names[best]
+                << " improves the score from " << result.score << " to "
+                << scores[best];
+      result.params = candidates[best];
+      result.score = scores[best];
+    } else {
+      step /= 2;
+    }
+  }
+  return result;
+}
+}  // namespace propeller
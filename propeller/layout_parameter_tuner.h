@@ -0,0 +1,90 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_LAYOUT_PARAMETER_TUNER_H_
+#define PROPELLER_LAYOUT_PARAMETER_TUNER_H_
+
+#include <vector>
+
+#include "absl/container/btree_map.h"
+#include "absl/status/statusor.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/layout_cache_simulator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+
+// Result of tuning the code layout parameters.
+struct LayoutTuningResult {
+  // Best parameters found.
+  PropellerCodeLayoutParameters params;
+  // Score of the layout generated with `params`.
+  double score = 0;
+  // Score of the layout generated with the initial parameters.
+  double initial_score = 0;
+  // Number of layouts generated and scored, including the initial one.
+  int num_evaluations = 0;
+};
+
+// LBR samples of the profiled program, which are replayed over the candidate
+// layouts by the `CACHE_COVERAGE` objective.
+struct LayoutTuningTrace {
+  // Maps the basic blocks of the program cfg's functions. Not owned.
+  const BinaryAddressMapper *address_mapper = nullptr;
+  // Sampled paths in binary addresses, with the branches of every path in
+  // execution order.
+  std::vector<BinaryAddressBranchPath> paths;
+  // Simulated caches, as returned by `GetLayoutTuningCacheConfig`.
+  InstructionCacheConfig cache_config;
+};
+
+// Returns the simulated instruction caches for the cache model of
+// `tuning_options`. The L1i cache and the iTLB have the sizes given by
+// `tuning_options`, and the default associativities of
+// `InstructionCacheConfig`. Returns an error if they can't be simulated.
+absl::StatusOr<InstructionCacheConfig> GetLayoutTuningCacheConfig(
+    const LayoutTuningOptions &tuning_options);
+
+// Returns the score of `layout` (as returned by `GenerateLayoutBySection`) for
+// `program_cfg` under `tuning_options.objective()`. Within each section, the
+// hot chains are placed in the order of their layout indices, followed by the
+// cold parts of the functions in the order of their cold chain layout indices.
+// The `CACHE_COVERAGE` objective replays `trace` if it is not null. Higher
+// scores are better.
+double ScoreLayout(
+    const ProgramCfg &program_cfg,
+    const absl::btree_map<llvm::StringRef, std::vector<FunctionChainInfo>>
+        &layout,
+    const LayoutTuningOptions &tuning_options,
+    const LayoutTuningTrace *trace = nullptr);
+
+// Searches for the numeric code layout parameters (edge weights, jump
+// distances and thresholds) which maximize the layout score of `program_cfg`,
+// starting from `initial_params`. Runs a coordinate search: every round lays
+// out the program with each parameter scaled up and down by the current step
+// (in parallel) and moves to the best candidate if it improves the score, or
+// halves the step otherwise. The returned parameters never score lower than
+// `initial_params`. Does not take ownership of `trace`, which may be null.
+LayoutTuningResult TuneCodeLayoutParameters(
+    const ProgramCfg &program_cfg,
+    const PropellerCodeLayoutParameters &initial_params,
+    const LayoutTuningOptions &tuning_options,
+    const LayoutTuningTrace *trace = nullptr);
+}  // namespace propeller
+
+#endif  // PROPELLER_LAYOUT_PARAMETER_TUNER_H_
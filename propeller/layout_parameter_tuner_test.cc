@@ -0,0 +1,208 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/layout_parameter_tuner.h"
+
+#include <memory>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/Object/ELFTypes.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/cfg_edge_kind.h"
+#include "propeller/cfg_testutil.h"
+#include "propeller/code_layout.h"
+#include "propeller/layout_cache_simulator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::StatusIs;
+using ::llvm::object::BBAddrMap;
+using ::testing::AllOf;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::Le;
+
+// Returns a program with a hot loop between blocks 1 and 3 of "foo", which
+// calls "bar" from block 2.
+std::unique_ptr<ProgramCfg> GetProgramCfg() {
+  return std::make_unique<ProgramCfg>(
+      TestCfgBuilder(
+          {.cfg_args = {{".text",
+                         0,
+                         "foo",
+                         {{0x1000, 0, 0x10},
+                          {0x1010, 1, 0x7},
+                          {0x1020, 2, 0x30},
+                          {0x1050, 3, 0x4},
+                          {0x1054, 4, 0x8}},
+                         {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough},
+                          {0, 2, 1, CFGEdgeKind::kBranchOrFallthough},
+                          {1, 3, 95, CFGEdgeKind::kBranchOrFallthough},
+                          {2, 3, 1, CFGEdgeKind::kBranchOrFallthough},
+                          {3, 1, 100, CFGEdgeKind::kBranchOrFallthough},
+                          {3, 4, 11, CFGEdgeKind::kBranchOrFallthough}}},
+                        {".text",
+                         1,
+                         "bar",
+                         {{0x2000, 0, 0x20}, {0x2020, 1, 0x10}},
+                         {{0, 1, 1, CFGEdgeKind::kBranchOrFallthough}}}},
+           .inter_edge_args = {{0, 2, 1, 0, 1, CFGEdgeKind::kCall},
+                               {1, 1, 0, 2, 1, CFGEdgeKind::kRet}}})
+          .Build());
+}
+
+TEST(LayoutParameterTunerTest, ScoresExtTspOfLayout) {
+  std::unique_ptr<ProgramCfg> program_cfg = GetProgramCfg();
+  PropellerCodeLayoutParameters params;
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  auto layout =
+      GenerateLayoutBySection(*program_cfg, params, code_layout_stats);
+  double optimized_score = 0;
+  for (const FunctionChainInfo &function_chain_info : layout.at(".text")) {
+    optimized_score += function_chain_info.optimized_score.intra_score +
+                       function_chain_info.optimized_score.inter_out_score;
+  }
+  LayoutTuningOptions tuning_options;
+  tuning_options.set_objective(LayoutTuningOptions::EXT_TSP);
+  EXPECT_DOUBLE_EQ(ScoreLayout(*program_cfg, layout, tuning_options),
+                   optimized_score);
+}
+
+TEST(LayoutParameterTunerTest, ScoresCacheCoverage) {
+  std::unique_ptr<ProgramCfg> program_cfg = GetProgramCfg();
+  PropellerCodeLayoutParameters params;
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  auto layout =
+      GenerateLayoutBySection(*program_cfg, params, code_layout_stats);
+  LayoutTuningOptions tuning_options;
+  // All the code fits in the cache and the tlb.
+  EXPECT_DOUBLE_EQ(ScoreLayout(*program_cfg, layout, tuning_options), 2);
+  // Only the hottest line fits in the cache.
+  tuning_options.set_cache_lines(1);
+  EXPECT_THAT(ScoreLayout(*program_cfg, layout, tuning_options),
+              AllOf(Gt(1), Le(2)));
+}
+
+TEST(LayoutParameterTunerTest, ReplaysTraceOverLayout) {
+  std::unique_ptr<ProgramCfg> program_cfg = GetProgramCfg();
+  LayoutTuningOptions tuning_options;
+  ASSERT_OK_AND_ASSIGN(InstructionCacheConfig cache_config,
+                       GetLayoutTuningCacheConfig(tuning_options));
+  const BinaryAddressMapper address_mapper(
+      /*selected_functions=*/{0, 1}, /*bb_addr_map=*/
+      {{{{.BaseAddress = 0x1000,
+          .BBEntries = {BBAddrMap::BBEntry(/*ID=*/0, /*Offset=*/0,
+                                           /*Size=*/0x10, /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/1, /*Offset=*/0x10,
+                                           /*Size=*/0x7, /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/2, /*Offset=*/0x20,
+                                           /*Size=*/0x30, /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/3, /*Offset=*/0x50,
+                                           /*Size=*/0x4, /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/4, /*Offset=*/0x54,
+                                           /*Size=*/0x8, /*Metadata=*/{})}}}},
+       {{{.BaseAddress = 0x2000,
+          .BBEntries = {BBAddrMap::BBEntry(/*ID=*/0, /*Offset=*/0,
+                                           /*Size=*/0x20, /*Metadata=*/{}),
+                        BBAddrMap::BBEntry(/*ID=*/1, /*Offset=*/0x20,
+                                           /*Size=*/0x10,
+                                           /*Metadata=*/{})}}}}},
+      /*bb_handles=*/
+      {{.function_index = 0, .bb_index = 0},
+       {.function_index = 0, .bb_index = 1},
+       {.function_index = 0, .bb_index = 2},
+       {.function_index = 0, .bb_index = 3},
+       {.function_index = 0, .bb_index = 4},
+       {.function_index = 1, .bb_index = 0},
+       {.function_index = 1, .bb_index = 1}},
+      /*symbol_info_map=*/{});
+  // Runs the loop between blocks 1 and 3 of "foo", which are in different
+  // cache lines of the original binary.
+  const LayoutTuningTrace trace = {
+      .address_mapper = &address_mapper,
+      .paths = {{.branches = {{.from = 0x1053, .to = 0x1010},
+                              {.from = 0x1016, .to = 0x1050},
+                              {.from = 0x1053, .to = 0x1010}}}},
+      .cache_config = cache_config};
+
+  PropellerCodeLayoutParameters params;
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  auto layout =
+      GenerateLayoutBySection(*program_cfg, params, code_layout_stats);
+  // The loop is in one cache line and one page of the layout.
+  EXPECT_DOUBLE_EQ(ScoreLayout(*program_cfg, layout, tuning_options, &trace),
+                   -2);
+
+  LayoutTuningResult result = TuneCodeLayoutParameters(
+      *program_cfg, params, tuning_options, &trace);
+  EXPECT_DOUBLE_EQ(result.initial_score, -2);
+  EXPECT_THAT(result.score, Ge(result.initial_score));
+}
+
+TEST(LayoutParameterTunerTest, RejectsInvalidCacheModel) {
+  LayoutTuningOptions tuning_options;
+  tuning_options.set_cache_line_size(48);
+  EXPECT_THAT(GetLayoutTuningCacheConfig(tuning_options),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(LayoutParameterTunerTest, NeverWorsensScore) {
+  std::unique_ptr<ProgramCfg> program_cfg = GetProgramCfg();
+  PropellerCodeLayoutParameters initial_params;
+  initial_params.set_fallthrough_weight(1);
+  initial_params.set_forward_jump_distance(1);
+  initial_params.set_backward_jump_distance(1);
+  LayoutTuningOptions tuning_options;
+  tuning_options.set_max_rounds(4);
+
+  LayoutTuningResult result =
+      TuneCodeLayoutParameters(*program_cfg, initial_params, tuning_options);
+  EXPECT_THAT(result.score, Ge(result.initial_score));
+  EXPECT_GT(result.num_evaluations, 1);
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  EXPECT_DOUBLE_EQ(
+      ScoreLayout(*program_cfg,
+                  GenerateLayoutBySection(*program_cfg, result.params,
+                                          code_layout_stats),
+                  tuning_options),
+      result.score);
+}
+
+TEST(LayoutParameterTunerTest, IsDeterministic) {
+  std::unique_ptr<ProgramCfg> program_cfg = GetProgramCfg();
+  LayoutTuningOptions tuning_options;
+  tuning_options.set_cache_lines(1);
+
+  LayoutTuningResult result = TuneCodeLayoutParameters(
+      *program_cfg, PropellerCodeLayoutParameters(), tuning_options);
+  // Evaluating one candidate at a time doesn't change the result.
+  tuning_options.set_max_parallel_evaluations(1);
+  LayoutTuningResult other_result = TuneCodeLayoutParameters(
+      *program_cfg, PropellerCodeLayoutParameters(), tuning_options);
+  EXPECT_EQ(result.params.SerializeAsString(),
+            other_result.params.SerializeAsString());
+  EXPECT_EQ(result.score, other_result.score);
+  EXPECT_EQ(result.num_evaluations, other_result.num_evaluations);
+}
+}  // namespace
+}  // namespace propeller
@@ -82,9 +82,8 @@ std::unique_ptr<CFGNode> CreateNodeFromNodePb(int function_index,
       /*metadata=*/ConvertFromPb(nodepb.metadata()),
       /*function_index=*/function_index);
 }
+}  // namespace
 
-// Creates control flow graphs from protobuf.
-// Calls `CalculateNodeFreqs` after creating the cfgs.
 std::unique_ptr<ProtoProgramCfg> BuildFromCfgProto(
     const ProgramCfgPb &program_cfg_pb) {
   absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs;
@@ -139,7 +138,6 @@ std::unique_ptr<ProtoProgramCfg> BuildFromCfgProto(
   return std::make_unique<ProtoProgramCfg>(std::move(bump_ptr_allocator),
                                            std::move(cfgs));
 }
-}  // namespace
 
 absl::StatusOr<std::unique_ptr<ProtoProgramCfg>> BuildFromCfgProtoPath(
     const std::string &path_to_cfg_proto) {
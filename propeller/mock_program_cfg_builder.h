@@ -23,6 +23,7 @@
 #include "absl/status/statusor.h"
 #include "llvm/Support/Allocator.h"
 #include "propeller/cfg.h"
+#include "propeller/cfg.pb.h"
 #include "propeller/cfg_testutil.h"
 #include "propeller/program_cfg.h"
 
@@ -44,6 +45,10 @@ class ProtoProgramCfg {
   std::unique_ptr<llvm::BumpPtrAllocator> bump_ptr_allocator_;
 };
 
+// Constructs and returns a `ProtoProgramCfg` from `program_cfg_pb`.
+std::unique_ptr<ProtoProgramCfg> BuildFromCfgProto(
+    const ProgramCfgPb &program_cfg_pb);
+
 // Constructs and returns a `ProtoProgramCfg` from a a protobuf file stored in
 // `path_to_cfg_proto`.
 absl::StatusOr<std::unique_ptr<ProtoProgramCfg>> BuildFromCfgProtoPath(
@@ -15,6 +15,7 @@
 #include "propeller/node_chain_builder.h"
 
 #include <memory>
+#include <optional>
 #include <tuple>
 #include <utility>
 #include <vector>
@@ -23,6 +24,8 @@
 #include "absl/container/btree_map.h"
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/statusor.h"
@@ -205,7 +208,65 @@ std::vector<std::vector<const CFGNode *>> GetForcedPaths(
   return paths;
 }
 
+absl::flat_hash_set<const CFGNode *> NodeChainBuilder::GetRelayoutNodes(
+    const ControlFlowGraph &cfg,
+    absl::Span<const std::vector<std::vector<const CFGNode *>>> node_chains)
+    const {
+  absl::flat_hash_set<const CFGNode *> relayout_nodes;
+  auto it = relayout_bb_indices_->find(cfg.function_index());
+  if (it == relayout_bb_indices_->end()) return relayout_nodes;
+  const absl::flat_hash_set<int> &bb_indices = it->second;
+  // Returns whether any node in `node_chain` satisfies `pred`.
+  auto has_node =
+      [](const std::vector<std::vector<const CFGNode *>> &node_chain,
+         absl::FunctionRef<bool(const CFGNode *)> pred) {
+        return absl::c_any_of(node_chain, [&](const auto &bundle_nodes) {
+          return absl::c_any_of(bundle_nodes, pred);
+        });
+      };
+  auto insert_nodes =
+      [&](const std::vector<std::vector<const CFGNode *>> &node_chain) {
+        for (const auto &bundle_nodes : node_chain)
+          relayout_nodes.insert(bundle_nodes.begin(), bundle_nodes.end());
+      };
+  // The relayout blocks (including their clones) and their chains.
+  for (const std::unique_ptr<CFGNode> &node : cfg.nodes()) {
+    if (bb_indices.contains(node->bb_index()))
+      relayout_nodes.insert(node.get());
+  }
+  std::vector<bool> is_relayout_chain(node_chains.size(), false);
+  for (int i = 0; i < node_chains.size(); ++i) {
+    is_relayout_chain[i] =
+        has_node(node_chains[i], [&](const CFGNode *node) {
+          return bb_indices.contains(node->bb_index());
+        });
+    if (is_relayout_chain[i]) insert_nodes(node_chains[i]);
+  }
+  // The nodes connected to the relayout chains and their chains.
+  absl::flat_hash_set<const CFGNode *> neighbor_nodes;
+  for (const CFGNode *node : relayout_nodes) {
+    node->ForEachOutEdgeRef([&](const CFGEdge &edge) {
+      if (ShouldVisitEdge(edge)) neighbor_nodes.insert(edge.sink());
+    });
+    node->ForEachInEdgeRef([&](const CFGEdge &edge) {
+      if (ShouldVisitEdge(edge)) neighbor_nodes.insert(edge.src());
+    });
+  }
+  for (int i = 0; i < node_chains.size(); ++i) {
+    if (is_relayout_chain[i]) continue;
+    if (has_node(node_chains[i], [&](const CFGNode *node) {
+          return neighbor_nodes.contains(node);
+        })) {
+      insert_nodes(node_chains[i]);
+    }
+  }
+  relayout_nodes.insert(neighbor_nodes.begin(), neighbor_nodes.end());
+  return relayout_nodes;
+}
+
 void NodeChainBuilder::InitNodeChains() {
+  CHECK(!relayout_bb_indices_.has_value() || cfgs_.size() == 1)
+      << "Relayout is only supported for a single CFG.";
   auto add_new_chain =
       [&](std::vector<std::vector<const CFGNode *>> chain_nodes) {
         if (chain_nodes.size() == 1 && chain_nodes[0].size() == 1) {
@@ -296,8 +357,10 @@ void NodeChainBuilder::InitNodeChains() {
     // When `split_functions=false`, build a chain for all the cold nodes so it
     // can be merged with the other nodes to build a single chain without
     // splitting the cold part.
+    // Cold nodes are never in the neighborhood of the relayout blocks, since
+    // chains are only connected by edges with nonzero weights.
     if (!code_layout_scorer_.code_layout_params().split_functions() &&
-        !cold_nodes_in_order.empty())
+        !relayout_bb_indices_.has_value() && !cold_nodes_in_order.empty())
       add_new_chain({std::move(cold_nodes_in_order)});
 
     // When `reorder_blocks=false`, build a single chain for all hot nodes to
@@ -311,7 +374,9 @@ void NodeChainBuilder::InitNodeChains() {
       continue;
     }
     // Construct the initial chains if requested.
+    std::vector<std::vector<std::vector<const CFGNode *>>> node_chains;
     if (!cfg_initial_chains.empty()) {
+      node_chains.reserve(cfg_initial_chains.size());
       for (const auto &chain : cfg_initial_chains) {
         std::vector<std::vector<const CFGNode *>> node_chain;
         node_chain.reserve(chain.bb_bundles.size());
@@ -325,17 +390,32 @@ void NodeChainBuilder::InitNodeChains() {
         }
         CHECK(!node_chain.empty());
         // These chains won't be bundled (They can be split later).
-        add_new_chain(std::move(node_chain));
+        node_chains.push_back(std::move(node_chain));
       }
     } else {
       // Construct bundled node chains for the paths.
-      for (auto &path : GetForcedPaths(*cfg)) add_new_chain({std::move(path)});
+      for (auto &path : GetForcedPaths(*cfg))
+        node_chains.push_back({std::move(path)});
+    }
+
+    // Only build the chains in the neighborhood of the relayout blocks, if
+    // requested.
+    std::optional<absl::flat_hash_set<const CFGNode *>> relayout_nodes;
+    if (relayout_bb_indices_.has_value())
+      relayout_nodes = GetRelayoutNodes(*cfg, node_chains);
+    auto is_relayout_node = [&](const CFGNode *node) {
+      return !relayout_nodes.has_value() || relayout_nodes->contains(node);
+    };
+    for (auto &node_chain : node_chains) {
+      if (!is_relayout_node(node_chain.front().front())) continue;
+      add_new_chain(std::move(node_chain));
     }
 
     // Make single-node chains for the remaining hot nodes.
     for (const CFGNode *node : hot_nodes_in_order) {
       if (node_to_bundle_mapper_->GetBundleMappingEntry(node).bundle != nullptr)
         continue;
+      if (!is_relayout_node(node)) continue;
       add_new_chain({{node}});
     }
   }
@@ -352,8 +432,10 @@ std::vector<std::unique_ptr<NodeChain>> NodeChainBuilder::BuildChains() {
     MergeChains(node_chain_assemblies_->GetBestAssembly());
   }
 
-  // Merge all chains into a if we only have a single cfg.
-  if (cfgs_.size() == 1) CoalesceChains();
+  // Merge all chains into a if we only have a single cfg. The chains built
+  // for the neighborhood of the relayout blocks are not coalesced as they don't
+  // cover the cfg.
+  if (cfgs_.size() == 1 && !relayout_bb_indices_.has_value()) CoalesceChains();
 
   std::vector<std::unique_ptr<NodeChain>> chains;
   chains.reserve(chains_.size());
@@ -419,6 +501,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
         if (!ShouldVisitEdge(edge)) return;
         const CFGNodeBundle *sink_node_bundle =
             node_to_bundle_mapper_->GetBundleMappingEntry(edge.sink()).bundle;
+        // Ignore edges to nodes outside the neighborhood of the relayout
+        // blocks.
+        if (sink_node_bundle == nullptr) return;
         if (sink_node_bundle->chain_mapping().chain->id() != split_chain.id())
           return;
         if (sink_node_bundle->nodes().front() != edge.sink()) return;
@@ -432,6 +517,9 @@ void NodeChainBuilder::UpdateNodeChainAssembly(NodeChain &split_chain,
         if (!ShouldVisitEdge(edge)) return;
         const CFGNodeBundle *src_node_bundle =
             node_to_bundle_mapper_->GetBundleMappingEntry(edge.src()).bundle;
+        // Ignore edges from nodes outside the neighborhood of the relayout
+        // blocks.
+        if (src_node_bundle == nullptr) return;
         if (src_node_bundle->chain_mapping().chain->id() != split_chain.id())
           return;
         if (src_node_bundle->nodes().back() != edge.src()) return;
@@ -494,6 +582,9 @@ void NodeChainBuilder::InitChainEdges() {
             node_to_bundle_mapper_->GetBundleMappingEntry(edge.src()).bundle;
         const CFGNodeBundle *sink_node_bundle =
             node_to_bundle_mapper_->GetBundleMappingEntry(edge.sink()).bundle;
+        // Ignore edges to nodes outside the neighborhood of the relayout
+        // blocks.
+        if (sink_node_bundle == nullptr) return;
         // Ignore edges running within the same bundle, as they won't be split.
         if (src_node_bundle == sink_node_bundle) return;
         NodeChain *sink_node_chain = sink_node_bundle->chain_mapping().chain;
@@ -508,11 +599,12 @@ void NodeChainBuilder::InitChainEdges() {
         else
           it->second.push_back(&edge);
       });
-      // Make sure that the intra-chain edges are sorted.
-      if (chain->node_bundles().size() > 1) {
-        chain->SortIntraChainEdges(*node_to_bundle_mapper_);
-      }
     });
+    // Make sure that the intra-chain edges are sorted. This sorts the edges of
+    // all bundles, so it is done once after all edges of the chain are added.
+    if (chain->node_bundles().size() > 1) {
+      chain->SortIntraChainEdges(*node_to_bundle_mapper_);
+    }
   }
   for (auto &[chain_id, chain] : chains_) {
     chain->SetScore(
@@ -17,6 +17,7 @@
 
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <set>
 #include <utility>
 #include <vector>
@@ -24,7 +25,9 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/btree_map.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
 #include "absl/log/check.h"
+#include "absl/types/span.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_id.h"
@@ -184,6 +187,18 @@ class NodeChainBuilder {
     return *node_chain_assemblies_;
   }
 
+  // Restricts chain building to the neighborhood of the blocks specified by
+  // `relayout_bb_indices` (as a map from function indexes to bb indexes). Only
+  // the initial chains which contain these blocks, and the initial chains
+  // having edges to or from those chains, are built and merged. Edges to and
+  // from the other nodes are ignored, and the built chains are not coalesced.
+  // This is only supported for a single CFG. Must be called before
+  // `InitNodeChains`.
+  void set_relayout_bb_indices(
+      absl::flat_hash_map<int, absl::flat_hash_set<int>> relayout_bb_indices) {
+    relayout_bb_indices_ = std::move(relayout_bb_indices);
+  }
+
   // This function initializes the chains and then iteratively constructs larger
   // chains by merging the best chains, to achieve the highest score.
   // Clients of this class must use this function after calling the constructor.
@@ -261,8 +276,17 @@ class NodeChainBuilder {
   void UpdateNodeChainAssembly(NodeChain &split_chain,
                                NodeChain &unsplit_chain);
 
+  // Returns the nodes of `cfg` in the neighborhood of `relayout_bb_indices_`:
+  // the nodes of the blocks and their clones, the nodes in the same chains of
+  // `node_chains` (the initial chains of `cfg`), and the nodes having edges to
+  // or from these nodes along with their chains.
+  absl::flat_hash_set<const CFGNode *> GetRelayoutNodes(
+      const ControlFlowGraph &cfg,
+      absl::Span<const std::vector<std::vector<const CFGNode *>>> node_chains)
+      const;
+
   // Returns whether `edge` should be considered in constructing the chains.
-  bool ShouldVisitEdge(const CFGEdge &edge) {
+  bool ShouldVisitEdge(const CFGEdge &edge) const {
     return edge.weight() != 0 && !edge.IsReturn() &&
            ((code_layout_scorer_.code_layout_params()
                  .inter_function_reordering() &&
@@ -292,6 +316,11 @@ class NodeChainBuilder {
   // Assembly (merge) candidates. This maps every pair of chains to its
   // (non-zero) merge score.
   std::unique_ptr<NodeChainAssemblyQueue> node_chain_assemblies_;
+
+  // Blocks whose neighborhood must be re-laid out, as a map from function
+  // indexes to bb indexes. `std::nullopt` means all chains are re-laid out.
+  std::optional<absl::flat_hash_map<int, absl::flat_hash_set<int>>>
+      relayout_bb_indices_;
 };
 
 // Returns vectors of nodes which form forced-fallthrough paths. These are
@@ -0,0 +1,133 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/path_buffer.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/log/check.h"
+#include "absl/time/time.h"
+#include "propeller/binary_address_mapper.h"
+
+namespace propeller {
+namespace {
+bool CompareSampleTimes(const FlatBbHandleBranchPath &lhs,
+                        const FlatBbHandleBranchPath &rhs) {
+  return lhs.sample_time < rhs.sample_time;
+}
+}  // namespace
+
+void PathBuffer::Bucket::Sort() {
+  if (sorted) return;
+  std::stable_sort(paths.begin() + num_released, paths.end(),
+                   CompareSampleTimes);
+  sorted = true;
+}
+
+void PathBuffer::Bucket::Clear() {
+  paths.clear();
+  num_released = 0;
+  sorted = true;
+  min_sample_time = absl::InfiniteFuture();
+}
+
+PathBuffer::PathBuffer(absl::Duration bucket_width, int num_buckets)
+    : bucket_width_(std::max(bucket_width, absl::Nanoseconds(1))),
+      ring_(num_buckets) {
+  CHECK_GT(num_buckets, 0);
+}
+
+absl::Duration PathBuffer::GetTimeSpan() const {
+  if (empty()) return absl::ZeroDuration();
+  for (int64_t bucket_number = first_bucket_number_;; ++bucket_number) {
+    const Bucket &bucket = GetBucket(bucket_number);
+    if (bucket.num_unreleased() != 0)
+      return max_sample_time_ - bucket.min_sample_time;
+  }
+}
+
+std::vector<FlatBbHandleBranchPath> PathBuffer::GetPaths() const {
+  std::vector<FlatBbHandleBranchPath> paths;
+  paths.reserve(size_);
+  for (int i = 0; i < ring_.size(); ++i) {
+    const Bucket &bucket = GetBucket(first_bucket_number_ + i);
+    auto bucket_begin = paths.insert(
+        paths.end(), bucket.paths.begin() + bucket.num_released,
+        bucket.paths.end());
+    if (!bucket.sorted)
+      std::stable_sort(bucket_begin, paths.end(), CompareSampleTimes);
+  }
+  return paths;
+}
+
+void PathBuffer::Add(const FlatBbHandleBranchPath &path, PathHandler handler) {
+  if (!origin_.has_value()) origin_ = path.sample_time;
+  absl::Duration remainder;
+  int64_t bucket_number = std::max(
+      first_bucket_number_,
+      absl::IDivDuration(path.sample_time - *origin_, bucket_width_,
+                         &remainder));
+  if (empty()) first_bucket_number_ = bucket_number;
+  int64_t num_buckets = ring_.size();
+  if (bucket_number - first_bucket_number_ >= num_buckets)
+    ReleaseBucketsBefore(bucket_number - num_buckets + 1, handler);
+
+  Bucket &bucket = GetBucket(bucket_number);
+  if (bucket.num_unreleased() != 0 &&
+      path.sample_time < bucket.paths.back().sample_time) {
+    bucket.sorted = false;
+  }
+  bucket.paths.push_back(path);
+  bucket.min_sample_time = std::min(bucket.min_sample_time, path.sample_time);
+  max_sample_time_ = std::max(max_sample_time_, path.sample_time);
+  ++size_;
+}
+
+void PathBuffer::Release(int64_t num_paths, PathHandler handler) {
+  CHECK_LE(num_paths, size_);
+  while (num_paths != 0) {
+    Bucket &bucket = GetBucket(first_bucket_number_);
+    bucket.Sort();
+    int64_t num_to_release = std::min(num_paths, bucket.num_unreleased());
+    for (int64_t i = 0; i < num_to_release; ++i)
+      handler(bucket.paths[bucket.num_released + i]);
+    bucket.num_released += num_to_release;
+    size_ -= num_to_release;
+    num_paths -= num_to_release;
+    if (bucket.num_unreleased() != 0) {
+      bucket.min_sample_time = bucket.paths[bucket.num_released].sample_time;
+      continue;
+    }
+    bucket.Clear();
+    ++first_bucket_number_;
+  }
+  if (empty()) max_sample_time_ = absl::InfinitePast();
+}
+
+void PathBuffer::ReleaseBucketsBefore(int64_t end_bucket_number,
+                                      PathHandler handler) {
+  int64_t num_paths = 0;
+  for (int64_t bucket_number = first_bucket_number_;
+       bucket_number < end_bucket_number &&
+       bucket_number < first_bucket_number_ + ring_.size();
+       ++bucket_number) {
+    num_paths += GetBucket(bucket_number).num_unreleased();
+  }
+  Release(num_paths, handler);
+  first_bucket_number_ = std::max(first_bucket_number_, end_bucket_number);
+}
+}  // namespace propeller
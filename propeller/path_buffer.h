@@ -0,0 +1,111 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_PATH_BUFFER_H_
+#define PROPELLER_PATH_BUFFER_H_
+
+#include <cstdint>
+#include <optional>
+#include <vector>
+
+#include "absl/functional/function_ref.h"
+#include "absl/time/time.h"
+#include "propeller/binary_address_mapper.h"
+
+namespace propeller {
+
+// A time-bucketed ring buffer of `FlatBbHandleBranchPath`s. Paths are stored
+// in buckets covering consecutive ranges of `bucket_width` in sample time, in
+// the order they arrive, and are released to a handler in nondecreasing order
+// of their sample times. Every bucket is sorted at most once before its paths
+// are released (and only if its paths arrived out of order), and its storage is
+// reused for later buckets. Paths are never moved once stored.
+class PathBuffer {
+ public:
+  using PathHandler =
+      absl::FunctionRef<void(const propeller::FlatBbHandleBranchPath &)>;
+
+  // Constructs a buffer of `num_buckets` buckets, each covering `bucket_width`
+  // of sample time. The buffered paths span at most `num_buckets` buckets.
+  PathBuffer(absl::Duration bucket_width, int num_buckets);
+
+  PathBuffer(const PathBuffer &) = delete;
+  PathBuffer &operator=(const PathBuffer &) = delete;
+  PathBuffer(PathBuffer &&) = default;
+  PathBuffer &operator=(PathBuffer &&) = default;
+
+  int64_t size() const { return size_; }
+  bool empty() const { return size_ == 0; }
+
+  // Returns the difference between the maximum and minimum sample times of the
+  // buffered paths.
+  absl::Duration GetTimeSpan() const;
+
+  // Returns a copy of the buffered paths in nondecreasing order of their sample
+  // times.
+  std::vector<propeller::FlatBbHandleBranchPath> GetPaths() const;
+
+  // Stores a copy of `path` in the bucket for its sample time. Paths older than
+  // the oldest buffered bucket are stored in that bucket. If the bucket for
+  // `path` falls beyond the ring, releases the oldest buckets to `handler` to
+  // make room for it.
+  void Add(const propeller::FlatBbHandleBranchPath &path, PathHandler handler);
+
+  // Releases the `num_paths` oldest buffered paths to `handler` in
+  // nondecreasing order of their sample times.
+  void Release(int64_t num_paths, PathHandler handler);
+
+ private:
+  struct Bucket {
+    // Paths in this bucket in their order of arrival, unless `sorted`.
+    std::vector<propeller::FlatBbHandleBranchPath> paths;
+    // Number of paths at the front of `paths` which have been released.
+    int64_t num_released = 0;
+    // Whether the unreleased paths are sorted by their sample times.
+    bool sorted = true;
+    // Minimum sample time of the unreleased paths.
+    absl::Time min_sample_time = absl::InfiniteFuture();
+
+    int64_t num_unreleased() const { return paths.size() - num_released; }
+    // Sorts the unreleased paths by their sample times if they are not sorted.
+    void Sort();
+    // Clears the bucket, keeping the storage of `paths` for reuse.
+    void Clear();
+  };
+
+  Bucket &GetBucket(int64_t bucket_number) {
+    return ring_[bucket_number % ring_.size()];
+  }
+  const Bucket &GetBucket(int64_t bucket_number) const {
+    return ring_[bucket_number % ring_.size()];
+  }
+
+  // Releases all paths in the buckets numbered before `end_bucket_number`.
+  void ReleaseBucketsBefore(int64_t end_bucket_number, PathHandler handler);
+
+  absl::Duration bucket_width_;
+  std::vector<Bucket> ring_;
+  // Sample time of the first path ever stored, used as the start time of the
+  // bucket numbered zero.
+  std::optional<absl::Time> origin_;
+  // Number of the oldest bucket which may contain unreleased paths. Buckets
+  // numbered in [first_bucket_number_, first_bucket_number_ + ring_.size())
+  // live in the ring.
+  int64_t first_bucket_number_ = 0;
+  // Maximum sample time of the buffered paths.
+  absl::Time max_sample_time_ = absl::InfinitePast();
+  int64_t size_ = 0;
+};
+}  // namespace propeller
+#endif  // PROPELLER_PATH_BUFFER_H_
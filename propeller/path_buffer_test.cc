@@ -0,0 +1,86 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/path_buffer.h"
+
+#include <cstdint>
+#include <vector>
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/binary_address_mapper.h"
+
+namespace propeller {
+namespace {
+using ::testing::ElementsAre;
+using ::testing::IsEmpty;
+
+FlatBbHandleBranchPath MakePath(int64_t sample_time_millis) {
+  return {.pid = 1, .sample_time = absl::FromUnixMillis(sample_time_millis)};
+}
+
+std::vector<int64_t> GetSampleTimes(
+    const std::vector<FlatBbHandleBranchPath> &paths) {
+  std::vector<int64_t> sample_times;
+  for (const FlatBbHandleBranchPath &path : paths)
+    sample_times.push_back(absl::ToUnixMillis(path.sample_time));
+  return sample_times;
+}
+
+TEST(PathBufferTest, ReleasesPathsInSampleTimeOrder) {
+  std::vector<int64_t> released;
+  auto handler = [&](const FlatBbHandleBranchPath &path) {
+    released.push_back(absl::ToUnixMillis(path.sample_time));
+  };
+  PathBuffer buffer(absl::Milliseconds(100), /*num_buckets=*/4);
+  for (int64_t sample_time : {1010, 910, 1150, 1120, 1030})
+    buffer.Add(MakePath(sample_time), handler);
+  EXPECT_THAT(released, IsEmpty());
+  EXPECT_EQ(buffer.size(), 5);
+  EXPECT_EQ(buffer.GetTimeSpan(), absl::Milliseconds(240));
+  EXPECT_THAT(GetSampleTimes(buffer.GetPaths()),
+              ElementsAre(910, 1010, 1030, 1120, 1150));
+
+  buffer.Release(2, handler);
+  EXPECT_THAT(released, ElementsAre(910, 1010));
+  EXPECT_EQ(buffer.GetTimeSpan(), absl::Milliseconds(120));
+  // Paths older than the oldest bucket are stored in that bucket.
+  buffer.Add(MakePath(1000), handler);
+  buffer.Release(buffer.size(), handler);
+  EXPECT_THAT(released, ElementsAre(910, 1010, 1000, 1030, 1120, 1150));
+  EXPECT_TRUE(buffer.empty());
+  EXPECT_EQ(buffer.GetTimeSpan(), absl::ZeroDuration());
+}
+
+TEST(PathBufferTest, ReleasesOldestBucketsToMakeRoom) {
+  std::vector<int64_t> released;
+  auto handler = [&](const FlatBbHandleBranchPath &path) {
+    released.push_back(absl::ToUnixMillis(path.sample_time));
+  };
+  PathBuffer buffer(absl::Milliseconds(100), /*num_buckets=*/4);
+  for (int64_t sample_time : {1000, 1150, 1110, 1250, 1390})
+    buffer.Add(MakePath(sample_time), handler);
+  EXPECT_THAT(released, IsEmpty());
+  // The bucket for 1400 is four buckets after the oldest, so the oldest bucket
+  // is released.
+  buffer.Add(MakePath(1400), handler);
+  EXPECT_THAT(released, ElementsAre(1000));
+  // The bucket for 2000 is far beyond the ring, so all buckets are released.
+  buffer.Add(MakePath(2000), handler);
+  EXPECT_THAT(released, ElementsAre(1000, 1110, 1150, 1250, 1390, 1400));
+  EXPECT_THAT(GetSampleTimes(buffer.GetPaths()), ElementsAre(2000));
+}
+}  // namespace
+}  // namespace propeller
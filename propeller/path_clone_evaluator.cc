@@ -15,11 +15,13 @@
 #include "propeller/path_clone_evaluator.h"
 
 #include <algorithm>
+#include <cstddef>
 #include <memory>
 #include <optional>
 #include <utility>
 #include <vector>
 
+#include "absl/algorithm/container.h"
 #include "absl/base/nullability.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
@@ -28,17 +30,28 @@
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
 #include "propeller/bb_handle.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_node.h"
 #include "propeller/code_layout.h"
+#include "propeller/code_layout_scorer.h"
+#include "propeller/compact_path_trie.h"
 #include "propeller/function_chain_info.h"
+#include "propeller/node_chain.h"
+#include "propeller/node_chain_builder.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
+#include "propeller/progress_tracker.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
 #include "propeller/status_macros.h"  // Included for macros.
+#include "propeller/trace_recorder.h"
 
 namespace propeller {
 
@@ -63,8 +76,171 @@ double GetClonePenalty(const ControlFlowGraph &cfg,
   return total_icache_penalty * path_profile_options.icache_penalty_factor() +
          total_base_penalty * path_profile_options.base_penalty_factor();
 }
+
+// Builds the CFG from `cfg_builder` with only `paths_to_drop` dropped.
+std::unique_ptr<ControlFlowGraph> BuildCfgWithPathsDropped(
+    const CfgBuilder &cfg_builder,
+    std::vector<const PathNode *absl_nonnull> paths_to_drop) {
+  CfgBuilder cfg_builder_for_dropping_paths_with_missing_pred =
+      cfg_builder.Clone();
+  cfg_builder_for_dropping_paths_with_missing_pred.AddCfgChange(
+      {.paths_to_drop = std::move(paths_to_drop)});
+  return std::move(cfg_builder_for_dropping_paths_with_missing_pred).Build();
+}
+
+// Returns the indices of the blocks whose incoming or outgoing edges are
+// rerouted by `cfg_change`.
+absl::flat_hash_set<int> GetRerouteBbIndices(
+    const CfgChangeFromPathCloning &cfg_change) {
+  absl::flat_hash_set<int> bb_indices;
+  for (const auto &intra_edge_reroute : cfg_change.intra_edge_reroutes) {
+    bb_indices.insert(intra_edge_reroute.src_bb_index);
+    bb_indices.insert(intra_edge_reroute.sink_bb_index);
+  }
+  return bb_indices;
+}
+
+// Returns the initial chains for `cfg` extracted from `chain_info`, broken
+// around the blocks in `bb_indices` (see the public `GetInitialChains`).
+std::vector<FunctionChainInfo::BbChain> GetInitialChains(
+    const ControlFlowGraph &cfg, const FunctionChainInfo &chain_info,
+    const absl::flat_hash_set<int> &bb_indices) {
+  CHECK_EQ(cfg.function_index(), chain_info.function_index);
+  std::vector<FunctionChainInfo::BbChain> all_chains;
+  for (const FunctionChainInfo::BbChain &bb_chain : chain_info.bb_chains) {
+    FunctionChainInfo::BbChain new_bb_chain(bb_chain.layout_index);
+    for (const auto &bundle : bb_chain.bb_bundles) {
+      new_bb_chain.bb_bundles.emplace_back();
+      for (const FullIntraCfgId &full_bb_id : bundle.full_bb_ids) {
+        CHECK(!new_bb_chain.bb_bundles.empty());
+        // Commit the current chain and skip this block if it's in the path.
+        if (bb_indices.contains(full_bb_id.intra_cfg_id.bb_index)) {
+          all_chains.push_back(std::move(new_bb_chain));
+          new_bb_chain = FunctionChainInfo::BbChain(bb_chain.layout_index);
+          new_bb_chain.bb_bundles.emplace_back();
+          continue;
+        }
+        // Simply insert the block in the chain if the chain is empty.
+        if (new_bb_chain.bb_bundles.back().full_bb_ids.empty()) {
+          new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
+          continue;
+        }
+        // Extend the current chain only if the previous block of the chain
+        // has an edge to this block.
+        if (!cfg.GetNodeById(new_bb_chain.bb_bundles.back()
+                                 .full_bb_ids.back()
+                                 .intra_cfg_id)
+                 .HasEdgeTo(cfg.GetNodeById(full_bb_id.intra_cfg_id),
+                            CFGEdgeKind::kBranchOrFallthough)) {
+          all_chains.push_back(std::move(new_bb_chain));
+          new_bb_chain = FunctionChainInfo::BbChain(bb_chain.layout_index);
+          new_bb_chain.bb_bundles.emplace_back();
+          new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
+          continue;
+        }
+        new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
+      }
+    }
+    all_chains.push_back(std::move(new_bb_chain));
+  }
+  all_chains.erase(
+      std::remove_if(all_chains.begin(), all_chains.end(),
+                     [](FunctionChainInfo::BbChain &chain) {
+                       chain.bb_bundles.erase(
+                           std::remove_if(
+                               chain.bb_bundles.begin(), chain.bb_bundles.end(),
+                               [](const FunctionChainInfo::BbBundle &bundle) {
+                                 return bundle.full_bb_ids.empty();
+                               }),
+                           chain.bb_bundles.end());
+                       return chain.bb_bundles.empty();
+                     }),
+      all_chains.end());
+  return all_chains;
+}
+
+// Returns the intra-function score of the layout computed for `cfg` starting
+// from the chains in `optimal_chain_info`, broken around the blocks in
+// `bb_indices`. If `local_relayout` is true, only the chains in the
+// neighborhood of those blocks are built and merged, and the sum of their
+// scores is returned instead. The chains outside the neighborhood are the same
+// for any two CFGs which only differ in the edges between these blocks, so the
+// difference between their local scores approximates the difference between
+// their full layout scores.
+double ComputeLayoutScore(
+    const ControlFlowGraph &cfg, const FunctionChainInfo &optimal_chain_info,
+    absl::flat_hash_set<int> bb_indices,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    bool local_relayout) {
+  absl::flat_hash_map<int, std::vector<FunctionChainInfo::BbChain>>
+      initial_chains;
+  initial_chains.emplace(cfg.function_index(),
+                         GetInitialChains(cfg, optimal_chain_info, bb_indices));
+  if (!local_relayout) {
+    return CodeLayout(code_layout_params, {&cfg}, std::move(initial_chains))
+        .OrderAll()
+        .front()
+        .optimized_score.intra_score;
+  }
+  PropellerStats::CodeLayoutStats stats;
+  NodeChainBuilder node_chain_builder =
+      NodeChainBuilder::CreateNodeChainBuilder(
+          PropellerCodeLayoutScorer(code_layout_params), {&cfg},
+          initial_chains, stats);
+  node_chain_builder.set_relayout_bb_indices(
+      {{cfg.function_index(), std::move(bb_indices)}});
+  double score = 0;
+  for (const std::unique_ptr<NodeChain> &chain :
+       node_chain_builder.BuildChains())
+    score += chain->score();
+  return score;
+}
 }  // namespace
 
+double ComputeBaselineScore(
+    const CfgBuilder &cfg_builder, const CfgChangeFromPathCloning &cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const FunctionChainInfo &optimal_chain_info, bool local_relayout) {
+  std::unique_ptr<ControlFlowGraph> cfg_with_paths_dropped =
+      BuildCfgWithPathsDropped(cfg_builder, cfg_change.paths_to_drop);
+  return ComputeLayoutScore(*cfg_with_paths_dropped, optimal_chain_info,
+                            GetRerouteBbIndices(cfg_change),
+                            code_layout_params, local_relayout);
+}
+
+double BaselineLayoutCache::GetBaselineScore(
+    const CfgBuilder &cfg_builder, const CfgChangeFromPathCloning &cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const FunctionChainInfo &optimal_chain_info, bool local_relayout) {
+  // Dropping paths and breaking chains around blocks are insensitive to their
+  // order and multiplicity, so we canonicalize both sets.
+  Key key;
+  key.first.assign(cfg_change.paths_to_drop.begin(),
+                   cfg_change.paths_to_drop.end());
+  absl::c_sort(key.first);
+  key.first.erase(std::unique(key.first.begin(), key.first.end()),
+                  key.first.end());
+  absl::flat_hash_set<int> reroute_bb_indices = GetRerouteBbIndices(cfg_change);
+  key.second.assign(reroute_bb_indices.begin(), reroute_bb_indices.end());
+  absl::c_sort(key.second);
+
+  if (auto it = scores_by_key_.find(key); it != scores_by_key_.end()) {
+    ++hits_;
+    return it->second;
+  }
+  ++misses_;
+  double score = ComputeBaselineScore(cfg_builder, cfg_change,
+                                      code_layout_params, optimal_chain_info,
+                                      local_relayout);
+  if (scores_by_key_.size() >= static_cast<size_t>(max_entries_)) {
+    scores_by_key_.erase(keys_in_insertion_order_.front());
+    keys_in_insertion_order_.pop_front();
+  }
+  scores_by_key_.emplace(key, score);
+  keys_in_insertion_order_.push_back(std::move(key));
+  return score;
+}
+
 absl::StatusOr<CfgChangeFromPathCloning> CfgChangeBuilder::Build() && {
   // Construct the CfgChangeFromPathCloning by tracing the cloning path.
   while (CurrentPathVisitStatus() != PathVisitStatus::kFinished) {
@@ -97,7 +273,7 @@ absl::StatusOr<CfgChangeFromPathCloning> CfgChangeBuilder::Build() && {
 absl::Status CfgChangeBuilder::AddEdgeReroute(
     CfgChangeFromPathCloning::IntraEdgeReroute edge_reroute) {
   if (edge_reroute.src_is_cloned) {
-    if (conflict_edges_.path_pred_edges.contains(
+    if (conflict_edges_.IsPathPredEdge(
             {.from_bb_index = edge_reroute.src_bb_index,
              .to_bb_index = edge_reroute.sink_bb_index})) {
       // If any of these affected edges were found to have been the path
@@ -108,7 +284,7 @@ absl::Status CfgChangeBuilder::AddEdgeReroute(
           "applied.");
     }
   } else {
-    if (conflict_edges_.affected_edges.contains(
+    if (conflict_edges_.IsAffectedEdge(
             {.from_bb_index = edge_reroute.src_bb_index,
              .to_bb_index = edge_reroute.sink_bb_index})) {
       // We can't confidently apply a cloning if its path predecessor edge has
@@ -245,52 +421,96 @@ absl::Status CfgChangeBuilder::VisitNext() {
   return absl::OkStatus();
 }
 
+double GetCloningScoreUpperBound(
+    const ControlFlowGraph &cfg, const PathCloning &path_cloning,
+    const CfgChangeFromPathCloning &cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const PathProfileOptions &path_profile_options) {
+  // Every block has at most one fallthrough successor. So we group the
+  // rerouted edges by their (possibly cloned) source blocks and allow only the
+  // heaviest edge in each group to be scored as a fallthrough.
+  struct OutWeights {
+    int total = 0;
+    int max = 0;
+  };
+  absl::flat_hash_map<std::pair<int, bool>, OutWeights> out_weights_by_src;
+  for (const CfgChangeFromPathCloning::IntraEdgeReroute &edge_reroute :
+       cfg_change.intra_edge_reroutes) {
+    if (edge_reroute.kind != CFGEdgeKind::kBranchOrFallthough) continue;
+    OutWeights &out_weights = out_weights_by_src[{edge_reroute.src_bb_index,
+                                                  edge_reroute.src_is_cloned}];
+    out_weights.total += edge_reroute.weight;
+    out_weights.max = std::max(out_weights.max, edge_reroute.weight);
+  }
+  const double max_jump_weight =
+      std::max(code_layout_params.forward_jump_weight(),
+               code_layout_params.backward_jump_weight());
+  const double max_edge_weight = std::max<double>(
+      code_layout_params.fallthrough_weight(), max_jump_weight);
+  double upper_bound = 0;
+  for (const auto &[src, out_weights] : out_weights_by_src) {
+    upper_bound += out_weights.max * max_edge_weight +
+                   (out_weights.total - out_weights.max) * max_jump_weight;
+  }
+  return upper_bound -
+         GetClonePenalty(cfg, path_profile_options, path_cloning);
+}
+
 absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
     const CfgBuilder &cfg_builder, const PathCloning &path_cloning,
     const PropellerCodeLayoutParameters &code_layout_params,
     const PathProfileOptions &path_profile_options, double min_score,
     const FunctionChainInfo &optimal_chain_info,
-    const FunctionPathProfile &function_path_profile) {
+    const FunctionPathProfile &function_path_profile,
+    BaselineLayoutCache *absl_nullable baseline_cache) {
+  ASSIGN_OR_RETURN(CfgChangeFromPathCloning cfg_change,
+                   CfgChangeBuilder(path_cloning, cfg_builder.conflict_edges(),
+                                    function_path_profile)
+                       .Build());
+  return EvaluateCloning(cfg_builder, path_cloning, std::move(cfg_change),
+                         code_layout_params, path_profile_options, min_score,
+                         optimal_chain_info, baseline_cache);
+}
+
+absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
+    const CfgBuilder &cfg_builder, const PathCloning &path_cloning,
+    CfgChangeFromPathCloning new_cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const PathProfileOptions &path_profile_options, double min_score,
+    const FunctionChainInfo &optimal_chain_info,
+    BaselineLayoutCache *absl_nullable baseline_cache) {
+  llvm::StringRef name = cfg_builder.cfg().GetPrimaryName();
+  ScopedTraceSpan trace_span("EvaluateCloning",
+                             absl::string_view(name.data(), name.size()),
+                             TraceSpanFrequency::kHigh);
+  ProgressTracker::Global().Increment(
+      ProgressTracker::Counter::kCloningsEvaluated);
   CHECK(!code_layout_params.call_chain_clustering());
   CHECK(!code_layout_params.inter_function_reordering());
   CHECK_EQ(optimal_chain_info.function_index,
            cfg_builder.cfg().function_index());
-  ASSIGN_OR_RETURN(CfgChangeFromPathCloning new_cfg_change,
-                   CfgChangeBuilder(path_cloning, cfg_builder.conflict_edges(),
-                                    function_path_profile)
-                       .Build());
   // To make a fair evaluation, we need to drop the paths with missing
-  // predecessors for both the original and cloned CFGs. So we first build a
-  // CFG with only the paths with missing predecessors dropped.
-  CfgBuilder cfg_builder_for_dropping_paths_with_missing_pred =
-      cfg_builder.Clone();
-  cfg_builder_for_dropping_paths_with_missing_pred.AddCfgChange(
-      {.paths_to_drop = new_cfg_change.paths_to_drop});
-
-  std::unique_ptr<ControlFlowGraph> cfg_with_paths_dropped =
-      std::move(cfg_builder_for_dropping_paths_with_missing_pred).Build();
-  FunctionChainInfo paths_dropped_chain_info =
-      CodeLayout(code_layout_params, {cfg_with_paths_dropped.get()},
-                 {{cfg_builder.cfg().function_index(),
-                   GetInitialChains(*cfg_with_paths_dropped, optimal_chain_info,
-                                    new_cfg_change)}})
-          .OrderAll()
-          .front();
+  // predecessors for both the original and cloned CFGs. So we compare against
+  // the layout of a CFG with only the paths with missing predecessors dropped.
+  double paths_dropped_score =
+      baseline_cache != nullptr
+          ? baseline_cache->GetBaselineScore(
+                cfg_builder, new_cfg_change, code_layout_params,
+                optimal_chain_info, path_profile_options.local_clone_relayout())
+          : ComputeBaselineScore(cfg_builder, new_cfg_change,
+                                 code_layout_params, optimal_chain_info,
+                                 path_profile_options.local_clone_relayout());
 
   CfgBuilder cfg_builder_for_cloning = cfg_builder.Clone();
   cfg_builder_for_cloning.AddCfgChange(new_cfg_change);
   std::unique_ptr<ControlFlowGraph> cfg_with_cloning =
       std::move(cfg_builder_for_cloning).Build();
-  FunctionChainInfo clone_chain_info =
-      CodeLayout(code_layout_params, {cfg_with_cloning.get()},
-                 {{cfg_builder.cfg().function_index(),
-                   GetInitialChains(*cfg_with_cloning, optimal_chain_info,
-                                    new_cfg_change)}})
-          .OrderAll()
-          .front();
   double score_gain =
-      clone_chain_info.optimized_score.intra_score -
-      paths_dropped_chain_info.optimized_score.intra_score -
+      ComputeLayoutScore(*cfg_with_cloning, optimal_chain_info,
+                         GetRerouteBbIndices(new_cfg_change),
+                         code_layout_params,
+                         path_profile_options.local_clone_relayout()) -
+      paths_dropped_score -
       GetClonePenalty(cfg_builder.cfg(), path_profile_options, path_cloning);
   if (score_gain < min_score) {
     return absl::FailedPreconditionError(
@@ -303,7 +523,7 @@ absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
 }
 
 void PathTreeCloneEvaluator::EvaluateCloningsForSubtree(
-    const PathNode &path_tree, int path_length,
+    const CompactPathNode &path_tree, int path_length,
     const absl::flat_hash_set<int> &path_preds_in_path,
     std::vector<EvaluatedPathCloning> &clonings,
     const FunctionPathProfile &function_path_profile) {
@@ -322,7 +542,8 @@ void PathTreeCloneEvaluator::EvaluateCloningsForSubtree(
   }
 
   std::optional<absl::flat_hash_set<int>> updated_path_preds_in_path;
-  if (path_tree.path_pred_info().entries.contains(path_tree.node_bb_index())) {
+  if (path_tree.path_pred_info().GetEntry(path_tree.node_bb_index()) !=
+      nullptr) {
     updated_path_preds_in_path = path_preds_in_path;
     updated_path_preds_in_path->insert(path_tree.node_bb_index());
   }
@@ -341,16 +562,15 @@ void PathTreeCloneEvaluator::EvaluateCloningsForSubtree(
   // branches as they can't be rewired.
   if (has_indirect_branch) return;
 
-  for (auto &[child_bb_index, child_path_node] : path_tree.children()) {
-    CHECK_NE(child_path_node, nullptr);
-    EvaluateCloningsForSubtree(*child_path_node, path_length + 1,
+  for (const CompactPathNode &child_path_node : path_tree.children()) {
+    EvaluateCloningsForSubtree(child_path_node, path_length + 1,
                                new_path_preds_in_path, clonings,
                                function_path_profile);
   }
 }
 
 void PathTreeCloneEvaluator::EvaluateCloningsForPath(
-    const PathNode &path_node,
+    const CompactPathNode &path_node,
     const absl::flat_hash_set<int> &path_preds_in_path,
     std::vector<EvaluatedPathCloning> &clonings,
     const FunctionPathProfile &function_path_profile) {
@@ -359,8 +579,11 @@ void PathTreeCloneEvaluator::EvaluateCloningsForPath(
   if (path_node.children().size() < 2 && !is_return_block) {
     return;
   }
-  for (const auto &[pred_bb_index, path_pred_info_entry] :
+  // The path node which the clonings refer to, looked up on first use.
+  const PathNode *cloning_path_node = nullptr;
+  for (const CompactPathPredInfoEntry &path_pred_info_entry :
        path_node.path_pred_info().entries) {
+    const int pred_bb_index = path_pred_info_entry.path_pred_bb_index;
     // We can't clone a path when the path predecessor has an indirect branch as
     // it can't be rewired.
     if (cfg_.nodes().at(pred_bb_index)->has_indirect_branch()) continue;
@@ -373,13 +596,34 @@ void PathTreeCloneEvaluator::EvaluateCloningsForPath(
                 path_pred_info_entry.freq) {
       continue;
     }
-    PathCloning cloning = {.path_node = &path_node,
+    if (cloning_path_node == nullptr) {
+      cloning_path_node = FindPathNode(function_path_profile, path_node);
+      CHECK_NE(cloning_path_node, nullptr);
+    }
+    PathCloning cloning = {.path_node = cloning_path_node,
                            .function_index = cfg_.function_index(),
                            .path_pred_bb_index = pred_bb_index};
+    CfgBuilder cfg_builder(&cfg_);
+    absl::StatusOr<CfgChangeFromPathCloning> cfg_change =
+        CfgChangeBuilder(cloning, cfg_builder.conflict_edges(),
+                         function_path_profile)
+            .Build();
+    if (!cfg_change.ok()) continue;
+    // Constructing the CFG change is cheap compared to building and laying out
+    // the CFGs. So we first check if the cloning can be profitable.
+    if (path_profile_options_.prune_clonings_by_score_upper_bound() &&
+        GetCloningScoreUpperBound(cfg_, cloning, *cfg_change,
+                                  code_layout_params_, path_profile_options_) <
+            path_profile_options_.min_initial_cloning_score()) {
+      ++n_clonings_pruned_;
+      continue;
+    }
+    ++n_clonings_evaluated_;
     absl::StatusOr<EvaluatedPathCloning> evaluated_cloning = EvaluateCloning(
-        CfgBuilder(&cfg_), cloning, code_layout_params_, path_profile_options_,
+        cfg_builder, cloning, *std::move(cfg_change), code_layout_params_,
+        path_profile_options_,
         path_profile_options_.min_initial_cloning_score(), optimal_chain_info_,
-        function_path_profile);
+        baseline_cache_);
     if (!evaluated_cloning.ok()) continue;
     clonings.push_back(std::move(*std::move(evaluated_cloning)));
   }
@@ -389,7 +633,8 @@ absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
     const ProgramCfg *program_cfg,
     const ProgramPathProfile *program_path_profile,
     const PropellerCodeLayoutParameters &code_layout_params,
-    const PathProfileOptions &path_profile_options) {
+    const PathProfileOptions &path_profile_options,
+    PropellerStats::CloningStats *absl_nullable cloning_stats) {
   CHECK(!code_layout_params.call_chain_clustering());
   CHECK(!code_layout_params.inter_function_reordering());
   LOG(INFO) << "Evaluating clonings...";
@@ -404,13 +649,28 @@ absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
                    /*initial_chains=*/{})
             .OrderAll()
             .front();
+    // All path trees of this function are evaluated against the same CFG and
+    // optimal layout, so they can share their baseline layouts.
+    BaselineLayoutCache baseline_cache;
+    // The path trees are only read from here on, so they are traversed in
+    // their compact form.
+    const CompactPathTrie path_trie(function_path_profile);
     auto &clonings = cloning_scores_by_function_index[function_index];
-    for (const auto &[root_bb_index, path_tree] :
-         function_path_profile.path_trees_by_root_bb_index()) {
-      PathTreeCloneEvaluator(cfg, &fast_response_original_optimal_chain_info,
-                             &path_profile_options, &code_layout_params)
-          .EvaluateCloningsForSubtree(*path_tree, /*path_length=*/1, {},
-                                      clonings, function_path_profile);
+    for (const CompactPathNode &path_tree : path_trie.path_trees()) {
+      PathTreeCloneEvaluator path_tree_clone_evaluator(
+          cfg, &fast_response_original_optimal_chain_info,
+          &path_profile_options, &code_layout_params, &baseline_cache);
+      path_tree_clone_evaluator.EvaluateCloningsForSubtree(
+          path_tree, /*path_length=*/1, {}, clonings, function_path_profile);
+      if (cloning_stats == nullptr) continue;
+      cloning_stats->clonings_evaluated +=
+          path_tree_clone_evaluator.n_clonings_evaluated();
+      cloning_stats->clonings_pruned_by_score_upper_bound +=
+          path_tree_clone_evaluator.n_clonings_pruned();
+    }
+    if (cloning_stats != nullptr) {
+      cloning_stats->baseline_layout_cache_hits += baseline_cache.hits();
+      cloning_stats->baseline_layout_cache_misses += baseline_cache.misses();
     }
   }
   return cloning_scores_by_function_index;
@@ -419,63 +679,7 @@ absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
 std::vector<FunctionChainInfo::BbChain> GetInitialChains(
     const ControlFlowGraph &cfg, const FunctionChainInfo &chain_info,
     const CfgChangeFromPathCloning &cfg_change) {
-  CHECK_EQ(cfg.function_index(), chain_info.function_index);
-  absl::flat_hash_set<int> bb_indices;
-  for (const auto &intra_edge_reroute : cfg_change.intra_edge_reroutes) {
-    bb_indices.insert(intra_edge_reroute.src_bb_index);
-    bb_indices.insert(intra_edge_reroute.sink_bb_index);
-  }
-  std::vector<FunctionChainInfo::BbChain> all_chains;
-  for (const FunctionChainInfo::BbChain &bb_chain : chain_info.bb_chains) {
-    FunctionChainInfo::BbChain new_bb_chain(bb_chain.layout_index);
-    for (const auto &bundle : bb_chain.bb_bundles) {
-      new_bb_chain.bb_bundles.emplace_back();
-      for (const FullIntraCfgId &full_bb_id : bundle.full_bb_ids) {
-        CHECK(!new_bb_chain.bb_bundles.empty());
-        // Commit the current chain and skip this block if it's in the path.
-        if (bb_indices.contains(full_bb_id.intra_cfg_id.bb_index)) {
-          all_chains.push_back(std::move(new_bb_chain));
-          new_bb_chain = FunctionChainInfo::BbChain(bb_chain.layout_index);
-          new_bb_chain.bb_bundles.emplace_back();
-          continue;
-        }
-        // Simply insert the block in the chain if the chain is empty.
-        if (new_bb_chain.bb_bundles.back().full_bb_ids.empty()) {
-          new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
-          continue;
-        }
-        // Extend the current chain only if the previous block of the chain
-        // has an edge to this block.
-        if (!cfg.GetNodeById(new_bb_chain.bb_bundles.back()
-                                 .full_bb_ids.back()
-                                 .intra_cfg_id)
-                 .HasEdgeTo(cfg.GetNodeById(full_bb_id.intra_cfg_id),
-                            CFGEdgeKind::kBranchOrFallthough)) {
-          all_chains.push_back(std::move(new_bb_chain));
-          new_bb_chain = FunctionChainInfo::BbChain(bb_chain.layout_index);
-          new_bb_chain.bb_bundles.emplace_back();
-          new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
-          continue;
-        }
-        new_bb_chain.bb_bundles.back().full_bb_ids.push_back(full_bb_id);
-      }
-    }
-    all_chains.push_back(std::move(new_bb_chain));
-  }
-  all_chains.erase(
-      std::remove_if(all_chains.begin(), all_chains.end(),
-                     [](FunctionChainInfo::BbChain &chain) {
-                       chain.bb_bundles.erase(
-                           std::remove_if(
-                               chain.bb_bundles.begin(), chain.bb_bundles.end(),
-                               [](const FunctionChainInfo::BbBundle &bundle) {
-                                 return bundle.full_bb_ids.empty();
-                               }),
-                           chain.bb_bundles.end());
-                       return chain.bb_bundles.empty();
-                     }),
-      all_chains.end());
-  return all_chains;
+  return GetInitialChains(cfg, chain_info, GetRerouteBbIndices(cfg_change));
 }
 
 }  // namespace propeller
@@ -15,6 +15,8 @@
 #ifndef PROPELLER_PATH_CLONE_EVALUATOR_H_
 #define PROPELLER_PATH_CLONE_EVALUATOR_H_
 
+#include <deque>
+#include <memory>
 #include <optional>
 #include <tuple>
 #include <utility>
@@ -29,11 +31,14 @@
 #include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "propeller/cfg.h"
+#include "propeller/cfg_id.h"
+#include "propeller/compact_path_trie.h"
 #include "propeller/function_chain_info.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
 #include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
 
 namespace propeller {
 
@@ -184,31 +189,133 @@ void AbslStringify(Sink &sink, const EvaluatedPathCloning &e) {
                e.score.has_value() ? absl::StrCat(*e.score) : "nullopt");
 }
 
+// Memoizes the baseline layout scores computed by `EvaluateCloning` for a
+// single CFG. The baseline of a cloning is the current layout of the CFG with
+// only its `paths_to_drop` dropped, seeded with the optimal chains broken
+// around the blocks rerouted by the cloning. So it only depends on the
+// (canonicalized) set of dropped paths and set of rerouted blocks, and is
+// shared by all clonings of the function which agree on both. At most
+// `max_entries` scores are kept, and the oldest ones are evicted first.
+//
+// A cache is only valid for a fixed `CfgBuilder` state, optimal chain info,
+// code layout parameters and relayout mode. It must be cleared whenever any of
+// them change.
+class BaselineLayoutCache {
+ public:
+  static constexpr int kDefaultMaxEntries = 1024;
+
+  explicit BaselineLayoutCache(int max_entries = kDefaultMaxEntries)
+      : max_entries_(max_entries) {
+    CHECK_GT(max_entries_, 0);
+  }
+
+  BaselineLayoutCache(const BaselineLayoutCache &) = delete;
+  BaselineLayoutCache &operator=(const BaselineLayoutCache &) = delete;
+  BaselineLayoutCache(BaselineLayoutCache &&) = default;
+  BaselineLayoutCache &operator=(BaselineLayoutCache &&) = default;
+
+  // Returns the baseline score of `cfg_change` for the CFG built by
+  // `cfg_builder` (see `ComputeBaselineScore`). Only computes the layout if
+  // the baseline for the same dropped paths and rerouted blocks is not cached.
+  double GetBaselineScore(
+      const CfgBuilder &cfg_builder, const CfgChangeFromPathCloning &cfg_change,
+      const PropellerCodeLayoutParameters &code_layout_params,
+      const FunctionChainInfo &optimal_chain_info, bool local_relayout);
+
+  // Drops all cached baselines. Hit and miss counts are preserved.
+  void Clear() {
+    scores_by_key_.clear();
+    keys_in_insertion_order_.clear();
+  }
+
+  // Number of baseline layouts which were served from the cache.
+  int hits() const { return hits_; }
+  // Number of baseline layouts which had to be computed.
+  int misses() const { return misses_; }
+
+ private:
+  // The sorted dropped paths and the sorted rerouted block indices.
+  using Key = std::pair<std::vector<const PathNode *>, std::vector<int>>;
+
+  int max_entries_;
+  absl::flat_hash_map<Key, double> scores_by_key_;
+  // Keys of `scores_by_key_` in insertion order, for eviction.
+  std::deque<Key> keys_in_insertion_order_;
+  int hits_ = 0;
+  int misses_ = 0;
+};
+
+// Returns the intra-function score of the baseline layout for `cfg_change`
+// applied to the CFG built by `cfg_builder`. The CFG is built with only the
+// paths in `cfg_change.paths_to_drop` dropped and laid out starting from the
+// chains in `optimal_chain_info`, broken around the blocks rerouted by
+// `cfg_change`, as for the layout of the cloned CFG. If `local_relayout` is
+// true, only the chains in the neighborhood of those blocks are built, and the
+// sum of their scores is returned instead.
+double ComputeBaselineScore(
+    const CfgBuilder &cfg_builder, const CfgChangeFromPathCloning &cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const FunctionChainInfo &optimal_chain_info, bool local_relayout);
+
+// Returns an analytic upper bound on the score gain of applying `cfg_change`
+// (constructed for `path_cloning`) to `cfg`, net of the clone penalty. Only the
+// rerouted intra-function edges can gain score from cloning: the heaviest
+// rerouted edge out of every block can at best become a fallthrough, and the
+// others can at best be zero-distance jumps. The bound holds for optimal
+// layouts and is used to discard clonings which cannot be profitable before
+// paying for their CFGs and layouts.
+double GetCloningScoreUpperBound(
+    const ControlFlowGraph &cfg, const PathCloning &path_cloning,
+    const CfgChangeFromPathCloning &cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const PathProfileOptions &path_profile_options);
+
 // Evaluates `path_cloning` for `cfg` and returns the evaluated path cloning.
 // Returns `absl::kFailedPrecondition` if `path_cloning` is infeasible to apply
 // or if its score gain is lower than `min_score`. `function_path_profile` is
 // the path profile of the corresponding function, and its missing path
 // predecessor info is used to drop the edge weights which cannot be confidently
-// rerouted.
+// rerouted. If `path_profile_options.local_clone_relayout()` is true, both the
+// baseline and the cloned layouts only re-lay out the chains around the blocks
+// affected by the cloning. If `baseline_cache` is not null, it is used to look
+// up and store the baseline layout score, and must be valid for `cfg_builder`,
+// `code_layout_params` and `optimal_chain_info`.
 absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
     const CfgBuilder &cfg_builder, const PathCloning &path_cloning,
     const PropellerCodeLayoutParameters &code_layout_params,
     const PathProfileOptions &path_profile_options, double min_score,
     const FunctionChainInfo &optimal_chain_info,
     const FunctionPathProfile &function_path_profile
-        ABSL_ATTRIBUTE_LIFETIME_BOUND);
+        ABSL_ATTRIBUTE_LIFETIME_BOUND,
+    BaselineLayoutCache *absl_nullable baseline_cache = nullptr);
+
+// Same as above, but evaluates the already built `cfg_change` of
+// `path_cloning`, which must have been built with the conflict edges of
+// `cfg_builder`.
+absl::StatusOr<EvaluatedPathCloning> EvaluateCloning(
+    const CfgBuilder &cfg_builder, const PathCloning &path_cloning,
+    CfgChangeFromPathCloning cfg_change,
+    const PropellerCodeLayoutParameters &code_layout_params,
+    const PathProfileOptions &path_profile_options, double min_score,
+    const FunctionChainInfo &optimal_chain_info,
+    BaselineLayoutCache *absl_nullable baseline_cache = nullptr);
 
 // Evaluates and returns all applicable and profitable clonings in
 // `program_path_profile` with `code_layout_params` and `path_profile_options`.
 // Returns these clonings in a map keyed by the function index of the associated
-// CFG.
+// CFG. If `cloning_stats` is not null, it is updated with the baseline layout
+// cache statistics.
 absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>> EvaluateAllClonings(
     const ProgramCfg *program_cfg,
     const ProgramPathProfile *program_path_profile,
     const PropellerCodeLayoutParameters &code_layout_params,
-    const PathProfileOptions &path_profile_options);
+    const PathProfileOptions &path_profile_options,
+    PropellerStats::CloningStats *absl_nullable cloning_stats = nullptr);
 
-// Evaluates all PathClonings in a path tree associated with a single CFG.
+// Evaluates all PathClonings in a path tree associated with a single CFG. The
+// path tree is traversed in its `CompactPathTrie` form, frozen from the
+// aggregated path profile, and the `PathNode` of a cloning is only looked up
+// once the cloning passes the path frequency checks.
 // Example usage:
 //   std::vector<PathCloning> clonings;
 //   PathTreeCloneEvaluator(cfg,
@@ -221,15 +328,18 @@ class PathTreeCloneEvaluator {
  public:
   // Does not take ownership of any of its arguments which should all point
   // to valid objects which will outlive the constructed object.
+  // `baseline_cache` may be null, in which case baselines are not memoized.
   PathTreeCloneEvaluator(
       const ControlFlowGraph *absl_nonnull cfg,
       const FunctionChainInfo *absl_nonnull optimal_chain_info,
       const PathProfileOptions *absl_nonnull path_profile_options,
-      const PropellerCodeLayoutParameters *absl_nonnull code_layout_params)
+      const PropellerCodeLayoutParameters *absl_nonnull code_layout_params,
+      BaselineLayoutCache *absl_nullable baseline_cache = nullptr)
       : cfg_(*cfg),
         path_profile_options_(*path_profile_options),
         code_layout_params_(*code_layout_params),
-        optimal_chain_info_(*optimal_chain_info) {}
+        optimal_chain_info_(*optimal_chain_info),
+        baseline_cache_(baseline_cache) {}
 
   // Evaluates all clonings in `path_tree` and inserts the scored clonings in
   // `clonings`. `path_length` must be provided as the length of the path
@@ -239,9 +349,9 @@ class PathTreeCloneEvaluator {
   // root which have been encountered in the path to `path_tree` (excluding
   // `path_tree` itself). These are filtered out from the predecessor blocks
   // when evaluating path clonings. `function_path_profile` is the path profile
-  // of the corresponding function.
+  // of the corresponding function, from which `path_tree` was frozen.
   void EvaluateCloningsForSubtree(
-      const PathNode &path_tree, int path_length,
+      const CompactPathNode &path_tree, int path_length,
       const absl::flat_hash_set<int> &path_preds_in_path,
       std::vector<EvaluatedPathCloning> &clonings,
       const FunctionPathProfile &function_path_profile);
@@ -252,18 +362,28 @@ class PathTreeCloneEvaluator {
   // of path predecessor bb indices of the root which have been encountered in
   // the path to `path_tree` (excluding `path_tree` itself). These are filtered
   // out from the predecessor blocks when evaluating path clonings.
-  // `function_path_profile` is the path profile of the corresponding function.
+  // `function_path_profile` is the path profile of the corresponding function,
+  // from which `path_node` was frozen.
   void EvaluateCloningsForPath(
-      const PathNode &path_node,
+      const CompactPathNode &path_node,
       const absl::flat_hash_set<int> &path_preds_in_path,
       std::vector<EvaluatedPathCloning> &clonings,
       const FunctionPathProfile &function_path_profile);
 
+  // Number of clonings evaluated with full layouts so far.
+  int n_clonings_evaluated() const { return n_clonings_evaluated_; }
+  // Number of clonings skipped so far because their score gain upper bound is
+  // below `min_initial_cloning_score`.
+  int n_clonings_pruned() const { return n_clonings_pruned_; }
+
  private:
   const ControlFlowGraph &cfg_;
   const PathProfileOptions &path_profile_options_;
   const PropellerCodeLayoutParameters &code_layout_params_;
   const FunctionChainInfo &optimal_chain_info_;
+  BaselineLayoutCache *absl_nullable baseline_cache_;
+  int n_clonings_evaluated_ = 0;
+  int n_clonings_pruned_ = 0;
 };
 }  // namespace propeller
 #endif  // PROPELLER_PATH_CLONE_EVALUATOR_H_
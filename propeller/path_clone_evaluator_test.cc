@@ -16,6 +16,7 @@
 
 #include <memory>
 #include <optional>
+#include <tuple>
 #include <utility>
 #include <vector>
 
@@ -23,6 +24,8 @@
 #include "absl/container/node_hash_map.h"
 #include "absl/status/status.h"
 #include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
 #include "absl/types/span.h"
 #include "gmock/gmock.h"
 #include "gtest/gtest.h"
@@ -41,11 +44,13 @@
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
 #include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
 #include "propeller/status_testing_macros.h"
 
 namespace propeller {
 namespace {
 
+using ::absl_testing::IsOkAndHolds;
 using ::absl_testing::StatusIs;
 using ::testing::_;
 using ::testing::Contains;
@@ -54,10 +59,13 @@ using ::testing::DoubleNear;
 using ::testing::ElementsAre;
 using ::testing::ExplainMatchResult;
 using ::testing::Field;
+using ::testing::IsEmpty;
 using ::testing::Key;
+using ::testing::Not;
 using ::testing::Optional;
 using ::testing::Pair;
 using ::testing::Property;
+using ::testing::SizeIs;
 using ::testing::UnorderedElementsAre;
 
 constexpr double kEpsilon = 1e-2;
@@ -81,6 +89,27 @@ MATCHER_P3(EvaluatedPathCloningIs, path_cloning_matcher, score_matcher,
                             result_listener);
 }
 
+// Expects `local_relayout_clonings` to have the same clonings as
+// `full_relayout_clonings` for function 6, in the same order and with scores
+// within `kEpsilon`.
+void ExpectSameClonings(
+    const absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>&
+        local_relayout_clonings,
+    const absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>&
+        full_relayout_clonings) {
+  ASSERT_THAT(full_relayout_clonings, Contains(Pair(6, Not(IsEmpty()))));
+  ASSERT_THAT(local_relayout_clonings,
+              UnorderedElementsAre(Pair(
+                  6, SizeIs(full_relayout_clonings.at(6).size()))));
+  for (size_t i = 0; i < full_relayout_clonings.at(6).size(); ++i) {
+    const EvaluatedPathCloning& full = full_relayout_clonings.at(6)[i];
+    const EvaluatedPathCloning& local = local_relayout_clonings.at(6)[i];
+    EXPECT_EQ(local.path_cloning, full.path_cloning);
+    EXPECT_THAT(local.score, Optional(DoubleNear(*full.score, kEpsilon)))
+        << absl::StrCat(full);
+  }
+}
+
 // Returns a map from bb_index to PathNodeArg from `args`.
 absl::node_hash_map<int, PathNodeArg> GetMapByIndex(
     absl::Span<const PathNodeArg> args) {
@@ -101,6 +130,18 @@ absl::flat_hash_map<int, FunctionPathProfileArg> GetMapByIndex(
   return result;
 }
 
+// Returns the intra-function edges of `cfg` as tuples of their source id, sink
+// id, and weight.
+std::vector<std::tuple<IntraCfgId, IntraCfgId, int>> GetIntraEdges(
+    const ControlFlowGraph& cfg) {
+  std::vector<std::tuple<IntraCfgId, IntraCfgId, int>> result;
+  for (const auto& edge : cfg.intra_edges()) {
+    result.emplace_back(edge->src()->intra_cfg_id(),
+                        edge->sink()->intra_cfg_id(), edge->weight());
+  }
+  return result;
+}
+
 ProgramPathProfileArg GetDefaultPathProfileArg() {
   auto children_of_3_args = GetMapByIndex(
       {{.node_bb_index = 4,
@@ -342,6 +383,143 @@ TEST(PathCloneEvaluator, LimitsCloningPathLength) {
                                   ElementsAre(2, 3)))))));
 }
 
+TEST(PathCloneEvaluator, ScoreUpperBoundIsAboveEvaluatedScores) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  const ControlFlowGraph& foo_cfg = *program_cfg->GetCfgByIndex(/*index=*/6);
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PathProfileOptions path_profile_options;
+  path_profile_options.set_prune_clonings_by_score_upper_bound(false);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      evaluated_clonings =
+          EvaluateAllClonings(program_cfg.get(), &path_profile,
+                              code_layout_params, path_profile_options);
+  ASSERT_THAT(evaluated_clonings, Contains(Key(6)));
+  ASSERT_THAT(evaluated_clonings.at(6), Not(IsEmpty()));
+  for (const EvaluatedPathCloning& cloning : evaluated_clonings.at(6)) {
+    ASSERT_TRUE(cloning.score.has_value());
+    EXPECT_GE(GetCloningScoreUpperBound(foo_cfg, cloning.path_cloning,
+                                        cloning.cfg_change, code_layout_params,
+                                        path_profile_options),
+              *cloning.score)
+        << absl::StrCat(cloning);
+  }
+}
+
+TEST(PathCloneEvaluator, PrunesCloningsByScoreUpperBound) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PathProfileOptions path_profile_options;
+  path_profile_options.set_prune_clonings_by_score_upper_bound(true);
+  // No cloning can reach this score.
+  path_profile_options.set_min_initial_cloning_score(1000000);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PropellerStats::CloningStats cloning_stats;
+  EXPECT_THAT(EvaluateAllClonings(program_cfg.get(), &path_profile,
+                                  code_layout_params, path_profile_options,
+                                  &cloning_stats),
+              UnorderedElementsAre(Pair(6, IsEmpty())));
+  EXPECT_EQ(cloning_stats.clonings_evaluated, 0);
+  EXPECT_GT(cloning_stats.clonings_pruned_by_score_upper_bound, 0);
+  EXPECT_EQ(cloning_stats.baseline_layout_cache_misses, 0);
+}
+
+TEST(PathCloneEvaluator, PruningByScoreUpperBoundKeepsProfitableClonings) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PathProfileOptions path_profile_options;
+  ASSERT_FALSE(path_profile_options.prune_clonings_by_score_upper_bound());
+  // Some, but not all, clonings of foo have an upper bound below this score.
+  path_profile_options.set_min_initial_cloning_score(10);
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      unpruned_clonings =
+          EvaluateAllClonings(program_cfg.get(), &path_profile,
+                              code_layout_params, path_profile_options);
+  ASSERT_THAT(unpruned_clonings, Contains(Pair(6, Not(IsEmpty()))));
+  path_profile_options.set_prune_clonings_by_score_upper_bound(true);
+  PropellerStats::CloningStats cloning_stats;
+  EXPECT_EQ(EvaluateAllClonings(program_cfg.get(), &path_profile,
+                                code_layout_params, path_profile_options,
+                                &cloning_stats),
+            unpruned_clonings);
+  EXPECT_GT(cloning_stats.clonings_pruned_by_score_upper_bound, 0);
+}
+
+TEST(PathCloneEvaluator, LocalRelayoutMatchesFullRelayout) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PathProfileOptions path_profile_options;
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      full_relayout_clonings =
+          EvaluateAllClonings(program_cfg.get(), &path_profile,
+                              code_layout_params, path_profile_options);
+  path_profile_options.set_local_clone_relayout(true);
+  // Every chain in foo is in the neighborhood of the blocks affected by each
+  // cloning. So the local relayout must find the same layouts, and the sums of
+  // the chain scores must match the layout scores.
+  ExpectSameClonings(EvaluateAllClonings(program_cfg.get(), &path_profile,
+                                         code_layout_params,
+                                         path_profile_options),
+                     full_relayout_clonings);
+}
+
+TEST(PathCloneEvaluator, LocalRelayoutMatchesFullRelayoutWithDistantChains) {
+  MultiCfgArg default_cfg_arg = GetDefaultProgramCfgArg();
+  const CfgArg& foo_arg = default_cfg_arg.cfg_args.at(0);
+  std::vector<NodeArg> node_args = foo_arg.node_args;
+  // Blocks 6-8 are only weakly connected to block 4, and blocks 9 and 10 are
+  // only connected to block 8. So their chains are either neighbors of
+  // neighbors of the blocks affected by cloning, or not connected to them at
+  // all.
+  node_args.push_back({0x1066, 6, 0x10, {.CanFallThrough = true}});
+  node_args.push_back({0x1076, 7, 0x10, {.CanFallThrough = true}});
+  node_args.push_back({0x1086, 8, 0x8, {.CanFallThrough = true}});
+  node_args.push_back({0x108e, 9, 0x10, {.CanFallThrough = true}});
+  node_args.push_back({0x109e, 10, 0x8, {.HasReturn = true}});
+  node_args.push_back({0x10a6, 11, 0x10, {.CanFallThrough = true}});
+  node_args.push_back({0x10b6, 12, 0x8, {.HasReturn = true}});
+  std::vector<IntraEdgeArg> edge_args = foo_arg.edge_args;
+  edge_args.push_back({4, 6, 5, CFGEdgeKind::kBranchOrFallthough});
+  edge_args.push_back({6, 7, 300, CFGEdgeKind::kBranchOrFallthough});
+  edge_args.push_back({7, 8, 280, CFGEdgeKind::kBranchOrFallthough});
+  edge_args.push_back({8, 9, 250, CFGEdgeKind::kBranchOrFallthough});
+  edge_args.push_back({9, 10, 200, CFGEdgeKind::kBranchOrFallthough});
+  edge_args.push_back({11, 12, 400, CFGEdgeKind::kBranchOrFallthough});
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{foo_arg.section_name, foo_arg.function_index,
+                     foo_arg.function_name, std::move(node_args),
+                     std::move(edge_args)},
+                    default_cfg_arg.cfg_args.at(1),
+                    default_cfg_arg.cfg_args.at(2)},
+       .inter_edge_args = default_cfg_arg.inter_edge_args});
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PathProfileOptions path_profile_options;
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      full_relayout_clonings =
+          EvaluateAllClonings(program_cfg.get(), &path_profile,
+                              code_layout_params, path_profile_options);
+  path_profile_options.set_local_clone_relayout(true);
+  // The distant chains are already optimally laid out in the initial chains,
+  // so leaving them out of the layout must not change the score of any
+  // cloning.
+  ExpectSameClonings(EvaluateAllClonings(program_cfg.get(), &path_profile,
+                                         code_layout_params,
+                                         path_profile_options),
+                     full_relayout_clonings);
+}
+
 TEST(PathCloneEvaluator, GetsInitialChains) {
   std::unique_ptr<ProgramCfg> program_cfg =
       BuildFromCfgArg(GetDefaultProgramCfgArg());
@@ -475,6 +653,49 @@ TEST(ApplyCloningsTest, ChangesIntraCfg) {
                          NodeIntraIdIs(IntraCfgId{5, 0}), 50, _)})));
 }
 
+TEST(ApplyCloningsTest, BuildsFromCommittedCfgChanges) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_by_index =
+      std::move(*std::move(program_cfg)).release_cfgs_by_index();
+  ControlFlowGraph* foo_cfg = cfgs_by_index.at(6).get();
+  ASSERT_NE(foo_cfg, nullptr);
+
+  CfgBuilder cfg_builder(foo_cfg);
+  PathCloning first_cloning = {
+      .path_node = function_path_profile.GetPathTree(4),
+      .function_index = 6,
+      .path_pred_bb_index = 2};
+  ASSERT_OK_AND_ASSIGN(
+      CfgChangeFromPathCloning first_cfg_change,
+      CfgChangeBuilder(first_cloning, cfg_builder.conflict_edges(),
+                       function_path_profile)
+          .Build());
+  cfg_builder.AddCfgChange(first_cfg_change);
+  CfgBuilder uncommitted_cfg_builder = cfg_builder.Clone();
+  cfg_builder.CommitCfgChanges();
+  EXPECT_EQ(GetIntraEdges(*cfg_builder.Clone().Build()),
+            GetIntraEdges(*uncommitted_cfg_builder.Clone().Build()));
+
+  PathCloning second_cloning = {
+      .path_node = function_path_profile.GetPathTree(3)->GetChild(5),
+      .function_index = 6,
+      .path_pred_bb_index = 2};
+  ASSERT_OK_AND_ASSIGN(
+      CfgChangeFromPathCloning second_cfg_change,
+      CfgChangeBuilder(second_cloning, cfg_builder.conflict_edges(),
+                       function_path_profile)
+          .Build());
+  cfg_builder.AddCfgChange(second_cfg_change);
+  uncommitted_cfg_builder.AddCfgChange(second_cfg_change);
+  // Only the second change is applied on top of the committed edges.
+  EXPECT_EQ(GetIntraEdges(*std::move(cfg_builder).Build()),
+            GetIntraEdges(*std::move(uncommitted_cfg_builder).Build()));
+}
+
 TEST(EvaluateOneCloning, RejectsNonProfitableCloning) {
   std::unique_ptr<ProgramCfg> program_cfg =
       BuildFromCfgArg(GetDefaultProgramCfgArg());
@@ -508,5 +729,270 @@ TEST(EvaluateOneCloning, RejectsNonProfitableCloning) {
       StatusIs(absl::StatusCode::kFailedPrecondition,
                "Cloning is not acceptable with score gain: -190.223 < -170"));
 }
+
+TEST(EvaluateOneCloning, SharesBaselineLayoutsThroughCache) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_by_index =
+      std::move(*std::move(program_cfg)).release_cfgs_by_index();
+  ControlFlowGraph* foo_cfg = cfgs_by_index.at(6).get();
+  ASSERT_NE(foo_cfg, nullptr);
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PathProfileOptions path_profile_options;
+  FunctionChainInfo optimal_chain_info =
+      CodeLayout(code_layout_params, {foo_cfg},
+                 /*initial_chains=*/{})
+          .OrderAll()
+          .front();
+
+  PathCloning cloning = {
+      .path_node = function_path_profile.GetPathTree(4),
+      .function_index = 6,
+      .path_pred_bb_index = 2};
+
+  ASSERT_OK_AND_ASSIGN(
+      EvaluatedPathCloning uncached_cloning,
+      EvaluateCloning(CfgBuilder(foo_cfg), cloning, code_layout_params,
+                      path_profile_options, /*min_score=*/-1000,
+                      optimal_chain_info, function_path_profile));
+
+  BaselineLayoutCache baseline_cache;
+  for (int i = 0; i < 2; ++i) {
+    EXPECT_THAT(
+        EvaluateCloning(CfgBuilder(foo_cfg), cloning, code_layout_params,
+                        path_profile_options, /*min_score=*/-1000,
+                        optimal_chain_info, function_path_profile,
+                        &baseline_cache),
+        IsOkAndHolds(Field("score", &EvaluatedPathCloning::score,
+                           Optional(DoubleNear(*uncached_cloning.score,
+                                               kEpsilon)))));
+  }
+  EXPECT_EQ(baseline_cache.misses(), 1);
+  EXPECT_EQ(baseline_cache.hits(), 1);
+}
+
+TEST(EvaluateOneCloning, KeysBaselineLayoutsOnReroutedBlocks) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_by_index =
+      std::move(*std::move(program_cfg)).release_cfgs_by_index();
+  ControlFlowGraph* foo_cfg = cfgs_by_index.at(6).get();
+  ASSERT_NE(foo_cfg, nullptr);
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PathProfileOptions path_profile_options;
+  FunctionChainInfo optimal_chain_info =
+      CodeLayout(code_layout_params, {foo_cfg},
+                 /*initial_chains=*/{})
+          .OrderAll()
+          .front();
+
+  // Both clonings drop the same paths (those of path tree 3 with the missing
+  // predecessor 38), but reroute the edges from different predecessors. So
+  // their baselines are seeded from differently broken chains and are not
+  // shared.
+  std::vector<PathCloning> clonings = {
+      {.path_node = function_path_profile.GetPathTree(3),
+       .function_index = 6,
+       .path_pred_bb_index = 1},
+      {.path_node = function_path_profile.GetPathTree(3),
+       .function_index = 6,
+       .path_pred_bb_index = 2}};
+
+  BaselineLayoutCache baseline_cache;
+  for (const PathCloning& cloning : clonings) {
+    ASSERT_OK_AND_ASSIGN(
+        EvaluatedPathCloning uncached_cloning,
+        EvaluateCloning(CfgBuilder(foo_cfg), cloning, code_layout_params,
+                        path_profile_options, /*min_score=*/-1000,
+                        optimal_chain_info, function_path_profile));
+    EXPECT_THAT(
+        EvaluateCloning(CfgBuilder(foo_cfg), cloning, code_layout_params,
+                        path_profile_options, /*min_score=*/-1000,
+                        optimal_chain_info, function_path_profile,
+                        &baseline_cache),
+        IsOkAndHolds(Field("score", &EvaluatedPathCloning::score,
+                           Optional(DoubleNear(*uncached_cloning.score,
+                                               kEpsilon)))));
+  }
+  EXPECT_EQ(baseline_cache.misses(), 2);
+  EXPECT_EQ(baseline_cache.hits(), 0);
+}
+
+// Returns the intra-function score of the layout of `cfg_builder` with
+// `applied_change` applied, seeded from `optimal_chain_info` broken around the
+// blocks rerouted by `cloning_change`. This is how `EvaluateCloning` originally
+// computed both layouts, without any caching or local relayout.
+double GetReferenceLayoutScore(const CfgBuilder& cfg_builder,
+                               const CfgChangeFromPathCloning& applied_change,
+                               const CfgChangeFromPathCloning& cloning_change,
+                               const PropellerCodeLayoutParameters& params,
+                               const FunctionChainInfo& optimal_chain_info) {
+  CfgBuilder new_cfg_builder = cfg_builder.Clone();
+  new_cfg_builder.AddCfgChange(applied_change);
+  std::unique_ptr<ControlFlowGraph> cfg = std::move(new_cfg_builder).Build();
+  return CodeLayout(
+             params, {cfg.get()},
+             {{cfg->function_index(),
+               GetInitialChains(*cfg, optimal_chain_info, cloning_change)}})
+      .OrderAll()
+      .front()
+      .optimized_score.intra_score;
+}
+
+TEST(EvaluateOneCloning, CachedBaselinesMatchReferenceEvaluation) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_by_index =
+      std::move(*std::move(program_cfg)).release_cfgs_by_index();
+  ControlFlowGraph* foo_cfg = cfgs_by_index.at(6).get();
+  ASSERT_NE(foo_cfg, nullptr);
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  // Without clone penalties the score is the difference of the two layouts.
+  PathProfileOptions path_profile_options;
+  path_profile_options.set_base_penalty_factor(0);
+  path_profile_options.set_icache_penalty_factor(0);
+  FunctionChainInfo optimal_chain_info =
+      CodeLayout(code_layout_params, {foo_cfg},
+                 /*initial_chains=*/{})
+          .OrderAll()
+          .front();
+  CfgBuilder cfg_builder(foo_cfg);
+
+  // Every cloning of the path trees and their children.
+  std::vector<PathCloning> clonings;
+  for (const auto& [root_bb_index, path_tree] :
+       function_path_profile.path_trees_by_root_bb_index()) {
+    std::vector<const PathNode*> path_nodes = {path_tree.get()};
+    for (const auto& [child_bb_index, child] : path_tree->children())
+      path_nodes.push_back(child.get());
+    for (const PathNode* path_node : path_nodes) {
+      for (const auto& [pred_bb_index, entry] :
+           path_node->path_pred_info().entries) {
+        clonings.push_back({.path_node = path_node,
+                            .function_index = 6,
+                            .path_pred_bb_index = pred_bb_index});
+      }
+    }
+  }
+
+  BaselineLayoutCache baseline_cache;
+  int num_evaluated_clonings = 0;
+  for (const PathCloning& cloning : clonings) {
+    absl::StatusOr<CfgChangeFromPathCloning> cfg_change =
+        CfgChangeBuilder(cloning, cfg_builder.conflict_edges(),
+                         function_path_profile)
+            .Build();
+    if (!cfg_change.ok()) continue;
+    ++num_evaluated_clonings;
+    double reference_baseline_score = GetReferenceLayoutScore(
+        cfg_builder, {.paths_to_drop = cfg_change->paths_to_drop}, *cfg_change,
+        code_layout_params, optimal_chain_info);
+    double reference_score =
+        GetReferenceLayoutScore(cfg_builder, *cfg_change, *cfg_change,
+                                code_layout_params, optimal_chain_info) -
+        reference_baseline_score;
+
+    EXPECT_DOUBLE_EQ(
+        ComputeBaselineScore(cfg_builder, *cfg_change, code_layout_params,
+                             optimal_chain_info, /*local_relayout=*/false),
+        reference_baseline_score);
+    for (int i = 0; i < 2; ++i) {
+      EXPECT_DOUBLE_EQ(
+          baseline_cache.GetBaselineScore(cfg_builder, *cfg_change,
+                                          code_layout_params,
+                                          optimal_chain_info,
+                                          /*local_relayout=*/false),
+          reference_baseline_score);
+    }
+    EXPECT_THAT(
+        EvaluateCloning(cfg_builder, cloning, code_layout_params,
+                        path_profile_options, /*min_score=*/-1000,
+                        optimal_chain_info, function_path_profile),
+        IsOkAndHolds(Field("score", &EvaluatedPathCloning::score,
+                           Optional(DoubleNear(reference_score, kEpsilon)))));
+    EXPECT_THAT(
+        EvaluateCloning(cfg_builder, cloning, code_layout_params,
+                        path_profile_options, /*min_score=*/-1000,
+                        optimal_chain_info, function_path_profile,
+                        &baseline_cache),
+        IsOkAndHolds(Field("score", &EvaluatedPathCloning::score,
+                           Optional(DoubleNear(reference_score, kEpsilon)))));
+  }
+  EXPECT_GE(num_evaluated_clonings, 3);
+}
+
+TEST(BaselineLayoutCache, EvictsOldestBaselineLayouts) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  absl::flat_hash_map<int, std::unique_ptr<ControlFlowGraph>> cfgs_by_index =
+      std::move(*std::move(program_cfg)).release_cfgs_by_index();
+  ControlFlowGraph* foo_cfg = cfgs_by_index.at(6).get();
+  ASSERT_NE(foo_cfg, nullptr);
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  const FunctionPathProfile& function_path_profile =
+      path_profile.path_profiles_by_function_index().at(6);
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  FunctionChainInfo optimal_chain_info =
+      CodeLayout(code_layout_params, {foo_cfg},
+                 /*initial_chains=*/{})
+          .OrderAll()
+          .front();
+  CfgBuilder cfg_builder(foo_cfg);
+  const PathNode* path_tree_3 = function_path_profile.GetPathTree(3);
+  const PathNode* path_tree_4 = function_path_profile.GetPathTree(4);
+
+  BaselineLayoutCache baseline_cache(/*max_entries=*/1);
+  auto get_baseline_score = [&](std::vector<const PathNode*> paths_to_drop) {
+    return baseline_cache.GetBaselineScore(
+        cfg_builder, {.paths_to_drop = std::move(paths_to_drop)},
+        code_layout_params, optimal_chain_info,
+        /*local_relayout=*/false);
+  };
+  double score_3 = get_baseline_score({path_tree_3});
+  // Order and duplicates of the dropped paths don't matter.
+  EXPECT_EQ(get_baseline_score({path_tree_3, path_tree_3}), score_3);
+  EXPECT_EQ(baseline_cache.hits(), 1);
+  get_baseline_score({path_tree_4});
+  EXPECT_EQ(baseline_cache.misses(), 2);
+  // The baseline for path tree 3 has been evicted.
+  EXPECT_EQ(get_baseline_score({path_tree_3}), score_3);
+  EXPECT_EQ(baseline_cache.misses(), 3);
+  EXPECT_EQ(baseline_cache.hits(), 1);
+}
+
+TEST(PathCloneEvaluator, ReportsBaselineLayoutCacheStats) {
+  std::unique_ptr<ProgramCfg> program_cfg =
+      BuildFromCfgArg(GetDefaultProgramCfgArg());
+  ProgramPathProfile path_profile(GetDefaultPathProfileArg());
+  PathProfileOptions path_profile_options;
+  PropellerCodeLayoutParameters code_layout_params;
+  code_layout_params.set_call_chain_clustering(false);
+  PropellerStats::CloningStats cloning_stats;
+  absl::flat_hash_map<int, std::vector<EvaluatedPathCloning>>
+      evaluated_clonings = EvaluateAllClonings(
+          program_cfg.get(), &path_profile, code_layout_params,
+          path_profile_options, &cloning_stats);
+  EXPECT_EQ(evaluated_clonings,
+            EvaluateAllClonings(program_cfg.get(), &path_profile,
+                                code_layout_params, path_profile_options));
+  // Every evaluated cloning needs a baseline, whether cached or not.
+  EXPECT_GE(cloning_stats.baseline_layout_cache_hits +
+                cloning_stats.baseline_layout_cache_misses,
+            evaluated_clonings.at(6).size());
+  EXPECT_GT(cloning_stats.baseline_layout_cache_misses, 0);
+}
 }  // namespace
 }  // namespace propeller
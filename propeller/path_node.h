@@ -54,6 +54,16 @@ struct PathPredInfoEntry {
   // frequency of returns into it.
   absl::flat_hash_map<propeller::FlatBbHandle, int> return_to_freqs;
 
+  // Adds the frequencies and the cache pressure of `other` to this entry.
+  void Merge(const PathPredInfoEntry &other) {
+    freq += other.freq;
+    cache_pressure += other.cache_pressure;
+    for (const auto &[call_ret, call_freq] : other.call_freqs)
+      call_freqs[call_ret] += call_freq;
+    for (const auto &[return_to_bb, return_freq] : other.return_to_freqs)
+      return_to_freqs[return_to_bb] += return_freq;
+  }
+
   // Implementation of the `AbslStringify` interface.
   template <typename Sink>
   friend void AbslStringify(Sink &sink, const PathPredInfoEntry &e);
@@ -113,6 +123,13 @@ struct PathPredInfo {
     return &it->second;
   }
 
+  // Merges the entries of `other` into the entries of this `PathPredInfo`.
+  void Merge(const PathPredInfo &other) {
+    for (const auto &[path_pred_bb_index, entry] : other.entries)
+      entries[path_pred_bb_index].Merge(entry);
+    missing_pred_entry.Merge(other.missing_pred_entry);
+  }
+
   // Implementation of the `AbslStringify` interface.
   template <typename Sink>
   friend void AbslStringify(Sink &sink, const PathPredInfo &p);
@@ -268,6 +285,25 @@ class PathNode {
     return it->second.get();
   }
 
+  // Merges the path tree rooted at `other` into the path tree rooted at this
+  // path node. Both must be associated with the same block at the same depth.
+  // Subtrees of `other` which don't exist in this tree are moved into it.
+  void Merge(PathNode &&other) {
+    CHECK_EQ(node_bb_index_, other.node_bb_index_);
+    CHECK_EQ(path_length_, other.path_length_);
+    path_pred_info_.Merge(other.path_pred_info_);
+    for (auto &[child_bb_index, other_child] : other.children_) {
+      auto [it, inserted] = children_.try_emplace(child_bb_index, nullptr);
+      if (inserted) {
+        other_child->parent_ = this;
+        it->second = std::move(other_child);
+      } else {
+        it->second->Merge(std::move(*other_child));
+      }
+    }
+    other.children_.clear();
+  }
+
   // Implementation of the `AbslStringify` interface for logging the subtree
   // rooted at a path node. Do not rely on exact format.
   template <typename Sink>
@@ -412,6 +448,23 @@ class FunctionPathProfile {
     return it->second.get();
   }
 
+  // Merges the path trees of `other` (which must be for the same function) into
+  // this profile.
+  void Merge(FunctionPathProfile &&other) {
+    CHECK_EQ(function_index_, other.function_index_);
+    for (auto &[bb_index, other_path_tree] :
+         other.path_trees_by_root_bb_index_) {
+      auto [it, inserted] =
+          path_trees_by_root_bb_index_.try_emplace(bb_index, nullptr);
+      if (inserted) {
+        it->second = std::move(other_path_tree);
+      } else {
+        it->second->Merge(std::move(*other_path_tree));
+      }
+    }
+    other.path_trees_by_root_bb_index_.clear();
+  }
+
   // Implementation of the `AbslStringify` interface for logging the function
   // path profile. Do not rely on exact format.
   template <typename Sink>
@@ -465,6 +518,25 @@ class ProgramPathProfile {
         .first->second;
   }
 
+  // Merges the function path profiles of `other` into this profile. The
+  // result is independent of how the paths were split between the two
+  // profiles, except for the floating-point summation order of cache
+  // pressures. So profiles must be merged in a fixed order to get
+  // deterministic results.
+  void Merge(ProgramPathProfile &&other) {
+    for (auto &[function_index, other_function_path_profile] :
+         other.path_profiles_by_function_index_) {
+      auto it = path_profiles_by_function_index_.find(function_index);
+      if (it == path_profiles_by_function_index_.end()) {
+        path_profiles_by_function_index_.try_emplace(
+            function_index, std::move(other_function_path_profile));
+      } else {
+        it->second.Merge(std::move(other_function_path_profile));
+      }
+    }
+    other.path_profiles_by_function_index_.clear();
+  }
+
  private:
   // Function path profiles keyed by their function index.
   absl::flat_hash_map<int, FunctionPathProfile>
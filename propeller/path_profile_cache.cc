@@ -0,0 +1,261 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/path_profile_cache.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/ErrorOr.h"
+#include "llvm/Support/FileSystem.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "llvm/Support/xxhash.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/bb_handle.h"
+#include "propeller/file_helpers.h"
+#include "propeller/path_node.h"
+#include "propeller/path_profile.pb.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/resolve_mmap_name.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+namespace {
+void ToProto(const FlatBbHandle &handle, FlatBbHandlePb &handle_pb) {
+  handle_pb.set_function_index(handle.function_index);
+  handle_pb.set_flat_bb_index(handle.flat_bb_index);
+}
+
+FlatBbHandle FromProto(const FlatBbHandlePb &handle_pb) {
+  return {.function_index = handle_pb.function_index(),
+          .flat_bb_index = handle_pb.flat_bb_index()};
+}
+
+void ToProto(const PathPredInfoEntry &entry, PathPredInfoEntryPb &entry_pb) {
+  entry_pb.set_freq(entry.freq);
+  entry_pb.set_cache_pressure(entry.cache_pressure);
+  for (const auto &[call_ret, freq] : entry.call_freqs) {
+    CallFreqPb &call_freq_pb = *entry_pb.add_call_freqs();
+    if (call_ret.callee.has_value()) call_freq_pb.set_callee(*call_ret.callee);
+    if (call_ret.return_bb.has_value())
+      ToProto(*call_ret.return_bb, *call_freq_pb.mutable_return_bb());
+    call_freq_pb.set_freq(freq);
+  }
+  for (const auto &[return_to_bb, freq] : entry.return_to_freqs) {
+    ReturnToFreqPb &return_to_freq_pb = *entry_pb.add_return_to_freqs();
+    ToProto(return_to_bb, *return_to_freq_pb.mutable_return_to_bb());
+    return_to_freq_pb.set_freq(freq);
+  }
+}
+
+PathPredInfoEntry FromProto(const PathPredInfoEntryPb &entry_pb) {
+  PathPredInfoEntry entry = {.freq = entry_pb.freq(),
+                             .cache_pressure = entry_pb.cache_pressure()};
+  for (const CallFreqPb &call_freq_pb : entry_pb.call_freqs()) {
+    CallRetInfo call_ret;
+    if (call_freq_pb.has_callee()) call_ret.callee = call_freq_pb.callee();
+    if (call_freq_pb.has_return_bb())
+      call_ret.return_bb = FromProto(call_freq_pb.return_bb());
+    entry.call_freqs[call_ret] += call_freq_pb.freq();
+  }
+  for (const ReturnToFreqPb &return_to_freq_pb : entry_pb.return_to_freqs()) {
+    entry.return_to_freqs[FromProto(return_to_freq_pb.return_to_bb())] +=
+        return_to_freq_pb.freq();
+  }
+  return entry;
+}
+
+void ToProto(const PathNode &path_node, PathNodePb &path_node_pb) {
+  path_node_pb.set_node_bb_index(path_node.node_bb_index());
+  for (const auto &[pred_bb_index, entry] :
+       path_node.path_pred_info().entries) {
+    PathPredInfoEntryPb &entry_pb = *path_node_pb.add_path_pred_info_entries();
+    entry_pb.set_path_pred_bb_index(pred_bb_index);
+    ToProto(entry, entry_pb);
+  }
+  ToProto(path_node.path_pred_info().missing_pred_entry,
+          *path_node_pb.mutable_missing_pred_entry());
+  for (const auto &[child_bb_index, child] : path_node.children())
+    ToProto(*child, *path_node_pb.add_children());
+}
+
+void FromProto(const PathNodePb &path_node_pb, PathNodeArg &path_node_arg) {
+  path_node_arg.node_bb_index = path_node_pb.node_bb_index();
+  for (const PathPredInfoEntryPb &entry_pb :
+       path_node_pb.path_pred_info_entries()) {
+    path_node_arg.path_pred_info.entries.emplace(entry_pb.path_pred_bb_index(),
+                                                 FromProto(entry_pb));
+  }
+  path_node_arg.path_pred_info.missing_pred_entry =
+      FromProto(path_node_pb.missing_pred_entry());
+  for (const PathNodePb &child_pb : path_node_pb.children()) {
+    FromProto(child_pb, path_node_arg.children_args[child_pb.node_bb_index()]);
+  }
+}
+
+// Returns the hash of the contents of the file `file_name`.
+absl::StatusOr<uint64_t> HashFileContents(absl::string_view file_name) {
+  llvm::ErrorOr<std::unique_ptr<llvm::MemoryBuffer>> file =
+      llvm::MemoryBuffer::getFile(std::string(file_name), /*IsText=*/false,
+                                  /*RequiresNullTerminator=*/false);
+  if (!file) {
+    return absl::FailedPreconditionError(absl::StrCat(
+        "Failed to read file '", file_name, "': ", file.getError().message()));
+  }
+  return llvm::xxHash64((*file)->getBuffer());
+}
+}  // namespace
+
+absl::StatusOr<PathProfileCacheKey> ComputePathProfileCacheKey(
+    const PropellerOptions &options, absl::string_view build_id) {
+  const PathProfileOptions &path_profile_options =
+      options.path_profile_options();
+  // Serialize everything which affects the aggregated path profile into one
+  // string and hash it. The binary is identified by its build id (or by its
+  // contents if it has none) and the input profiles by their contents, so
+  // renaming or moving them doesn't invalidate the cache. Only the name used
+  // to select the profiled binary's samples from the profiles is keyed by
+  // name, as it is the name recorded in the profiles.
+  std::string key_data = absl::StrFormat(
+      "%s|%d|%d|%d|%d", ResolveMmapName(options),
+      path_profile_options.hot_cutoff_percentile(),
+      path_profile_options.max_path_length(),
+      path_profile_options.max_time_diff_in_path_buffer_millis(),
+      path_profile_options.max_icache_penalty_interval_millis());
+  if (build_id.empty()) {
+    ASSIGN_OR_RETURN(uint64_t binary_hash,
+                     HashFileContents(options.binary_name()));
+    absl::StrAppendFormat(&key_data, "|%016x", binary_hash);
+  }
+  for (const InputProfile &input_profile : options.input_profiles()) {
+    ASSIGN_OR_RETURN(uint64_t file_hash,
+                     HashFileContents(input_profile.name()));
+    absl::StrAppendFormat(&key_data, "|%d:%016x", input_profile.type(),
+                          file_hash);
+  }
+  return PathProfileCacheKey{.build_id = std::string(build_id),
+                             .input_hash = llvm::xxHash64(key_data)};
+}
+
+ProgramPathProfilePb ConvertToProto(
+    const ProgramPathProfile &program_path_profile,
+    const PathProfileCacheKey &key) {
+  ProgramPathProfilePb program_path_profile_pb;
+  program_path_profile_pb.set_build_id(key.build_id);
+  program_path_profile_pb.set_input_hash(key.input_hash);
+  for (const auto &[function_index, function_path_profile] :
+       program_path_profile.path_profiles_by_function_index()) {
+    FunctionPathProfilePb &function_path_profile_pb =
+        *program_path_profile_pb.add_function_path_profiles();
+    function_path_profile_pb.set_function_index(function_index);
+    for (const auto &[bb_index, path_tree] :
+         function_path_profile.path_trees_by_root_bb_index()) {
+      ToProto(*path_tree, *function_path_profile_pb.add_path_trees());
+    }
+  }
+  return program_path_profile_pb;
+}
+
+ProgramPathProfile ConvertFromProto(
+    const ProgramPathProfilePb &program_path_profile_pb) {
+  ProgramPathProfileArg program_path_profile_arg;
+  for (const FunctionPathProfilePb &function_path_profile_pb :
+       program_path_profile_pb.function_path_profiles()) {
+    FunctionPathProfileArg &function_path_profile_arg =
+        program_path_profile_arg.GetProfileForFunctionIndex(
+            function_path_profile_pb.function_index());
+    for (const PathNodePb &path_tree_pb :
+         function_path_profile_pb.path_trees()) {
+      FromProto(path_tree_pb, function_path_profile_arg.GetOrInsertPathTree(
+                                  path_tree_pb.node_bb_index()));
+    }
+  }
+  return ProgramPathProfile(program_path_profile_arg);
+}
+
+absl::Status WritePathProfileCache(
+    const ProgramPathProfile &program_path_profile,
+    const PathProfileCacheKey &key, absl::string_view file_name) {
+  std::ofstream os((std::string(file_name)), std::ios::binary);
+  if (!os) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open file: ", file_name));
+  }
+  if (!ConvertToProto(program_path_profile, key).SerializeToOstream(&os)) {
+    return absl::InternalError(
+        absl::StrCat("Failed to write path profile to ", file_name));
+  }
+  return absl::OkStatus();
+}
+
+absl::StatusOr<std::optional<ProgramPathProfile>> ReadPathProfileCache(
+    absl::string_view file_name, const PathProfileCacheKey &key) {
+  if (!llvm::sys::fs::exists(std::string(file_name))) return std::nullopt;
+  ASSIGN_OR_RETURN(
+      ProgramPathProfilePb program_path_profile_pb,
+      propeller_file::GetBinaryProto<ProgramPathProfilePb>(file_name));
+  if (program_path_profile_pb.build_id() != key.build_id ||
+      program_path_profile_pb.input_hash() != key.input_hash) {
+    return std::nullopt;
+  }
+  return ConvertFromProto(program_path_profile_pb);
+}
+
+absl::StatusOr<ProgramPathProfile> CachingPathProfileAggregator::Aggregate(
+    const BinaryContent &binary_content,
+    const BinaryAddressMapper &binary_address_mapper,
+    const ProgramCfg &program_cfg) {
+  const std::string &cache_name = options_.path_profile_cache_name();
+  ASSIGN_OR_RETURN(
+      PathProfileCacheKey key,
+      ComputePathProfileCacheKey(options_, binary_content.build_id));
+  absl::StatusOr<std::optional<ProgramPathProfile>> cached_path_profile =
+      ReadPathProfileCache(cache_name, key);
+  if (!cached_path_profile.ok()) {
+    // A corrupt or unreadable cache is only a missed opportunity. It will be
+    // overwritten below.
+    LOG(WARNING) << "Failed to read path profile cache '" << cache_name
+                 << "': " << cached_path_profile.status()
+                 << ". Aggregating path profile.";
+  } else if (cached_path_profile->has_value()) {
+    LOG(INFO) << "Loaded path profile from '" << cache_name << "'.";
+    return **std::move(cached_path_profile);
+  } else {
+    LOG(INFO) << "No matching path profile in '" << cache_name
+              << "'. Aggregating path profile.";
+  }
+  ASSIGN_OR_RETURN(ProgramPathProfile program_path_profile,
+                   path_profile_aggregator_->Aggregate(
+                       binary_content, binary_address_mapper, program_cfg));
+  if (absl::Status status =
+          WritePathProfileCache(program_path_profile, key, cache_name);
+      !status.ok()) {
+    LOG(WARNING) << "Failed to cache path profile: " << status;
+  }
+  return program_path_profile;
+}
+}  // namespace propeller
@@ -0,0 +1,110 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_PATH_PROFILE_CACHE_H_
+#define PROPELLER_PATH_PROFILE_CACHE_H_
+
+#include <cstdint>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/path_node.h"
+#include "propeller/path_profile.pb.h"
+#include "propeller/path_profile_aggregator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+
+// Identifies the inputs a `ProgramPathProfile` is aggregated from.
+struct PathProfileCacheKey {
+  // Build id of the profiled binary.
+  std::string build_id;
+  // Hash of the contents of the input profiles and of the options affecting
+  // path profile aggregation.
+  uint64_t input_hash = 0;
+
+  bool operator==(const PathProfileCacheKey &other) const {
+    return build_id == other.build_id && input_hash == other.input_hash;
+  }
+  bool operator!=(const PathProfileCacheKey &other) const {
+    return !(*this == other);
+  }
+};
+
+// Returns the cache key for aggregating the path profile of the binary with
+// `build_id` from the input profiles in `options`. The key is based on the
+// contents of the input profiles (and of the binary if `build_id` is empty),
+// not on their file names. Options which only affect the evaluation of
+// clonings (e.g., `min_initial_cloning_score`) are excluded from the key, so
+// the cached profile can be reused when tuning them.
+absl::StatusOr<PathProfileCacheKey> ComputePathProfileCacheKey(
+    const PropellerOptions &options, absl::string_view build_id);
+
+// Converts `program_path_profile` to its serialized form, keyed by `key`.
+ProgramPathProfilePb ConvertToProto(
+    const ProgramPathProfile &program_path_profile,
+    const PathProfileCacheKey &key);
+
+// Reconstructs the `ProgramPathProfile` from its serialized form.
+ProgramPathProfile ConvertFromProto(
+    const ProgramPathProfilePb &program_path_profile_pb);
+
+// Writes `program_path_profile` keyed by `key` into `file_name` in binary
+// proto format.
+absl::Status WritePathProfileCache(
+    const ProgramPathProfile &program_path_profile,
+    const PathProfileCacheKey &key, absl::string_view file_name);
+
+// Reads the path profile cached in `file_name`. Returns `std::nullopt` if the
+// file doesn't exist or if it was written for a key different from `key`.
+absl::StatusOr<std::optional<ProgramPathProfile>> ReadPathProfileCache(
+    absl::string_view file_name, const PathProfileCacheKey &key);
+
+// Path profile aggregator which loads the path profile from the cache file
+// `options.path_profile_cache_name()` if it matches the binary and the input
+// profiles, and otherwise aggregates it with `path_profile_aggregator` and
+// writes it to the cache file. A cache file which can't be read or parsed is
+// treated as a mismatch and overwritten.
+class CachingPathProfileAggregator : public PathProfileAggregator {
+ public:
+  CachingPathProfileAggregator(
+      const PropellerOptions &options,
+      std::unique_ptr<PathProfileAggregator> path_profile_aggregator)
+      : options_(options),
+        path_profile_aggregator_(std::move(path_profile_aggregator)) {}
+
+  CachingPathProfileAggregator(const CachingPathProfileAggregator &) = delete;
+  CachingPathProfileAggregator &operator=(
+      const CachingPathProfileAggregator &) = delete;
+
+  absl::StatusOr<ProgramPathProfile> Aggregate(
+      const BinaryContent &binary_content,
+      const BinaryAddressMapper &binary_address_mapper,
+      const ProgramCfg &program_cfg) override;
+
+ private:
+  const PropellerOptions &options_;
+  std::unique_ptr<PathProfileAggregator> path_profile_aggregator_;
+};
+
+}  // namespace propeller
+#endif  // PROPELLER_PATH_PROFILE_CACHE_H_
@@ -0,0 +1,285 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/path_profile_cache.h"
+
+#include <cstdint>
+#include <fstream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/multi_cfg_test_case.h"
+#include "propeller/path_node.h"
+#include "propeller/path_profile.pb.h"
+#include "propeller/path_profile_aggregator.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOk;
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::Eq;
+
+// Path profile aggregator which returns the default test path profile and
+// counts how many times it has been called.
+class FakePathProfileAggregator : public PathProfileAggregator {
+ public:
+  explicit FakePathProfileAggregator(int &num_calls) : num_calls_(num_calls) {}
+
+  absl::StatusOr<ProgramPathProfile> Aggregate(
+      const BinaryContent &binary_content,
+      const BinaryAddressMapper &binary_address_mapper,
+      const ProgramCfg &program_cfg) override {
+    ++num_calls_;
+    return ProgramPathProfile(GetDefaultPathProfileArg());
+  }
+
+ private:
+  int &num_calls_;
+};
+
+void ExpectSameEntry(const PathPredInfoEntry &entry,
+                     const PathPredInfoEntry &expected) {
+  EXPECT_EQ(entry.freq, expected.freq);
+  EXPECT_EQ(entry.cache_pressure, expected.cache_pressure);
+  EXPECT_EQ(entry.call_freqs, expected.call_freqs);
+  EXPECT_EQ(entry.return_to_freqs, expected.return_to_freqs);
+}
+
+void ExpectSameTree(const PathNode &path_node, const PathNode &expected) {
+  EXPECT_EQ(path_node.node_bb_index(), expected.node_bb_index());
+  EXPECT_EQ(path_node.path_length(), expected.path_length());
+  ASSERT_EQ(path_node.path_pred_info().entries.size(),
+            expected.path_pred_info().entries.size());
+  for (const auto &[pred_bb_index, expected_entry] :
+       expected.path_pred_info().entries) {
+    const PathPredInfoEntry *entry =
+        path_node.path_pred_info().GetEntry(pred_bb_index);
+    ASSERT_NE(entry, nullptr);
+    ExpectSameEntry(*entry, expected_entry);
+  }
+  ExpectSameEntry(path_node.path_pred_info().missing_pred_entry,
+                  expected.path_pred_info().missing_pred_entry);
+  ASSERT_EQ(path_node.children().size(), expected.children().size());
+  for (const auto &[child_bb_index, expected_child] : expected.children()) {
+    auto it = path_node.children().find(child_bb_index);
+    ASSERT_NE(it, path_node.children().end());
+    EXPECT_EQ(it->second->parent(), &path_node);
+    ExpectSameTree(*it->second, *expected_child);
+  }
+}
+
+void ExpectSameProfile(const ProgramPathProfile &profile,
+                       const ProgramPathProfile &expected) {
+  ASSERT_EQ(profile.path_profiles_by_function_index().size(),
+            expected.path_profiles_by_function_index().size());
+  for (const auto &[function_index, expected_function_profile] :
+       expected.path_profiles_by_function_index()) {
+    auto it = profile.path_profiles_by_function_index().find(function_index);
+    ASSERT_NE(it, profile.path_profiles_by_function_index().end());
+    const FunctionPathProfile &function_profile = it->second;
+    EXPECT_EQ(function_profile.function_index(), function_index);
+    ASSERT_EQ(function_profile.path_trees_by_root_bb_index().size(),
+              expected_function_profile.path_trees_by_root_bb_index().size());
+    for (const auto &[bb_index, expected_path_tree] :
+         expected_function_profile.path_trees_by_root_bb_index()) {
+      const PathNode *path_tree = function_profile.GetPathTree(bb_index);
+      ASSERT_NE(path_tree, nullptr);
+      EXPECT_EQ(path_tree->parent(), nullptr);
+      ExpectSameTree(*path_tree, *expected_path_tree);
+    }
+  }
+}
+
+TEST(PathProfileCacheTest, ConvertsToAndFromProto) {
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  ProgramPathProfilePb program_path_profile_pb = ConvertToProto(
+      program_path_profile, {.build_id = "abcd", .input_hash = 17});
+  EXPECT_EQ(program_path_profile_pb.build_id(), "abcd");
+  EXPECT_EQ(program_path_profile_pb.input_hash(), uint64_t{17});
+  ExpectSameProfile(ConvertFromProto(program_path_profile_pb),
+                    program_path_profile);
+}
+
+TEST(PathProfileCacheTest, ReadsCacheWithMatchingKey) {
+  const std::string file_name =
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_matching.pb");
+  const PathProfileCacheKey key = {.build_id = "abcd", .input_hash = 17};
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  ASSERT_THAT(WritePathProfileCache(program_path_profile, key, file_name),
+              IsOk());
+
+  absl::StatusOr<std::optional<ProgramPathProfile>> cached_path_profile =
+      ReadPathProfileCache(file_name, key);
+  ASSERT_THAT(cached_path_profile, IsOk());
+  ASSERT_TRUE(cached_path_profile->has_value());
+  ExpectSameProfile(**cached_path_profile, program_path_profile);
+}
+
+TEST(PathProfileCacheTest, IgnoresCacheWithMismatchingKey) {
+  const std::string file_name =
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_mismatching.pb");
+  ProgramPathProfile program_path_profile(GetDefaultPathProfileArg());
+  ASSERT_THAT(WritePathProfileCache(program_path_profile,
+                                    {.build_id = "abcd", .input_hash = 17},
+                                    file_name),
+              IsOk());
+
+  EXPECT_THAT(ReadPathProfileCache(file_name,
+                                   {.build_id = "abcd", .input_hash = 18}),
+              IsOkAndHolds(Eq(std::nullopt)));
+  EXPECT_THAT(ReadPathProfileCache(file_name,
+                                   {.build_id = "efgh", .input_hash = 17}),
+              IsOkAndHolds(Eq(std::nullopt)));
+}
+
+TEST(PathProfileCacheTest, IgnoresMissingCache) {
+  EXPECT_THAT(
+      ReadPathProfileCache(
+          absl::StrCat(::testing::TempDir(), "/path_profile_cache_missing.pb"),
+          {.build_id = "abcd", .input_hash = 17}),
+      IsOkAndHolds(Eq(std::nullopt)));
+}
+
+TEST(PathProfileCacheTest, CacheKeyDependsOnInputProfileContents) {
+  const std::string profile_name =
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_input.data");
+  PropellerOptions options;
+  options.add_input_profiles()->set_name(profile_name);
+
+  auto compute_key_with_contents = [&](absl::string_view contents) {
+    std::ofstream(profile_name, std::ios::binary) << contents;
+    return ComputePathProfileCacheKey(options, "abcd");
+  };
+  absl::StatusOr<PathProfileCacheKey> key1 = compute_key_with_contents("foo");
+  absl::StatusOr<PathProfileCacheKey> key2 = compute_key_with_contents("foo");
+  absl::StatusOr<PathProfileCacheKey> key3 = compute_key_with_contents("bar");
+  ASSERT_THAT(key1, IsOk());
+  ASSERT_THAT(key2, IsOk());
+  ASSERT_THAT(key3, IsOk());
+  EXPECT_EQ(key1->build_id, "abcd");
+  EXPECT_EQ(*key1, *key2);
+  EXPECT_NE(*key1, *key3);
+
+  options.mutable_path_profile_options()->set_max_path_length(3);
+  absl::StatusOr<PathProfileCacheKey> key4 = compute_key_with_contents("bar");
+  ASSERT_THAT(key4, IsOk());
+  EXPECT_NE(*key3, *key4);
+}
+
+TEST(PathProfileCacheTest, CacheKeyDoesNotDependOnBinaryFileName) {
+  const std::string profile_name = absl::StrCat(
+      ::testing::TempDir(), "/path_profile_cache_binary_name.data");
+  std::ofstream(profile_name, std::ios::binary) << "foo";
+  PropellerOptions options;
+  options.add_input_profiles()->set_name(profile_name);
+  options.set_profiled_binary_name("foo.bin");
+
+  options.set_binary_name("/old/dir/foo.bin");
+  absl::StatusOr<PathProfileCacheKey> key1 =
+      ComputePathProfileCacheKey(options, "abcd");
+  options.set_binary_name("/new/dir/foo.bin");
+  absl::StatusOr<PathProfileCacheKey> key2 =
+      ComputePathProfileCacheKey(options, "abcd");
+  ASSERT_THAT(key1, IsOk());
+  ASSERT_THAT(key2, IsOk());
+  EXPECT_EQ(*key1, *key2);
+
+  // The profiled binary name selects which samples are aggregated.
+  options.set_profiled_binary_name("bar.bin");
+  absl::StatusOr<PathProfileCacheKey> key3 =
+      ComputePathProfileCacheKey(options, "abcd");
+  ASSERT_THAT(key3, IsOk());
+  EXPECT_NE(*key1, *key3);
+}
+
+TEST(PathProfileCacheTest, CacheKeyDependsOnBinaryContentsWithoutBuildId) {
+  const std::string profile_name = absl::StrCat(
+      ::testing::TempDir(), "/path_profile_cache_no_build_id.data");
+  const std::string binary_name = absl::StrCat(
+      ::testing::TempDir(), "/path_profile_cache_no_build_id.bin");
+  std::ofstream(profile_name, std::ios::binary) << "foo";
+  PropellerOptions options;
+  options.add_input_profiles()->set_name(profile_name);
+  options.set_binary_name(binary_name);
+
+  auto compute_key_with_binary_contents = [&](absl::string_view contents) {
+    std::ofstream(binary_name, std::ios::binary) << contents;
+    return ComputePathProfileCacheKey(options, /*build_id=*/"");
+  };
+  absl::StatusOr<PathProfileCacheKey> key1 =
+      compute_key_with_binary_contents("foo");
+  absl::StatusOr<PathProfileCacheKey> key2 =
+      compute_key_with_binary_contents("bar");
+  ASSERT_THAT(key1, IsOk());
+  ASSERT_THAT(key2, IsOk());
+  EXPECT_NE(*key1, *key2);
+}
+
+TEST(PathProfileCacheTest, CacheKeyFailsForMissingInputProfile) {
+  PropellerOptions options;
+  options.add_input_profiles()->set_name(
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_no_such.data"));
+  EXPECT_THAT(ComputePathProfileCacheKey(options, "abcd"),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+TEST(PathProfileCacheTest, ReaggregatesAndOverwritesCorruptCache) {
+  const std::string profile_name =
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_corrupt.data");
+  const std::string cache_name =
+      absl::StrCat(::testing::TempDir(), "/path_profile_cache_corrupt.pb");
+  std::ofstream(profile_name, std::ios::binary) << "foo";
+  std::ofstream(cache_name, std::ios::binary) << "\xff\xff\xff\xff garbage";
+  PropellerOptions options;
+  options.add_input_profiles()->set_name(profile_name);
+  options.set_path_profile_cache_name(cache_name);
+
+  BinaryContent binary_content;
+  binary_content.build_id = "abcd";
+  BinaryAddressMapper binary_address_mapper({}, {}, {}, {});
+  ProgramCfg program_cfg({});
+  int num_aggregations = 0;
+  CachingPathProfileAggregator aggregator(
+      options, std::make_unique<FakePathProfileAggregator>(num_aggregations));
+
+  absl::StatusOr<ProgramPathProfile> path_profile = aggregator.Aggregate(
+      binary_content, binary_address_mapper, program_cfg);
+  ASSERT_THAT(path_profile, IsOk());
+  EXPECT_EQ(num_aggregations, 1);
+  ExpectSameProfile(*path_profile,
+                    ProgramPathProfile(GetDefaultPathProfileArg()));
+
+  // The corrupt cache has been overwritten, so it is used the next time.
+  absl::StatusOr<ProgramPathProfile> cached_path_profile =
+      aggregator.Aggregate(binary_content, binary_address_mapper, program_cfg);
+  ASSERT_THAT(cached_path_profile, IsOk());
+  EXPECT_EQ(num_aggregations, 1);
+  ExpectSameProfile(*cached_path_profile,
+                    ProgramPathProfile(GetDefaultPathProfileArg()));
+}
+}  // namespace
+}  // namespace propeller
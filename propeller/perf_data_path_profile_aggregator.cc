@@ -14,15 +14,23 @@
 
 #include "propeller/perf_data_path_profile_aggregator.h"
 
+#include <cstddef>
 #include <memory>
 #include <optional>
 #include <string>
 #include <utility>
 
+#include "absl/base/thread_annotations.h"
+#include "absl/container/flat_hash_map.h"
 #include "absl/functional/bind_front.h"
+#include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/log/vlog_is_on.h"
+#include "absl/status/status.h"
 #include "absl/status/statusor.h"
+#include "absl/synchronization/mutex.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/binary_content.h"
 #include "propeller/path_node.h"
@@ -30,43 +38,129 @@
 #include "propeller/perf_data_provider.h"
 #include "propeller/perfdata_reader.h"
 #include "propeller/program_cfg.h"
+#include "propeller/progress_tracker.h"
 #include "propeller/program_cfg_path_analyzer.h"
 #include "propeller/resolve_mmap_name.h"
 #include "propeller/status_macros.h"  // Included for macros.
+#include "propeller/trace_recorder.h"
 
 namespace propeller {
 using ::propeller::ProgramCfgPathAnalyzer;
 using ::propeller::ProgramPathProfile;
 
-absl::StatusOr<ProgramPathProfile> PerfDataPathProfileAggregator::Aggregate(
+namespace {
+// Analyzes the paths in `perf_data` into a new path profile. Returns an empty
+// profile if `perf_data` can't be read.
+ProgramPathProfile AnalyzePerfData(
+    PerfDataProvider::BufferHandle perf_data,
+    const PropellerOptions &propeller_options,
     const BinaryContent &binary_content,
     const BinaryAddressMapper &binary_address_mapper,
     const ProgramCfg &program_cfg) {
   ProgramPathProfile program_path_profile;
+  std::string description = perf_data.description;
+  LOG(INFO) << "Parsing " << description << " ...";
+  ScopedTraceSpan trace_span("AnalyzePerfData", description);
+  absl::StatusOr<PerfDataReader> perf_data_reader =
+      BuildPerfDataReader(std::move(perf_data), &binary_content,
+                          ResolveMmapName(propeller_options));
+  if (!perf_data_reader.ok()) {
+    LOG(WARNING) << "Skipped profile " << description << ": "
+                 << perf_data_reader.status();
+    return program_path_profile;
+  }
   ProgramCfgPathAnalyzer path_analyzer(
-      &propeller_options_.path_profile_options(), &program_cfg,
+      &propeller_options.path_profile_options(), &program_cfg,
       &program_path_profile);
-  while (true) {
-    ASSIGN_OR_RETURN(std::optional<PerfDataProvider::BufferHandle> perf_data,
-                     perf_data_provider_->GetNext());
-    if (!perf_data.has_value()) break;
-    std::string description = perf_data->description;
-    LOG(INFO) << "Parsing " << description << " ...";
-    absl::StatusOr<PerfDataReader> perf_data_reader =
-        BuildPerfDataReader(*std::move(perf_data), &binary_content,
-                            ResolveMmapName(propeller_options_));
-    if (!perf_data_reader.ok()) {
-      LOG(WARNING) << "Skipped profile " << description << ": "
-                   << perf_data_reader.status();
-      continue;
+  PerfDataPathReader(&*perf_data_reader, &binary_address_mapper)
+      .ReadPathsAndApplyCallBack(absl::bind_front(
+          &ProgramCfgPathAnalyzer::StoreAndAnalyzePaths, &path_analyzer));
+  // Analyze the remaining paths.
+  path_analyzer.AnalyzePaths(/*paths_to_analyze=*/std::nullopt);
+  ProgressTracker::Global().Increment(ProgressTracker::Counter::kPerfFilesRead);
+  return program_path_profile;
+}
+}  // namespace
+
+absl::StatusOr<ProgramPathProfile> PerfDataPathProfileAggregator::Aggregate(
+    const BinaryContent &binary_content,
+    const BinaryAddressMapper &binary_address_mapper,
+    const ProgramCfg &program_cfg) {
+  // Every perf data file is analyzed independently into its own path profile
+  // by one of the workers. Workers fetch the files from `perf_data_provider_`
+  // one at a time, so at most one file per worker is held in memory.
+  const int num_workers = llvm::parallel::strategy.compute_thread_count();
+  // Path profiles are merged in the order the files were fetched, so the
+  // result is deterministic. Each one is merged (and released) as soon as all
+  // earlier ones have been merged. Workers don't fetch new files while
+  // `max_unmerged_files` files are waiting to be merged, which bounds the
+  // number of per-file path profiles held in memory when one file takes much
+  // longer to analyze than the following ones.
+  const int max_unmerged_files = 2 * num_workers;
+  absl::Mutex mutex;
+  // First error from `perf_data_provider_`. Guarded by `mutex`.
+  absl::Status status;
+  // Number of files fetched and merged so far. Guarded by `mutex`.
+  int num_fetched_files = 0;
+  int num_merged_files = 0;
+  // Path profiles of the analyzed files which can't be merged yet, keyed by
+  // the index of their file. Guarded by `mutex`.
+  absl::flat_hash_map<int, ProgramPathProfile> unmerged_file_path_profiles;
+  // Whether a worker is merging path profiles into `program_path_profile`.
+  // Guarded by `mutex`.
+  bool merging = false;
+  // Only accessed by the worker which set `merging`.
+  ProgramPathProfile program_path_profile;
+  auto can_fetch = [&]() ABSL_EXCLUSIVE_LOCKS_REQUIRED(mutex) {
+    return !status.ok() ||
+           num_fetched_files - num_merged_files < max_unmerged_files;
+  };
+  auto run_worker = [&](size_t) {
+    while (true) {
+      std::optional<PerfDataProvider::BufferHandle> perf_data;
+      int file_index;
+      {
+        absl::MutexLock lock(&mutex);
+        mutex.Await(absl::Condition(&can_fetch));
+        if (!status.ok()) return;
+        absl::StatusOr<std::optional<PerfDataProvider::BufferHandle>> next =
+            perf_data_provider_->GetNext();
+        if (!next.ok()) {
+          status = next.status();
+          return;
+        }
+        if (!next->has_value()) return;
+        perf_data = **std::move(next);
+        file_index = num_fetched_files++;
+      }
+      ProgramPathProfile file_path_profile =
+          AnalyzePerfData(*std::move(perf_data), propeller_options_,
+                          binary_content, binary_address_mapper, program_cfg);
+      absl::MutexLock lock(&mutex);
+      unmerged_file_path_profiles.emplace(file_index,
+                                          std::move(file_path_profile));
+      // Another worker is merging and will pick up this profile when its turn
+      // comes.
+      if (merging) continue;
+      merging = true;
+      while (true) {
+        auto it = unmerged_file_path_profiles.find(num_merged_files);
+        if (it == unmerged_file_path_profiles.end()) break;
+        ProgramPathProfile next_path_profile = std::move(it->second);
+        unmerged_file_path_profiles.erase(it);
+        // Let the other workers fetch and store files while merging.
+        mutex.Unlock();
+        program_path_profile.Merge(std::move(next_path_profile));
+        mutex.Lock();
+        ++num_merged_files;
+      }
+      merging = false;
     }
+  };
+  llvm::parallelFor(0, num_workers, run_worker);
+  RETURN_IF_ERROR(status);
+  CHECK(unmerged_file_path_profiles.empty());
 
-    PerfDataPathReader(&*perf_data_reader, &binary_address_mapper)
-        .ReadPathsAndApplyCallBack(absl::bind_front(
-            &ProgramCfgPathAnalyzer::StoreAndAnalyzePaths, &path_analyzer));
-    // Analyze the remaining paths.
-    path_analyzer.AnalyzePaths(/*paths_to_analyze=*/std::nullopt);
-  }
   if (VLOG_IS_ON(1)) {
     for (const auto &[function_index, function_path_profile] :
          program_path_profile.path_profiles_by_function_index()) {
@@ -29,7 +29,9 @@
 #include "propeller/propeller_options.pb.h"
 namespace propeller {
 
-// Aggregates path profiles from perf data.
+// Aggregates path profiles from perf data. Perf data files are analyzed in
+// parallel into separate path profiles, which are merged in the order of the
+// files as soon as all earlier files have been merged.
 class PerfDataPathProfileAggregator : public PathProfileAggregator {
  public:
   PerfDataPathProfileAggregator(
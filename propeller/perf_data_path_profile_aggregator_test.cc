@@ -0,0 +1,145 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/perf_data_path_profile_aggregator.h"
+
+#include <memory>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/Support/Parallel.h"
+#include "llvm/Support/Threading.h"
+#include "propeller/binary_content.h"
+#include "propeller/file_perf_data_provider.h"
+#include "propeller/path_node.h"
+#include "propeller/profile_computer.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::testing::IsEmpty;
+using ::testing::Not;
+
+static std::string GetPropellerTestDataFilePath(absl::string_view filename) {
+  return absl::StrCat(::testing::SrcDir(), "_main/propeller/testdata/",
+                      filename);
+}
+
+void ExpectSameEntry(const PathPredInfoEntry &entry,
+                     const PathPredInfoEntry &expected) {
+  EXPECT_EQ(entry.freq, expected.freq);
+  EXPECT_EQ(entry.cache_pressure, expected.cache_pressure);
+  EXPECT_EQ(entry.call_freqs, expected.call_freqs);
+  EXPECT_EQ(entry.return_to_freqs, expected.return_to_freqs);
+}
+
+void ExpectSameTree(const PathNode &path_node, const PathNode &expected) {
+  EXPECT_EQ(path_node.node_bb_index(), expected.node_bb_index());
+  ASSERT_EQ(path_node.path_pred_info().entries.size(),
+            expected.path_pred_info().entries.size());
+  for (const auto &[pred_bb_index, expected_entry] :
+       expected.path_pred_info().entries) {
+    const PathPredInfoEntry *entry =
+        path_node.path_pred_info().GetEntry(pred_bb_index);
+    ASSERT_NE(entry, nullptr);
+    ExpectSameEntry(*entry, expected_entry);
+  }
+  ExpectSameEntry(path_node.path_pred_info().missing_pred_entry,
+                  expected.path_pred_info().missing_pred_entry);
+  ASSERT_EQ(path_node.children().size(), expected.children().size());
+  for (const auto &[child_bb_index, expected_child] : expected.children()) {
+    auto it = path_node.children().find(child_bb_index);
+    ASSERT_NE(it, path_node.children().end());
+    ExpectSameTree(*it->second, *expected_child);
+  }
+}
+
+void ExpectSameProfile(const ProgramPathProfile &profile,
+                       const ProgramPathProfile &expected) {
+  ASSERT_EQ(profile.path_profiles_by_function_index().size(),
+            expected.path_profiles_by_function_index().size());
+  for (const auto &[function_index, expected_function_profile] :
+       expected.path_profiles_by_function_index()) {
+    auto it = profile.path_profiles_by_function_index().find(function_index);
+    ASSERT_NE(it, profile.path_profiles_by_function_index().end());
+    ASSERT_EQ(it->second.path_trees_by_root_bb_index().size(),
+              expected_function_profile.path_trees_by_root_bb_index().size());
+    for (const auto &[bb_index, expected_path_tree] :
+         expected_function_profile.path_trees_by_root_bb_index()) {
+      const PathNode *path_tree = it->second.GetPathTree(bb_index);
+      ASSERT_NE(path_tree, nullptr);
+      ExpectSameTree(*path_tree, *expected_path_tree);
+    }
+  }
+}
+
+TEST(PerfDataPathProfileAggregatorTest, MergesFilesInOrderWithBoundedWindow) {
+  // Use fewer workers than files, so that workers fetch new files while
+  // earlier ones are still waiting to be merged.
+  llvm::parallel::strategy = llvm::hardware_concurrency(2);
+  const std::vector<std::string> perf_data_files = {
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.1"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.2"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.1"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.2"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.2"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.1"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.1"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.2"),
+      GetPropellerTestDataFilePath("bimodal_sample_v2.perfdata.1")};
+
+  PropellerOptions options;
+  options.set_binary_name(
+      GetPropellerTestDataFilePath("bimodal_sample_v2.bin"));
+  for (const std::string &perf_data_file : perf_data_files)
+    options.add_input_profiles()->set_name(perf_data_file);
+
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(options.binary_name()));
+  ASSERT_OK_AND_ASSIGN(
+      std::unique_ptr<PropellerProfileComputer> profile_computer,
+      PropellerProfileComputer::Create(options, binary_content.get()));
+
+  PerfDataPathProfileAggregator aggregator(
+      options, std::make_unique<GenericFilePerfDataProvider>(perf_data_files));
+  ASSERT_OK_AND_ASSIGN(
+      ProgramPathProfile path_profile,
+      aggregator.Aggregate(*binary_content,
+                           profile_computer->binary_address_mapper(),
+                           profile_computer->program_cfg()));
+  EXPECT_THAT(path_profile.path_profiles_by_function_index(), Not(IsEmpty()));
+
+  // Aggregate every file on its own and merge them sequentially.
+  ProgramPathProfile expected_path_profile;
+  for (const std::string &perf_data_file : perf_data_files) {
+    PerfDataPathProfileAggregator file_aggregator(
+        options, std::make_unique<GenericFilePerfDataProvider>(
+                     std::vector<std::string>{perf_data_file}));
+    ASSERT_OK_AND_ASSIGN(
+        ProgramPathProfile file_path_profile,
+        file_aggregator.Aggregate(*binary_content,
+                                  profile_computer->binary_address_mapper(),
+                                  profile_computer->program_cfg()));
+    expected_path_profile.Merge(std::move(file_path_profile));
+  }
+  ExpectSameProfile(path_profile, expected_path_profile);
+}
+}  // namespace
+}  // namespace propeller
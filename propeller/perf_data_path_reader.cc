@@ -26,13 +26,10 @@
 
 namespace propeller {
 
-void PerfDataPathReader::ReadPathsAndApplyCallBack(
-    absl::FunctionRef<void(absl::Span<const FlatBbHandleBranchPath>)>
-        handle_paths_callback) {
-  std::vector<FlatBbHandleBranchPath> result;
+void PerfDataPathReader::ReadBinaryAddressPathsAndApplyCallBack(
+    absl::FunctionRef<void(const BinaryAddressBranchPath &)> path_callback) {
   perf_data_reader_->ReadWithSampleCallBack(
       [&](const quipper::PerfDataProto_SampleEvent &event) {
-        std::vector<FlatBbHandleBranchPath> paths;
         BinaryAddressBranchPath lbr_path(
             {.pid = event.pid(),
              .sample_time = absl::FromUnixNanos(event.sample_time_ns())});
@@ -46,6 +43,15 @@ void PerfDataPathReader::ReadPathsAndApplyCallBack(
               event.pid(), branch_entry.to_ip());
           lbr_path.branches.push_back({.from = from, .to = to});
         }
+        path_callback(lbr_path);
+      });
+}
+
+void PerfDataPathReader::ReadPathsAndApplyCallBack(
+    absl::FunctionRef<void(absl::Span<const FlatBbHandleBranchPath>)>
+        handle_paths_callback) {
+  ReadBinaryAddressPathsAndApplyCallBack(
+      [&](const BinaryAddressBranchPath &lbr_path) {
         handle_paths_callback(
             address_mapper_->ExtractIntraFunctionPaths(lbr_path));
       });
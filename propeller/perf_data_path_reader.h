@@ -17,6 +17,7 @@
 
 #include "absl/functional/function_ref.h"
 #include "absl/types/span.h"
+#include "propeller/binary_address_branch_path.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/perfdata_reader.h"
 
@@ -37,6 +38,11 @@ class PerfDataPathReader {
   PerfDataPathReader(PerfDataPathReader &&) = default;
   PerfDataPathReader &operator=(PerfDataPathReader &&) = default;
 
+  // Calls `path_callback` on the LBR path, in binary addresses, of every
+  // sample event with a branch stack.
+  void ReadBinaryAddressPathsAndApplyCallBack(
+      absl::FunctionRef<void(const BinaryAddressBranchPath &)> path_callback);
+
   // Reads intra-function paths from every LBR sample event and calls
   // `handle_paths_callback` on the set of paths captured from each sample.
   void ReadPathsAndApplyCallBack(
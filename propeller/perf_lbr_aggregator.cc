@@ -32,9 +32,11 @@
 #include "propeller/mini_disassembler.h"
 #include "propeller/perf_data_provider.h"
 #include "propeller/perfdata_reader.h"
+#include "propeller/progress_tracker.h"
 #include "propeller/propeller_options.pb.h"
 #include "propeller/propeller_statistics.h"
 #include "propeller/resolve_mmap_name.h"
+#include "propeller/stage_timer.h"
 #include "propeller/status_macros.h"  // Included for macros.
 
 namespace propeller {
@@ -53,8 +55,11 @@ absl::StatusOr<LbrAggregation> PerfLbrAggregator::AggregateLbrData(
 
     const std::string description = perf_data->description;
     LOG(INFO) << "Parsing " << description << " ...";
-    absl::StatusOr<PerfDataReader> perf_data_reader = BuildPerfDataReader(
-        std::move(*perf_data), &binary_content, ResolveMmapName(options));
+    absl::StatusOr<PerfDataReader> perf_data_reader = [&] {
+      ScopedStageTimer timer("mmap_selection", stats.stage_stats);
+      return BuildPerfDataReader(std::move(*perf_data), &binary_content,
+                                 ResolveMmapName(options));
+    }();
     if (!perf_data_reader.ok()) {
       LOG(WARNING) << "Skipped profile " << description << ": "
                    << perf_data_reader.status();
@@ -63,7 +68,10 @@ absl::StatusOr<LbrAggregation> PerfLbrAggregator::AggregateLbrData(
 
     profile_stats.binary_mmap_num += perf_data_reader->binary_mmaps().size();
     ++stats.profile_stats.perf_file_parsed;
+    ScopedStageTimer timer("lbr_aggregation", stats.stage_stats);
     perf_data_reader->AggregateLBR(&lbr_aggregation);
+    ProgressTracker::Global().Increment(
+        ProgressTracker::Counter::kPerfFilesRead);
   }
   profile_stats.br_counters_accumulated +=
       lbr_aggregation.GetNumberOfBranchCounters();
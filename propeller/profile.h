@@ -16,22 +16,44 @@
 #define PROPELLER_PROFILE_H_
 
 #include <memory>
+#include <optional>
+#include <string>
 #include <vector>
 
 #include "absl/container/btree_map.h"
+#include "absl/container/flat_hash_map.h"
 #include "llvm/ADT/StringRef.h"
+#include "propeller/cluster_profile.h"
 #include "propeller/function_chain_info.h"
 #include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
 #include "propeller/propeller_statistics.h"
 
 namespace propeller {
 
+// Cluster profile of a function whose layout is kept from a previously
+// generated profile.
+struct PreviousFunctionProfile {
+  // Cluster profile of the function in `VERSION_1` text format.
+  std::string text;
+  // Edge profile of the function in the previous profile.
+  std::optional<std::vector<CfgProfileNode>> cfg_profile;
+};
+
 struct PropellerProfile {
   std::unique_ptr<ProgramCfg> program_cfg;
   // Layout of functions in each section.
   absl::btree_map<llvm::StringRef, std::vector<FunctionChainInfo>>
       functions_chain_info_by_section_name;
   PropellerStats stats;
+  // Previous cluster profiles of the functions whose layout is unchanged or
+  // whose layout changes were suppressed, by function index. These are
+  // written instead of the cluster profiles of their layouts, so they stay
+  // byte-identical.
+  absl::flat_hash_map<int, PreviousFunctionProfile> previous_function_profiles;
+  // Code layout parameters used for the layout, if they were tuned (see
+  // `LayoutTuningOptions`).
+  std::optional<PropellerCodeLayoutParameters> tuned_code_layout_params;
 };
 }  // namespace propeller
 
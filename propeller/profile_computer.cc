@@ -17,6 +17,8 @@
 #include <cstdint>
 #include <iterator>
 #include <memory>
+#include <optional>
+#include <random>
 #include <string>
 #include <utility>
 #include <vector>
@@ -29,12 +31,14 @@
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/memory/memory.h"
+#include "absl/random/distributions.h"
 #include "absl/status/status.h"
 #include "absl/status/statusor.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/string_view.h"
 #include "llvm/ADT/StringRef.h"
 #include "propeller/addr2cu.h"
+#include "propeller/binary_address_branch_path.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/binary_content.h"
 #include "propeller/branch_aggregation.h"
@@ -43,16 +47,24 @@
 #include "propeller/code_layout.h"
 #include "propeller/file_perf_data_provider.h"
 #include "propeller/function_chain_info.h"
+#include "propeller/layout_cache_simulator.h"
+#include "propeller/layout_parameter_tuner.h"
 #include "propeller/lbr_branch_aggregator.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_aggregator.h"
+#include "propeller/path_profile_cache.h"
 #include "propeller/perf_data_path_profile_aggregator.h"
+#include "propeller/perf_data_path_reader.h"
 #include "propeller/perf_data_provider.h"
 #include "propeller/perf_lbr_aggregator.h"
+#include "propeller/perfdata_reader.h"
 #include "propeller/profile.h"
 #include "propeller/program_cfg_builder.h"
+#include "propeller/progress_tracker.h"
 #include "propeller/propeller_options.pb.h"
 #include "propeller/propeller_statistics.h"
+#include "propeller/resolve_mmap_name.h"
+#include "propeller/stage_timer.h"
 #include "propeller/status_macros.h"  // Included for macros.
 
 namespace propeller {
@@ -81,25 +93,114 @@ std::vector<std::string> ExtractProfileNames(const PropellerOptions &options) {
 
   return profile_names;
 }
+
+// Returns a uniform random sample of up to `max_samples` LBR paths of all the
+// input profiles of `options`, to be replayed by the layout tuner. The sample
+// is drawn by reservoir sampling over every sample of every profile with a
+// fixed seed, and the paths are returned in the order they were read.
+// Profiles which can't be read are skipped.
+absl::StatusOr<std::vector<BinaryAddressBranchPath>> ReadLayoutTuningPaths(
+    const PropellerOptions &options, const BinaryContent &binary_content,
+    const BinaryAddressMapper &binary_address_mapper, int max_samples) {
+  // Sampled paths along with their positions in the read order.
+  std::vector<std::pair<int64_t, BinaryAddressBranchPath>> reservoir;
+  int64_t num_read_paths = 0;
+  std::mt19937_64 gen(/*seed=*/0);
+  GenericFilePerfDataProvider perf_data_provider(ExtractProfileNames(options));
+  while (true) {
+    ASSIGN_OR_RETURN(std::optional<PerfDataProvider::BufferHandle> perf_data,
+                     perf_data_provider.GetNext());
+    if (!perf_data.has_value()) break;
+    std::string description = perf_data->description;
+    absl::StatusOr<PerfDataReader> perf_data_reader = BuildPerfDataReader(
+        *std::move(perf_data), &binary_content, ResolveMmapName(options));
+    if (!perf_data_reader.ok()) {
+      LOG(WARNING) << "Skipped profile " << description << ": "
+                   << perf_data_reader.status();
+      continue;
+    }
+    PerfDataPathReader(&*perf_data_reader, &binary_address_mapper)
+        .ReadBinaryAddressPathsAndApplyCallBack(
+            [&](const BinaryAddressBranchPath &path) {
+              const int64_t index = num_read_paths++;
+              if (reservoir.size() < max_samples) {
+                reservoir.emplace_back(index, path);
+                return;
+              }
+              const int64_t slot =
+                  absl::Uniform<int64_t>(gen, 0, num_read_paths);
+              if (slot < max_samples) reservoir[slot] = {index, path};
+            });
+  }
+  absl::c_sort(reservoir, [](const auto &a, const auto &b) {
+    return a.first < b.first;
+  });
+  std::vector<BinaryAddressBranchPath> paths;
+  paths.reserve(reservoir.size());
+  for (auto &[index, path] : reservoir) paths.push_back(std::move(path));
+  return paths;
+}
 }  // namespace
 
 absl::StatusOr<PropellerProfile> PropellerProfileComputer::ComputeProfile() && {
   CHECK_NE(program_cfg_, nullptr) << "ProgramCfg is not initialized.";
   if (program_path_profile_.has_value()) {
+    ScopedStageTimer timer("clone_evaluation", stats_.stage_stats);
     program_cfg_ = ApplyClonings(
         options_.code_layout_params(), options_.path_profile_options(),
         *program_path_profile_, std::move(program_cfg_), stats_.cloning_stats);
+    ProgressTracker::Global().UpdateStats(stats_);
+  }
+
+  std::optional<PropellerCodeLayoutParameters> tuned_code_layout_params;
+  const LayoutTuningOptions &tuning_options = options_.layout_tuning_options();
+  if (tuning_options.has_tuned_params_out_name()) {
+    ScopedStageTimer timer("layout_tuning", stats_.stage_stats);
+    // Replay the LBR samples over the candidate layouts if the objective is
+    // the cache behavior and they can be read.
+    std::optional<LayoutTuningTrace> trace;
+    if (tuning_options.objective() != LayoutTuningOptions::EXT_TSP &&
+        tuning_options.max_trace_samples() > 0) {
+      ASSIGN_OR_RETURN(InstructionCacheConfig cache_config,
+                       GetLayoutTuningCacheConfig(tuning_options));
+      ASSIGN_OR_RETURN(
+          std::vector<BinaryAddressBranchPath> paths,
+          ReadLayoutTuningPaths(options_, *binary_content_,
+                                *binary_address_mapper_,
+                                tuning_options.max_trace_samples()));
+      if (!paths.empty()) {
+        trace = LayoutTuningTrace{
+            .address_mapper = binary_address_mapper_.get(),
+            .paths = std::move(paths),
+            .cache_config = cache_config};
+      }
+    }
+    LayoutTuningResult tuning_result = TuneCodeLayoutParameters(
+        *program_cfg_, options_.code_layout_params(), tuning_options,
+        trace.has_value() ? &*trace : nullptr);
+    LOG(INFO) << "Tuned code layout parameters in "
+              << tuning_result.num_evaluations << " evaluations, score: "
+              << tuning_result.initial_score << " -> " << tuning_result.score;
+    tuned_code_layout_params = std::move(tuning_result.params);
   }
 
   absl::btree_map<llvm::StringRef, std::vector<FunctionChainInfo>>
-      chain_info_by_section_name =
-          GenerateLayoutBySection(*program_cfg_, options_.code_layout_params(),
-                                  stats_.code_layout_stats);
-
-  return PropellerProfile({.program_cfg = std::move(program_cfg_),
-                           .functions_chain_info_by_section_name =
-                               std::move(chain_info_by_section_name),
-                           .stats = std::move(stats_)});
+      chain_info_by_section_name;
+  {
+    ScopedStageTimer timer("layout", stats_.stage_stats);
+    chain_info_by_section_name = GenerateLayoutBySection(
+        *program_cfg_,
+        tuned_code_layout_params.value_or(options_.code_layout_params()),
+        stats_.code_layout_stats);
+  }
+  ProgressTracker::Global().UpdateStats(stats_);
+
+  return PropellerProfile(
+      {.program_cfg = std::move(program_cfg_),
+       .functions_chain_info_by_section_name =
+           std::move(chain_info_by_section_name),
+       .stats = std::move(stats_),
+       .tuned_code_layout_params = std::move(tuned_code_layout_params)});
 }
 
 absl::StatusOr<std::unique_ptr<PropellerProfileComputer>>
@@ -131,10 +232,16 @@ PropellerProfileComputer::Create(
   if (!options.path_profile_options().enable_cloning())
     return Create(options, binary_content, std::move(branch_aggregator));
 
+  std::unique_ptr<PathProfileAggregator> path_profile_aggregator =
+      std::make_unique<PerfDataPathProfileAggregator>(
+          options, std::make_unique<GenericFilePerfDataProvider>(
+                       /*file_names=*/ExtractProfileNames(options)));
+  if (!options.path_profile_cache_name().empty()) {
+    path_profile_aggregator = std::make_unique<CachingPathProfileAggregator>(
+        options, std::move(path_profile_aggregator));
+  }
   return Create(options, binary_content, std::move(branch_aggregator),
-                std::make_unique<PerfDataPathProfileAggregator>(
-                    options, std::make_unique<GenericFilePerfDataProvider>(
-                                 /*file_names=*/ExtractProfileNames(options))));
+                std::move(path_profile_aggregator));
 }
 
 absl::StatusOr<std::unique_ptr<PropellerProfileComputer>>
@@ -164,13 +271,26 @@ absl::Status PropellerProfileComputer::InitializeProgramProfile() {
   ASSIGN_OR_RETURN(absl::flat_hash_set<uint64_t> unique_addresses,
                    branch_aggregator_->GetBranchEndpointAddresses());
 
-  ASSIGN_OR_RETURN(binary_address_mapper_,
-                   BuildBinaryAddressMapper(options_, *binary_content_, stats_,
-                                            &unique_addresses));
+  {
+    ScopedStageTimer timer("address_mapping", stats_.stage_stats);
+    ASSIGN_OR_RETURN(binary_address_mapper_,
+                     BuildBinaryAddressMapper(options_, *binary_content_,
+                                              stats_, &unique_addresses));
+  }
+  // Export the stats of every stage to /statusz as soon as it finishes.
+  ProgressTracker::Global().UpdateStats(stats_);
 
-  ASSIGN_OR_RETURN(
-      BranchAggregation branch_aggregation,
-      branch_aggregator_->Aggregate(*binary_address_mapper_, stats_));
+  std::optional<ColumnarBranchAggregation> branch_aggregation;
+  {
+    ScopedStageTimer timer("branch_aggregation", stats_.stage_stats);
+    ASSIGN_OR_RETURN(
+        BranchAggregation aggregation,
+        branch_aggregator_->Aggregate(*binary_address_mapper_, stats_));
+    // Freeze the aggregation into sorted columns, so that cfg building maps
+    // the branches to blocks in address order.
+    branch_aggregation.emplace(aggregation);
+  }
+  ProgressTracker::Global().UpdateStats(stats_);
 
   std::unique_ptr<Addr2Cu> addr2cu;
   if (options_.output_module_name()) {
@@ -183,16 +303,22 @@ absl::Status PropellerProfileComputer::InitializeProgramProfile() {
           options_.binary_name().c_str(), options_.binary_name().c_str()));
     }
   }
-  ASSIGN_OR_RETURN(program_cfg_,
-                   ProgramCfgBuilder(binary_address_mapper_.get(), stats_)
-                       .Build(branch_aggregation, addr2cu.get()));
+  {
+    ScopedStageTimer timer("cfg_build", stats_.stage_stats);
+    ASSIGN_OR_RETURN(program_cfg_,
+                     ProgramCfgBuilder(binary_address_mapper_.get(), stats_)
+                         .Build(*branch_aggregation, addr2cu.get()));
+  }
+  ProgressTracker::Global().UpdateStats(stats_);
 
   if (path_profile_aggregator_ != nullptr) {
+    ScopedStageTimer timer("path_profiling", stats_.stage_stats);
     ASSIGN_OR_RETURN(
         program_path_profile_,
         path_profile_aggregator_->Aggregate(
             *binary_content_, *binary_address_mapper_, *program_cfg_));
   }
+  ProgressTracker::Global().UpdateStats(stats_);
   return absl::OkStatus();
 }
 }  // namespace propeller
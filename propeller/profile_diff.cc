@@ -0,0 +1,479 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/profile_diff.h"
+
+#include <algorithm>
+#include <cstdint>
+#include <fstream>
+#include <optional>
+#include <string>
+#include <tuple>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/container/flat_hash_map.h"
+#include "absl/container/flat_hash_set.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringRef.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_id.h"
+#include "propeller/cfg_node.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/code_layout.h"
+#include "propeller/code_layout_scorer.h"
+#include "propeller/file_helpers.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/profile.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/status_macros.h"  // Included for macros.
+
+namespace propeller {
+namespace {
+// Returns the key for matching functions across profiles.
+std::string GetFunctionKey(std::optional<absl::string_view> module_name,
+                           absl::string_view primary_name) {
+  return absl::StrCat(module_name.value_or(""), ":", primary_name);
+}
+
+absl::string_view ToStringView(llvm::StringRef str) {
+  return absl::string_view(str.data(), str.size());
+}
+
+ProfileBbId ToProfileBbId(const FullIntraCfgId &full_bb_id) {
+  return {.bb_id = full_bb_id.bb_id,
+          .clone_number = full_bb_id.intra_cfg_id.clone_number};
+}
+
+// Returns the clone paths of `cfg` by their bb ids.
+std::vector<std::vector<int>> GetCloneBbIdPaths(const ControlFlowGraph &cfg) {
+  std::vector<std::vector<int>> clone_paths;
+  for (const std::vector<int> &clone_path : cfg.clone_paths()) {
+    std::vector<int> &bb_ids = clone_paths.emplace_back();
+    for (int bb_index : clone_path)
+      bb_ids.push_back(cfg.nodes()[bb_index]->bb_id());
+  }
+  return clone_paths;
+}
+
+// Returns the clusters of the layout in `func_chain_info`.
+std::vector<std::vector<ProfileBbId>> GetClusters(
+    const FunctionChainInfo &func_chain_info) {
+  std::vector<std::vector<ProfileBbId>> clusters;
+  for (const FunctionChainInfo::BbChain &chain : func_chain_info.bb_chains) {
+    std::vector<ProfileBbId> &cluster = clusters.emplace_back();
+    for (const FullIntraCfgId &full_bb_id : chain.GetAllBbs())
+      cluster.push_back(ToProfileBbId(full_bb_id));
+  }
+  return clusters;
+}
+
+// Returns the nodes of `cfg` in `clusters`, or `std::nullopt` if any of the
+// blocks doesn't exist in `cfg` or appears more than once.
+std::optional<std::vector<std::vector<const CFGNode *>>> GetClusterNodes(
+    const ControlFlowGraph &cfg,
+    absl::Span<const std::vector<ProfileBbId>> clusters) {
+  absl::flat_hash_map<std::pair<int, int>, const CFGNode *> nodes_by_bb_id;
+  for (const auto &node : cfg.nodes()) {
+    nodes_by_bb_id.emplace(std::make_pair(node->bb_id(), node->clone_number()),
+                           node.get());
+  }
+  absl::flat_hash_set<const CFGNode *> seen_nodes;
+  std::vector<std::vector<const CFGNode *>> cluster_nodes;
+  for (const std::vector<ProfileBbId> &cluster : clusters) {
+    if (cluster.empty()) return std::nullopt;
+    std::vector<const CFGNode *> &nodes = cluster_nodes.emplace_back();
+    for (const ProfileBbId &bb_id : cluster) {
+      auto it = nodes_by_bb_id.find(
+          std::make_pair(bb_id.bb_id, bb_id.clone_number));
+      if (it == nodes_by_bb_id.end() || !seen_nodes.insert(it->second).second)
+        return std::nullopt;
+      nodes.push_back(it->second);
+    }
+  }
+  return cluster_nodes;
+}
+
+// Returns the intra-function ext-tsp score of `cfg` when its `clusters` are
+// laid out consecutively, followed by its remaining nodes in their original
+// order. This ignores the interleaving with other functions' clusters, so it
+// allows comparing two layouts of the same function.
+double ComputeIntraScore(
+    const ControlFlowGraph &cfg,
+    absl::Span<const std::vector<const CFGNode *>> clusters,
+    const PropellerCodeLayoutScorer &scorer) {
+  absl::flat_hash_map<const CFGNode *, uint64_t> layout_address_map;
+  uint64_t layout_addr = 0;
+  for (const std::vector<const CFGNode *> &cluster : clusters) {
+    for (const CFGNode *node : cluster) {
+      layout_address_map.emplace(node, layout_addr);
+      layout_addr += node->size();
+    }
+  }
+  for (const auto &node : cfg.nodes()) {
+    if (layout_address_map.emplace(node.get(), layout_addr).second)
+      layout_addr += node->size();
+  }
+  return ComputeCfgScore(
+             cfg, scorer,
+             [&](const CFGNode *node) -> std::optional<uint64_t> {
+               return layout_address_map.at(node);
+             },
+             /*score_inter_edges=*/false)
+      .intra_score;
+}
+
+// Returns the number of `clusters` which are not in `previous_clusters`.
+int CountChangedClusters(
+    absl::Span<const std::vector<ProfileBbId>> clusters,
+    absl::Span<const std::vector<ProfileBbId>> previous_clusters) {
+  return absl::c_count_if(clusters, [&](const std::vector<ProfileBbId> &c) {
+    return !absl::c_linear_search(previous_clusters, c);
+  });
+}
+
+// Replaces the bb chains of `func_chain_info` with `cluster_nodes`. The i'th
+// new chain takes the layout index of the i'th old chain (or the last one if
+// there are fewer old chains), so the layout indices of the section must be
+// renumbered afterwards.
+void ReplaceChains(
+    FunctionChainInfo &func_chain_info,
+    absl::Span<const std::vector<const CFGNode *>> cluster_nodes) {
+  CHECK(!func_chain_info.bb_chains.empty());
+  const int num_old_chains = func_chain_info.bb_chains.size();
+  std::vector<FunctionChainInfo::BbChain> bb_chains;
+  bb_chains.reserve(cluster_nodes.size());
+  for (int i = 0; i < cluster_nodes.size(); ++i) {
+    FunctionChainInfo::BbChain &chain = bb_chains.emplace_back(
+        func_chain_info.bb_chains[std::min(i, num_old_chains - 1)]
+            .layout_index);
+    FunctionChainInfo::BbBundle &bb_bundle = chain.bb_bundles.emplace_back();
+    for (const CFGNode *node : cluster_nodes[i])
+      bb_bundle.full_bb_ids.push_back(node->full_intra_cfg_id());
+  }
+  func_chain_info.bb_chains = std::move(bb_chains);
+}
+
+// Renumbers the layout indices of the chains in `section_chain_infos` to be
+// consecutive, ordering chains with the same layout index by their index in
+// their function.
+void RenumberLayoutIndices(
+    std::vector<FunctionChainInfo> &section_chain_infos) {
+  std::vector<std::tuple<unsigned, int, FunctionChainInfo::BbChain *>> chains;
+  for (FunctionChainInfo &func_chain_info : section_chain_infos) {
+    for (int i = 0; i < func_chain_info.bb_chains.size(); ++i) {
+      FunctionChainInfo::BbChain &chain = func_chain_info.bb_chains[i];
+      chains.emplace_back(chain.layout_index, i, &chain);
+    }
+  }
+  absl::c_sort(chains);
+  for (unsigned layout_index = 0; layout_index < chains.size(); ++layout_index)
+    std::get<2>(chains[layout_index])->layout_index = layout_index;
+}
+
+// Returns the profile to write for a function whose layout is kept from
+// `previous_function`. The text of a function parsed from a text profile is
+// kept verbatim, except for the lines which `options` doesn't write.
+PreviousFunctionProfile GetPreviousFunctionProfile(
+    const ClusterProfileFunction &previous_function,
+    const PropellerOptions &options) {
+  PreviousFunctionProfile previous_function_profile;
+  if (options.write_cfg_profile())
+    previous_function_profile.cfg_profile = previous_function.cfg_profile;
+  if (previous_function.text.empty()) {
+    ClusterProfileFunction kept_function = previous_function;
+    kept_function.cfg_profile = previous_function_profile.cfg_profile;
+    // Pass the function's own section name to omit the section line.
+    AppendTextClusterProfile(kept_function, kept_function.section_name,
+                             previous_function_profile.text);
+    return previous_function_profile;
+  }
+  for (absl::string_view line :
+       absl::StrSplit(previous_function.text, '\n', absl::SkipEmpty())) {
+    if (!options.write_cfg_profile() && absl::StartsWith(line, "#cfg"))
+      continue;
+    if (!options.verbose_cluster_output() && absl::StartsWith(line, "#ext-tsp"))
+      continue;
+    absl::StrAppend(&previous_function_profile.text, line, "\n");
+  }
+  return previous_function_profile;
+}
+
+// Returns the report line for `kind`.
+absl::string_view GetKindName(FunctionProfileDiff::Kind kind) {
+  switch (kind) {
+    case FunctionProfileDiff::Kind::kAdded:
+      return "added";
+    case FunctionProfileDiff::Kind::kRemoved:
+      return "removed";
+    case FunctionProfileDiff::Kind::kChanged:
+      return "changed";
+    case FunctionProfileDiff::Kind::kSuppressed:
+      return "suppressed";
+  }
+  return "unknown";
+}
+}  // namespace
+
+ProfileDiff ApplyProfileDiff(
+    absl::Span<const ClusterProfileFunction> previous_functions,
+    const PropellerOptions &options, PropellerProfile &profile) {
+  const ProfileDiffOptions &diff_options = options.profile_diff_options();
+  const PropellerCodeLayoutScorer scorer(options.code_layout_params());
+
+  // Index the previous functions by their keys. If a key repeats, the first
+  // function wins.
+  absl::flat_hash_map<std::string, int> previous_function_indices;
+  for (int i = 0; i < previous_functions.size(); ++i) {
+    const ClusterProfileFunction &function = previous_functions[i];
+    if (function.names.empty()) continue;
+    previous_function_indices.try_emplace(
+        GetFunctionKey(function.module_name, function.names.front()), i);
+  }
+  std::vector<bool> previous_function_matched(previous_functions.size());
+
+  ProfileDiff profile_diff;
+  for (auto &[section_name, section_chain_infos] :
+       profile.functions_chain_info_by_section_name) {
+    bool section_changed = false;
+    for (FunctionChainInfo &func_chain_info : section_chain_infos) {
+      const ControlFlowGraph *cfg =
+          profile.program_cfg->GetCfgByIndex(func_chain_info.function_index);
+      CHECK_NE(cfg, nullptr);
+      std::optional<absl::string_view> module_name;
+      if (cfg->module_name().has_value())
+        module_name = ToStringView(*cfg->module_name());
+      const std::string name(cfg->GetPrimaryName());
+      auto it =
+          previous_function_indices.find(GetFunctionKey(module_name, name));
+      if (it == previous_function_indices.end()) {
+        profile_diff.function_diffs.push_back(
+            {.kind = FunctionProfileDiff::Kind::kAdded, .name = name});
+        continue;
+      }
+      previous_function_matched[it->second] = true;
+      const ClusterProfileFunction &previous_function =
+          previous_functions[it->second];
+      std::vector<std::vector<ProfileBbId>> clusters =
+          GetClusters(func_chain_info);
+      std::vector<std::vector<int>> clone_paths = GetCloneBbIdPaths(*cfg);
+      if (clusters == previous_function.clusters &&
+          clone_paths == previous_function.clone_paths) {
+        // Keep the previous profile of the function (unless it lacks the edge
+        // profile to write), so its output stays byte-identical even if its
+        // edge weights changed.
+        if (!options.write_cfg_profile() ||
+            previous_function.cfg_profile.has_value()) {
+          profile.previous_function_profiles[func_chain_info.function_index] =
+              GetPreviousFunctionProfile(previous_function, options);
+        }
+        continue;
+      }
+      FunctionProfileDiff function_diff = {
+          .kind = FunctionProfileDiff::Kind::kChanged,
+          .name = name,
+          .num_changed_clusters =
+              CountChangedClusters(clusters, previous_function.clusters)};
+      // The previous layout can only be evaluated (and kept) if the function
+      // is cloned the same way.
+      std::optional<std::vector<std::vector<const CFGNode *>>>
+          previous_cluster_nodes;
+      if (clone_paths == previous_function.clone_paths) {
+        previous_cluster_nodes =
+            GetClusterNodes(*cfg, previous_function.clusters);
+      }
+      if (previous_cluster_nodes.has_value()) {
+        std::optional<std::vector<std::vector<const CFGNode *>>> cluster_nodes =
+            GetClusterNodes(*cfg, clusters);
+        CHECK(cluster_nodes.has_value());
+        function_diff.score_gain =
+            ComputeIntraScore(*cfg, *cluster_nodes, scorer) -
+            ComputeIntraScore(*cfg, *previous_cluster_nodes, scorer);
+        if (*function_diff.score_gain <= diff_options.min_score_gain()) {
+          function_diff.kind = FunctionProfileDiff::Kind::kSuppressed;
+          ReplaceChains(func_chain_info, *previous_cluster_nodes);
+          section_changed = true;
+          profile.previous_function_profiles[func_chain_info.function_index] =
+              GetPreviousFunctionProfile(previous_function, options);
+        }
+      }
+      profile_diff.function_diffs.push_back(std::move(function_diff));
+    }
+    if (section_changed) RenumberLayoutIndices(section_chain_infos);
+  }
+  for (int i = 0; i < previous_functions.size(); ++i) {
+    if (previous_function_matched[i] || previous_functions[i].names.empty())
+      continue;
+    profile_diff.function_diffs.push_back(
+        {.kind = FunctionProfileDiff::Kind::kRemoved,
+         .name = std::string(previous_functions[i].names.front())});
+  }
+  return profile_diff;
+}
+
+absl::StatusOr<ProfileDiff> ApplyPreviousProfile(
+    const PropellerOptions &options, PropellerProfile &profile) {
+  const std::string &previous_cluster_profile_name =
+      options.profile_diff_options().previous_cluster_profile_name();
+  ASSIGN_OR_RETURN(std::string previous_cluster_profile,
+                   propeller_file::GetContents(previous_cluster_profile_name));
+  ASSIGN_OR_RETURN(std::vector<ClusterProfileFunction> previous_functions,
+                   ParseClusterProfile(previous_cluster_profile));
+  LOG(INFO) << "Diffing against " << previous_functions.size()
+            << " functions in '" << previous_cluster_profile_name << "'.";
+  return ApplyProfileDiff(previous_functions, options, profile);
+}
+
+SymbolOrderDiff DiffSymbolOrders(
+    absl::Span<const absl::string_view> previous_symbols,
+    absl::Span<const absl::string_view> symbols) {
+  SymbolOrderDiff symbol_order_diff;
+  absl::flat_hash_map<absl::string_view, int> previous_positions;
+  for (int i = 0; i < previous_symbols.size(); ++i)
+    previous_positions.try_emplace(previous_symbols[i], i);
+
+  // Previous positions of the common symbols, in the new order.
+  std::vector<int> common_positions;
+  std::vector<absl::string_view> common_symbols;
+  absl::flat_hash_set<absl::string_view> seen_symbols;
+  for (absl::string_view symbol : symbols) {
+    if (!seen_symbols.insert(symbol).second) continue;
+    auto it = previous_positions.find(symbol);
+    if (it == previous_positions.end()) {
+      symbol_order_diff.added_symbols.emplace_back(symbol);
+      continue;
+    }
+    common_positions.push_back(it->second);
+    common_symbols.push_back(symbol);
+  }
+  for (int i = 0; i < previous_symbols.size(); ++i) {
+    // Only report the first occurrence of a repeated symbol.
+    if (!seen_symbols.contains(previous_symbols[i]) &&
+        previous_positions.at(previous_symbols[i]) == i) {
+      symbol_order_diff.removed_symbols.emplace_back(previous_symbols[i]);
+    }
+  }
+
+  // The common symbols which keep their relative order form the longest
+  // increasing subsequence of `common_positions`. All others must be moved.
+  // `tails[k]` is the index of the smallest tail of an increasing subsequence
+  // of length k + 1 and `predecessors[i]` is the index of the element before
+  // `i` in the subsequence ending at `i`.
+  std::vector<int> tails;
+  std::vector<int> predecessors(common_positions.size(), -1);
+  for (int i = 0; i < common_positions.size(); ++i) {
+    auto it = absl::c_lower_bound(tails, i, [&](int a, int b) {
+      return common_positions[a] < common_positions[b];
+    });
+    if (it != tails.begin()) predecessors[i] = *std::prev(it);
+    if (it == tails.end()) {
+      tails.push_back(i);
+    } else {
+      *it = i;
+    }
+  }
+  std::vector<bool> in_order(common_positions.size());
+  for (int i = tails.empty() ? -1 : tails.back(); i != -1; i = predecessors[i])
+    in_order[i] = true;
+  for (int i = 0; i < common_symbols.size(); ++i) {
+    if (!in_order[i])
+      symbol_order_diff.moved_symbols.emplace_back(common_symbols[i]);
+  }
+  return symbol_order_diff;
+}
+
+std::string FormatProfileDiff(const ProfileDiff &profile_diff) {
+  absl::flat_hash_map<FunctionProfileDiff::Kind, int> counts;
+  for (const FunctionProfileDiff &function_diff : profile_diff.function_diffs)
+    ++counts[function_diff.kind];
+  std::string out = absl::StrFormat(
+      "functions: %d added, %d removed, %d changed, %d suppressed",
+      counts[FunctionProfileDiff::Kind::kAdded],
+      counts[FunctionProfileDiff::Kind::kRemoved],
+      counts[FunctionProfileDiff::Kind::kChanged],
+      counts[FunctionProfileDiff::Kind::kSuppressed]);
+  const std::optional<SymbolOrderDiff> &symbol_order_diff =
+      profile_diff.symbol_order_diff;
+  if (symbol_order_diff.has_value()) {
+    absl::StrAppendFormat(&out, "; symbols: %d added, %d removed, %d moved",
+                          symbol_order_diff->added_symbols.size(),
+                          symbol_order_diff->removed_symbols.size(),
+                          symbol_order_diff->moved_symbols.size());
+  }
+  absl::StrAppend(&out, "\n");
+  for (const FunctionProfileDiff &function_diff : profile_diff.function_diffs) {
+    absl::StrAppend(&out, GetKindName(function_diff.kind), " ",
+                    function_diff.name);
+    if (function_diff.kind == FunctionProfileDiff::Kind::kChanged ||
+        function_diff.kind == FunctionProfileDiff::Kind::kSuppressed) {
+      absl::StrAppend(&out, " changed_clusters=",
+                      function_diff.num_changed_clusters, " score_gain=");
+      if (function_diff.score_gain.has_value()) {
+        absl::StrAppendFormat(&out, "%f", *function_diff.score_gain);
+      } else {
+        absl::StrAppend(&out, "unknown");
+      }
+    }
+    absl::StrAppend(&out, "\n");
+  }
+  if (symbol_order_diff.has_value()) {
+    for (const std::string &symbol : symbol_order_diff->added_symbols)
+      absl::StrAppend(&out, "added_symbol ", symbol, "\n");
+    for (const std::string &symbol : symbol_order_diff->removed_symbols)
+      absl::StrAppend(&out, "removed_symbol ", symbol, "\n");
+    for (const std::string &symbol : symbol_order_diff->moved_symbols)
+      absl::StrAppend(&out, "moved_symbol ", symbol, "\n");
+  }
+  return out;
+}
+
+absl::Status WriteProfileDiff(const PropellerOptions &options,
+                              ProfileDiff &profile_diff) {
+  const ProfileDiffOptions &diff_options = options.profile_diff_options();
+  if (diff_options.has_previous_symbol_order_name()) {
+    ASSIGN_OR_RETURN(
+        std::string previous_symbol_order,
+        propeller_file::GetContents(diff_options.previous_symbol_order_name()));
+    ASSIGN_OR_RETURN(
+        std::string symbol_order,
+        propeller_file::GetContents(options.symbol_order_out_name()));
+    std::vector<absl::string_view> previous_symbols =
+        absl::StrSplit(previous_symbol_order, '\n', absl::SkipEmpty());
+    std::vector<absl::string_view> symbols =
+        absl::StrSplit(symbol_order, '\n', absl::SkipEmpty());
+    profile_diff.symbol_order_diff =
+        DiffSymbolOrders(previous_symbols, symbols);
+  }
+  std::string report = FormatProfileDiff(profile_diff);
+  LOG(INFO) << "Profile diff: " << report.substr(0, report.find('\n'));
+  if (!diff_options.has_diff_out_name()) return absl::OkStatus();
+  std::ofstream os(diff_options.diff_out_name(), std::ios::binary);
+  if (!os) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open file: ", diff_options.diff_out_name()));
+  }
+  os.write(report.data(), report.size());
+  return absl::OkStatus();
+}
+}  // namespace propeller
@@ -0,0 +1,107 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_PROFILE_DIFF_H_
+#define PROPELLER_PROFILE_DIFF_H_
+
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/profile.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+
+// Difference of one function's cluster profile from the previous profile.
+struct FunctionProfileDiff {
+  enum class Kind {
+    // The function is only in the new profile.
+    kAdded,
+    // The function is only in the previous profile.
+    kRemoved,
+    // The clusters or clone paths of the function changed.
+    kChanged,
+    // The clusters or clone paths of the function changed, but the change was
+    // suppressed and the previous cluster profile is kept.
+    kSuppressed,
+  };
+
+  Kind kind;
+  // Primary name of the function.
+  std::string name;
+  // Number of clusters of the new layout which are not in the previous layout.
+  int num_changed_clusters = 0;
+  // Intra-function layout score gain of the new layout over the previous
+  // layout, or `std::nullopt` if the previous layout doesn't apply to the
+  // current cfg (e.g., because the clone paths changed).
+  std::optional<double> score_gain;
+};
+
+// Difference of the symbol order from the previous symbol order.
+struct SymbolOrderDiff {
+  std::vector<std::string> added_symbols;
+  std::vector<std::string> removed_symbols;
+  // Smallest set of common symbols which must be moved to turn the previous
+  // symbol order into the new one.
+  std::vector<std::string> moved_symbols;
+};
+
+struct ProfileDiff {
+  // Diffs of added, removed and changed functions, in the order of the new
+  // profile followed by the removed functions.
+  std::vector<FunctionProfileDiff> function_diffs;
+  std::optional<SymbolOrderDiff> symbol_order_diff;
+};
+
+// Diffs the layout in `profile` against the `previous_functions` of the
+// previous cluster profile. Functions are matched by their module and primary
+// names. Changed functions whose score gain does not exceed
+// `diff_options.min_score_gain()` get their previous layout back: their bb
+// chains in `profile` are replaced with the previous clusters (renumbering the
+// layout indices of the section). The previous cluster profiles of these and
+// of the unchanged functions are recorded in
+// `profile.previous_function_profiles`, keeping the text of functions parsed
+// from a text profile verbatim.
+ProfileDiff ApplyProfileDiff(
+    absl::Span<const ClusterProfileFunction> previous_functions,
+    const PropellerOptions &options, PropellerProfile &profile);
+
+// Reads the previous cluster profile `options.profile_diff_options()` and
+// applies it to `profile` with `ApplyProfileDiff`.
+absl::StatusOr<ProfileDiff> ApplyPreviousProfile(
+    const PropellerOptions &options, PropellerProfile &profile);
+
+// Returns the difference of `symbols` from `previous_symbols`.
+SymbolOrderDiff DiffSymbolOrders(
+    absl::Span<const absl::string_view> previous_symbols,
+    absl::Span<const absl::string_view> symbols);
+
+// Returns the report of `profile_diff`: a summary line followed by one line
+// per function and symbol difference.
+std::string FormatProfileDiff(const ProfileDiff &profile_diff);
+
+// Completes `profile_diff` with the symbol order difference (if the previous
+// symbol order profile is specified) and writes its report to the diff output
+// file in `options.profile_diff_options()`. Must be called after the new
+// profiles are written.
+absl::Status WriteProfileDiff(const PropellerOptions &options,
+                              ProfileDiff &profile_diff);
+}  // namespace propeller
+#endif  // PROPELLER_PROFILE_DIFF_H_
@@ -0,0 +1,251 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/profile_diff.h"
+
+#include <memory>
+#include <optional>
+#include <string>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/cfg_edge_kind.h"
+#include "propeller/cfg_id.h"
+#include "propeller/cfg_testutil.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/code_layout.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/profile.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::testing::_;
+using ::testing::AllOf;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::FieldsAre;
+using ::testing::Gt;
+using ::testing::IsEmpty;
+using ::testing::Key;
+using ::testing::Optional;
+using ::testing::UnorderedElementsAre;
+
+// Returns the profile of a single function "foo" with a hot loop between
+// blocks 1 and 3.
+PropellerProfile GetProfile(const PropellerOptions &options) {
+  PropellerProfile profile = {
+      .program_cfg = std::make_unique<ProgramCfg>(
+          TestCfgBuilder(
+              {.cfg_args = {{".text",
+                             0,
+                             "foo",
+                             {{0x1000, 0, 0x10},
+                              {0x1010, 1, 0x7},
+                              {0x1020, 2, 0xa},
+                              {0x102a, 3, 0x4}},
+                             {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough},
+                              {0, 2, 1, CFGEdgeKind::kBranchOrFallthough},
+                              {1, 3, 95, CFGEdgeKind::kBranchOrFallthough},
+                              {3, 1, 100, CFGEdgeKind::kBranchOrFallthough}}}}})
+              .Build())};
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  profile.functions_chain_info_by_section_name = GenerateLayoutBySection(
+      *profile.program_cfg, options.code_layout_params(), code_layout_stats);
+  return profile;
+}
+
+// Returns the clusters of "foo" in `profile`, by their bb ids.
+std::vector<std::vector<int>> GetFooClusters(const PropellerProfile &profile) {
+  std::vector<std::vector<int>> clusters;
+  for (const FunctionChainInfo::BbChain &chain :
+       profile.functions_chain_info_by_section_name.at(".text")
+           .front()
+           .bb_chains) {
+    std::vector<int> &cluster = clusters.emplace_back();
+    for (const FullIntraCfgId &full_bb_id : chain.GetAllBbs())
+      cluster.push_back(full_bb_id.bb_id);
+  }
+  return clusters;
+}
+
+// Returns the previous profile of "foo" with the given `clusters`.
+ClusterProfileFunction GetPreviousFoo(
+    const std::vector<std::vector<int>> &clusters) {
+  ClusterProfileFunction function = {.section_name = ".text",
+                                     .names = {"foo"}};
+  for (const std::vector<int> &cluster : clusters) {
+    std::vector<ProfileBbId> &profile_cluster =
+        function.clusters.emplace_back();
+    for (int bb_id : cluster) profile_cluster.push_back({.bb_id = bb_id});
+  }
+  return function;
+}
+
+TEST(ProfileDiffTest, IgnoresUnchangedFunctions) {
+  PropellerOptions options;
+  PropellerProfile profile = GetProfile(options);
+  const std::vector<std::vector<int>> clusters = GetFooClusters(profile);
+  const ClusterProfileFunction previous_foo = GetPreviousFoo(clusters);
+
+  ProfileDiff profile_diff = ApplyProfileDiff({previous_foo}, options, profile);
+  EXPECT_THAT(profile_diff.function_diffs, IsEmpty());
+  EXPECT_THAT(profile.previous_function_profiles, IsEmpty());
+  EXPECT_EQ(GetFooClusters(profile), clusters);
+}
+
+TEST(ProfileDiffTest, KeepsPreviousTextOfUnchangedFunctions) {
+  PropellerOptions options;
+  options.set_verbose_cluster_output(true);
+  PropellerProfile profile = GetProfile(options);
+  std::string clusters_text;
+  for (const std::vector<int> &cluster : GetFooClusters(profile))
+    absl::StrAppend(&clusters_text, "c", absl::StrJoin(cluster, " "), "\n");
+  // The previous profile has other scores and edge weights.
+  const std::string previous_foo_text =
+      absl::StrCat("f foo\n#ext-tsp score: [intra: 1 -> 2]\n", clusters_text,
+                   "#cfg 0:1\n");
+  const std::string previous_profile = absl::StrCat("v1\n", previous_foo_text);
+  ASSERT_OK_AND_ASSIGN(std::vector<ClusterProfileFunction> previous_functions,
+                       ParseTextClusterProfile(previous_profile));
+
+  ProfileDiff profile_diff =
+      ApplyProfileDiff(previous_functions, options, profile);
+  EXPECT_THAT(profile_diff.function_diffs, IsEmpty());
+  ASSERT_THAT(profile.previous_function_profiles, ElementsAre(Key(0)));
+  EXPECT_EQ(profile.previous_function_profiles.at(0).text, previous_foo_text);
+
+  // Lines which are not written with the new options are dropped.
+  options.set_verbose_cluster_output(false);
+  options.set_write_cfg_profile(false);
+  profile = GetProfile(options);
+  ApplyProfileDiff(previous_functions, options, profile);
+  ASSERT_THAT(profile.previous_function_profiles, ElementsAre(Key(0)));
+  EXPECT_EQ(profile.previous_function_profiles.at(0).text,
+            absl::StrCat("f foo\n", clusters_text));
+}
+
+TEST(ProfileDiffTest, ReportsAddedAndRemovedFunctions) {
+  PropellerOptions options;
+  PropellerProfile profile = GetProfile(options);
+  const ClusterProfileFunction previous_bar = {.section_name = ".text",
+                                               .names = {"bar"}};
+
+  ProfileDiff profile_diff = ApplyProfileDiff({previous_bar}, options, profile);
+  EXPECT_THAT(
+      profile_diff.function_diffs,
+      ElementsAre(FieldsAre(FunctionProfileDiff::Kind::kAdded, "foo", 0,
+                            std::nullopt),
+                  FieldsAre(FunctionProfileDiff::Kind::kRemoved, "bar", 0,
+                            std::nullopt)));
+}
+
+TEST(ProfileDiffTest, KeepsChangesWithLargeScoreGain) {
+  PropellerOptions options;
+  PropellerProfile profile = GetProfile(options);
+  const std::vector<std::vector<int>> clusters = GetFooClusters(profile);
+  // Splitting the hot loop gives a lower score than the new layout.
+  const ClusterProfileFunction previous_foo = GetPreviousFoo({{0, 3}, {1}});
+
+  ProfileDiff profile_diff = ApplyProfileDiff({previous_foo}, options, profile);
+  EXPECT_THAT(profile_diff.function_diffs,
+              ElementsAre(FieldsAre(FunctionProfileDiff::Kind::kChanged,
+                                    "foo", _, Optional(Gt(0)))));
+  EXPECT_THAT(profile.previous_function_profiles, IsEmpty());
+  EXPECT_EQ(GetFooClusters(profile), clusters);
+}
+
+TEST(ProfileDiffTest, SuppressesChangesWithSmallScoreGain) {
+  PropellerOptions options;
+  options.mutable_profile_diff_options()->set_min_score_gain(1e9);
+  options.set_write_cfg_profile(false);
+  PropellerProfile profile = GetProfile(options);
+  ClusterProfileFunction previous_foo = GetPreviousFoo({{0, 3}, {1}});
+  previous_foo.cfg_profile.emplace();
+
+  ProfileDiff profile_diff = ApplyProfileDiff({previous_foo}, options, profile);
+  EXPECT_THAT(profile_diff.function_diffs,
+              ElementsAre(Field(&FunctionProfileDiff::kind,
+                                FunctionProfileDiff::Kind::kSuppressed)));
+  EXPECT_THAT(GetFooClusters(profile), ElementsAre(ElementsAre(0, 3),
+                                                   ElementsAre(1)));
+  // Layout indices stay consecutive.
+  const std::vector<FunctionChainInfo::BbChain> &bb_chains =
+      profile.functions_chain_info_by_section_name.at(".text")
+          .front()
+          .bb_chains;
+  EXPECT_THAT(
+      bb_chains,
+      UnorderedElementsAre(
+          Field(&FunctionChainInfo::BbChain::layout_index, 0),
+          Field(&FunctionChainInfo::BbChain::layout_index, 1)));
+  ASSERT_THAT(profile.previous_function_profiles, ElementsAre(Key(0)));
+  EXPECT_EQ(profile.previous_function_profiles.at(0).text,
+            "f foo\nc0 3\nc1\n");
+  EXPECT_EQ(profile.previous_function_profiles.at(0).cfg_profile,
+            std::nullopt);
+}
+
+TEST(ProfileDiffTest, DoesNotSuppressInapplicableLayouts) {
+  PropellerOptions options;
+  options.mutable_profile_diff_options()->set_min_score_gain(1e9);
+  PropellerProfile profile = GetProfile(options);
+  // Block 7 doesn't exist in the current cfg.
+  const ClusterProfileFunction previous_foo = GetPreviousFoo({{0, 7}});
+
+  ProfileDiff profile_diff = ApplyProfileDiff({previous_foo}, options, profile);
+  EXPECT_THAT(profile_diff.function_diffs,
+              ElementsAre(AllOf(Field(&FunctionProfileDiff::kind,
+                                      FunctionProfileDiff::Kind::kChanged),
+                                Field(&FunctionProfileDiff::score_gain,
+                                      std::nullopt))));
+  EXPECT_THAT(profile.previous_function_profiles, IsEmpty());
+}
+
+TEST(ProfileDiffTest, DiffsSymbolOrders) {
+  const std::vector<absl::string_view> previous_symbols = {"a", "b", "c", "d",
+                                                           "e"};
+  const std::vector<absl::string_view> symbols = {"b", "a", "c", "e", "f"};
+  SymbolOrderDiff symbol_order_diff =
+      DiffSymbolOrders(previous_symbols, symbols);
+  EXPECT_THAT(symbol_order_diff.added_symbols, ElementsAre("f"));
+  EXPECT_THAT(symbol_order_diff.removed_symbols, ElementsAre("d"));
+  EXPECT_THAT(symbol_order_diff.moved_symbols, ElementsAre("b"));
+}
+
+TEST(ProfileDiffTest, FormatsProfileDiff) {
+  ProfileDiff profile_diff = {
+      .function_diffs = {{.kind = FunctionProfileDiff::Kind::kAdded,
+                          .name = "foo"},
+                         {.kind = FunctionProfileDiff::Kind::kSuppressed,
+                          .name = "bar",
+                          .num_changed_clusters = 2,
+                          .score_gain = 1.5}},
+      .symbol_order_diff = SymbolOrderDiff{.moved_symbols = {"baz"}}};
+  EXPECT_EQ(FormatProfileDiff(profile_diff),
+            "functions: 1 added, 0 removed, 0 changed, 1 suppressed; symbols: "
+            "0 added, 0 removed, 1 moved\n"
+            "added foo\n"
+            "suppressed bar changed_clusters=2 score_gain=1.500000\n"
+            "moved_symbol baz\n");
+}
+}  // namespace
+}  // namespace propeller
@@ -14,17 +14,22 @@
 
 #include "propeller/profile_generator.h"
 
+#include <fstream>
+#include <ios>
 #include <iterator>
 #include <memory>
+#include <optional>
 #include <string>
 #include <utility>
 #include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_set.h"
+#include "absl/functional/function_ref.h"
 #include "absl/log/check.h"
 #include "absl/log/log.h"
 #include "absl/status/status.h"
+#include "absl/status/statusor.h"
 #include "absl/strings/str_cat.h"
 #include "google/protobuf/repeated_ptr_field.h"
 #include "propeller/binary_content.h"
@@ -40,10 +45,16 @@
 #include "propeller/perf_lbr_aggregator.h"
 #include "propeller/profile.h"
 #include "propeller/profile_computer.h"
+#include "propeller/profile_diff.h"
 #include "propeller/profile_writer.h"
+#include "propeller/progress_tracker.h"
 #include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
 #include "propeller/proto_branch_frequencies_aggregator.h"
+#include "propeller/stage_timer.h"
+#include "propeller/status_server.h"
 #include "propeller/status_macros.h"  // Included for macros.
+#include "propeller/trace_recorder.h"
 
 namespace propeller {
 namespace {
@@ -151,53 +162,117 @@ CreatePathProfileAggregator(ProfileType profile_type,
       opts, CreatePerfDataProvider(opts));
 }
 
-// Generates propeller profiles for the provided options.
+// Loads the binary content of `opts.binary_name()`, recording its stage stats
+// in `stage_stats`.
+absl::StatusOr<std::unique_ptr<BinaryContent>> LoadBinaryContent(
+    const PropellerOptions &opts, PropellerStats::StageStats &stage_stats) {
+  ScopedStageTimer timer("binary_load", stage_stats);
+  return GetBinaryContent(opts.binary_name());
+}
+
+// Writes the stage stats in JSON format to `opts.stage_stats_out_name()`, if
+// it is specified.
+absl::Status WriteStageStats(const PropellerOptions &opts,
+                             const PropellerStats::StageStats &stage_stats) {
+  if (opts.stage_stats_out_name().empty()) return absl::OkStatus();
+  std::ofstream os(opts.stage_stats_out_name(), std::ios::binary);
+  if (!os) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open file: ", opts.stage_stats_out_name()));
+  }
+  os << stage_stats.ToJson();
+  return absl::OkStatus();
+}
+
+// Generates propeller profiles for the provided options. `stage_stats` holds
+// the stats of the stages which ran before (e.g., binary load).
 absl::Status GeneratePropellerProfiles(
     const PropellerOptions &opts, std::unique_ptr<BinaryContent> binary_content,
     std::unique_ptr<BranchAggregator> branch_aggregator,
-    std::unique_ptr<PathProfileAggregator> path_profile_aggregator) {
+    std::unique_ptr<PathProfileAggregator> path_profile_aggregator,
+    PropellerStats::StageStats stage_stats) {
   ASSIGN_OR_RETURN(std::unique_ptr<PropellerProfileComputer> profile_computer,
                    PropellerProfileComputer::Create(
                        opts, binary_content.get(), std::move(branch_aggregator),
                        std::move(path_profile_aggregator)));
   ASSIGN_OR_RETURN(PropellerProfile profile,
                    std::move(*std::move(profile_computer)).ComputeProfile());
+  stage_stats += profile.stats.stage_stats;
+  profile.stats.stage_stats = std::move(stage_stats);
 
-  PropellerProfileWriter(opts).Write(profile);
+  std::optional<ProfileDiff> profile_diff;
+  if (opts.profile_diff_options().has_previous_cluster_profile_name()) {
+    ASSIGN_OR_RETURN(profile_diff, ApplyPreviousProfile(opts, profile));
+  }
+  {
+    ScopedStageTimer timer("write", profile.stats.stage_stats);
+    RETURN_IF_ERROR(PropellerProfileWriter(opts).Write(profile));
+    if (profile_diff.has_value())
+      RETURN_IF_ERROR(WriteProfileDiff(opts, *profile_diff));
+  }
   LOG(INFO) << profile.stats.DebugString();
 
-  return absl::OkStatus();
+  return WriteStageStats(opts, profile.stats.stage_stats);
+}
+
+// Runs `generate`, serving /statusz if `opts.http()` is set and recording its
+// trace if `opts.trace_options()` specifies a trace output file. The trace is
+// written even if `generate` fails.
+absl::Status RunInstrumented(const PropellerOptions &opts,
+                             absl::FunctionRef<absl::Status()> generate) {
+  std::unique_ptr<StatusServer> status_server;
+  if (opts.http()) {
+    ASSIGN_OR_RETURN(status_server, StatusServer::Start(
+                                        opts.http_port(),
+                                        ProgressTracker::Global()));
+  }
+  if (!opts.trace_options().has_trace_out_name()) return generate();
+  TraceRecorder trace_recorder(opts.trace_options());
+  absl::Status status = generate();
+  absl::Status write_status =
+      trace_recorder.Write(opts.trace_options().trace_out_name());
+  return status.ok() ? write_status : status;
 }
 }  // namespace
 
 absl::Status GeneratePropellerProfiles(const PropellerOptions &opts) {
-  ASSIGN_OR_RETURN(ProfileType profile_type, GetProfileType(opts));
-  ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
-                   GetBinaryContent(opts.binary_name()));
-  ASSIGN_OR_RETURN(std::unique_ptr<BranchAggregator> branch_aggregator,
-                   CreateBranchAggregator(profile_type, opts, *binary_content));
-  ASSIGN_OR_RETURN(
-      std::unique_ptr<PathProfileAggregator> path_profile_aggregator,
-      CreatePathProfileAggregator(profile_type, opts));
-  return GeneratePropellerProfiles(opts, std::move(binary_content),
-                                   std::move(branch_aggregator),
-                                   std::move(path_profile_aggregator));
+  return RunInstrumented(opts, [&]() -> absl::Status {
+    RETURN_IF_ERROR(ValidateCfgDumpOptions(opts.cfg_dump_options()));
+    ASSIGN_OR_RETURN(ProfileType profile_type, GetProfileType(opts));
+    PropellerStats::StageStats stage_stats;
+    ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
+                     LoadBinaryContent(opts, stage_stats));
+    ASSIGN_OR_RETURN(
+        std::unique_ptr<BranchAggregator> branch_aggregator,
+        CreateBranchAggregator(profile_type, opts, *binary_content));
+    ASSIGN_OR_RETURN(
+        std::unique_ptr<PathProfileAggregator> path_profile_aggregator,
+        CreatePathProfileAggregator(profile_type, opts));
+    return GeneratePropellerProfiles(
+        opts, std::move(binary_content), std::move(branch_aggregator),
+        std::move(path_profile_aggregator), std::move(stage_stats));
+  });
 }
 
 absl::Status GeneratePropellerProfiles(
     const PropellerOptions &opts,
     std::unique_ptr<PerfDataProvider> perf_data_provider,
     ProfileType profile_type) {
-  ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
-                   GetBinaryContent(opts.binary_name()));
-  ASSIGN_OR_RETURN(std::unique_ptr<BranchAggregator> branch_aggregator,
-                   CreateBranchAggregator(profile_type, opts, *binary_content,
-                                          std::move(perf_data_provider)));
-  // If we only have one perf_data_provider, we can't have both branch and
-  // path data.
-  return GeneratePropellerProfiles(opts, std::move(binary_content),
-                                   std::move(branch_aggregator),
-                                   /*path_profile_aggregator=*/nullptr);
+  return RunInstrumented(opts, [&]() -> absl::Status {
+    RETURN_IF_ERROR(ValidateCfgDumpOptions(opts.cfg_dump_options()));
+    PropellerStats::StageStats stage_stats;
+    ASSIGN_OR_RETURN(std::unique_ptr<BinaryContent> binary_content,
+                     LoadBinaryContent(opts, stage_stats));
+    ASSIGN_OR_RETURN(std::unique_ptr<BranchAggregator> branch_aggregator,
+                     CreateBranchAggregator(profile_type, opts, *binary_content,
+                                            std::move(perf_data_provider)));
+    // If we only have one perf_data_provider, we can't have both branch and
+    // path data.
+    return GeneratePropellerProfiles(opts, std::move(binary_content),
+                                     std::move(branch_aggregator),
+                                     /*path_profile_aggregator=*/nullptr,
+                                     std::move(stage_stats));
+  });
 }
 
 }  // namespace propeller
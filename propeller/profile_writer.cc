@@ -14,10 +14,13 @@
 
 #include "propeller/profile_writer.h"
 
+#include <cstddef>
+#include <cstdint>
 #include <fstream>
 #include <memory>
 #include <optional>
 #include <ostream>
+#include <sstream>
 #include <string>
 #include <utility>
 #include <vector>
@@ -25,34 +28,134 @@
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/status.h"
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
 #include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "google/protobuf/text_format.h"
 #include "llvm/ADT/SmallString.h"
 #include "llvm/ADT/SmallVector.h"
 #include "llvm/ADT/StringExtras.h"
 #include "llvm/ADT/StringRef.h"
 #include "llvm/Support/FileSystem.h"
+#include "llvm/Support/Parallel.h"
 #include "llvm/Support/Path.h"
+#include "llvm/Support/Regex.h"
 #include "propeller/cfg.h"
 #include "propeller/cfg_edge.h"
 #include "propeller/cfg_id.h"
 #include "propeller/cfg_node.h"
+#include "propeller/cluster_profile.h"
 #include "propeller/function_chain_info.h"
 #include "propeller/profile.h"
 #include "propeller/propeller_options.pb.h"
+#include "propeller/status_macros.h"  // Included for macros.
 
 namespace propeller {
 namespace {
+// Returns the functions whose cfgs must be dumped according to
+// `cfg_dump_options`, in the order they appear in `profile`.
+std::vector<const FunctionChainInfo *> SelectCfgsToDump(
+    const PropellerProfile &profile, const CfgDumpOptions &cfg_dump_options) {
+  std::optional<llvm::Regex> function_name_regex;
+  if (cfg_dump_options.has_function_name_regex()) {
+    function_name_regex.emplace(cfg_dump_options.function_name_regex());
+    // The regex is checked by `ValidateCfgDumpOptions` when the options are
+    // parsed.
+    CHECK(function_name_regex->isValid());
+  }
+  std::vector<const FunctionChainInfo *> selected;
+  for (const auto &[section_name, section_function_chain_info] :
+       profile.functions_chain_info_by_section_name) {
+    for (const FunctionChainInfo &func_chain_info :
+         section_function_chain_info) {
+      if (func_chain_info.optimized_score.intra_score -
+              func_chain_info.original_score.intra_score <
+          cfg_dump_options.min_score_gain()) {
+        continue;
+      }
+      if (function_name_regex.has_value()) {
+        const ControlFlowGraph *cfg =
+            profile.program_cfg->GetCfgByIndex(func_chain_info.function_index);
+        CHECK_NE(cfg, nullptr);
+        if (absl::c_none_of(cfg->names(), [&](llvm::StringRef name) {
+              return function_name_regex->match(name);
+            })) {
+          continue;
+        }
+      }
+      selected.push_back(&func_chain_info);
+    }
+  }
+  const int max_functions = cfg_dump_options.max_functions();
+  if (max_functions <= 0 || selected.size() <= max_functions) return selected;
+
+  // Keep the most frequently executed functions, breaking ties by their order
+  // in the profile.
+  std::vector<std::pair<int64_t, int>> freq_and_index;
+  freq_and_index.reserve(selected.size());
+  for (int i = 0; i < selected.size(); ++i) {
+    int64_t total_freq = 0;
+    profile.program_cfg->GetCfgByIndex(selected[i]->function_index)
+        ->ForEachNodeRef([&](const CFGNode &node) {
+          total_freq += node.CalculateFrequency();
+        });
+    freq_and_index.emplace_back(-total_freq, i);
+  }
+  auto top_end = freq_and_index.begin() + max_functions;
+  absl::c_nth_element(freq_and_index, top_end);
+  std::vector<int> top_indices;
+  top_indices.reserve(max_functions);
+  for (auto it = freq_and_index.begin(); it != top_end; ++it)
+    top_indices.push_back(it->second);
+  absl::c_sort(top_indices);
+  std::vector<const FunctionChainInfo *> top_selected;
+  top_selected.reserve(top_indices.size());
+  for (int index : top_indices) top_selected.push_back(selected[index]);
+  return top_selected;
+}
+
+// Returns the cfg of `func_chain_info` in dot format, with the layout edges
+// colored red.
+std::string GetCfgDotFormat(const ControlFlowGraph &cfg,
+                            const FunctionChainInfo &func_chain_info) {
+  absl::flat_hash_map<IntraCfgId, int> layout_index_map;
+  for (auto &bb_chain : func_chain_info.bb_chains) {
+    int bbs = 0;
+    for (auto &bb_bundle : bb_chain.bb_bundles) {
+      for (int bbi = 0; bbi < bb_bundle.full_bb_ids.size(); ++bbi) {
+        layout_index_map.insert({bb_bundle.full_bb_ids[bbi].intra_cfg_id,
+                                 bb_chain.layout_index + bbs + bbi});
+      }
+      bbs += bb_bundle.full_bb_ids.size();
+    }
+  }
+  std::ostringstream os;
+  cfg.WriteDotFormat(os, layout_index_map);
+  return std::move(os).str();
+}
+
+// Returns the path of the file `file_name` in the directory `dir_name`.
+std::string GetFilePath(absl::string_view dir_name, llvm::StringRef file_name) {
+  llvm::SmallString<100> file_path(dir_name.begin(), dir_name.end());
+  llvm::sys::path::append(file_path, file_name);
+  return std::string(file_path.str());
+}
+
 void DumpCfgs(const PropellerProfile &profile,
-              absl::string_view cfg_dump_dir_name) {
+              absl::string_view cfg_dump_dir_name,
+              const CfgDumpOptions &cfg_dump_options) {
+  std::vector<const FunctionChainInfo *> func_chain_infos =
+      SelectCfgsToDump(profile, cfg_dump_options);
+  LOG(INFO) << "Dumping " << func_chain_infos.size() << " cfgs into "
+            << cfg_dump_dir_name;
+
   // Create the cfg dump directory and the cfg index file.
   llvm::sys::fs::create_directory(cfg_dump_dir_name);
-  llvm::SmallString<100> cfg_index_file_vec(cfg_dump_dir_name.begin(),
-                                            cfg_dump_dir_name.end());
-  llvm::sys::path::append(cfg_index_file_vec, "cfg-index.txt");
-  std::string cfg_index_file(cfg_index_file_vec.str());
+  std::string cfg_index_file = GetFilePath(cfg_dump_dir_name, "cfg-index.txt");
   std::ofstream cfg_index_os(cfg_index_file, std::ofstream::out);
   CHECK(cfg_index_os.good())
       << "Failed to open " << cfg_index_file << " for writing.";
@@ -62,50 +165,50 @@ void DumpCfgs(const PropellerProfile &profile,
                                 " ")
                << "\n";
 
-  for (const auto &[section_name, section_function_chain_info] :
-       profile.functions_chain_info_by_section_name) {
-    for (const FunctionChainInfo &func_chain_info :
-         section_function_chain_info) {
-      const ControlFlowGraph *cfg =
-          profile.program_cfg->GetCfgByIndex(func_chain_info.function_index);
-      CHECK_NE(cfg, nullptr);
-      // Dump hot cfgs into the given directory.
-      auto func_addr_str =
-          absl::StrCat("0x", absl::Hex(cfg->GetEntryNode()->addr()));
-      cfg_index_os << cfg->GetPrimaryName().str() << " " << func_addr_str << " "
-                   << cfg->nodes().size() << " "
-                   << func_chain_info.bb_chains.size() << " "
-                   << func_chain_info.original_score.intra_score << " "
-                   << func_chain_info.optimized_score.intra_score << "\n";
-
-      // Use the address of the function as the CFG filename for uniqueness.
-      llvm::SmallString<100> cfg_dump_file_vec(cfg_dump_dir_name.begin(),
-                                               cfg_dump_dir_name.end());
-      llvm::sys::path::append(cfg_dump_file_vec,
-                              absl::StrCat(func_addr_str, ".dot"));
-      std::string cfg_dump_file(cfg_dump_file_vec.str());
-      std::ofstream cfg_dump_os(cfg_dump_file, std::ofstream::out);
-      CHECK(cfg_dump_os.good())
-          << "Failed to open " << cfg_dump_file << " for writing.";
+  // Format (and unless dumping into a single file, write) the cfgs in
+  // parallel.
+  std::vector<std::string> cfg_dots(
+      cfg_dump_options.single_file() ? func_chain_infos.size() : 0);
+  llvm::parallelFor(0, func_chain_infos.size(), [&](size_t i) {
+    const FunctionChainInfo &func_chain_info = *func_chain_infos[i];
+    const ControlFlowGraph *cfg =
+        profile.program_cfg->GetCfgByIndex(func_chain_info.function_index);
+    CHECK_NE(cfg, nullptr);
+    std::string cfg_dot = GetCfgDotFormat(*cfg, func_chain_info);
+    if (cfg_dump_options.single_file()) {
+      cfg_dots[i] = std::move(cfg_dot);
+      return;
+    }
+    // Use the address of the function as the CFG filename for uniqueness.
+    std::string cfg_dump_file = GetFilePath(
+        cfg_dump_dir_name,
+        absl::StrCat("0x", absl::Hex(cfg->GetEntryNode()->addr()), ".dot"));
+    std::ofstream cfg_dump_os(cfg_dump_file, std::ofstream::out);
+    CHECK(cfg_dump_os.good())
+        << "Failed to open " << cfg_dump_file << " for writing.";
+    cfg_dump_os << cfg_dot;
+  });
 
-      absl::flat_hash_map<IntraCfgId, int> layout_index_map;
-      for (auto &bb_chain : func_chain_info.bb_chains) {
-        int bbs = 0;
-        for (auto &bb_bundle : bb_chain.bb_bundles) {
-          for (int bbi = 0; bbi < bb_bundle.full_bb_ids.size(); ++bbi) {
-            layout_index_map.insert({bb_bundle.full_bb_ids[bbi].intra_cfg_id,
-                                     bb_chain.layout_index + bbs + bbi});
-          }
-          bbs += bb_bundle.full_bb_ids.size();
-        }
-      }
+  for (const FunctionChainInfo *func_chain_info : func_chain_infos) {
+    const ControlFlowGraph *cfg =
+        profile.program_cfg->GetCfgByIndex(func_chain_info->function_index);
+    cfg_index_os << cfg->GetPrimaryName().str() << " "
+                 << absl::StrCat("0x", absl::Hex(cfg->GetEntryNode()->addr()))
+                 << " " << cfg->nodes().size() << " "
+                 << func_chain_info->bb_chains.size() << " "
+                 << func_chain_info->original_score.intra_score << " "
+                 << func_chain_info->optimized_score.intra_score << "\n";
+  }
 
-      cfg->WriteDotFormat(cfg_dump_os, layout_index_map);
-    }
+  if (cfg_dump_options.single_file()) {
+    std::string cfgs_file = GetFilePath(cfg_dump_dir_name, "cfgs.dot");
+    std::ofstream cfgs_os(cfgs_file, std::ofstream::out);
+    CHECK(cfgs_os.good()) << "Failed to open " << cfgs_file << " for writing.";
+    for (const std::string &cfg_dot : cfg_dots) cfgs_os << cfg_dot;
   }
 }
 
-// Writes the intra-function edge profile of `cfg` into `out` in a single line
+// Appends the intra-function edge profile of `cfg` to `out` in a single line
 // which starts with the "#cfg" marker.
 // For each CFGNode with non-zero frequency, it prints out the node and edge
 // frequencies in the following format:
@@ -113,34 +216,239 @@ void DumpCfgs(const PropellerProfile &profile,
 // which starts first with the full bb id and frequency of that node, followed
 // by the successors and their edge frequencies. Please note that the edge
 // weights may not precisely add up to the node frequency.
-void WriteCfgProfile(const ControlFlowGraph &cfg, std::ofstream &out) {
-  out << "#cfg";
+void AppendCfgProfile(const ControlFlowGraph &cfg, std::string &out) {
+  absl::StrAppend(&out, "#cfg");
   cfg.ForEachNodeRef([&](const CFGNode &node) {
     int node_frequency = node.CalculateFrequency();
     if (node_frequency == 0) return;
-    out << " " << node.full_intra_cfg_id().profile_bb_id() << ":"
-        << node_frequency;
+    absl::StrAppend(&out, " ", node.full_intra_cfg_id().profile_bb_id(), ":",
+                    node_frequency);
     node.ForEachOutEdgeInOrder([&](const CFGEdge &edge) {
       if (!edge.IsBranchOrFallthrough()) return;
-      out << "," << edge.sink()->full_intra_cfg_id().profile_bb_id() << ":"
-          << edge.weight();
+      absl::StrAppend(&out, ",",
+                      edge.sink()->full_intra_cfg_id().profile_bb_id(), ":",
+                      edge.weight());
     });
   });
-  out << "\n";
+  absl::StrAppend(&out, "\n");
+}
+
+// Returns the intra-function edge profile of `cfg` for the binary encoding,
+// with the same contents as written by `AppendCfgProfile`.
+std::vector<CfgProfileNode> GetCfgProfile(const ControlFlowGraph &cfg) {
+  auto to_profile_bb_id = [](const FullIntraCfgId &full_bb_id) {
+    return ProfileBbId{.bb_id = full_bb_id.bb_id,
+                       .clone_number = full_bb_id.intra_cfg_id.clone_number};
+  };
+  std::vector<CfgProfileNode> cfg_profile;
+  cfg.ForEachNodeRef([&](const CFGNode &node) {
+    int node_frequency = node.CalculateFrequency();
+    if (node_frequency == 0) return;
+    CfgProfileNode &profile_node = cfg_profile.emplace_back();
+    profile_node.bb_id = to_profile_bb_id(node.full_intra_cfg_id());
+    profile_node.freq = node_frequency;
+    node.ForEachOutEdgeInOrder([&](const CFGEdge &edge) {
+      if (!edge.IsBranchOrFallthrough()) return;
+      profile_node.successors.push_back(
+          {.bb_id = to_profile_bb_id(edge.sink()->full_intra_cfg_id()),
+           .weight = edge.weight()});
+    });
+  });
+  return cfg_profile;
+}
+
+// Writes `contents` into the file `file_name` with a single write. Returns an
+// error if the file can't be opened or written.
+absl::Status WriteFile(const std::string &file_name,
+                       absl::string_view contents) {
+  std::ofstream os(file_name, std::ofstream::out | std::ofstream::binary);
+  if (!os) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("failed to open ", file_name, " for writing"));
+  }
+  os.write(contents.data(), contents.size());
+  os.close();
+  if (!os) {
+    return absl::InternalError(absl::StrCat("failed to write ", file_name));
+  }
+  return absl::OkStatus();
 }
 }  // namespace
 
-void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
-  std::ofstream cc_profile_os(options_.cluster_out_name());
-  std::ofstream ld_profile_os(options_.symbol_order_out_name());
-  if (profile_encoding_.version != ClusterEncodingVersion::VERSION_0) {
-    cc_profile_os << profile_encoding_.version_specifier << "\n";
+void PropellerProfileWriter::AppendFunctionClusterProfile(
+    const ControlFlowGraph &cfg, const FunctionChainInfo &func_layout_info,
+    std::string &out) const {
+  if (cfg.module_name().has_value() &&
+      profile_encoding_.version == ClusterEncodingVersion::VERSION_1) {
+    // For version 1, print the module name before the function name
+    // specifier on a separate line.
+    absl::StrAppend(&out, profile_encoding_.module_name_specifier,
+                    cfg.module_name().value().str(), "\n");
+  }
+  // Print all alias names of the function.
+  absl::StrAppend(&out, profile_encoding_.function_name_specifier,
+                  llvm::join(cfg.names(),
+                             profile_encoding_.function_name_separator));
+  if (cfg.module_name().has_value() &&
+      profile_encoding_.version == ClusterEncodingVersion::VERSION_0) {
+    // For version 0, print the module name after the function names and on
+    // the same line.
+    absl::StrAppend(&out, profile_encoding_.module_name_specifier,
+                    cfg.module_name().value().str());
+  }
+  absl::StrAppend(&out, "\n");
+  // Print cloning paths.
+  if (!cfg.clone_paths().empty()) {
+    CHECK_EQ(profile_encoding_.version, ClusterEncodingVersion::VERSION_1)
+        << "cloning is not supported for version: "
+        << profile_encoding_.version;
+  }
+  for (const std::vector<int> &clone_path : cfg.clone_paths()) {
+    absl::StrAppend(&out, profile_encoding_.clone_path_specifier);
+    absl::StrAppend(&out,
+                    absl::StrJoin(clone_path, " ",
+                                  [&](std::string *result, const int bb_index) {
+                                    absl::StrAppend(
+                                        result, cfg.nodes()[bb_index]->bb_id());
+                                  }),
+                    "\n");
+  }
+  if (options_.verbose_cluster_output()) {
+    // Print the layout score for intra-function and inter-function edges
+    // involving this function. This information allows us to study the
+    // impact on layout score on each individual function.
+    absl::StrAppendFormat(
+        &out, "#ext-tsp score: [intra: %f -> %f] [inter: %f -> %f]\n",
+        func_layout_info.original_score.intra_score,
+        func_layout_info.optimized_score.intra_score,
+        func_layout_info.original_score.inter_out_score,
+        func_layout_info.optimized_score.inter_out_score);
+  }
+  for (const FunctionChainInfo::BbChain &chain : func_layout_info.bb_chains) {
+    absl::string_view separator = profile_encoding_.cluster_specifier;
+    for (const FunctionChainInfo::BbBundle &bb_bundle : chain.bb_bundles) {
+      for (const FullIntraCfgId &full_bb_id : bb_bundle.full_bb_ids) {
+        absl::StrAppend(&out, separator, full_bb_id.profile_bb_id());
+        separator = " ";
+      }
+    }
+    absl::StrAppend(&out, "\n");
+  }
+
+  // Dump the edge profile for this CFG if requested.
+  if (options_.write_cfg_profile()) AppendCfgProfile(cfg, out);
+}
+
+ClusterProfileFunction PropellerProfileWriter::GetClusterProfileFunction(
+    absl::string_view section_name, const ControlFlowGraph &cfg,
+    const FunctionChainInfo &func_layout_info) const {
+  ClusterProfileFunction function = {.section_name = section_name};
+  if (cfg.module_name().has_value()) {
+    function.module_name = absl::string_view(cfg.module_name()->data(),
+                                             cfg.module_name()->size());
+  }
+  for (llvm::StringRef name : cfg.names())
+    function.names.emplace_back(name.data(), name.size());
+  for (const std::vector<int> &clone_path : cfg.clone_paths()) {
+    std::vector<int> &bb_ids = function.clone_paths.emplace_back();
+    for (int bb_index : clone_path)
+      bb_ids.push_back(cfg.nodes()[bb_index]->bb_id());
+  }
+  for (const FunctionChainInfo::BbChain &chain : func_layout_info.bb_chains) {
+    std::vector<ProfileBbId> &cluster = function.clusters.emplace_back();
+    for (const FunctionChainInfo::BbBundle &bb_bundle : chain.bb_bundles) {
+      for (const FullIntraCfgId &full_bb_id : bb_bundle.full_bb_ids) {
+        cluster.push_back(
+            {.bb_id = full_bb_id.bb_id,
+             .clone_number = full_bb_id.intra_cfg_id.clone_number});
+      }
+    }
+  }
+  if (options_.write_cfg_profile()) function.cfg_profile = GetCfgProfile(cfg);
+  return function;
+}
+
+absl::Status ValidateCfgDumpOptions(const CfgDumpOptions &cfg_dump_options) {
+  if (!cfg_dump_options.has_function_name_regex()) return absl::OkStatus();
+  std::string error;
+  if (!llvm::Regex(cfg_dump_options.function_name_regex()).isValid(error)) {
+    return absl::InvalidArgumentError(
+        absl::StrCat("Invalid cfg dump function name regex '",
+                     cfg_dump_options.function_name_regex(), "': ", error));
   }
+  return absl::OkStatus();
+}
+
+absl::Status PropellerProfileWriter::Write(
+    const PropellerProfile &profile) const {
+  // The profiles are formatted into memory and each is written with a single
+  // write at the end.
+  std::string cc_profile;
+  std::string ld_profile;
+  const bool binary =
+      profile_encoding_.version == ClusterEncodingVersion::BINARY;
+  // Function records for the binary encoding, in output order.
+  std::vector<ClusterProfileFunction> binary_functions;
+  if (profile_encoding_.version == ClusterEncodingVersion::VERSION_1)
+    absl::StrAppend(&cc_profile, profile_encoding_.version_specifier, "\n");
   // TODO(b/160339651): Remove this in favour of structured format in LLVM code.
   for (const auto &[section_name, section_function_chain_info] :
        profile.functions_chain_info_by_section_name) {
-    if (options_.verbose_cluster_output())
-      cc_profile_os << "#section " << section_name.str() << "\n";
+    if (binary) {
+      const absl::string_view binary_section_name(section_name.data(),
+                                                  section_name.size());
+      const size_t section_begin = binary_functions.size();
+      binary_functions.resize(section_begin +
+                              section_function_chain_info.size());
+      llvm::parallelFor(0, section_function_chain_info.size(), [&](size_t i) {
+        const FunctionChainInfo &func_layout_info =
+            section_function_chain_info[i];
+        const ControlFlowGraph *cfg =
+            profile.program_cfg->GetCfgByIndex(func_layout_info.function_index);
+        CHECK_NE(cfg, nullptr);
+        ClusterProfileFunction &function = binary_functions[section_begin + i];
+        function = GetClusterProfileFunction(binary_section_name, *cfg,
+                                             func_layout_info);
+        // The layout of this function is kept from the previous profile, so
+        // keep its edge profile too.
+        if (auto it = profile.previous_function_profiles.find(
+                func_layout_info.function_index);
+            it != profile.previous_function_profiles.end()) {
+          function.cfg_profile = it->second.cfg_profile;
+        }
+      });
+    } else {
+      if (options_.verbose_cluster_output())
+        absl::StrAppend(&cc_profile, "#section ", section_name.str(), "\n");
+
+      // Format the cluster profiles of the functions in parallel, each into
+      // its own buffer, and concatenate them in order.
+      std::vector<std::string> function_cc_profiles(
+          section_function_chain_info.size());
+      llvm::parallelFor(0, section_function_chain_info.size(), [&](size_t i) {
+        const FunctionChainInfo &func_layout_info =
+            section_function_chain_info[i];
+        const ControlFlowGraph *cfg =
+            profile.program_cfg->GetCfgByIndex(func_layout_info.function_index);
+        CHECK_NE(cfg, nullptr);
+        if (auto it = profile.previous_function_profiles.find(
+                func_layout_info.function_index);
+            it != profile.previous_function_profiles.end() &&
+            profile_encoding_.version == ClusterEncodingVersion::VERSION_1) {
+          function_cc_profiles[i] = it->second.text;
+          return;
+        }
+        AppendFunctionClusterProfile(*cfg, func_layout_info,
+                                     function_cc_profiles[i]);
+      });
+      size_t section_cc_profile_size = 0;
+      for (const std::string &function_cc_profile : function_cc_profiles)
+        section_cc_profile_size += function_cc_profile.size();
+      cc_profile.reserve(cc_profile.size() + section_cc_profile_size);
+      for (const std::string &function_cc_profile : function_cc_profiles)
+        cc_profile.append(function_cc_profile);
+    }
+
     // Find total number of chains.
     unsigned total_chains = 0;
     for (const auto &func_chain_info : section_function_chain_info)
@@ -159,80 +467,20 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
          section_function_chain_info) {
       const ControlFlowGraph *cfg =
           profile.program_cfg->GetCfgByIndex(func_layout_info.function_index);
-      CHECK_NE(cfg, nullptr);
-      if (cfg->module_name().has_value() &&
-          profile_encoding_.version == ClusterEncodingVersion::VERSION_1) {
-        // For version 1, print the module name before the function name
-        // specifier on a separate line.
-        cc_profile_os << profile_encoding_.module_name_specifier
-                      << cfg->module_name().value().str() << "\n";
-      }
-      // Print all alias names of the function.
-      cc_profile_os << profile_encoding_.function_name_specifier
-                    << llvm::join(cfg->names(),
-                                  profile_encoding_.function_name_separator);
-      if (cfg->module_name().has_value() &&
-          profile_encoding_.version == ClusterEncodingVersion::VERSION_0) {
-        // For version 0, print the module name after the function names and on
-        // the same line.
-        cc_profile_os << profile_encoding_.module_name_specifier
-                      << cfg->module_name().value().str();
-      }
-      cc_profile_os << "\n";
-      // Print cloning paths.
-      if (!cfg->clone_paths().empty()) {
-        CHECK_EQ(profile_encoding_.version, ClusterEncodingVersion::VERSION_1)
-            << "cloning is not supported for version: "
-            << profile_encoding_.version;
-      }
-      for (const std::vector<int> &clone_path : cfg->clone_paths()) {
-        cc_profile_os << profile_encoding_.clone_path_specifier
-                      << absl::StrJoin(
-                             clone_path, " ",
-                             [&](std::string *out, const int bb_index) {
-                               absl::StrAppend(out,
-                                               cfg->nodes()[bb_index]->bb_id());
-                             })
-                      << "\n";
-      }
-      if (options_.verbose_cluster_output()) {
-        // Print the layout score for intra-function and inter-function edges
-        // involving this function. This information allows us to study the
-        // impact on layout score on each individual function.
-        cc_profile_os << absl::StreamFormat(
-            "#ext-tsp score: [intra: %f -> %f] [inter: %f -> %f]\n",
-            func_layout_info.original_score.intra_score,
-            func_layout_info.optimized_score.intra_score,
-            func_layout_info.original_score.inter_out_score,
-            func_layout_info.optimized_score.inter_out_score);
-      }
       const std::vector<FunctionChainInfo::BbChain> &chains =
           func_layout_info.bb_chains;
       for (unsigned chain_id = 0; chain_id < chains.size(); ++chain_id) {
         auto &chain = chains[chain_id];
-        std::vector<FullIntraCfgId> bb_ids_in_chain =
-            chains[chain_id].GetAllBbs();
         // If a chain starts with zero BB index (function entry basic block),
         // the function name is sufficient for section ordering. Otherwise,
         // the chain number is required.
         symbol_order[chain.layout_index] =
             std::pair<llvm::SmallVector<llvm::StringRef, 3>,
                       std::optional<unsigned>>(
-                cfg->names(), bb_ids_in_chain.front().intra_cfg_id.bb_index == 0
+                cfg->names(), chain.GetFirstBb().intra_cfg_id.bb_index == 0
                                   ? std::optional<unsigned>()
                                   : chain_id);
-        for (int bbi = 0; bbi < bb_ids_in_chain.size(); ++bbi) {
-          const auto &full_bb_id = bb_ids_in_chain[bbi];
-          cc_profile_os << (bbi != 0 ? " "
-                                     : profile_encoding_.cluster_specifier)
-                        << full_bb_id.profile_bb_id();
-        }
-        cc_profile_os << "\n";
       }
-
-      // Dump the edge profile for this CFG if requested.
-      if (options_.write_cfg_profile()) WriteCfgProfile(*cfg, cc_profile_os);
-
       cold_symbol_order[func_layout_info.cold_chain_layout_index] =
           &func_layout_info;
     }
@@ -242,10 +490,10 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
       // guarantees we get the right order regardless of which function name is
       // picked by the compiler.
       for (auto &func_name : func_names) {
-        ld_profile_os << func_name.str();
+        absl::StrAppend(&ld_profile, func_name.str());
         if (chain_id.has_value())
-          ld_profile_os << ".__part." << chain_id.value();
-        ld_profile_os << "\n";
+          absl::StrAppend(&ld_profile, ".__part.", chain_id.value());
+        absl::StrAppend(&ld_profile, "\n");
       }
     }
 
@@ -268,15 +516,32 @@ void PropellerProfileWriter::Write(const PropellerProfile &profile) const {
             return chain.GetFirstBb().intra_cfg_id.bb_index == 0;
           });
       for (auto &func_name : cfg->names()) {
-        ld_profile_os << func_name.str();
+        absl::StrAppend(&ld_profile, func_name.str());
         // If the entry node is not in chains, function name can serve as the
         // cold symbol name. So we don't need the ".cold" suffix.
-        if (entry_is_in_chains) ld_profile_os << ".cold";
-        ld_profile_os << "\n";
+        if (entry_is_in_chains) absl::StrAppend(&ld_profile, ".cold");
+        absl::StrAppend(&ld_profile, "\n");
       }
     }
   }
-  if (options_.has_cfg_dump_dir_name())
-    DumpCfgs(profile, options_.cfg_dump_dir_name());
+  if (binary) cc_profile = EncodeBinaryClusterProfile(binary_functions);
+  RETURN_IF_ERROR(WriteFile(options_.cluster_out_name(), cc_profile));
+  RETURN_IF_ERROR(WriteFile(options_.symbol_order_out_name(), ld_profile));
+  if (profile.tuned_code_layout_params.has_value()) {
+    std::string tuned_params;
+    if (!google::protobuf::TextFormat::PrintToString(
+            *profile.tuned_code_layout_params, &tuned_params)) {
+      return absl::InternalError(
+          "failed to print the tuned code layout parameters");
+    }
+    RETURN_IF_ERROR(WriteFile(
+        options_.layout_tuning_options().tuned_params_out_name(),
+        tuned_params));
+  }
+  if (options_.has_cfg_dump_dir_name()) {
+    DumpCfgs(profile, options_.cfg_dump_dir_name(),
+             options_.cfg_dump_options());
+  }
+  return absl::OkStatus();
 }
 }  // namespace propeller
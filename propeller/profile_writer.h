@@ -18,10 +18,19 @@
 #include <string>
 
 #include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "propeller/cfg.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/function_chain_info.h"
 #include "propeller/profile.h"
 #include "propeller/propeller_options.pb.h"
 
 namespace propeller {
+// Returns an `InvalidArgumentError` if `cfg_dump_options` can't be used for
+// dumping cfgs, e.g., if `function_name_regex` is not a valid regex.
+absl::Status ValidateCfgDumpOptions(const CfgDumpOptions& cfg_dump_options);
+
 // Writes the propeller profiles to output files.
 class PropellerProfileWriter {
  public:
@@ -30,8 +39,10 @@ class PropellerProfileWriter {
         profile_encoding_(GetProfileEncoding(options.cluster_out_version())) {}
 
   // Writes code layout result in `all_functions_cluster_info` into the output
-  // file.
-  void Write(const PropellerProfile& profile) const;
+  // file. The cluster profiles of the functions are formatted in parallel.
+  // Returns an error if an output file can't be written, or if the tuned code
+  // layout parameters can't be printed.
+  absl::Status Write(const PropellerProfile& profile) const;
 
  private:
   struct ProfileEncoding {
@@ -63,11 +74,25 @@ class PropellerProfileWriter {
                 .module_name_specifier = "m ",
                 .cluster_specifier = "c",
                 .clone_path_specifier = "p"};
+      case ClusterEncodingVersion::BINARY:
+        return {.version = version};
       default:
         LOG(FATAL) << "Unknown value for ClusterEncodingVersion: "
                    << static_cast<int>(version);
     }
   }
+  // Appends the cluster profile of the function with `cfg` and
+  // `func_layout_info` to `out`.
+  void AppendFunctionClusterProfile(const ControlFlowGraph& cfg,
+                                    const FunctionChainInfo& func_layout_info,
+                                    std::string& out) const;
+
+  // Returns the cluster profile record of the function with `cfg` and
+  // `func_layout_info` in section `section_name`, for the binary encoding.
+  ClusterProfileFunction GetClusterProfileFunction(
+      absl::string_view section_name, const ControlFlowGraph& cfg,
+      const FunctionChainInfo& func_layout_info) const;
+
   PropellerOptions options_;
   ProfileEncoding profile_encoding_;
 };
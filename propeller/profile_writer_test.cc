@@ -0,0 +1,334 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/profile_writer.h"
+
+#include <memory>
+#include <string>
+#include <vector>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/ADT/StringRef.h"
+#include "llvm/Support/FileSystem.h"
+#include "propeller/cfg_edge_kind.h"
+#include "propeller/cfg_testutil.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/code_layout.h"
+#include "propeller/file_helpers.h"
+#include "propeller/function_chain_info.h"
+#include "propeller/profile.h"
+#include "propeller/profile_diff.h"
+#include "propeller/program_cfg.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOk;
+using ::absl_testing::StatusIs;
+using ::testing::AllOf;
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::HasSubstr;
+using ::testing::IsEmpty;
+using ::testing::Not;
+using ::testing::Optional;
+using ::testing::SizeIs;
+
+// Returns the profile of three functions: "foo" and "bar" with a hot loop
+// between blocks 1 and 3 (where "bar" is 10 times hotter than "foo"), and the
+// coldest function "qux" whose original layout is already optimal.
+// `foo_back_edge_weight` is the weight of the back edge of the loop in "foo".
+PropellerProfile GetProfile(int foo_back_edge_weight = 100) {
+  PropellerProfile profile = {
+      .program_cfg = std::make_unique<ProgramCfg>(
+          TestCfgBuilder(
+              {.cfg_args = {{".text",
+                             0,
+                             "foo",
+                             {{0x1000, 0, 0x10},
+                              {0x1010, 1, 0x7},
+                              {0x1020, 2, 0xa},
+                              {0x102a, 3, 0x4}},
+                             {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough},
+                              {0, 2, 1, CFGEdgeKind::kBranchOrFallthough},
+                              {1, 3, 95, CFGEdgeKind::kBranchOrFallthough},
+                              {3, 1, foo_back_edge_weight,
+                               CFGEdgeKind::kBranchOrFallthough}}},
+                            {".text",
+                             1,
+                             "bar",
+                             {{0x2000, 0, 0x10},
+                              {0x2010, 1, 0x7},
+                              {0x2020, 2, 0xa},
+                              {0x202a, 3, 0x4}},
+                             {{0, 1, 100, CFGEdgeKind::kBranchOrFallthough},
+                              {0, 2, 10, CFGEdgeKind::kBranchOrFallthough},
+                              {1, 3, 950, CFGEdgeKind::kBranchOrFallthough},
+                              {3, 1, 1000, CFGEdgeKind::kBranchOrFallthough}}},
+                            {".text",
+                             2,
+                             "qux",
+                             {{0x3000, 0, 0x10},
+                              {0x3010, 1, 0x8},
+                              {0x3018, 2, 0x8}},
+                             {{0, 1, 5, CFGEdgeKind::kBranchOrFallthough},
+                              {1, 2, 5, CFGEdgeKind::kBranchOrFallthough}}}}})
+              .Build())};
+  PropellerStats::CodeLayoutStats code_layout_stats;
+  profile.functions_chain_info_by_section_name = GenerateLayoutBySection(
+      *profile.program_cfg, PropellerCodeLayoutParameters(),
+      code_layout_stats);
+  return profile;
+}
+
+// Returns the intra-function score gain of the function named `name` in
+// `profile`.
+double GetScoreGain(const PropellerProfile &profile, llvm::StringRef name) {
+  for (const FunctionChainInfo &func_chain_info :
+       profile.functions_chain_info_by_section_name.at(".text")) {
+    if (profile.program_cfg->GetCfgByIndex(func_chain_info.function_index)
+            ->GetPrimaryName() == name) {
+      return func_chain_info.optimized_score.intra_score -
+             func_chain_info.original_score.intra_score;
+    }
+  }
+  ADD_FAILURE() << "No function named " << name.str();
+  return 0;
+}
+
+// Returns a fresh directory for the output of the test `test_name`.
+std::string GetOutputDir(absl::string_view test_name) {
+  std::string dir = absl::StrCat(::testing::TempDir(), "/", test_name);
+  llvm::sys::fs::remove_directories(dir);
+  llvm::sys::fs::create_directories(dir);
+  return dir;
+}
+
+// Writes `profile` with `options`, dumping the cfgs into `cfg_dump_dir_name`,
+// and returns the names of the functions in the cfg index.
+std::vector<std::string> WriteAndGetDumpedFunctions(
+    const PropellerProfile &profile, PropellerOptions options,
+    const std::string &cfg_dump_dir_name) {
+  options.set_cluster_out_name(absl::StrCat(cfg_dump_dir_name, ".cc.txt"));
+  options.set_symbol_order_out_name(absl::StrCat(cfg_dump_dir_name, ".ld.txt"));
+  options.set_cfg_dump_dir_name(cfg_dump_dir_name);
+  EXPECT_THAT(PropellerProfileWriter(options).Write(profile), IsOk());
+
+  absl::StatusOr<std::string> cfg_index = propeller_file::GetContents(
+      absl::StrCat(cfg_dump_dir_name, "/cfg-index.txt"));
+  EXPECT_THAT(cfg_index, IsOk());
+  if (!cfg_index.ok()) return {};
+  std::vector<std::string> function_names;
+  std::vector<absl::string_view> lines =
+      absl::StrSplit(*cfg_index, '\n', absl::SkipEmpty());
+  // Skip the header line.
+  for (int i = 1; i < lines.size(); ++i) {
+    function_names.emplace_back(
+        std::vector<absl::string_view>(absl::StrSplit(lines[i], ' ')).front());
+  }
+  return function_names;
+}
+
+TEST(ProfileWriterTest, DumpsAllCfgsByDefault) {
+  PropellerProfile profile = GetProfile();
+  std::string dir = GetOutputDir("cfg_dump_default");
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, PropellerOptions(), dir),
+              ElementsAre("foo", "bar", "qux"));
+  EXPECT_TRUE(llvm::sys::fs::exists(absl::StrCat(dir, "/0x1000.dot")));
+  EXPECT_TRUE(llvm::sys::fs::exists(absl::StrCat(dir, "/0x2000.dot")));
+  EXPECT_TRUE(llvm::sys::fs::exists(absl::StrCat(dir, "/0x3000.dot")));
+  EXPECT_FALSE(llvm::sys::fs::exists(absl::StrCat(dir, "/cfgs.dot")));
+}
+
+TEST(ProfileWriterTest, DumpsCfgsOfHottestFunctions) {
+  PropellerProfile profile = GetProfile();
+  PropellerOptions options;
+  options.mutable_cfg_dump_options()->set_max_functions(2);
+  // The dumped functions are kept in profile order.
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options,
+                                         GetOutputDir("cfg_dump_max")),
+              ElementsAre("foo", "bar"));
+  options.mutable_cfg_dump_options()->set_max_functions(1);
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options,
+                                         GetOutputDir("cfg_dump_max_1")),
+              ElementsAre("bar"));
+}
+
+TEST(ProfileWriterTest, DumpsCfgsOfMatchingFunctions) {
+  PropellerProfile profile = GetProfile();
+  PropellerOptions options;
+  options.mutable_cfg_dump_options()->set_function_name_regex("^(foo|qux)$");
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options,
+                                         GetOutputDir("cfg_dump_regex")),
+              ElementsAre("foo", "qux"));
+}
+
+TEST(ProfileWriterTest, DumpsCfgsWithMinScoreGain) {
+  PropellerProfile profile = GetProfile();
+  const double foo_score_gain = GetScoreGain(profile, "foo");
+  const double bar_score_gain = GetScoreGain(profile, "bar");
+  ASSERT_GT(foo_score_gain, 0);
+  ASSERT_GT(bar_score_gain, foo_score_gain);
+  EXPECT_EQ(GetScoreGain(profile, "qux"), 0);
+
+  PropellerOptions options;
+  options.mutable_cfg_dump_options()->set_min_score_gain(foo_score_gain);
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options,
+                                         GetOutputDir("cfg_dump_gain_foo")),
+              ElementsAre("foo", "bar"));
+  options.mutable_cfg_dump_options()->set_min_score_gain(
+      (foo_score_gain + bar_score_gain) / 2);
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options,
+                                         GetOutputDir("cfg_dump_gain_bar")),
+              ElementsAre("bar"));
+}
+
+TEST(ProfileWriterTest, DumpsCfgsIntoSingleFile) {
+  PropellerProfile profile = GetProfile();
+  PropellerOptions options;
+  options.mutable_cfg_dump_options()->set_single_file(true);
+  options.mutable_cfg_dump_options()->set_function_name_regex("^(bar|qux)$");
+  std::string dir = GetOutputDir("cfg_dump_single_file");
+  EXPECT_THAT(WriteAndGetDumpedFunctions(profile, options, dir),
+              ElementsAre("bar", "qux"));
+  EXPECT_FALSE(llvm::sys::fs::exists(absl::StrCat(dir, "/0x2000.dot")));
+  EXPECT_FALSE(llvm::sys::fs::exists(absl::StrCat(dir, "/0x3000.dot")));
+
+  ASSERT_OK_AND_ASSIGN(
+      std::string cfgs_dot,
+      propeller_file::GetContents(absl::StrCat(dir, "/cfgs.dot")));
+  std::vector<absl::string_view> graphs =
+      absl::StrSplit(cfgs_dot, "digraph {", absl::SkipEmpty());
+  ASSERT_EQ(graphs.size(), 2);
+  // The graphs are written in the order of the cfg index.
+  EXPECT_THAT(graphs[0], HasSubstr("label=\"bar#1\""));
+  EXPECT_THAT(graphs[1], HasSubstr("label=\"qux#2\""));
+}
+
+TEST(ProfileWriterTest, WritesBinaryClusterProfileMatchingText) {
+  PropellerProfile profile = GetProfile();
+  PropellerOptions options;
+  options.set_write_cfg_profile(true);
+  // Verbose output names the section of the functions, like the binary
+  // encoding.
+  options.set_verbose_cluster_output(true);
+  const std::string dir = GetOutputDir("binary_cluster_profile");
+  options.set_cluster_out_name(absl::StrCat(dir, "/cc_profile.txt"));
+  options.set_symbol_order_out_name(absl::StrCat(dir, "/ld_profile.txt"));
+  ASSERT_THAT(PropellerProfileWriter(options).Write(profile), IsOk());
+  ASSERT_OK_AND_ASSIGN(std::string text,
+                       propeller_file::GetContents(options.cluster_out_name()));
+  ASSERT_OK_AND_ASSIGN(
+      std::string text_ld_profile,
+      propeller_file::GetContents(options.symbol_order_out_name()));
+
+  options.set_cluster_out_version(ClusterEncodingVersion::BINARY);
+  options.set_cluster_out_name(absl::StrCat(dir, "/cc_profile.bin"));
+  ASSERT_THAT(PropellerProfileWriter(options).Write(profile), IsOk());
+  ASSERT_OK_AND_ASSIGN(std::string binary,
+                       propeller_file::GetContents(options.cluster_out_name()));
+  ASSERT_OK_AND_ASSIGN(
+      std::string binary_ld_profile,
+      propeller_file::GetContents(options.symbol_order_out_name()));
+  EXPECT_EQ(binary_ld_profile, text_ld_profile);
+  ASSERT_TRUE(absl::StartsWith(binary, kBinaryClusterProfileMagic));
+
+  ASSERT_OK_AND_ASSIGN(std::vector<ClusterProfileFunction> text_functions,
+                       ParseClusterProfile(text));
+  ASSERT_OK_AND_ASSIGN(std::vector<ClusterProfileFunction> binary_functions,
+                       ParseClusterProfile(binary));
+  ASSERT_THAT(text_functions, SizeIs(3));
+  EXPECT_THAT(text_functions[1],
+              AllOf(Field(&ClusterProfileFunction::section_name, ".text"),
+                    Field(&ClusterProfileFunction::names, ElementsAre("bar")),
+                    Field(&ClusterProfileFunction::cfg_profile,
+                          Optional(Not(IsEmpty())))));
+  EXPECT_EQ(binary_functions, text_functions);
+
+  // Converting the binary profile back to text loses only the verbose score
+  // lines.
+  ASSERT_OK_AND_ASSIGN(std::string converted_text,
+                       ConvertBinaryClusterProfileToText(binary));
+  ASSERT_OK_AND_ASSIGN(std::vector<ClusterProfileFunction> converted_functions,
+                       ParseClusterProfile(converted_text));
+  EXPECT_EQ(converted_functions, text_functions);
+}
+
+TEST(ProfileWriterTest, WritesUnchangedFunctionsByteIdentical) {
+  PropellerOptions options;
+  options.set_verbose_cluster_output(true);
+  const std::string dir = GetOutputDir("unchanged_functions");
+  options.set_cluster_out_name(absl::StrCat(dir, "/previous_cc_profile.txt"));
+  options.set_symbol_order_out_name(absl::StrCat(dir, "/ld_profile.txt"));
+  ASSERT_THAT(PropellerProfileWriter(options).Write(GetProfile()), IsOk());
+  ASSERT_OK_AND_ASSIGN(std::string previous_cc_profile,
+                       propeller_file::GetContents(options.cluster_out_name()));
+
+  // Perturbing the edge weights of "foo" changes its edge profile and scores,
+  // but not its layout.
+  options.mutable_profile_diff_options()->set_previous_cluster_profile_name(
+      options.cluster_out_name());
+  options.set_cluster_out_name(absl::StrCat(dir, "/cc_profile.txt"));
+  ASSERT_THAT(PropellerProfileWriter(options).Write(
+                  GetProfile(/*foo_back_edge_weight=*/120)),
+              IsOk());
+  ASSERT_OK_AND_ASSIGN(std::string perturbed_cc_profile,
+                       propeller_file::GetContents(options.cluster_out_name()));
+  EXPECT_NE(perturbed_cc_profile, previous_cc_profile);
+
+  PropellerProfile profile = GetProfile(/*foo_back_edge_weight=*/120);
+  ASSERT_THAT(ApplyPreviousProfile(options, profile), IsOk());
+  ASSERT_THAT(PropellerProfileWriter(options).Write(profile), IsOk());
+  ASSERT_OK_AND_ASSIGN(std::string cc_profile,
+                       propeller_file::GetContents(options.cluster_out_name()));
+  EXPECT_EQ(cc_profile, previous_cc_profile);
+}
+
+TEST(ProfileWriterTest, ReturnsErrorIfOutputCantBeWritten) {
+  PropellerOptions options;
+  const std::string dir = GetOutputDir("unwritable_output");
+  options.set_cluster_out_name(absl::StrCat(dir, "/missing/cc_profile.txt"));
+  options.set_symbol_order_out_name(absl::StrCat(dir, "/ld_profile.txt"));
+  EXPECT_THAT(PropellerProfileWriter(options).Write(GetProfile()),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+
+  options.set_cluster_out_name(absl::StrCat(dir, "/cc_profile.txt"));
+  options.mutable_layout_tuning_options()->set_tuned_params_out_name(
+      absl::StrCat(dir, "/missing/tuned_params.txtpb"));
+  PropellerProfile profile = GetProfile();
+  profile.tuned_code_layout_params = PropellerCodeLayoutParameters();
+  EXPECT_THAT(PropellerProfileWriter(options).Write(profile),
+              StatusIs(absl::StatusCode::kFailedPrecondition));
+}
+
+TEST(ProfileWriterTest, ValidatesCfgDumpOptions) {
+  CfgDumpOptions cfg_dump_options;
+  EXPECT_THAT(ValidateCfgDumpOptions(cfg_dump_options), IsOk());
+  cfg_dump_options.set_function_name_regex("^foo.*");
+  EXPECT_THAT(ValidateCfgDumpOptions(cfg_dump_options), IsOk());
+  cfg_dump_options.set_function_name_regex("foo(");
+  EXPECT_THAT(ValidateCfgDumpOptions(cfg_dump_options),
+              StatusIs(absl::StatusCode::kInvalidArgument, HasSubstr("foo(")));
+}
+}  // namespace
+}  // namespace propeller
@@ -14,6 +14,7 @@
 
 #include "propeller/program_cfg_builder.h"
 
+#include <cstdint>
 #include <memory>
 #include <optional>
 #include <tuple>
@@ -32,6 +33,7 @@
 #include "llvm/Object/ELFTypes.h"
 #include "propeller/addr2cu.h"
 #include "propeller/bb_handle.h"
+#include "propeller/binary_address_branch.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/binary_content.h"
 #include "propeller/branch_aggregation.h"
@@ -64,6 +66,12 @@ std::vector<std::unique_ptr<CFGNode>> CreateCfgNodes(
 
 absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
     const BranchAggregation &branch_aggregation, Addr2Cu *addr2cu) && {
+  return std::move(*this).Build(ColumnarBranchAggregation(branch_aggregation),
+                                addr2cu);
+}
+
+absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
+    const ColumnarBranchAggregation &branch_aggregation, Addr2Cu *addr2cu) && {
   // Temporary map from Id -> CFGNode.
   absl::flat_hash_map<InterCfgId, CFGNode *> node_map;
   // Insert node mappings for initial CFGs.
@@ -138,24 +146,29 @@ absl::StatusOr<std::unique_ptr<ProgramCfg>> ProgramCfgBuilder::Build(
 //    to_sym>.
 // 3. create edges and apply weights for the above path.
 void ProgramCfgBuilder::CreateFallthroughs(
-    const BranchAggregation &branch_aggregation,
+    const ColumnarBranchAggregation &branch_aggregation,
     const absl::flat_hash_map<InterCfgId, CFGNode *> &tmp_node_map,
     absl::flat_hash_map<std::pair<int, int>, int> *tmp_bb_fallthrough_counters,
     absl::flat_hash_map<std::pair<InterCfgId, InterCfgId>, CFGEdge *>
         *tmp_edge_map) {
-  for (auto [fallthrough, cnt] : branch_aggregation.fallthrough_counters) {
-    // A fallthrough from A to B implies a branch to A followed by a branch
-    // from B. Therefore we respectively use BranchDirection::kTo and
-    // BranchDirection::kFrom for A and B when calling
-    // `FindBbHandleIndexUsingBinaryAddress` to find their associated blocks.
-    std::optional<int> from_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            fallthrough.from, BranchDirection::kTo);
+  const ColumnarBranchAggregation::Columns &fallthroughs =
+      branch_aggregation.fallthroughs();
+  // A fallthrough from A to B implies a branch to A followed by a branch from
+  // B. Therefore we respectively use BranchDirection::kTo and
+  // BranchDirection::kFrom for A and B to find their associated blocks. The
+  // fallthroughs are sorted by their `from` addresses, so their blocks are
+  // found by walking the bb handles alongside.
+  BinaryAddressMapper::BbHandleIndexCursor from_cursor(*binary_address_mapper_,
+                                                       BranchDirection::kTo);
+  for (int64_t i = 0; i < fallthroughs.size(); ++i) {
+    std::optional<int> from_index = from_cursor.Find(fallthroughs.from[i]);
     std::optional<int> to_index =
         binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            fallthrough.to, BranchDirection::kFrom);
-    if (from_index && to_index)
-      (*tmp_bb_fallthrough_counters)[{*from_index, *to_index}] += cnt;
+            fallthroughs.to[i], BranchDirection::kFrom);
+    if (from_index && to_index) {
+      (*tmp_bb_fallthrough_counters)[{*from_index, *to_index}] +=
+          fallthroughs.counts[i];
+    }
   }
 
   for (auto &i : *tmp_bb_fallthrough_counters) {
@@ -230,7 +243,7 @@ CFGEdge *ProgramCfgBuilder::InternalCreateEdge(
 // to_symbol> and by using tmp_node_map, we further translate it to <from_node,
 // to_node>, and finally create a CFGEdge for such CFGNode pair.
 absl::Status ProgramCfgBuilder::CreateEdges(
-    const BranchAggregation &branch_aggregation,
+    const ColumnarBranchAggregation &branch_aggregation,
     const absl::flat_hash_map<InterCfgId, CFGNode *> &tmp_node_map) {
   // Temp map that records which CFGEdges are created, so we do not re-create
   // edges. Note this is necessary: although
@@ -243,11 +256,18 @@ absl::Status ProgramCfgBuilder::CreateEdges(
 
   int weight_on_dubious_edges = 0;
   int edges_recorded = 0;
-  for (auto [branch, weight] : branch_aggregation.branch_counters) {
+  // The branches are sorted by their `from` addresses, so their source blocks
+  // are found by walking the bb handles alongside.
+  const ColumnarBranchAggregation::Columns &branches =
+      branch_aggregation.branches();
+  BinaryAddressMapper::BbHandleIndexCursor from_cursor(
+      *binary_address_mapper_, BranchDirection::kFrom);
+  for (int64_t i = 0; i < branches.size(); ++i) {
+    const BinaryAddressBranch branch = {.from = branches.from[i],
+                                        .to = branches.to[i]};
+    const int64_t weight = branches.counts[i];
     ++edges_recorded;
-    std::optional<int> from_bb_index =
-        binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
-            branch.from, BranchDirection::kFrom);
+    std::optional<int> from_bb_index = from_cursor.Find(branch.from);
     std::optional<int> to_bb_index =
         binary_address_mapper_->FindBbHandleIndexUsingBinaryAddress(
             branch.to, BranchDirection::kTo);
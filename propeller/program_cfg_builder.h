@@ -54,6 +54,12 @@ class ProgramCfgBuilder {
   // Creates profile CFGs using the branch profile in `branch_aggregation`.
   // `addr2cu`, if provided, will be used to retrieve module names for CFGs.
   // This function does not assume ownership of it.
+  absl::StatusOr<std::unique_ptr<ProgramCfg>> Build(
+      const ColumnarBranchAggregation &branch_aggregation,
+      Addr2Cu *addr2cu = nullptr) &&;
+
+  // Same as above, but first converts `branch_aggregation` to its columnar
+  // form.
   absl::StatusOr<std::unique_ptr<ProgramCfg>> Build(
       const BranchAggregation &branch_aggregation,
       Addr2Cu *addr2cu = nullptr) &&;
@@ -70,7 +76,7 @@ class ProgramCfgBuilder {
           *tmp_edge_map);
 
   void CreateFallthroughs(
-      const BranchAggregation &branch_aggregation,
+      const ColumnarBranchAggregation &branch_aggregation,
       const absl::flat_hash_map<InterCfgId, CFGNode *> &tmp_node_map,
       absl::flat_hash_map<std::pair<int, int>, int>
           *tmp_bb_fallthrough_counters,
@@ -84,7 +90,7 @@ class ProgramCfgBuilder {
   // it to <from_node, to_node>, and finally create a CFGEdge for such CFGNode
   // pair.
   absl::Status CreateEdges(
-      const BranchAggregation &branch_aggregation,
+      const ColumnarBranchAggregation &branch_aggregation,
       const absl::flat_hash_map<InterCfgId, CFGNode *> &node_map);
 
   const BinaryAddressMapper *binary_address_mapper_;
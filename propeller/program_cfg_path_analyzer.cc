@@ -16,13 +16,11 @@
 
 #include <algorithm>
 #include <functional>
-#include <iterator>
 #include <memory>
 #include <optional>
 #include <utility>
 #include <vector>
 
-#include "absl/algorithm/container.h"
 #include "absl/container/btree_set.h"
 #include "absl/container/flat_hash_map.h"
 #include "absl/container/flat_hash_set.h"
@@ -32,6 +30,7 @@
 #include "propeller/bb_handle.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/cfg.h"
+#include "propeller/path_buffer.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_options.pb.h"
 
@@ -309,59 +308,56 @@ class CloningPathTraceHandler : public PathTraceHandler {
 };
 }  // namespace
 
-void ProgramCfgPathAnalyzer::AnalyzePaths(std::optional<int> paths_to_analyze) {
-  int num_paths = paths_to_analyze.value_or(bb_branch_paths_.size());
-  CHECK_LE(num_paths, bb_branch_paths_.size());
-  absl::c_stable_sort(bb_branch_paths_, [](const FlatBbHandleBranchPath &lhs,
-                                           const FlatBbHandleBranchPath &rhs) {
-    return lhs.sample_time < rhs.sample_time;
-  });
-  for (int i = 0; i < num_paths; ++i) {
-    const FlatBbHandleBranchPath &path = bb_branch_paths_[i];
-    if (i != 0) CHECK_GE(path.sample_time, bb_branch_paths_[i - 1].sample_time);
-    if (!IsFromFunctionWithHotJoinBbs(path)) continue;
-    int path_function_index =
-        path.branches.front().from_bb.has_value()
-            ? path.branches.front().from_bb->function_index
-            : path.branches.front().to_bb->function_index;
-    const ControlFlowGraph *cfg =
-        program_cfg_->GetCfgByIndex(path_function_index);
-    CHECK_NE(cfg, nullptr);
-    FunctionPathInfo &function_path_info =
-        all_function_path_info_
-            .try_emplace(path_function_index, cfg->nodes().size())
-            .first->second;
+void ProgramCfgPathAnalyzer::AnalyzePath(const FlatBbHandleBranchPath &path) {
+  if (!IsFromFunctionWithHotJoinBbs(path)) return;
+  int path_function_index = path.branches.front().from_bb.has_value()
+                                ? path.branches.front().from_bb->function_index
+                                : path.branches.front().to_bb->function_index;
+  const ControlFlowGraph *cfg =
+      program_cfg_->GetCfgByIndex(path_function_index);
+  CHECK_NE(cfg, nullptr);
+  FunctionPathInfo &function_path_info =
+      all_function_path_info_
+          .try_emplace(path_function_index, cfg->nodes().size())
+          .first->second;
 
-    if (!path.branches.front().to_bb.has_value()) {
-      CHECK_EQ(path.branches.size(), 1)
-          << "Path with unknown block in the middle: " << path;
-      function_path_info.UpdateCachePressure(
-          path.branches.front().from_bb->flat_bb_index, path.sample_time, {},
-          /*path_length=*/1,
-          absl::Milliseconds(
-              path_profile_options_->max_icache_penalty_interval_millis()));
-      continue;
-    }
-    CloningPathTraceHandler handler(
-        path_profile_options_, cfg, &hot_join_bbs_.at(path_function_index),
-        &function_path_info,
-        &program_path_profile_->GetProfileForFunctionIndex(
-            path_function_index));
-    PathTracer(cfg, &handler).TracePath(path);
+  if (!path.branches.front().to_bb.has_value()) {
+    CHECK_EQ(path.branches.size(), 1)
+        << "Path with unknown block in the middle: " << path;
+    function_path_info.UpdateCachePressure(
+        path.branches.front().from_bb->flat_bb_index, path.sample_time, {},
+        /*path_length=*/1,
+        absl::Milliseconds(
+            path_profile_options_->max_icache_penalty_interval_millis()));
+    return;
   }
-  bb_branch_paths_.erase(bb_branch_paths_.begin(),
-                         bb_branch_paths_.begin() + num_paths);
+  CloningPathTraceHandler handler(
+      path_profile_options_, cfg, &hot_join_bbs_.at(path_function_index),
+      &function_path_info,
+      &program_path_profile_->GetProfileForFunctionIndex(path_function_index));
+  PathTracer(cfg, &handler).TracePath(path);
+}
+
+void ProgramCfgPathAnalyzer::AnalyzePaths(std::optional<int> paths_to_analyze) {
+  int num_paths = paths_to_analyze.value_or(path_buffer_.size());
+  CHECK_LE(num_paths, path_buffer_.size());
+  path_buffer_.Release(num_paths, [this](const FlatBbHandleBranchPath &path) {
+    AnalyzePath(path);
+  });
 }
 
 void ProgramCfgPathAnalyzer::StoreAndAnalyzePaths(
     absl::Span<const FlatBbHandleBranchPath> bb_branch_paths) {
-  absl::c_move(bb_branch_paths, std::back_inserter(bb_branch_paths_));
-  if (!bb_branch_paths_.empty() &&
-      bb_branch_paths_.back().sample_time -
-              bb_branch_paths_.front().sample_time >
-          absl::Milliseconds(
-              path_profile_options_->max_time_diff_in_path_buffer_millis())) {
-    AnalyzePaths(bb_branch_paths_.size() / 2);
+  for (const FlatBbHandleBranchPath &path : bb_branch_paths) {
+    path_buffer_.Add(path,
+                     [this](const FlatBbHandleBranchPath &released_path) {
+                       AnalyzePath(released_path);
+                     });
+  }
+  if (path_buffer_.GetTimeSpan() >
+      absl::Milliseconds(
+          path_profile_options_->max_time_diff_in_path_buffer_millis())) {
+    AnalyzePaths(path_buffer_.size() / 2);
   }
 }
 }  // namespace propeller
@@ -16,7 +16,6 @@
 #define PROPELLER_PROGRAM_CFG_PATH_ANALYZER_H_
 #include <algorithm>
 #include <cstdint>
-#include <deque>
 #include <optional>
 #include <utility>
 #include <vector>
@@ -33,6 +32,7 @@
 #include "propeller/bb_handle.h"
 #include "propeller/binary_address_mapper.h"
 #include "propeller/cfg.h"
+#include "propeller/path_buffer.h"
 #include "propeller/path_node.h"
 #include "propeller/path_profile_options.pb.h"
 #include "propeller/program_cfg.h"
@@ -302,6 +302,11 @@ class ProgramCfgPathAnalyzer {
         program_cfg_(program_cfg),
         hot_join_bbs_(program_cfg->GetHotJoinNodes(
             hot_threshold_, /*hot_edge_frequency_threshold=*/1)),
+        path_buffer_(
+            absl::Milliseconds(
+                path_profile_options->max_time_diff_in_path_buffer_millis()) /
+                kPathBufferBucketsPerTimeDiff,
+            2 * kPathBufferBucketsPerTimeDiff),
         program_path_profile_(program_path_profile) {}
 
   ProgramCfgPathAnalyzer(const ProgramCfgPathAnalyzer &) = delete;
@@ -313,19 +318,23 @@ class ProgramCfgPathAnalyzer {
     return *program_path_profile_;
   }
 
-  const std::deque<propeller::FlatBbHandleBranchPath> &bb_branch_paths() const {
-    return bb_branch_paths_;
+  // Returns the paths remaining to be analyzed, in nondecreasing order of their
+  // sample times.
+  std::vector<propeller::FlatBbHandleBranchPath> bb_branch_paths() const {
+    return path_buffer_.GetPaths();
   }
 
-  // Stores the paths in `bb_branch_paths` into `bb_branch_paths_`. If the
-  // sampled times in `bb_branch_paths_` roughly exceeds
+  // Stores the paths in `bb_branch_paths` into `path_buffer_`. If the sampled
+  // times in `path_buffer_` exceed
   // `path_profile_options_->max_time_diff_in_path_buffer_millis`, analyzes and
   // purges half of them by calling `ProgramCfgPathAnalyzer::AnalyzePaths`.
+  // Paths which fall far enough behind the newest path to be pushed out of
+  // `path_buffer_` are analyzed right away.
   void StoreAndAnalyzePaths(
       absl::Span<const propeller::FlatBbHandleBranchPath> bb_branch_paths);
 
-  // Sorts all paths in `bb_branch_paths_` based on their sample_time. Then
-  // analyzes and removes the first `paths_to_analyze` paths and updates
+  // Analyzes and removes the first `paths_to_analyze` paths in `path_buffer_`
+  // in nondecreasing order of their sample times, and updates
   // `program_path_profile_`. Each path tree represents many paths which share
   // their second block. The shared block corresponds to the root of this
   // tree. Every path node in the tree represents all the program paths
@@ -335,7 +344,7 @@ class ProgramCfgPathAnalyzer {
   // possible path predecessor block. It also stores the frequency of every
   // call from the corresponding ending block, given every possible path
   // predecessor block. If `paths_to_analyze == std::nullopt` analyzes all
-  // paths in `bb_branch_paths_`.
+  // paths in `path_buffer_`.
   //
   void AnalyzePaths(std::optional<int> paths_to_analyze);
 
@@ -354,6 +363,13 @@ class ProgramCfgPathAnalyzer {
   }
 
  private:
+  // Number of `path_buffer_` buckets covering
+  // `max_time_diff_in_path_buffer_millis`.
+  static constexpr int kPathBufferBucketsPerTimeDiff = 8;
+
+  // Analyzes a single path and updates `program_path_profile_`.
+  void AnalyzePath(const propeller::FlatBbHandleBranchPath &path);
+
   const propeller::PathProfileOptions *path_profile_options_;
   // CFGNode and CFGEdge frequency threshold to be considered hot.
   int64_t hot_threshold_;
@@ -363,7 +379,7 @@ class ProgramCfgPathAnalyzer {
   // basic block indices.
   absl::flat_hash_map<int, absl::btree_set<int>> hot_join_bbs_;
   // Paths remaining to be analyzed.
-  std::deque<propeller::FlatBbHandleBranchPath> bb_branch_paths_;
+  PathBuffer path_buffer_;
   // Program path profile for all functions.
   propeller::ProgramPathProfile *program_path_profile_;
 };
@@ -18,6 +18,7 @@
 #include <iterator>
 #include <memory>
 #include <optional>
+#include <utility>
 #include <vector>
 
 #include "absl/algorithm/container.h"
@@ -52,6 +53,38 @@ using ::testing::UnorderedElementsAre;
 
 constexpr double kEpsilon = 0.001;
 
+// Checks that the path tree rooted at `path_node` has the same structure and
+// frequencies as the one rooted at `expected`.
+void ExpectSamePathTree(const PathNode &path_node, const PathNode &expected) {
+  EXPECT_EQ(path_node.node_bb_index(), expected.node_bb_index());
+  EXPECT_EQ(path_node.path_length(), expected.path_length());
+  auto expect_same_entry = [](const PathPredInfoEntry &entry,
+                              const PathPredInfoEntry &expected_entry) {
+    EXPECT_EQ(entry.freq, expected_entry.freq);
+    EXPECT_NEAR(entry.cache_pressure, expected_entry.cache_pressure, kEpsilon);
+    EXPECT_EQ(entry.call_freqs, expected_entry.call_freqs);
+    EXPECT_EQ(entry.return_to_freqs, expected_entry.return_to_freqs);
+  };
+  ASSERT_EQ(path_node.path_pred_info().entries.size(),
+            expected.path_pred_info().entries.size());
+  for (const auto &[pred_bb_index, expected_entry] :
+       expected.path_pred_info().entries) {
+    const PathPredInfoEntry *entry =
+        path_node.path_pred_info().GetEntry(pred_bb_index);
+    ASSERT_NE(entry, nullptr);
+    expect_same_entry(*entry, expected_entry);
+  }
+  expect_same_entry(path_node.path_pred_info().missing_pred_entry,
+                    expected.path_pred_info().missing_pred_entry);
+  ASSERT_EQ(path_node.children().size(), expected.children().size());
+  for (const auto &[child_bb_index, expected_child] : expected.children()) {
+    const PathNode *child = path_node.GetChild(child_bb_index);
+    ASSERT_NE(child, nullptr);
+    EXPECT_EQ(child->parent(), &path_node);
+    ExpectSamePathTree(*child, *expected_child);
+  }
+}
+
 // Returns the max depth in the path tree rooted at `path_node`, with the root
 // having a depth of 1.
 int GetMaxDepthForPathTree(const PathNode &path_node) {
@@ -886,6 +919,92 @@ TEST(ProgramCfgPathAnalyzer, TracksMissingPathPredecessorInfo) {
                                  Pair(3, path_node_is_3_matcher))))))))));
 }
 
+TEST(ProgramCfgPathAnalyzer, MergesPathProfilesOfSeparateAnalyzers) {
+  std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
+      {.cfg_args = {{".text",
+                     0,
+                     "foo",
+                     {{0x1000, 0, 0x10, {.CanFallThrough = true}},
+                      {0x1010, 1, 0x9, {.CanFallThrough = true}},
+                      {0x1020, 2, 0x8, {.CanFallThrough = true}},
+                      {0x1030, 3, 0x7, {}},
+                      {0x1040, 4, 0x6, {.CanFallThrough = true}},
+                      {0x1050, 5, 0x5, {.CanFallThrough = true}},
+                      {0x1060, 6, 0x6, {.HasReturn = true}}},
+                     {{0, 1, 10, CFGEdgeKind::kBranchOrFallthough},
+                      {0, 2, 5, CFGEdgeKind::kBranchOrFallthough},
+                      {1, 2, 10, CFGEdgeKind::kBranchOrFallthough},
+                      {2, 3, 10, CFGEdgeKind::kBranchOrFallthough},
+                      {3, 6, 12, CFGEdgeKind::kBranchOrFallthough},
+                      {2, 4, 6, CFGEdgeKind::kBranchOrFallthough},
+                      {4, 5, 6, CFGEdgeKind::kBranchOrFallthough},
+                      {5, 6, 6, CFGEdgeKind::kBranchOrFallthough}}}}});
+  FlatBbHandleBranchPath path1 = {
+      .pid = 2080799,
+      .branches = {{.from_bb = {{.function_index = 0, .flat_bb_index = 0}},
+                    .to_bb = {{.function_index = 0, .flat_bb_index = 2}}},
+                   {.from_bb = {{.function_index = 0, .flat_bb_index = 2}},
+                    .to_bb = {{.function_index = 0, .flat_bb_index = 4}}},
+                   {.from_bb = {{.function_index = 0, .flat_bb_index = 6}}}},
+      .returns_to = {{.function_index = 2, .flat_bb_index = 98}}};
+  FlatBbHandleBranchPath path2 = {
+      .pid = 2080799,
+      .branches = {{.to_bb = {{.function_index = 0, .flat_bb_index = 0}}},
+                   {.from_bb = {{.function_index = 0, .flat_bb_index = 3}},
+                    .to_bb = {{.function_index = 0, .flat_bb_index = 3}},
+                    .call_rets = {{.callee = 1,
+                                   .return_bb = {{.function_index = 1,
+                                                  .flat_bb_index = 87}}}}},
+                   {.from_bb = {{.function_index = 0, .flat_bb_index = 3}},
+                    .to_bb = {{.function_index = 0, .flat_bb_index = 6}}}},
+      .returns_to = {{.function_index = 2, .flat_bb_index = 98}}};
+  // Each shard of paths is analyzed by its own analyzer, like every perf data
+  // file in `PerfDataPathProfileAggregator`. Analyzing the shards into private
+  // profiles and merging them must be equivalent to analyzing all of them into
+  // one profile.
+  std::vector<std::vector<FlatBbHandleBranchPath>> shards = {
+      std::vector<FlatBbHandleBranchPath>(5, path1),
+      std::vector<FlatBbHandleBranchPath>(10, path2),
+      {path1, path2, path1}};
+
+  PathProfileOptions options;
+  options.set_hot_cutoff_percentile(30);
+  ProgramPathProfile expected_path_profile;
+  ProgramPathProfile merged_path_profile;
+  for (const std::vector<FlatBbHandleBranchPath> &shard : shards) {
+    ProgramCfgPathAnalyzer path_analyzer(&options, program_cfg.get(),
+                                         &expected_path_profile);
+    path_analyzer.StoreAndAnalyzePaths(shard);
+    path_analyzer.AnalyzePaths(/*paths_to_analyze=*/std::nullopt);
+
+    ProgramPathProfile shard_path_profile;
+    ProgramCfgPathAnalyzer shard_path_analyzer(&options, program_cfg.get(),
+                                               &shard_path_profile);
+    shard_path_analyzer.StoreAndAnalyzePaths(shard);
+    shard_path_analyzer.AnalyzePaths(/*paths_to_analyze=*/std::nullopt);
+    merged_path_profile.Merge(std::move(shard_path_profile));
+    EXPECT_THAT(shard_path_profile.path_profiles_by_function_index(),
+                IsEmpty());
+  }
+
+  ASSERT_THAT(merged_path_profile.path_profiles_by_function_index(),
+              ElementsAre(Key(0)));
+  const FunctionPathProfile &merged_function_path_profile =
+      merged_path_profile.path_profiles_by_function_index().at(0);
+  const FunctionPathProfile &expected_function_path_profile =
+      expected_path_profile.path_profiles_by_function_index().at(0);
+  ASSERT_EQ(
+      merged_function_path_profile.path_trees_by_root_bb_index().size(),
+      expected_function_path_profile.path_trees_by_root_bb_index().size());
+  for (const auto &[bb_index, expected_path_tree] :
+       expected_function_path_profile.path_trees_by_root_bb_index()) {
+    const PathNode *path_tree =
+        merged_function_path_profile.GetPathTree(bb_index);
+    ASSERT_NE(path_tree, nullptr);
+    ExpectSamePathTree(*path_tree, *expected_path_tree);
+  }
+}
+
 TEST(ProgramCfgPathAnalyzer,
      TracksMissingPathPredecessorInfoWithBogusFallthroughPath) {
   std::unique_ptr<ProgramCfg> program_cfg = BuildFromCfgArg(
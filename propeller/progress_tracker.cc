@@ -0,0 +1,97 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/progress_tracker.h"
+
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+
+ProgressTracker &ProgressTracker::Global() {
+  static ProgressTracker *const tracker = new ProgressTracker();
+  return *tracker;
+}
+
+void ProgressTracker::StartStage(absl::string_view name) {
+  absl::MutexLock lock(&mutex_);
+  active_stages_.push_back(
+      {.name = std::string(name), .start_time = absl::Now()});
+}
+
+void ProgressTracker::FinishStage(
+    const PropellerStats::StageStats::Stage &stage) {
+  absl::MutexLock lock(&mutex_);
+  // Stages normally finish in the reverse order of their start, but remove the
+  // innermost stage with the name in any case.
+  for (int i = active_stages_.size() - 1; i >= 0; --i) {
+    if (active_stages_[i].name != stage.name) continue;
+    active_stages_.erase(active_stages_.begin() + i);
+    break;
+  }
+  stats_.stage_stats.AddStage(stage);
+}
+
+void ProgressTracker::UpdateStats(const PropellerStats &stats) {
+  absl::MutexLock lock(&mutex_);
+  PropellerStats::StageStats finished_stages = std::move(stats_.stage_stats);
+  stats_ = stats;
+  stats_.stage_stats = std::move(finished_stages);
+}
+
+std::string ProgressTracker::current_stage() const {
+  absl::MutexLock lock(&mutex_);
+  return active_stages_.empty() ? "" : active_stages_.back().name;
+}
+
+std::string ProgressTracker::DebugString() const {
+  const absl::Time now = absl::Now();
+  absl::MutexLock lock(&mutex_);
+  std::vector<std::string> lines = {absl::StrFormat(
+      "Uptime: %.1fs", absl::ToDoubleSeconds(now - start_time_))};
+  if (active_stages_.empty()) {
+    lines.push_back("Current stage: none");
+  } else {
+    const ActiveStage &current = active_stages_.back();
+    lines.push_back(absl::StrFormat(
+        "Current stage: %s (running for %.1fs)", current.name,
+        absl::ToDoubleSeconds(now - current.start_time)));
+    // List the enclosing stages, innermost first.
+    for (int i = active_stages_.size() - 2; i >= 0; --i) {
+      lines.push_back(absl::StrFormat(
+          "  in stage: %s (running for %.1fs)", active_stages_[i].name,
+          absl::ToDoubleSeconds(now - active_stages_[i].start_time)));
+    }
+  }
+  lines.push_back(
+      absl::StrCat("Perf files read: ", Get(Counter::kPerfFilesRead)));
+  lines.push_back(
+      absl::StrCat("Functions laid out: ", Get(Counter::kFunctionsLaidOut)));
+  lines.push_back(
+      absl::StrCat("Clonings evaluated: ", Get(Counter::kCloningsEvaluated)));
+  lines.push_back(stats_.DebugString());
+  return absl::StrJoin(lines, "\n");
+}
+}  // namespace propeller
@@ -0,0 +1,102 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROPELLER_PROGRESS_TRACKER_H_
+#define PROPELLER_PROGRESS_TRACKER_H_
+
+#include <array>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/base/thread_annotations.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+
+// Tracks the progress of profile generation while it runs, so it can be
+// reported by /statusz. All methods are thread-safe.
+class ProgressTracker {
+ public:
+  enum class Counter {
+    // Perf data files read, once per aggregation which reads them.
+    kPerfFilesRead,
+    // Functions laid out by `NodeChainBuilder`, including the layouts
+    // computed for evaluating clonings.
+    kFunctionsLaidOut,
+    // Cloning candidates evaluated by `EvaluateCloning`.
+    kCloningsEvaluated,
+  };
+
+  ProgressTracker() : start_time_(absl::Now()) {}
+  ProgressTracker(const ProgressTracker &) = delete;
+  ProgressTracker &operator=(const ProgressTracker &) = delete;
+
+  // Returns the tracker of the process.
+  static ProgressTracker &Global();
+
+  // Records that the stage `name` started and is now the current stage. If
+  // another stage is running, `name` is nested in it.
+  void StartStage(absl::string_view name);
+
+  // Records that `stage` finished. If `stage` is the current stage, its parent
+  // stage (if any) becomes current again.
+  void FinishStage(const PropellerStats::StageStats::Stage &stage);
+
+  // Records the latest snapshot of the profile generation stats. The stage
+  // stats in `stats` are ignored, since `FinishStage` records them.
+  void UpdateStats(const PropellerStats &stats);
+
+  void Increment(Counter counter, int64_t n = 1) {
+    counters_[static_cast<int>(counter)].fetch_add(n,
+                                                   std::memory_order_relaxed);
+  }
+
+  int64_t Get(Counter counter) const {
+    return counters_[static_cast<int>(counter)].load(
+        std::memory_order_relaxed);
+  }
+
+  // Returns the name of the current (innermost) stage, or an empty string if
+  // no stage is running.
+  std::string current_stage() const;
+
+  // Returns the progress report: the running stages, the counters, the latest
+  // stats and the stats of the finished stages.
+  std::string DebugString() const;
+
+ private:
+  static constexpr int kNumCounters =
+      static_cast<int>(Counter::kCloningsEvaluated) + 1;
+
+  const absl::Time start_time_;
+  std::array<std::atomic<int64_t>, kNumCounters> counters_ = {};
+  struct ActiveStage {
+    std::string name;
+    absl::Time start_time;
+  };
+
+  mutable absl::Mutex mutex_;
+  // Running stages, from the outermost to the current one.
+  std::vector<ActiveStage> active_stages_ ABSL_GUARDED_BY(mutex_);
+  // Latest stats, with the stats of the finished stages.
+  PropellerStats stats_ ABSL_GUARDED_BY(mutex_);
+};
+}  // namespace propeller
+#endif  // PROPELLER_PROGRESS_TRACKER_H_
@@ -0,0 +1,82 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/progress_tracker.h"
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+using ::testing::AllOf;
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+TEST(ProgressTrackerTest, TracksStagesAndCounters) {
+  ProgressTracker progress_tracker;
+  EXPECT_EQ(progress_tracker.current_stage(), "");
+  progress_tracker.StartStage("layout");
+  progress_tracker.Increment(ProgressTracker::Counter::kFunctionsLaidOut, 3);
+  progress_tracker.Increment(ProgressTracker::Counter::kFunctionsLaidOut);
+  EXPECT_EQ(progress_tracker.current_stage(), "layout");
+  EXPECT_EQ(
+      progress_tracker.Get(ProgressTracker::Counter::kFunctionsLaidOut), 4);
+  EXPECT_EQ(progress_tracker.Get(ProgressTracker::Counter::kPerfFilesRead), 0);
+  EXPECT_THAT(progress_tracker.DebugString(),
+              AllOf(HasSubstr("Current stage: layout (running for "),
+                    HasSubstr("Functions laid out: 4")));
+
+  progress_tracker.FinishStage(
+      {.name = "layout", .wall_time = absl::Seconds(2)});
+  EXPECT_EQ(progress_tracker.current_stage(), "");
+  EXPECT_THAT(progress_tracker.DebugString(),
+              AllOf(HasSubstr("Current stage: none"),
+                    HasSubstr("layout: 2.000s wall time")));
+}
+
+TEST(ProgressTrackerTest, RestoresParentStage) {
+  ProgressTracker progress_tracker;
+  progress_tracker.StartStage("layout_tuning");
+  progress_tracker.StartStage("layout");
+  EXPECT_EQ(progress_tracker.current_stage(), "layout");
+  EXPECT_THAT(progress_tracker.DebugString(),
+              AllOf(HasSubstr("Current stage: layout (running for "),
+                    HasSubstr("in stage: layout_tuning (running for ")));
+
+  progress_tracker.FinishStage({.name = "layout"});
+  EXPECT_EQ(progress_tracker.current_stage(), "layout_tuning");
+  progress_tracker.FinishStage({.name = "layout_tuning"});
+  EXPECT_EQ(progress_tracker.current_stage(), "");
+}
+
+TEST(ProgressTrackerTest, ExportsStats) {
+  ProgressTracker progress_tracker;
+  progress_tracker.FinishStage(
+      {.name = "cfg_build", .wall_time = absl::Seconds(1)});
+  PropellerStats stats;
+  stats.cfg_stats.cfgs_created = 7;
+  stats.cloning_stats.paths_cloned = 3;
+  // Stage stats are recorded by `FinishStage` only.
+  stats.stage_stats.AddStage({.name = "ignored"});
+  progress_tracker.UpdateStats(stats);
+  EXPECT_THAT(progress_tracker.DebugString(),
+              AllOf(HasSubstr("Created 7 cfgs."), HasSubstr("Cloned 3 paths."),
+                    HasSubstr("cfg_build: 1.000s wall time"),
+                    Not(HasSubstr("ignored"))));
+}
+}  // namespace
+}  // namespace propeller
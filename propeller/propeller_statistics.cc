@@ -14,6 +14,7 @@
 
 #include "propeller/propeller_statistics.h"
 
+#include <algorithm>
 #include <cstdint>
 #include <string>
 #include <utility>
@@ -22,6 +23,8 @@
 #include "absl/strings/str_cat.h"
 #include "absl/strings/str_format.h"
 #include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/chain_merge_order.h"
 
@@ -143,20 +146,83 @@ std::string PropellerStats::BbAddrMapStats::DebugString() const {
 }
 
 std::string PropellerStats::CloningStats::DebugString() const {
+  int64_t total_candidates =
+      clonings_evaluated + clonings_pruned_by_score_upper_bound;
   return absl::StrJoin(
       {absl::StrCat("Cloned ", paths_cloned, " paths."),
        absl::StrCat("Added ", bbs_cloned, " cloned basic blocks."),
        absl::StrCat("Increased code size by ", bytes_cloned,
-                    " bytes with cloning."),
-       absl::StrCat("Gained ", score_gain, " in cloning score.")},
+                    " bytes with cloning (budget: ",
+                    clone_size_budget == 0 ? "unlimited"
+                                           : absl::StrCat(clone_size_budget),
+                    ")."),
+       absl::StrCat("Gained ", score_gain, " in cloning score."),
+       absl::StrCat("Baseline layout cache: ", baseline_layout_cache_hits,
+                    " hits, ", baseline_layout_cache_misses, " misses."),
+       absl::StrFormat(
+           "Pruned %d of %d cloning candidates (%.2f%%) by score upper bound.",
+           clonings_pruned_by_score_upper_bound, total_candidates,
+           total_candidates == 0 ? 0.0
+                                 : clonings_pruned_by_score_upper_bound *
+                                       100.0 / total_candidates),
+       absl::StrCat("Reevaluated ", clonings_reevaluated,
+                    " clonings while applying clonings.")},
       "\n");
 }
 
+void PropellerStats::StageStats::AddStage(const Stage &stage) {
+  for (Stage &existing_stage : stages) {
+    if (existing_stage.name != stage.name) continue;
+    existing_stage.wall_time += stage.wall_time;
+    existing_stage.peak_rss_bytes =
+        std::max(existing_stage.peak_rss_bytes, stage.peak_rss_bytes);
+    existing_stage.peak_rss_growth_bytes += stage.peak_rss_growth_bytes;
+    return;
+  }
+  stages.push_back(stage);
+}
+
+const PropellerStats::StageStats::Stage *PropellerStats::StageStats::GetStage(
+    absl::string_view name) const {
+  for (const Stage &stage : stages)
+    if (stage.name == name) return &stage;
+  return nullptr;
+}
+
+std::string PropellerStats::StageStats::DebugString() const {
+  std::vector<std::string> lines = {"Stage stats:"};
+  for (const Stage &stage : stages) {
+    lines.push_back(absl::StrFormat(
+        "%s: %.3fs wall time, %.1f MiB peak rss (%+.1f MiB)", stage.name,
+        absl::ToDoubleSeconds(stage.wall_time),
+        stage.peak_rss_bytes / (1024.0 * 1024.0),
+        stage.peak_rss_growth_bytes / (1024.0 * 1024.0)));
+  }
+  return absl::StrJoin(lines, "\n");
+}
+
+std::string PropellerStats::StageStats::ToJson() const {
+  return absl::StrCat(
+      "[",
+      absl::StrJoin(
+          stages, ",\n ",
+          [](std::string *out, const Stage &stage) {
+            absl::StrAppendFormat(
+                out,
+                "{\"name\": \"%s\", \"wall_time_ms\": %.3f, "
+                "\"peak_rss_bytes\": %d, \"peak_rss_growth_bytes\": %d}",
+                stage.name, absl::ToDoubleMilliseconds(stage.wall_time),
+                stage.peak_rss_bytes, stage.peak_rss_growth_bytes);
+          }),
+      "]\n");
+}
+
 std::string PropellerStats::DebugString() const {
   std::vector<std::string> stat_lines = {
       profile_stats.DebugString(),     bbaddrmap_stats.DebugString(),
       cfg_stats.DebugString(),         code_layout_stats.DebugString(),
-      disassembly_stats.DebugString(), cloning_stats.DebugString()};
+      disassembly_stats.DebugString(), cloning_stats.DebugString(),
+      stage_stats.DebugString()};
   return absl::StrJoin(stat_lines, "\n");
 }
 }  // namespace propeller
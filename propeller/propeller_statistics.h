@@ -18,9 +18,12 @@
 #include <cstdint>
 #include <string>
 #include <utility>
+#include <vector>
 
 #include "absl/algorithm/container.h"
 #include "absl/container/flat_hash_map.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
 #include "propeller/cfg_edge_kind.h"
 #include "propeller/chain_merge_order.h"
 
@@ -175,17 +178,70 @@ struct PropellerStats {
     int bbs_cloned = 0;
     int bytes_cloned = 0;
     double score_gain = 0;
+    // Number of baseline layouts served from / missed in the baseline layout
+    // cache during clone evaluation.
+    int64_t baseline_layout_cache_hits = 0;
+    int64_t baseline_layout_cache_misses = 0;
+    // Number of initial cloning candidates which were evaluated with full
+    // layouts, and which were pruned by their score gain upper bound.
+    int64_t clonings_evaluated = 0;
+    int64_t clonings_pruned_by_score_upper_bound = 0;
+    // Number of clonings reevaluated while applying clonings.
+    int64_t clonings_reevaluated = 0;
+    // Code size budget for cloning in bytes, or zero if unlimited.
+    int64_t clone_size_budget = 0;
 
     void operator+=(const CloningStats &other) {
       paths_cloned += other.paths_cloned;
       bbs_cloned += other.bbs_cloned;
       bytes_cloned += other.bytes_cloned;
       score_gain += other.score_gain;
+      baseline_layout_cache_hits += other.baseline_layout_cache_hits;
+      baseline_layout_cache_misses += other.baseline_layout_cache_misses;
+      clonings_evaluated += other.clonings_evaluated;
+      clonings_pruned_by_score_upper_bound +=
+          other.clonings_pruned_by_score_upper_bound;
+      clonings_reevaluated += other.clonings_reevaluated;
+      clone_size_budget += other.clone_size_budget;
     }
 
     std::string DebugString() const;
   };
 
+  // Wall time and peak memory of the stages of profile generation (e.g.,
+  // binary load, LBR aggregation, cfg build, layout and profile writing).
+  struct StageStats {
+    struct Stage {
+      std::string name;
+      absl::Duration wall_time;
+      // Peak resident set size of the process at the end of the stage.
+      int64_t peak_rss_bytes = 0;
+      // Growth of the peak resident set size of the process during the stage.
+      int64_t peak_rss_growth_bytes = 0;
+    };
+
+    // Stages in the order in which they were first added.
+    std::vector<Stage> stages;
+
+    // Adds `stage`. If a stage with the same name exists, accumulates `stage`
+    // into it: wall times and peak growths are added and the peak is the
+    // maximum of the two.
+    void AddStage(const Stage &stage);
+
+    void operator+=(const StageStats &other) {
+      for (const Stage &stage : other.stages) AddStage(stage);
+    }
+
+    // Returns the stage with name `name` or `nullptr` if it doesn't exist.
+    const Stage *GetStage(absl::string_view name) const;
+
+    std::string DebugString() const;
+
+    // Returns the stages as a JSON array of objects with fields "name",
+    // "wall_time_ms", "peak_rss_bytes" and "peak_rss_growth_bytes".
+    std::string ToJson() const;
+  };
+
   BbAddrMapStats bbaddrmap_stats;
 
   ProfileStats profile_stats;
@@ -194,6 +250,7 @@ struct PropellerStats {
   CfgStats cfg_stats;
   CodeLayoutStats code_layout_stats;
   CloningStats cloning_stats;
+  StageStats stage_stats;
 
   void operator+=(const PropellerStats &other) {
     bbaddrmap_stats += other.bbaddrmap_stats;
@@ -202,6 +259,7 @@ struct PropellerStats {
     cfg_stats += other.cfg_stats;
     code_layout_stats += other.code_layout_stats;
     cloning_stats += other.cloning_stats;
+    stage_stats += other.stage_stats;
   }
 
   std::string DebugString() const;
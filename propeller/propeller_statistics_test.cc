@@ -14,11 +14,16 @@
 
 #include "propeller/propeller_statistics.h"
 
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
 #include "gtest/gtest.h"
 #include "propeller/cfg_edge_kind.h"
 
 namespace propeller {
 namespace {
+using ::testing::AllOf;
+using ::testing::ElementsAre;
+using ::testing::Field;
 
 TEST(PropellerStatisticsTest, TotalEdgeWeightCreatedDoesntOverflow) {
   PropellerStats statistics = {
@@ -30,5 +35,39 @@ TEST(PropellerStatisticsTest, TotalEdgeWeightCreatedDoesntOverflow) {
   EXPECT_EQ(statistics.cfg_stats.total_edge_weight_created(), 2202261886);
 }
 
+TEST(PropellerStatisticsTest, AccumulatesStagesByName) {
+  PropellerStats statistics = {
+      .stage_stats = {.stages = {{.name = "binary_load",
+                                  .wall_time = absl::Seconds(1),
+                                  .peak_rss_bytes = 100,
+                                  .peak_rss_growth_bytes = 100}}}};
+  PropellerStats other_statistics = {
+      .stage_stats = {.stages = {{.name = "lbr_aggregation",
+                                  .wall_time = absl::Seconds(2),
+                                  .peak_rss_bytes = 300,
+                                  .peak_rss_growth_bytes = 200},
+                                 {.name = "binary_load",
+                                  .wall_time = absl::Seconds(3),
+                                  .peak_rss_bytes = 50,
+                                  .peak_rss_growth_bytes = 10}}}};
+  statistics += other_statistics;
+  EXPECT_THAT(
+      statistics.stage_stats.stages,
+      ElementsAre(
+          AllOf(Field(&PropellerStats::StageStats::Stage::name, "binary_load"),
+                Field(&PropellerStats::StageStats::Stage::wall_time,
+                      absl::Seconds(4)),
+                Field(&PropellerStats::StageStats::Stage::peak_rss_bytes, 100),
+                Field(&PropellerStats::StageStats::Stage::peak_rss_growth_bytes,
+                      110)),
+          Field(&PropellerStats::StageStats::Stage::name, "lbr_aggregation")));
+  EXPECT_EQ(statistics.stage_stats.GetStage("layout"), nullptr);
+  EXPECT_EQ(statistics.stage_stats.ToJson(),
+            "[{\"name\": \"binary_load\", \"wall_time_ms\": 4000.000, "
+            "\"peak_rss_bytes\": 100, \"peak_rss_growth_bytes\": 110},\n"
+            " {\"name\": \"lbr_aggregation\", \"wall_time_ms\": 2000.000, "
+            "\"peak_rss_bytes\": 300, \"peak_rss_growth_bytes\": 200}]\n");
+}
+
 }  // namespace
 }  // namespace  propeller
@@ -0,0 +1,174 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+// A standalone tool to estimate the instruction cache and iTLB effect of a
+// propeller layout without deploying it. It replays the LBR samples of the
+// given perf.data files over the original layout of the binary and over the
+// layout predicted from the cluster and symbol order profiles, and reports the
+// miss counts of both.
+//
+// Example:
+// ```
+// simulate_layout_cache --binary=sample.bin --profile=perf.data \
+//     --cc_profile=cc_profile.txt --ld_profile=ld_profile.txt
+// ```
+
+#include <cstdint>
+#include <iostream>
+#include <memory>
+#include <optional>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/flags/flag.h"
+#include "absl/flags/parse.h"
+#include "absl/flags/usage.h"
+#include "absl/log/check.h"
+#include "absl/log/log.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_split.h"
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "propeller/binary_address_branch_path.h"
+#include "propeller/binary_address_mapper.h"
+#include "propeller/binary_content.h"
+#include "propeller/cluster_profile.h"
+#include "propeller/file_helpers.h"
+#include "propeller/file_perf_data_provider.h"
+#include "propeller/layout_cache_simulator.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/perfdata_reader.h"
+#include "propeller/propeller_options.pb.h"
+#include "propeller/propeller_statistics.h"
+#include "src/quipper/perf_data.pb.h"
+
+ABSL_FLAG(std::string, binary, "", "Binary with a bb address map.");
+ABSL_FLAG(std::vector<std::string>, profile, {},
+          "Comma-separated perf.data files with LBR samples of the binary.");
+ABSL_FLAG(std::string, cc_profile, "",
+          "Cluster profile (binary or text) of the predicted layout.");
+ABSL_FLAG(std::string, ld_profile, "",
+          "Symbol order profile of the predicted layout.");
+ABSL_FLAG(std::string, mmap_name, "",
+          "File name of the binary in the mmap events. If empty, the mmaps "
+          "are matched by build id.");
+ABSL_FLAG(int64_t, line_size, 64, "L1i and L2 cache line size in bytes.");
+ABSL_FLAG(int64_t, l1i_size, 32 * 1024, "L1i cache size in bytes.");
+ABSL_FLAG(int, l1i_associativity, 8, "L1i cache associativity.");
+ABSL_FLAG(int64_t, l2_size, 1024 * 1024, "L2 cache size in bytes.");
+ABSL_FLAG(int, l2_associativity, 16, "L2 cache associativity.");
+ABSL_FLAG(int64_t, page_size, 4096, "Page size in bytes.");
+ABSL_FLAG(int64_t, itlb_entries, 128, "Number of iTLB entries.");
+ABSL_FLAG(int, itlb_associativity, 8, "iTLB associativity.");
+
+int main(int argc, char* argv[]) {
+  absl::SetProgramUsageMessage(argv[0]);
+  absl::ParseCommandLine(argc, argv);
+
+  absl::StatusOr<std::unique_ptr<propeller::BinaryContent>> binary_content =
+      propeller::GetBinaryContent(absl::GetFlag(FLAGS_binary));
+  QCHECK_OK(binary_content);
+  propeller::PropellerStats stats;
+  absl::StatusOr<std::unique_ptr<propeller::BinaryAddressMapper>>
+      address_mapper = propeller::BuildBinaryAddressMapper(
+          propeller::PropellerOptions(), **binary_content, stats);
+  QCHECK_OK(address_mapper);
+
+  absl::StatusOr<std::string> cluster_profile =
+      propeller_file::GetContents(absl::GetFlag(FLAGS_cc_profile));
+  QCHECK_OK(cluster_profile);
+  absl::StatusOr<std::vector<propeller::ClusterProfileFunction>> functions =
+      propeller::ParseClusterProfile(*cluster_profile);
+  QCHECK_OK(functions);
+  absl::StatusOr<std::string> symbol_order_profile =
+      propeller_file::GetContents(absl::GetFlag(FLAGS_ld_profile));
+  QCHECK_OK(symbol_order_profile);
+  const std::vector<absl::string_view> symbol_order =
+      absl::StrSplit(*symbol_order_profile, '\n', absl::SkipEmpty());
+  const propeller::LayoutAddressTranslator translator =
+      propeller::LayoutAddressTranslator::Create(address_mapper->get(),
+                                                 *functions, symbol_order);
+  // The original layout is packed like the predicted one, so that only the
+  // order of the blocks differs between them.
+  const propeller::LayoutAddressTranslator original_translator =
+      propeller::LayoutAddressTranslator::Create(
+          address_mapper->get(), /*functions=*/{}, /*symbol_order=*/{});
+
+  const propeller::InstructionCacheConfig config = {
+      .l1i = {.size = absl::GetFlag(FLAGS_l1i_size),
+              .line_size = absl::GetFlag(FLAGS_line_size),
+              .associativity = absl::GetFlag(FLAGS_l1i_associativity)},
+      .l2 = {.size = absl::GetFlag(FLAGS_l2_size),
+             .line_size = absl::GetFlag(FLAGS_line_size),
+             .associativity = absl::GetFlag(FLAGS_l2_associativity)},
+      .itlb = {.size = absl::GetFlag(FLAGS_itlb_entries) *
+                       absl::GetFlag(FLAGS_page_size),
+               .line_size = absl::GetFlag(FLAGS_page_size),
+               .associativity = absl::GetFlag(FLAGS_itlb_associativity)}};
+  absl::StatusOr<propeller::LayoutCacheSimulator> simulator =
+      propeller::LayoutCacheSimulator::Create(config, &original_translator,
+                                              &translator);
+  QCHECK_OK(simulator);
+
+  propeller::GenericFilePerfDataProvider perf_data_provider(
+      absl::GetFlag(FLAGS_profile));
+  while (true) {
+    absl::StatusOr<std::optional<propeller::PerfDataProvider::BufferHandle>>
+        perf_data = perf_data_provider.GetNext();
+    QCHECK_OK(perf_data);
+    if (!perf_data->has_value()) break;
+    const std::string description = (*perf_data)->description;
+    absl::StatusOr<propeller::PerfDataReader> perf_data_reader =
+        propeller::BuildPerfDataReader(std::move(**perf_data),
+                                       binary_content->get(),
+                                       absl::GetFlag(FLAGS_mmap_name));
+    if (!perf_data_reader.ok()) {
+      LOG(WARNING) << "Skipped profile " << description << ": "
+                   << perf_data_reader.status();
+      continue;
+    }
+    // Like in LBR aggregation, kernel branches can be in any process's LBR
+    // stack, so they are not filtered by pid.
+    const bool is_kernel_mode = perf_data_reader->IsKernelMode();
+    perf_data_reader->ReadWithSampleCallBack(
+        [&](const quipper::PerfDataProto_SampleEvent& event) {
+          uint32_t pid = propeller::PerfDataReader::kKernelPid;
+          if (!is_kernel_mode) {
+            if (!event.has_pid() ||
+                perf_data_reader->binary_mmaps().find(event.pid()) ==
+                    perf_data_reader->binary_mmaps().end()) {
+              return;
+            }
+            pid = event.pid();
+          }
+          propeller::BinaryAddressBranchPath path = {
+              .pid = pid,
+              .sample_time = absl::FromUnixNanos(event.sample_time_ns())};
+          const auto& branch_stack = event.branch_stack();
+          for (int p = branch_stack.size() - 1; p >= 0; --p) {
+            const auto& branch_entry = branch_stack.Get(p);
+            path.branches.push_back(
+                {.from = perf_data_reader->RuntimeAddressToBinaryAddress(
+                     pid, branch_entry.from_ip()),
+                 .to = perf_data_reader->RuntimeAddressToBinaryAddress(
+                     pid, branch_entry.to_ip())});
+          }
+          simulator->Replay(path);
+        });
+  }
+  std::cout << propeller::FormatLayoutCacheSimulationStats(
+      simulator->stats());
+}
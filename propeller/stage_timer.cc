@@ -0,0 +1,67 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/stage_timer.h"
+
+#include <sys/resource.h>
+#include <unistd.h>
+
+#include <cstdint>
+#include <fstream>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "propeller/progress_tracker.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+
+int64_t GetPeakRssBytes() {
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+  // `ru_maxrss` is in kilobytes.
+  return int64_t{usage.ru_maxrss} * 1024;
+}
+
+int64_t GetRssBytes() {
+  // The second field of /proc/self/statm is the resident set size in pages.
+  std::ifstream statm("/proc/self/statm");
+  int64_t size_pages, resident_pages;
+  if (!(statm >> size_pages >> resident_pages)) return 0;
+  return resident_pages * sysconf(_SC_PAGESIZE);
+}
+
+ScopedStageTimer::ScopedStageTimer(absl::string_view name,
+                                   PropellerStats::StageStats &stage_stats)
+    : name_(name),
+      trace_span_(name_),
+      stage_stats_(stage_stats),
+      start_time_(absl::Now()),
+      start_peak_rss_bytes_(GetPeakRssBytes()) {
+  ProgressTracker::Global().StartStage(name_);
+}
+
+ScopedStageTimer::~ScopedStageTimer() {
+  const int64_t peak_rss_bytes = GetPeakRssBytes();
+  const PropellerStats::StageStats::Stage stage = {
+      .name = name_,
+      .wall_time = absl::Now() - start_time_,
+      .peak_rss_bytes = peak_rss_bytes,
+      .peak_rss_growth_bytes = peak_rss_bytes - start_peak_rss_bytes_};
+  stage_stats_.AddStage(stage);
+  ProgressTracker::Global().FinishStage(stage);
+}
+}  // namespace propeller
@@ -0,0 +1,68 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROPELLER_STAGE_TIMER_H_
+#define PROPELLER_STAGE_TIMER_H_
+
+#include <cstdint>
+#include <string>
+
+#include "absl/strings/string_view.h"
+#include "absl/time/time.h"
+#include "propeller/propeller_statistics.h"
+#include "propeller/trace_recorder.h"
+
+namespace propeller {
+
+// Returns the peak resident set size of the process in bytes, or 0 if it
+// can't be determined.
+int64_t GetPeakRssBytes();
+
+// Returns the current resident set size of the process in bytes, or 0 if it
+// can't be determined.
+int64_t GetRssBytes();
+
+// Measures the wall time and the peak resident set size of a stage of profile
+// generation from its construction to its destruction, and adds them to
+// `stage_stats` as the stage `name`. Stages measured more than once (e.g., once
+// per perf file) are accumulated under the same name. The stage is also
+// recorded as a trace span if tracing is enabled, and reported to
+// `ProgressTracker::Global()`.
+//
+// Example:
+// ```
+// {
+//   ScopedStageTimer timer("cfg_build", stats.stage_stats);
+//   ...
+// }
+// ```
+class ScopedStageTimer {
+ public:
+  ScopedStageTimer(absl::string_view name,
+                   PropellerStats::StageStats &stage_stats);
+  ScopedStageTimer(const ScopedStageTimer &) = delete;
+  ScopedStageTimer &operator=(const ScopedStageTimer &) = delete;
+  ~ScopedStageTimer();
+
+ private:
+  std::string name_;
+  // Must be declared after `name_`, which it refers to.
+  ScopedTraceSpan trace_span_;
+  PropellerStats::StageStats &stage_stats_;
+  absl::Time start_time_;
+  int64_t start_peak_rss_bytes_;
+};
+}  // namespace propeller
+#endif  // PROPELLER_STAGE_TIMER_H_
@@ -0,0 +1,65 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/stage_timer.h"
+
+#include <string>
+
+#include "absl/time/time.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+using ::testing::ElementsAre;
+using ::testing::Field;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::IsEmpty;
+using ::testing::NotNull;
+
+TEST(ScopedStageTimerTest, AddsStageOnDestruction) {
+  PropellerStats::StageStats stage_stats;
+  {
+    ScopedStageTimer timer("layout", stage_stats);
+    EXPECT_THAT(stage_stats.stages, IsEmpty());
+    // Touch some memory so the stage does some work.
+    std::string buffer(1 << 20, 'x');
+    EXPECT_EQ(buffer.back(), 'x');
+  }
+  EXPECT_THAT(stage_stats.stages,
+              ElementsAre(Field(&PropellerStats::StageStats::Stage::name,
+                                "layout")));
+  const PropellerStats::StageStats::Stage *stage =
+      stage_stats.GetStage("layout");
+  ASSERT_THAT(stage, NotNull());
+  EXPECT_THAT(stage->wall_time, Ge(absl::ZeroDuration()));
+  EXPECT_THAT(stage->peak_rss_bytes, Gt(0));
+  EXPECT_THAT(stage->peak_rss_growth_bytes, Ge(0));
+  EXPECT_LE(stage->peak_rss_bytes, GetPeakRssBytes());
+}
+
+TEST(ScopedStageTimerTest, AccumulatesRepeatedStages) {
+  PropellerStats::StageStats stage_stats;
+  for (int i = 0; i < 3; ++i) {
+    ScopedStageTimer timer("mmap_selection", stage_stats);
+  }
+  EXPECT_THAT(stage_stats.stages,
+              ElementsAre(Field(&PropellerStats::StageStats::Stage::name,
+                                "mmap_selection")));
+}
+}  // namespace
+}  // namespace propeller
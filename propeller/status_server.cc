@@ -0,0 +1,161 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/status_server.h"
+
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <unistd.h>
+
+#include <cerrno>
+#include <cstring>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/log/log.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/match.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "propeller/progress_tracker.h"
+#include "propeller/stage_timer.h"
+
+namespace propeller {
+namespace {
+// Interval at which the serving thread checks whether it should stop.
+constexpr int kPollTimeoutMs = 100;
+
+// Maximum size of a request which is read.
+constexpr int kMaxRequestSize = 4096;
+
+// Writes all of `data` to the socket `fd`, giving up on errors. Doesn't raise
+// SIGPIPE if the client has disconnected.
+void WriteAll(int fd, absl::string_view data) {
+  while (!data.empty()) {
+    ssize_t written = send(fd, data.data(), data.size(), MSG_NOSIGNAL);
+    if (written <= 0) {
+      if (written < 0 && errno == EINTR) continue;
+      return;
+    }
+    data.remove_prefix(written);
+  }
+}
+
+// Returns the HTTP response with `status`, `content_type` and `body`.
+std::string GetResponse(absl::string_view status,
+                        absl::string_view content_type,
+                        absl::string_view body) {
+  return absl::StrCat("HTTP/1.1 ", status, "\r\nContent-Type: ", content_type,
+                      "\r\nContent-Length: ", body.size(),
+                      "\r\nConnection: close\r\n\r\n", body);
+}
+
+absl::Status ErrnoToStatus(absl::string_view operation) {
+  return absl::InternalError(
+      absl::StrCat("status server ", operation, " failed: ", strerror(errno)));
+}
+}  // namespace
+
+absl::StatusOr<std::unique_ptr<StatusServer>> StatusServer::Start(
+    int port, const ProgressTracker &progress_tracker) {
+  int socket_fd = socket(AF_INET, SOCK_STREAM | SOCK_CLOEXEC, 0);
+  if (socket_fd < 0) return ErrnoToStatus("socket");
+  int reuse_addr = 1;
+  setsockopt(socket_fd, SOL_SOCKET, SO_REUSEADDR, &reuse_addr,
+             sizeof(reuse_addr));
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  socklen_t address_size = sizeof(address);
+  if (bind(socket_fd, reinterpret_cast<sockaddr *>(&address), address_size) !=
+          0 ||
+      listen(socket_fd, /*backlog=*/16) != 0 ||
+      getsockname(socket_fd, reinterpret_cast<sockaddr *>(&address),
+                  &address_size) != 0) {
+    absl::Status status = ErrnoToStatus(absl::StrCat("listen on port ", port));
+    close(socket_fd);
+    return status;
+  }
+  port = ntohs(address.sin_port);
+  LOG(INFO) << "Serving /statusz on http://localhost:" << port << "/statusz";
+  return std::unique_ptr<StatusServer>(
+      new StatusServer(socket_fd, port, progress_tracker));
+}
+
+StatusServer::StatusServer(int socket_fd, int port,
+                           const ProgressTracker &progress_tracker)
+    : socket_fd_(socket_fd),
+      port_(port),
+      progress_tracker_(progress_tracker),
+      thread_(&StatusServer::Serve, this) {}
+
+StatusServer::~StatusServer() {
+  stopping_.store(true);
+  thread_.join();
+  close(socket_fd_);
+}
+
+std::string StatusServer::GetStatusz() const {
+  return absl::StrFormat(
+      "Propeller profile generation\n%s\nRSS: %.1f MiB (peak: %.1f MiB)\n",
+      progress_tracker_.DebugString(), GetRssBytes() / (1024.0 * 1024.0),
+      GetPeakRssBytes() / (1024.0 * 1024.0));
+}
+
+void StatusServer::Serve() {
+  while (!stopping_.load()) {
+    pollfd poll_fd = {.fd = socket_fd_, .events = POLLIN};
+    if (poll(&poll_fd, 1, kPollTimeoutMs) <= 0) continue;
+    int connection_fd = accept4(socket_fd_, nullptr, nullptr, SOCK_CLOEXEC);
+    if (connection_fd < 0) continue;
+    HandleConnection(connection_fd);
+    close(connection_fd);
+  }
+}
+
+void StatusServer::HandleConnection(int connection_fd) const {
+  // Don't let a slow client block the server.
+  timeval timeout = {.tv_sec = 1};
+  setsockopt(connection_fd, SOL_SOCKET, SO_RCVTIMEO, &timeout,
+             sizeof(timeout));
+  setsockopt(connection_fd, SOL_SOCKET, SO_SNDTIMEO, &timeout,
+             sizeof(timeout));
+  std::string request;
+  char buffer[kMaxRequestSize];
+  while (request.size() < kMaxRequestSize &&
+         !absl::StrContains(request, "\r\n\r\n")) {
+    ssize_t size = read(connection_fd, buffer, sizeof(buffer));
+    if (size <= 0) break;
+    request.append(buffer, size);
+  }
+  if (absl::StartsWith(request, "GET /statusz ") ||
+      absl::StartsWith(request, "GET /statusz?")) {
+    WriteAll(connection_fd, GetResponse("200 OK", "text/plain; charset=utf-8",
+                                        GetStatusz()));
+  } else if (absl::StartsWith(request, "GET ")) {
+    WriteAll(connection_fd,
+             GetResponse("404 Not Found", "text/plain", "Not found\n"));
+  } else {
+    WriteAll(connection_fd,
+             GetResponse("400 Bad Request", "text/plain", "Bad request\n"));
+  }
+}
+}  // namespace propeller
@@ -0,0 +1,69 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROPELLER_STATUS_SERVER_H_
+#define PROPELLER_STATUS_SERVER_H_
+
+#include <atomic>
+#include <memory>
+#include <string>
+#include <thread>
+
+#include "absl/base/attributes.h"
+#include "absl/status/statusor.h"
+#include "propeller/progress_tracker.h"
+
+namespace propeller {
+
+// A minimal HTTP server bound to localhost which serves the progress of
+// profile generation at /statusz, so that slow or hung runs can be detected.
+// Requests are served one at a time on a background thread.
+class StatusServer {
+ public:
+  // Starts serving the progress in `progress_tracker` on `port`, or on an
+  // ephemeral port if `port` is zero.
+  static absl::StatusOr<std::unique_ptr<StatusServer>> Start(
+      int port,
+      const ProgressTracker &progress_tracker ABSL_ATTRIBUTE_LIFETIME_BOUND);
+
+  StatusServer(const StatusServer &) = delete;
+  StatusServer &operator=(const StatusServer &) = delete;
+  // Stops serving.
+  ~StatusServer();
+
+  // Returns the port on which the server listens.
+  int port() const { return port_; }
+
+  // Returns the body of the /statusz page.
+  std::string GetStatusz() const;
+
+ private:
+  StatusServer(int socket_fd, int port,
+               const ProgressTracker &progress_tracker);
+
+  // Accepts and handles connections until `stopping_` is set.
+  void Serve();
+
+  // Reads one request from `connection_fd` and writes its response.
+  void HandleConnection(int connection_fd) const;
+
+  const int socket_fd_;
+  const int port_;
+  const ProgressTracker &progress_tracker_;
+  std::atomic<bool> stopping_ = false;
+  std::thread thread_;
+};
+}  // namespace propeller
+#endif  // PROPELLER_STATUS_SERVER_H_
@@ -0,0 +1,111 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/status_server.h"
+
+#include <netinet/in.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include <memory>
+#include <string>
+
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/progress_tracker.h"
+#include "propeller/propeller_statistics.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOk;
+using ::testing::AllOf;
+using ::testing::HasSubstr;
+using ::testing::StartsWith;
+
+// Sends `request` to `port` of localhost and returns the response.
+std::string SendRequest(int port, absl::string_view request) {
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons(port);
+  if (connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) !=
+      0) {
+    close(fd);
+    return "";
+  }
+  EXPECT_EQ(write(fd, request.data(), request.size()), request.size());
+  std::string response;
+  char buffer[1024];
+  ssize_t size;
+  while ((size = read(fd, buffer, sizeof(buffer))) > 0)
+    response.append(buffer, size);
+  close(fd);
+  return response;
+}
+
+TEST(StatusServerTest, ServesStatusz) {
+  ProgressTracker progress_tracker;
+  progress_tracker.StartStage("lbr_aggregation");
+  progress_tracker.Increment(ProgressTracker::Counter::kPerfFilesRead, 2);
+  PropellerStats stats;
+  stats.cfg_stats.cfgs_created = 5;
+  progress_tracker.UpdateStats(stats);
+  absl::StatusOr<std::unique_ptr<StatusServer>> status_server =
+      StatusServer::Start(/*port=*/0, progress_tracker);
+  ASSERT_THAT(status_server, IsOk());
+  EXPECT_NE((*status_server)->port(), 0);
+
+  EXPECT_THAT(
+      SendRequest((*status_server)->port(),
+                  "GET /statusz HTTP/1.1\r\nHost: localhost\r\n\r\n"),
+      AllOf(StartsWith("HTTP/1.1 200 OK\r\n"),
+            HasSubstr("Current stage: lbr_aggregation"),
+            HasSubstr("Perf files read: 2"), HasSubstr("Created 5 cfgs."),
+            HasSubstr("RSS: ")));
+  EXPECT_THAT(SendRequest((*status_server)->port(),
+                          "GET /foo HTTP/1.1\r\n\r\n"),
+              StartsWith("HTTP/1.1 404 Not Found\r\n"));
+}
+
+TEST(StatusServerTest, SurvivesClientsWhichDisconnect) {
+  ProgressTracker progress_tracker;
+  absl::StatusOr<std::unique_ptr<StatusServer>> status_server =
+      StatusServer::Start(/*port=*/0, progress_tracker);
+  ASSERT_THAT(status_server, IsOk());
+
+  // Reset the connection before the response is written, so that writing it
+  // fails.
+  int fd = socket(AF_INET, SOCK_STREAM, 0);
+  sockaddr_in address = {};
+  address.sin_family = AF_INET;
+  address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+  address.sin_port = htons((*status_server)->port());
+  ASSERT_EQ(
+      connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)),
+      0);
+  linger reset = {.l_onoff = 1, .l_linger = 0};
+  setsockopt(fd, SOL_SOCKET, SO_LINGER, &reset, sizeof(reset));
+  close(fd);
+
+  EXPECT_THAT(SendRequest((*status_server)->port(),
+                          "GET /statusz HTTP/1.1\r\n\r\n"),
+              StartsWith("HTTP/1.1 200 OK\r\n"));
+}
+}  // namespace
+}  // namespace propeller
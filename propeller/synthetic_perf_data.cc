@@ -0,0 +1,570 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/synthetic_perf_data.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <deque>
+#include <numeric>
+#include <ostream>
+#include <random>
+#include <sstream>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/algorithm/container.h"
+#include "absl/random/distributions.h"
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/string_view.h"
+#include "absl/types/span.h"
+#include "llvm/ADT/StringExtras.h"
+#include "llvm/Object/ELFTypes.h"
+#include "llvm/Support/Path.h"
+#include "propeller/binary_content.h"
+#include "propeller/status_macros.h"
+
+namespace propeller {
+namespace {
+using ::llvm::object::BBAddrMap;
+
+// Constants of the perf.data format, from linux/perf_event.h and
+// tools/perf/util/header.h.
+constexpr uint32_t kPerfRecordComm = 3;
+constexpr uint32_t kPerfRecordFork = 7;
+constexpr uint32_t kPerfRecordSample = 9;
+constexpr uint32_t kPerfRecordMmap2 = 10;
+constexpr uint16_t kPerfRecordMiscUser = 2;
+constexpr uint16_t kPerfRecordMiscCommExec = 1 << 13;
+constexpr uint16_t kPerfRecordMiscBuildIdSize = 1 << 15;
+constexpr uint64_t kPerfSampleIp = 1 << 0;
+constexpr uint64_t kPerfSampleTid = 1 << 1;
+constexpr uint64_t kPerfSampleTime = 1 << 2;
+constexpr uint64_t kPerfSamplePeriod = 1 << 8;
+constexpr uint64_t kPerfSampleBranchStack = 1 << 11;
+constexpr uint64_t kPerfSampleBranchAny = 1 << 3;
+// exclude_kernel, exclude_hv, mmap, comm, task and mmap2.
+constexpr uint64_t kPerfAttrFlags =
+    (1 << 5) | (1 << 6) | (1 << 8) | (1 << 9) | (1 << 13) | (1 << 23);
+// Size of `perf_event_attr` (PERF_ATTR_SIZE_VER5).
+constexpr uint64_t kPerfAttrSize = 112;
+// Size of `perf_file_header`.
+constexpr uint64_t kPerfFileHeaderSize = 104;
+// Size of `perf_file_section`.
+constexpr uint64_t kPerfFileSectionSize = 16;
+constexpr int kHeaderBuildIdFeature = 2;
+constexpr int kBuildIdSize = 20;
+constexpr int kBuildIdFileNameAlignment = 64;
+constexpr uint64_t kSamplePeriod = 100003;
+constexpr uint64_t kPageSize = 4096;
+
+// Size of the call instructions of the synthetic calls.
+constexpr uint64_t kCallSize = 5;
+// Maximum depth of the synthetic call stack.
+constexpr int kMaxCallDepth = 64;
+// Maximum distance between a basic block and its branch target, in blocks.
+constexpr int kMaxBranchDistance = 8;
+// Probability that the branch target of a basic block precedes it.
+constexpr double kBackwardBranchProbability = 0.3;
+
+// Appends the bytes of `value` to `out`. The perf.data format uses the byte
+// order of the host which records it.
+template <typename T>
+void Append(std::string &out, T value) {
+  out.append(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+// Appends `str` with a terminating null character, padded with null characters
+// to a multiple of `alignment`.
+void AppendString(std::string &out, absl::string_view str, int alignment) {
+  out.append(str.data(), str.size());
+  out.append(alignment - str.size() % alignment, '\0');
+}
+
+// An entry of an LBR branch stack.
+struct LbrEntry {
+  uint64_t from;
+  uint64_t to;
+};
+
+// Streams a perf.data file with a single event attr and the given events to
+// an output stream, as documented in
+// tools/perf/Documentation/perf.data-file-format.txt. The events are written as
+// they are added, and the file header, which has the size of the data section,
+// is rewritten by `Finish`.
+class PerfDataWriter {
+ public:
+  // Writes a provisional file header to `out`, which must be seekable.
+  explicit PerfDataWriter(std::ostream &out)
+      : out_(out), header_position_(out.tellp()) {
+    WriteFileHeader();
+  }
+
+  PerfDataWriter(const PerfDataWriter &) = delete;
+  PerfDataWriter &operator=(const PerfDataWriter &) = delete;
+
+  void AddForkEvent(uint32_t pid, uint32_t ppid) {
+    std::string &payload = StartPayload();
+    Append<uint32_t>(payload, pid);
+    Append<uint32_t>(payload, ppid);
+    Append<uint32_t>(payload, pid);
+    Append<uint32_t>(payload, ppid);
+    Append<uint64_t>(payload, /*time=*/0);
+    WriteEvent(kPerfRecordFork, /*misc=*/0);
+  }
+
+  void AddCommEvent(uint32_t pid, absl::string_view comm) {
+    std::string &payload = StartPayload();
+    Append<uint32_t>(payload, pid);
+    Append<uint32_t>(payload, pid);
+    AppendString(payload, comm, /*alignment=*/8);
+    WriteEvent(kPerfRecordComm, kPerfRecordMiscCommExec);
+  }
+
+  void AddMmap2Event(uint32_t pid, uint64_t start, uint64_t len,
+                     uint64_t pgoff, absl::string_view file_name) {
+    std::string &payload = StartPayload();
+    Append<uint32_t>(payload, pid);
+    Append<uint32_t>(payload, pid);
+    Append<uint64_t>(payload, start);
+    Append<uint64_t>(payload, len);
+    Append<uint64_t>(payload, pgoff);
+    Append<uint32_t>(payload, /*maj=*/0);
+    Append<uint32_t>(payload, /*min=*/0);
+    Append<uint64_t>(payload, /*ino=*/0);
+    Append<uint64_t>(payload, /*ino_generation=*/0);
+    Append<uint32_t>(payload, /*prot=PROT_READ|PROT_EXEC*/ 5);
+    Append<uint32_t>(payload, /*flags=MAP_PRIVATE*/ 2);
+    AppendString(payload, file_name, /*alignment=*/8);
+    WriteEvent(kPerfRecordMmap2, kPerfRecordMiscUser);
+  }
+
+  // Adds a sample whose `branch_stack` is ordered from the most recent branch.
+  void AddSampleEvent(uint32_t pid, uint64_t ip, uint64_t time,
+                      absl::Span<const LbrEntry> branch_stack) {
+    std::string &payload = StartPayload();
+    Append<uint64_t>(payload, ip);
+    Append<uint32_t>(payload, pid);
+    Append<uint32_t>(payload, pid);
+    Append<uint64_t>(payload, time);
+    Append<uint64_t>(payload, kSamplePeriod);
+    Append<uint64_t>(payload, branch_stack.size());
+    for (const LbrEntry &entry : branch_stack) {
+      Append<uint64_t>(payload, entry.from);
+      Append<uint64_t>(payload, entry.to);
+      Append<uint64_t>(payload, /*flags=predicted*/ 2);
+    }
+    WriteEvent(kPerfRecordSample, kPerfRecordMiscUser);
+  }
+
+  // Adds a build id feature entry for `file_name`. `build_id` has the raw
+  // bytes of the build id.
+  void AddBuildId(absl::string_view build_id, absl::string_view file_name) {
+    std::string entry;
+    Append<int32_t>(entry, /*pid=*/-1);
+    std::string build_id_bytes(build_id.substr(0, kBuildIdSize));
+    build_id_bytes.resize(kBuildIdSize + 4, '\0');
+    build_id_bytes[kBuildIdSize] =
+        static_cast<char>(std::min<int>(build_id.size(), kBuildIdSize));
+    entry.append(build_id_bytes);
+    AppendString(entry, file_name, kBuildIdFileNameAlignment);
+    AppendEventHeader(build_ids_, /*type=*/0,
+                      kPerfRecordMiscUser | kPerfRecordMiscBuildIdSize,
+                      entry.size());
+    build_ids_.append(entry);
+  }
+
+  // Writes the feature sections after the data section and rewrites the file
+  // header with the final section sizes.
+  absl::Status Finish() && {
+    if (!build_ids_.empty()) {
+      std::string features;
+      Append<uint64_t>(features, GetDataOffset() + data_size_ +
+                                     kPerfFileSectionSize);
+      Append<uint64_t>(features, build_ids_.size());
+      features.append(build_ids_);
+      out_.write(features.data(), features.size());
+    }
+    const std::ostream::pos_type end_position = out_.tellp();
+    out_.seekp(header_position_);
+    WriteFileHeader();
+    out_.seekp(end_position);
+    out_.flush();
+    if (!out_) return absl::InternalError("failed to write the perf.data file");
+    return absl::OkStatus();
+  }
+
+ private:
+  static uint64_t GetDataOffset() {
+    return kPerfFileHeaderSize + kPerfAttrSize + kPerfFileSectionSize;
+  }
+
+  static void AppendEventHeader(std::string &out, uint32_t type, uint16_t misc,
+                                uint64_t payload_size) {
+    Append<uint32_t>(out, type);
+    Append<uint16_t>(out, misc);
+    Append<uint16_t>(out, 8 + payload_size);
+  }
+
+  // Writes the file header and the attrs section for the events written so
+  // far.
+  void WriteFileHeader() {
+    const uint64_t attr_size = kPerfAttrSize + kPerfFileSectionSize;
+    std::string out;
+    out.append("PERFILE2");
+    Append<uint64_t>(out, kPerfFileHeaderSize);
+    Append<uint64_t>(out, attr_size);
+    // The attrs, data and event types sections.
+    Append<uint64_t>(out, kPerfFileHeaderSize);
+    Append<uint64_t>(out, attr_size);
+    Append<uint64_t>(out, GetDataOffset());
+    Append<uint64_t>(out, data_size_);
+    Append<uint64_t>(out, 0);
+    Append<uint64_t>(out, 0);
+    // The feature bitmap.
+    Append<uint64_t>(out,
+                     build_ids_.empty() ? 0 : uint64_t{1}
+                                                  << kHeaderBuildIdFeature);
+    for (int i = 1; i < 4; ++i) Append<uint64_t>(out, 0);
+
+    // The perf_event_attr of cycles with branch stack sampling.
+    Append<uint32_t>(out, /*type=PERF_TYPE_HARDWARE*/ 0);
+    Append<uint32_t>(out, kPerfAttrSize);
+    Append<uint64_t>(out, /*config=PERF_COUNT_HW_CPU_CYCLES*/ 0);
+    Append<uint64_t>(out, kSamplePeriod);
+    Append<uint64_t>(out, kPerfSampleIp | kPerfSampleTid | kPerfSampleTime |
+                              kPerfSamplePeriod | kPerfSampleBranchStack);
+    Append<uint64_t>(out, /*read_format=*/0);
+    Append<uint64_t>(out, kPerfAttrFlags);
+    // wakeup_events, bp_type, config1 and config2.
+    Append<uint32_t>(out, 0);
+    Append<uint32_t>(out, 0);
+    Append<uint64_t>(out, 0);
+    Append<uint64_t>(out, 0);
+    Append<uint64_t>(out, kPerfSampleBranchAny);
+    // sample_regs_user, sample_stack_user, clockid, sample_regs_intr,
+    // aux_watermark, sample_max_stack and padding.
+    Append<uint64_t>(out, 0);
+    Append<uint32_t>(out, 0);
+    Append<int32_t>(out, 0);
+    Append<uint64_t>(out, 0);
+    Append<uint32_t>(out, 0);
+    Append<uint16_t>(out, 0);
+    Append<uint16_t>(out, 0);
+    // The (empty) ids section of the attr.
+    Append<uint64_t>(out, 0);
+    Append<uint64_t>(out, 0);
+    out_.write(out.data(), out.size());
+  }
+
+  // Returns the reused event buffer, cleared and with room for the event
+  // header.
+  std::string &StartPayload() {
+    event_.assign(8, '\0');
+    return event_;
+  }
+
+  // Fills in the header of the event in `event_` and writes it to `out_`.
+  void WriteEvent(uint32_t type, uint16_t misc) {
+    std::string header;
+    AppendEventHeader(header, type, misc, event_.size() - 8);
+    event_.replace(0, header.size(), header);
+    out_.write(event_.data(), event_.size());
+    data_size_ += event_.size();
+  }
+
+  std::ostream &out_;
+  const std::ostream::pos_type header_position_;
+  // Size of the data section written so far.
+  uint64_t data_size_ = 0;
+  // Buffer of the event being written, reused across events.
+  std::string event_;
+  // The entries of the build id feature section.
+  std::string build_ids_;
+};
+
+// A basic block with a nonzero size, with its synthetic branch behavior.
+struct SyntheticBlock {
+  uint64_t address;
+  uint64_t size;
+  bool can_fall_through;
+  bool has_return;
+  // Index of the block's branch target in its function.
+  int branch_target;
+  double taken_probability;
+};
+
+using SyntheticFunction = std::vector<SyntheticBlock>;
+
+// Returns the functions of `bb_addr_maps` which have at least one basic block
+// with a nonzero size, with their branch behavior drawn from `gen`.
+std::vector<SyntheticFunction> GetSyntheticFunctions(
+    absl::Span<const BBAddrMap> bb_addr_maps,
+    const SyntheticPerfDataOptions &options, std::mt19937_64 &gen) {
+  std::vector<SyntheticFunction> functions;
+  for (const BBAddrMap &bb_addr_map : bb_addr_maps) {
+    SyntheticFunction function;
+    for (const BBAddrMap::BBRangeEntry &bb_range : bb_addr_map.getBBRanges()) {
+      // Blocks of different ranges are not contiguous, so the last block of a
+      // range never falls through.
+      if (!function.empty()) function.back().can_fall_through = false;
+      for (const BBAddrMap::BBEntry &bb_entry : bb_range.BBEntries) {
+        if (bb_entry.Size == 0) continue;
+        function.push_back({.address = bb_range.BaseAddress + bb_entry.Offset,
+                            .size = bb_entry.Size,
+                            .can_fall_through = bb_entry.canFallThrough(),
+                            .has_return = bb_entry.hasReturn()});
+      }
+    }
+    if (function.empty()) continue;
+    function.back().can_fall_through = false;
+    const int num_blocks = function.size();
+    for (int bb = 0; bb < num_blocks; ++bb) {
+      SyntheticBlock &block = function[bb];
+      if (bb + 1 == num_blocks ||
+          absl::Bernoulli(gen, kBackwardBranchProbability)) {
+        block.branch_target = absl::Uniform(
+            absl::IntervalClosed, gen, std::max(0, bb - kMaxBranchDistance),
+            bb);
+      } else {
+        block.branch_target =
+            absl::Uniform(absl::IntervalClosed, gen, bb + 1,
+                          std::min(num_blocks - 1, bb + kMaxBranchDistance));
+      }
+      block.taken_probability = absl::Uniform(absl::IntervalClosed, gen,
+                                              options.branch_bias, 1.0);
+      if (absl::Bernoulli(gen, 0.5))
+        block.taken_probability = 1 - block.taken_probability;
+    }
+    functions.push_back(std::move(function));
+  }
+  return functions;
+}
+
+// Walks the basic blocks of the synthetic functions and returns the taken
+// branches one by one.
+class SyntheticExecution {
+ public:
+  SyntheticExecution(const std::vector<SyntheticFunction> &functions,
+                     const SyntheticPerfDataOptions &options,
+                     std::mt19937_64 &gen)
+      : functions_(functions), options_(options), gen_(gen) {
+    // Pick the hot functions in random order, so that hotness is unrelated to
+    // the address order.
+    std::vector<int> function_indices(functions_.size());
+    std::iota(function_indices.begin(), function_indices.end(), 0);
+    for (int i = function_indices.size() - 1; i > 0; --i) {
+      std::swap(function_indices[i],
+                function_indices[absl::Uniform(absl::IntervalClosed, gen_, 0,
+                                               i)]);
+    }
+    if (options_.num_hot_functions > 0 &&
+        options_.num_hot_functions < function_indices.size()) {
+      function_indices.resize(options_.num_hot_functions);
+    }
+    hot_functions_ = std::move(function_indices);
+    double total_weight = 0;
+    for (int rank = 0; rank < hot_functions_.size(); ++rank) {
+      total_weight += 1 / std::pow(rank + 1, options_.hotness_skew);
+      cumulative_hotness_.push_back(total_weight);
+    }
+    Enter(PickHotFunction());
+  }
+
+  SyntheticExecution(const SyntheticExecution &) = delete;
+  SyntheticExecution &operator=(const SyntheticExecution &) = delete;
+
+  // Executes up to and including the next taken branch and returns it.
+  LbrEntry NextTakenBranch() {
+    while (true) {
+      const SyntheticFunction &function = functions_[function_index_];
+      const SyntheticBlock &block = function[bb_index_];
+      if (!returned_to_block_ && block.size > kCallSize &&
+          call_stack_.size() < kMaxCallDepth &&
+          absl::Bernoulli(gen_, options_.call_probability)) {
+        const uint64_t call_address =
+            block.address + (block.size - kCallSize) / 2;
+        call_stack_.push_back({.function_index = function_index_,
+                               .bb_index = bb_index_,
+                               .return_address = call_address + kCallSize});
+        Enter(PickHotFunction());
+        return {.from = call_address, .to = current_address()};
+      }
+      returned_to_block_ = false;
+      const uint64_t branch_address = block.address + block.size - 1;
+      if (block.has_return) {
+        if (call_stack_.empty()) {
+          // The caller is outside of the binary, which then calls another hot
+          // function.
+          Enter(PickHotFunction());
+          return {.from = branch_address, .to = current_address()};
+        }
+        const Frame frame = call_stack_.back();
+        call_stack_.pop_back();
+        function_index_ = frame.function_index;
+        bb_index_ = frame.bb_index;
+        returned_to_block_ = true;
+        return {.from = branch_address, .to = frame.return_address};
+      }
+      if (!block.can_fall_through ||
+          absl::Bernoulli(gen_, block.taken_probability)) {
+        bb_index_ = block.branch_target;
+        return {.from = branch_address, .to = current_address()};
+      }
+      ++bb_index_;
+    }
+  }
+
+  // Returns the address where the execution currently is.
+  uint64_t current_address() const {
+    return functions_[function_index_][bb_index_].address;
+  }
+
+ private:
+  struct Frame {
+    int function_index;
+    int bb_index;
+    uint64_t return_address;
+  };
+
+  int PickHotFunction() {
+    const double weight =
+        absl::Uniform(gen_, 0.0, cumulative_hotness_.back());
+    const int rank = std::min<int>(
+        absl::c_upper_bound(cumulative_hotness_, weight) -
+            cumulative_hotness_.begin(),
+        hot_functions_.size() - 1);
+    return hot_functions_[rank];
+  }
+
+  void Enter(int function_index) {
+    function_index_ = function_index;
+    bb_index_ = 0;
+    returned_to_block_ = false;
+  }
+
+  const std::vector<SyntheticFunction> &functions_;
+  const SyntheticPerfDataOptions &options_;
+  std::mt19937_64 &gen_;
+  // Indices of the hot functions, from the hottest.
+  std::vector<int> hot_functions_;
+  // `cumulative_hotness_[i]` is the total weight of the `i + 1` hottest
+  // functions.
+  std::vector<double> cumulative_hotness_;
+  int function_index_ = 0;
+  int bb_index_ = 0;
+  // Whether the execution just returned to the middle of the current block
+  // from a call.
+  bool returned_to_block_ = false;
+  std::vector<Frame> call_stack_;
+};
+
+absl::Status ValidateOptions(const SyntheticPerfDataOptions &options) {
+  if (options.num_samples < 0 || options.lbr_depth <= 0 ||
+      options.branches_per_sample <= 0 || options.num_processes <= 0 ||
+      options.num_hot_functions < 0) {
+    return absl::InvalidArgumentError(absl::StrFormat(
+        "invalid synthetic perf data options: num_samples=%d lbr_depth=%d "
+        "branches_per_sample=%d num_processes=%d num_hot_functions=%d",
+        options.num_samples, options.lbr_depth, options.branches_per_sample,
+        options.num_processes, options.num_hot_functions));
+  }
+  return absl::OkStatus();
+}
+}  // namespace
+
+absl::Status WriteSyntheticPerfData(const BinaryContent &binary_content,
+                                    const SyntheticPerfDataOptions &options,
+                                    std::ostream &out) {
+  RETURN_IF_ERROR(ValidateOptions(options));
+  if (binary_content.segments.empty()) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "'%s' has no executable segments", binary_content.file_name));
+  }
+  ASSIGN_OR_RETURN(BbAddrMapData bb_addr_map_data,
+                   ReadBbAddrMap(binary_content));
+  std::mt19937_64 gen(options.seed);
+  const std::vector<SyntheticFunction> functions =
+      GetSyntheticFunctions(bb_addr_map_data.bb_addr_maps, options, gen);
+  if (functions.empty()) {
+    return absl::FailedPreconditionError(absl::StrFormat(
+        "'%s' has no basic blocks with nonzero size",
+        binary_content.file_name));
+  }
+
+  const std::string mmap_name = options.mmap_name.empty()
+                                    ? binary_content.file_name
+                                    : options.mmap_name;
+  PerfDataWriter writer(out);
+  // Load addresses of the processes, which are only different for position
+  // independent binaries.
+  std::vector<uint64_t> load_biases;
+  for (int i = 0; i < options.num_processes; ++i) {
+    const uint32_t pid = 10000 + i;
+    const uint64_t load_bias =
+        binary_content.is_pie ? 0x555555554000 + i * uint64_t{1 << 30} : 0;
+    load_biases.push_back(load_bias);
+    writer.AddForkEvent(pid, /*ppid=*/1);
+    writer.AddCommEvent(pid, llvm::sys::path::filename(mmap_name).str());
+    for (const BinaryContent::Segment &segment : binary_content.segments) {
+      const uint64_t start = (load_bias + segment.vaddr) & ~(kPageSize - 1);
+      const uint64_t end =
+          (load_bias + segment.vaddr + segment.memsz + kPageSize - 1) &
+          ~(kPageSize - 1);
+      writer.AddMmap2Event(pid, start, end - start,
+                           segment.offset & ~(kPageSize - 1), mmap_name);
+    }
+  }
+  if (!binary_content.build_id.empty())
+    writer.AddBuildId(llvm::fromHex(binary_content.build_id), mmap_name);
+
+  SyntheticExecution execution(functions, options, gen);
+  // The most recent taken branches, from the oldest.
+  std::deque<LbrEntry> history;
+  for (int i = 0; i < options.lbr_depth; ++i)
+    history.push_back(execution.NextTakenBranch());
+  std::vector<LbrEntry> branch_stack(options.lbr_depth);
+  for (int sample = 0; sample < options.num_samples; ++sample) {
+    for (int i = 0; i < options.branches_per_sample; ++i) {
+      history.pop_front();
+      history.push_back(execution.NextTakenBranch());
+    }
+    const int process = sample % options.num_processes;
+    const uint64_t load_bias = load_biases[process];
+    // Branch stacks start with the most recent branch.
+    for (int i = 0; i < options.lbr_depth; ++i) {
+      const LbrEntry &entry = history[options.lbr_depth - 1 - i];
+      branch_stack[i] = {.from = entry.from + load_bias,
+                         .to = entry.to + load_bias};
+    }
+    writer.AddSampleEvent(/*pid=*/10000 + process,
+                          execution.current_address() + load_bias,
+                          /*time=*/(sample + 1) * uint64_t{1000},
+                          branch_stack);
+  }
+  return std::move(writer).Finish();
+}
+
+absl::StatusOr<std::string> GenerateSyntheticPerfData(
+    const BinaryContent &binary_content,
+    const SyntheticPerfDataOptions &options) {
+  std::ostringstream out;
+  RETURN_IF_ERROR(WriteSyntheticPerfData(binary_content, options, out));
+  return std::move(out).str();
+}
+}  // namespace propeller
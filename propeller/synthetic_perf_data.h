@@ -0,0 +1,76 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_SYNTHETIC_PERF_DATA_H_
+#define PROPELLER_SYNTHETIC_PERF_DATA_H_
+
+#include <cstdint>
+#include <ostream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/statusor.h"
+#include "propeller/binary_content.h"
+
+namespace propeller {
+
+// Options of a synthetic LBR perf.data file.
+struct SyntheticPerfDataOptions {
+  // Seed of the pseudo-random generator. Equal options and binaries always
+  // give equal perf.data files.
+  uint64_t seed = 0;
+  int num_samples = 1000000;
+  // Number of branch stack entries per sample.
+  int lbr_depth = 32;
+  // Number of taken branches executed between two consecutive samples.
+  int branches_per_sample = 32;
+  // Number of functions the execution is concentrated in, or 0 for all
+  // functions. Calls pick their callee from the hot functions, and the i'th
+  // hottest function is picked with weight `1 / (i + 1)^hotness_skew`.
+  int num_hot_functions = 100;
+  double hotness_skew = 1.0;
+  // Every basic block has one fixed branch target in its function which is
+  // taken with a probability drawn uniformly from [branch_bias, 1] and
+  // mirrored with probability 1/2.
+  double branch_bias = 0.8;
+  // Probability that a basic block calls a hot function before branching.
+  double call_probability = 0.05;
+  // Number of processes running the binary. Each process has its own pid and,
+  // for position independent binaries, its own load address.
+  int num_processes = 1;
+  // File name of the binary in the mmap events, or the binary's file name if
+  // empty.
+  std::string mmap_name;
+};
+
+// Writes a perf.data file with LBR samples of running `binary_content`, which
+// must have a BB address map, to `out`. The file has FORK, COMM and MMAP2
+// events for every process, one cycles event with branch stack sampling, and a
+// build id feature if the binary has a build id. The branch stacks follow a
+// random walk over the basic blocks of the binary, shaped by `options`, with
+// calls and returns between the hot functions. The samples are streamed to
+// `out` as they are generated, so `out` must be seekable for the file header
+// to be completed at the end.
+absl::Status WriteSyntheticPerfData(const BinaryContent &binary_content,
+                                    const SyntheticPerfDataOptions &options,
+                                    std::ostream &out);
+
+// Like `WriteSyntheticPerfData`, but returns the contents of the perf.data
+// file.
+absl::StatusOr<std::string> GenerateSyntheticPerfData(
+    const BinaryContent &binary_content,
+    const SyntheticPerfDataOptions &options);
+}  // namespace propeller
+
+#endif  // PROPELLER_SYNTHETIC_PERF_DATA_H_
@@ -0,0 +1,127 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/synthetic_perf_data.h"
+
+#include <memory>
+#include <sstream>
+#include <string>
+
+#include "absl/status/status.h"
+#include "absl/status/status_matchers.h"
+#include "absl/status/statusor.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/string_view.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "llvm/Support/MemoryBuffer.h"
+#include "propeller/binary_address_branch.h"
+#include "propeller/binary_content.h"
+#include "propeller/lbr_aggregation.h"
+#include "propeller/perf_data_provider.h"
+#include "propeller/perfdata_reader.h"
+#include "propeller/status_testing_macros.h"
+
+namespace propeller {
+namespace {
+using ::absl_testing::IsOk;
+using ::absl_testing::IsOkAndHolds;
+using ::absl_testing::StatusIs;
+using ::testing::Eq;
+using ::testing::IsEmpty;
+using ::testing::Ne;
+using ::testing::Not;
+
+std::string GetPropellerTestDataFilePath(absl::string_view filename) {
+  return absl::StrCat(::testing::SrcDir(), "_main/propeller/testdata/",
+                      filename);
+}
+
+PerfDataProvider::BufferHandle GetBufferHandle(absl::string_view perf_data) {
+  return {.description = "synthetic",
+          .buffer = llvm::MemoryBuffer::getMemBufferCopy(
+              llvm::StringRef(perf_data.data(), perf_data.size()))};
+}
+
+TEST(SyntheticPerfDataTest, IsDeterministic) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetPropellerTestDataFilePath(
+                           "bimodal_sample_v2.bin")));
+  const SyntheticPerfDataOptions options = {.seed = 7, .num_samples = 100};
+  absl::StatusOr<std::string> perf_data =
+      GenerateSyntheticPerfData(*binary_content, options);
+  ASSERT_THAT(perf_data, IsOk());
+  EXPECT_THAT(GenerateSyntheticPerfData(*binary_content, options),
+              IsOkAndHolds(Eq(*perf_data)));
+  EXPECT_THAT(GenerateSyntheticPerfData(*binary_content,
+                                        {.seed = 8, .num_samples = 100}),
+              IsOkAndHolds(Ne(*perf_data)));
+}
+
+TEST(SyntheticPerfDataTest, IsReadByPerfDataReader) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetPropellerTestDataFilePath(
+                           "bimodal_sample_v2.bin")));
+  const SyntheticPerfDataOptions options = {
+      .seed = 1, .num_samples = 50, .lbr_depth = 16, .num_processes = 2};
+  ASSERT_OK_AND_ASSIGN(std::string perf_data,
+                       GenerateSyntheticPerfData(*binary_content, options));
+  // The binary has a build id, so its mmaps are found without a name.
+  ASSERT_OK_AND_ASSIGN(PerfDataReader perf_data_reader,
+                       BuildPerfDataReader(GetBufferHandle(perf_data),
+                                           binary_content.get(),
+                                           /*match_mmap_name=*/""));
+
+  LbrAggregation lbr_aggregation;
+  perf_data_reader.AggregateLBR(&lbr_aggregation);
+  EXPECT_EQ(lbr_aggregation.GetNumberOfBranchCounters(),
+            options.num_samples * options.lbr_depth);
+  for (const auto &[branch, count] : lbr_aggregation.branch_counters) {
+    EXPECT_THAT(branch.from, Not(Eq(kInvalidBinaryAddress)));
+    EXPECT_THAT(branch.to, Not(Eq(kInvalidBinaryAddress)));
+  }
+  EXPECT_THAT(lbr_aggregation.fallthrough_counters, Not(IsEmpty()));
+}
+
+TEST(SyntheticPerfDataTest, StreamsToOutput) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetPropellerTestDataFilePath(
+                           "bimodal_sample_v2.bin")));
+  const SyntheticPerfDataOptions options = {.seed = 3, .num_samples = 20};
+  ASSERT_OK_AND_ASSIGN(std::string perf_data,
+                       GenerateSyntheticPerfData(*binary_content, options));
+  // The file header is completed in place even if the stream does not start
+  // at the file header.
+  std::ostringstream out;
+  out << "prefix";
+  ASSERT_THAT(WriteSyntheticPerfData(*binary_content, options, out), IsOk());
+  EXPECT_EQ(out.str(), absl::StrCat("prefix", perf_data));
+}
+
+TEST(SyntheticPerfDataTest, RejectsInvalidOptions) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetPropellerTestDataFilePath(
+                           "bimodal_sample_v2.bin")));
+  EXPECT_THAT(GenerateSyntheticPerfData(*binary_content, {.lbr_depth = 0}),
+              StatusIs(absl::StatusCode::kInvalidArgument));
+}
+
+TEST(SyntheticPerfDataTest, FailsWithoutBbAddrMap) {
+  ASSERT_OK_AND_ASSIGN(std::unique_ptr<BinaryContent> binary_content,
+                       GetBinaryContent(GetPropellerTestDataFilePath(
+                           "llvm_function_samples.binary")));
+  EXPECT_THAT(GenerateSyntheticPerfData(*binary_content, {}), Not(IsOk()));
+}
+}  // namespace
+}  // namespace propeller
@@ -0,0 +1,216 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/synthetic_program_cfg.h"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <limits>
+#include <numeric>
+#include <random>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/random/distributions.h"
+#include "absl/strings/str_cat.h"
+#include "propeller/cfg.pb.h"
+
+namespace propeller {
+namespace {
+// Maximum frequency of a basic block, so that every edge weight fits the `int`
+// weight of `CFGEdge`.
+constexpr int64_t kMaxFrequency = std::numeric_limits<int>::max();
+
+// Generates the basic blocks and intra-function edges of one synthetic
+// function.
+class SyntheticFunctionGenerator {
+ public:
+  SyntheticFunctionGenerator(const SyntheticProgramCfgOptions &options,
+                             std::mt19937_64 &gen, ControlFlowGraphPb &cfg_pb)
+      : options_(options), gen_(gen), cfg_pb_(cfg_pb) {}
+
+  SyntheticFunctionGenerator(const SyntheticFunctionGenerator &) = delete;
+  SyntheticFunctionGenerator &operator=(const SyntheticFunctionGenerator &) =
+      delete;
+
+  // Generates `num_blocks` basic blocks, entered `entry_count` times, and
+  // returns their frequencies.
+  std::vector<int64_t> Generate(int num_blocks, int64_t entry_count) && {
+    CHECK_GT(num_blocks, 0);
+    CHECK_LE(entry_count, kMaxFrequency);
+    for (int bb_id = 0; bb_id < num_blocks; ++bb_id) {
+      CFGNodePb &node_pb = *cfg_pb_.add_node();
+      node_pb.set_bb_id(bb_id);
+      node_pb.set_size(absl::Uniform(absl::IntervalClosed, gen_, 1,
+                                     options_.max_block_size));
+      node_pb.mutable_metadata()->set_can_fallthrough(bb_id + 1 != num_blocks);
+      node_pb.mutable_metadata()->set_has_return(bb_id + 1 == num_blocks);
+    }
+    node_freqs_.assign(num_blocks, 0);
+    GenerateRegion(0, num_blocks, entry_count, /*loop_depth=*/0);
+    return std::move(node_freqs_);
+  }
+
+ private:
+  // Generates the edges between the blocks in [`begin`, `end`) for a region
+  // which is entered at `begin` and exited from `end - 1`, `freq` times. The
+  // exiting edges are left to the caller.
+  void GenerateRegion(int begin, int end, int64_t freq, int loop_depth) {
+    for (int bb = begin; bb < end;) {
+      const int remaining = end - bb;
+      int construct_end = bb + 1;
+      if (loop_depth < options_.max_loop_depth &&
+          absl::Bernoulli(gen_, options_.loop_probability)) {
+        // A loop whose body is [bb, construct_end), with the back edge from the
+        // last block of the body to `bb`.
+        construct_end = bb + absl::LogUniform(gen_, 1, remaining);
+        const int64_t trip_count = absl::Uniform(
+            absl::IntervalClosed, gen_, 2, options_.max_loop_trip_count);
+        // Hot nested loops run fewer iterations rather than exceed the maximum
+        // frequency. Both operands are at most INT_MAX, so the product doesn't
+        // overflow.
+        const int64_t body_freq = std::min(freq * trip_count, kMaxFrequency);
+        GenerateRegion(bb, construct_end, body_freq, loop_depth + 1);
+        AddEdge(construct_end - 1, bb, body_freq - freq);
+      } else if (remaining >= 3 &&
+                 absl::Bernoulli(gen_, options_.branch_probability)) {
+        // An if-then construct: `bb` branches either to the then-region
+        // [bb + 1, construct_end - 1) or directly to the join block
+        // `construct_end - 1`.
+        construct_end = bb + absl::LogUniform(gen_, 3, remaining);
+        double taken_probability = absl::Uniform(
+            absl::IntervalClosed, gen_, options_.branch_bias, 1.0);
+        if (absl::Bernoulli(gen_, 0.5))
+          taken_probability = 1 - taken_probability;
+        const int64_t then_freq = std::llround(freq * taken_probability);
+        node_freqs_[bb] = freq;
+        node_freqs_[construct_end - 1] = freq;
+        AddEdge(bb, bb + 1, then_freq);
+        AddEdge(bb, construct_end - 1, freq - then_freq);
+        GenerateRegion(bb + 1, construct_end - 1, then_freq, loop_depth);
+        AddEdge(construct_end - 2, construct_end - 1, then_freq);
+      } else {
+        node_freqs_[bb] = freq;
+      }
+      if (construct_end < end) AddEdge(construct_end - 1, construct_end, freq);
+      bb = construct_end;
+    }
+  }
+
+  void AddEdge(int from_bb, int to_bb, int64_t weight) {
+    if (weight == 0) return;
+    CHECK_LE(weight, kMaxFrequency);
+    CFGEdgePb &edge_pb = *cfg_pb_.mutable_node(from_bb)->add_out_edges();
+    edge_pb.mutable_sink()->set_function_index(cfg_pb_.function_index());
+    edge_pb.mutable_sink()->set_bb_index(to_bb);
+    edge_pb.set_weight(weight);
+    edge_pb.set_kind(CFGEdgePb::BRANCH_OR_FALLTHROUGH);
+  }
+
+  const SyntheticProgramCfgOptions &options_;
+  std::mt19937_64 &gen_;
+  ControlFlowGraphPb &cfg_pb_;
+  // Frequencies of the basic blocks, indexed by their bb ids.
+  std::vector<int64_t> node_freqs_;
+};
+
+// Adds an edge of `kind` from `from_bb` in `from_function` to `to_bb` in
+// `to_function`.
+void AddInterFunctionEdge(int from_function, int from_bb, int to_function,
+                          int to_bb, int64_t weight, CFGEdgePb::Kind kind,
+                          ProgramCfgPb &program_cfg_pb) {
+  CFGEdgePb &edge_pb = *program_cfg_pb.mutable_cfg(from_function)
+                            ->mutable_node(from_bb)
+                            ->add_out_edges();
+  edge_pb.mutable_sink()->set_function_index(to_function);
+  edge_pb.mutable_sink()->set_bb_index(to_bb);
+  edge_pb.set_weight(weight);
+  edge_pb.set_kind(kind);
+}
+}  // namespace
+
+ProgramCfgPb GenerateSyntheticProgramCfg(
+    const SyntheticProgramCfgOptions &options) {
+  CHECK_GT(options.num_functions, 0);
+  CHECK_GE(options.min_num_blocks, 1);
+  CHECK_GE(options.max_num_blocks, options.min_num_blocks);
+  CHECK_GE(options.max_loop_trip_count, 2);
+  std::mt19937_64 gen(options.seed);
+
+  // `functions_by_hotness[i]` is the index of the i'th hottest function.
+  // `std::shuffle` is not used since its results differ between standard
+  // libraries.
+  std::vector<int> functions_by_hotness(options.num_functions);
+  std::iota(functions_by_hotness.begin(), functions_by_hotness.end(), 0);
+  for (int i = options.num_functions - 1; i > 0; --i) {
+    std::swap(functions_by_hotness[i],
+              functions_by_hotness[absl::Uniform(absl::IntervalClosed, gen, 0,
+                                                 i)]);
+  }
+  const int num_hot_functions = std::clamp<int>(
+      std::lround(options.num_functions * options.hot_function_fraction), 0,
+      options.num_functions);
+  std::vector<int64_t> entry_counts(options.num_functions, 0);
+  for (int rank = 0; rank < num_hot_functions; ++rank) {
+    entry_counts[functions_by_hotness[rank]] = std::clamp<int64_t>(
+        std::llround(std::min<double>(
+            options.max_entry_count / std::pow(rank + 1, options.hotness_skew),
+            kMaxFrequency)),
+        1, kMaxFrequency);
+  }
+
+  ProgramCfgPb program_cfg_pb;
+  // Frequencies of the basic blocks of every function.
+  std::vector<std::vector<int64_t>> node_freqs;
+  node_freqs.reserve(options.num_functions);
+  for (int function_index = 0; function_index < options.num_functions;
+       ++function_index) {
+    ControlFlowGraphPb &cfg_pb = *program_cfg_pb.add_cfg();
+    cfg_pb.set_function_index(function_index);
+    cfg_pb.add_name(absl::StrCat("synthetic_function_", function_index));
+    cfg_pb.set_section_name(".text");
+    node_freqs.push_back(
+        SyntheticFunctionGenerator(options, gen, cfg_pb)
+            .Generate(absl::LogUniform(gen, options.min_num_blocks,
+                                       options.max_num_blocks),
+                      entry_counts[function_index]));
+  }
+
+  // Calls are only generated from hot functions, to callees picked by hotness
+  // rank. Returns go back to the calling block, since calls do not end basic
+  // blocks.
+  for (int rank = 0; rank < num_hot_functions; ++rank) {
+    const int caller = functions_by_hotness[rank];
+    const int num_call_sites =
+        absl::Poisson<int>(gen, options.mean_num_call_sites);
+    for (int i = 0; i < num_call_sites; ++i) {
+      const int caller_bb =
+          absl::Uniform<int>(gen, 0, node_freqs[caller].size());
+      const int callee = functions_by_hotness[absl::Zipf<int>(
+          gen, options.num_functions - 1)];
+      const int64_t weight =
+          std::min(node_freqs[caller][caller_bb], entry_counts[callee]);
+      if (weight == 0) continue;
+      AddInterFunctionEdge(caller, caller_bb, callee, /*to_bb=*/0, weight,
+                           CFGEdgePb::CALL, program_cfg_pb);
+      AddInterFunctionEdge(callee, node_freqs[callee].size() - 1, caller,
+                           caller_bb, weight, CFGEdgePb::RETURN,
+                           program_cfg_pb);
+    }
+  }
+  return program_cfg_pb;
+}
+}  // namespace propeller
@@ -0,0 +1,73 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#ifndef PROPELLER_SYNTHETIC_PROGRAM_CFG_H_
+#define PROPELLER_SYNTHETIC_PROGRAM_CFG_H_
+
+#include <cstdint>
+
+#include "propeller/cfg.pb.h"
+
+namespace propeller {
+
+// Shape of a synthetic program cfg. The defaults give a program of roughly the
+// size of a large server binary's hot code.
+struct SyntheticProgramCfgOptions {
+  // Seed of the pseudo-random generator. Equal options always give equal
+  // program cfgs.
+  uint64_t seed = 0;
+  int num_functions = 10000;
+  // The number of basic blocks of every function is drawn from a log-uniform
+  // distribution over [min_num_blocks, max_num_blocks], so most functions are
+  // small and a few are very large.
+  int min_num_blocks = 1;
+  int max_num_blocks = 2000;
+  // Basic block sizes are drawn uniformly from [1, max_block_size].
+  int max_block_size = 64;
+  // Probability that a basic block starts a loop, as long as the loop nesting
+  // depth is below `max_loop_depth`.
+  double loop_probability = 0.05;
+  int max_loop_depth = 3;
+  // Trip counts of loops are drawn uniformly from [2, max_loop_trip_count].
+  int max_loop_trip_count = 16;
+  // Probability that a basic block starts an if-then construct.
+  double branch_probability = 0.3;
+  // The taken probability of every if-then branch is drawn uniformly from
+  // [branch_bias, 1] and mirrored with probability 1/2. Values close to 1 give
+  // strongly biased branches.
+  double branch_bias = 0.8;
+  // Mean number of call sites per hot function. Callees are drawn from a Zipf
+  // distribution over the functions ordered by hotness.
+  double mean_num_call_sites = 4;
+  // Fraction of the functions which are executed at all.
+  double hot_function_fraction = 0.2;
+  // The entry count of the i'th hottest function is
+  // `max_entry_count / (i + 1)^hotness_skew`. Entry counts and loop block
+  // frequencies are capped at INT_MAX (the maximum `CFGEdge` weight), which
+  // shortens the hottest loops.
+  int64_t max_entry_count = 1000000;
+  double hotness_skew = 1.0;
+};
+
+// Returns a synthetic program cfg with the shape given by `options`. Every
+// function is a structured cfg of basic blocks (straight-line code, if-then
+// constructs and loops) whose edge weights conserve the flow from the
+// function's entry count. Hot functions also have call edges to their callees
+// and return edges back to the calling blocks. Edges with zero weight are not
+// emitted. Use `BuildFromCfgProto` to construct the `ProgramCfg`.
+ProgramCfgPb GenerateSyntheticProgramCfg(
+    const SyntheticProgramCfgOptions &options);
+}  // namespace propeller
+
+#endif  // PROPELLER_SYNTHETIC_PROGRAM_CFG_H_
@@ -0,0 +1,152 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+#include "propeller/synthetic_program_cfg.h"
+
+#include <cstdint>
+#include <limits>
+#include <memory>
+#include <vector>
+
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/cfg.h"
+#include "propeller/cfg_edge.h"
+#include "propeller/cfg.pb.h"
+#include "propeller/mock_program_cfg_builder.h"
+
+namespace propeller {
+namespace {
+using ::testing::AllOf;
+using ::testing::Ge;
+using ::testing::Gt;
+using ::testing::Le;
+using ::testing::SizeIs;
+
+SyntheticProgramCfgOptions GetSmallOptions() {
+  return {.seed = 42,
+          .num_functions = 200,
+          .max_num_blocks = 100,
+          .hot_function_fraction = 0.5};
+}
+
+TEST(SyntheticProgramCfgTest, IsDeterministic) {
+  SyntheticProgramCfgOptions options = GetSmallOptions();
+  const ProgramCfgPb program_cfg_pb = GenerateSyntheticProgramCfg(options);
+  EXPECT_EQ(GenerateSyntheticProgramCfg(options).SerializeAsString(),
+            program_cfg_pb.SerializeAsString());
+  ++options.seed;
+  EXPECT_NE(GenerateSyntheticProgramCfg(options).SerializeAsString(),
+            program_cfg_pb.SerializeAsString());
+}
+
+TEST(SyntheticProgramCfgTest, HasRequestedShape) {
+  const SyntheticProgramCfgOptions options = GetSmallOptions();
+  const ProgramCfgPb program_cfg_pb = GenerateSyntheticProgramCfg(options);
+  ASSERT_THAT(program_cfg_pb.cfg(), SizeIs(options.num_functions));
+  int num_call_edges = 0;
+  for (const ControlFlowGraphPb &cfg_pb : program_cfg_pb.cfg()) {
+    EXPECT_THAT(cfg_pb.node(), SizeIs(AllOf(Ge(options.min_num_blocks),
+                                            Le(options.max_num_blocks))));
+    for (const CFGNodePb &node_pb : cfg_pb.node()) {
+      EXPECT_THAT(node_pb.size(), AllOf(Ge(1), Le(options.max_block_size)));
+      for (const CFGEdgePb &edge_pb : node_pb.out_edges()) {
+        EXPECT_GT(edge_pb.weight(), 0);
+        if (edge_pb.kind() == CFGEdgePb::CALL) ++num_call_edges;
+      }
+    }
+  }
+  EXPECT_GT(num_call_edges, 0);
+}
+
+// Checks that the intra-function edge weights of every function in
+// `program_cfg_pb` conserve the flow from its entry block to its last block.
+void ExpectConservedIntraFunctionFlow(const ProgramCfgPb &program_cfg_pb) {
+  for (const ControlFlowGraphPb &cfg_pb : program_cfg_pb.cfg()) {
+    // Incoming minus outgoing intra-function edge weights of every block.
+    std::vector<int64_t> flow_balance(cfg_pb.node_size(), 0);
+    for (const CFGNodePb &node_pb : cfg_pb.node()) {
+      for (const CFGEdgePb &edge_pb : node_pb.out_edges()) {
+        if (edge_pb.kind() != CFGEdgePb::BRANCH_OR_FALLTHROUGH) continue;
+        EXPECT_EQ(edge_pb.sink().function_index(), cfg_pb.function_index());
+        flow_balance[node_pb.bb_id()] -= edge_pb.weight();
+        flow_balance[edge_pb.sink().bb_index()] += edge_pb.weight();
+      }
+    }
+    // The flow enters at the entry block and exits at the last block.
+    const int64_t entry_count = -flow_balance.front();
+    EXPECT_GE(entry_count, 0);
+    if (cfg_pb.node_size() == 1) continue;
+    EXPECT_EQ(flow_balance.back(), entry_count);
+    for (int bb_id = 1; bb_id + 1 < cfg_pb.node_size(); ++bb_id)
+      EXPECT_EQ(flow_balance[bb_id], 0) << "function "
+                                        << cfg_pb.function_index() << " block "
+                                        << bb_id;
+  }
+}
+
+TEST(SyntheticProgramCfgTest, ConservesIntraFunctionFlow) {
+  ExpectConservedIntraFunctionFlow(
+      GenerateSyntheticProgramCfg(GetSmallOptions()));
+}
+
+TEST(SyntheticProgramCfgTest, KeepsEdgeWeightsInRangeWithMaximumOptions) {
+  const SyntheticProgramCfgOptions options = {
+      .seed = 7,
+      .num_functions = 50,
+      .max_num_blocks = 200,
+      .loop_probability = 0.5,
+      .max_loop_depth = 8,
+      .max_loop_trip_count = std::numeric_limits<int>::max(),
+      .hot_function_fraction = 1,
+      .max_entry_count = std::numeric_limits<int64_t>::max(),
+      .hotness_skew = 0};
+  const ProgramCfgPb program_cfg_pb = GenerateSyntheticProgramCfg(options);
+  for (const ControlFlowGraphPb &cfg_pb : program_cfg_pb.cfg()) {
+    for (const CFGNodePb &node_pb : cfg_pb.node()) {
+      for (const CFGEdgePb &edge_pb : node_pb.out_edges()) {
+        EXPECT_THAT(edge_pb.weight(),
+                    AllOf(Gt(0), Le(std::numeric_limits<int>::max())));
+      }
+    }
+  }
+  ExpectConservedIntraFunctionFlow(program_cfg_pb);
+
+  std::unique_ptr<ProtoProgramCfg> proto_program_cfg =
+      BuildFromCfgProto(program_cfg_pb);
+  for (const ControlFlowGraph *cfg :
+       proto_program_cfg->program_cfg().GetCfgs()) {
+    for (const std::unique_ptr<CFGEdge> &edge : cfg->intra_edges())
+      EXPECT_GE(edge->weight(), 0);
+    for (const std::unique_ptr<CFGEdge> &edge : cfg->inter_edges())
+      EXPECT_GE(edge->weight(), 0);
+  }
+}
+
+TEST(SyntheticProgramCfgTest, BuildsProgramCfg) {
+  const SyntheticProgramCfgOptions options = GetSmallOptions();
+  std::unique_ptr<ProtoProgramCfg> proto_program_cfg =
+      BuildFromCfgProto(GenerateSyntheticProgramCfg(options));
+  const std::vector<const ControlFlowGraph *> cfgs =
+      proto_program_cfg->program_cfg().GetCfgs();
+  ASSERT_THAT(cfgs, SizeIs(options.num_functions));
+  int num_hot_cfgs = 0;
+  for (const ControlFlowGraph *cfg : cfgs)
+    if (cfg->is_hot()) ++num_hot_cfgs;
+  EXPECT_THAT(num_hot_cfgs,
+              AllOf(Gt(0), Le(options.num_functions *
+                              options.hot_function_fraction)));
+}
+}  // namespace
+}  // namespace propeller
@@ -0,0 +1,150 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/trace_recorder.h"
+
+#include <algorithm>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <fstream>
+#include <ios>
+#include <string>
+#include <utility>
+#include <vector>
+
+#include "absl/log/check.h"
+#include "absl/status/status.h"
+#include "absl/strings/str_cat.h"
+#include "absl/strings/str_format.h"
+#include "absl/strings/str_join.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/clock.h"
+#include "absl/time/time.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+namespace {
+// Returns a small id of the calling thread, which is stable for the lifetime
+// of the thread.
+int GetThreadId() {
+  static std::atomic<int> next_thread_id = 0;
+  thread_local const int thread_id = next_thread_id++;
+  return thread_id;
+}
+
+// Appends `str` to `out` as a JSON string literal.
+void AppendJsonString(std::string *out, absl::string_view str) {
+  out->push_back('"');
+  for (char c : str) {
+    switch (c) {
+      case '"':
+        out->append("\\\"");
+        break;
+      case '\\':
+        out->append("\\\\");
+        break;
+      default:
+        if (static_cast<unsigned char>(c) < 0x20) {
+          absl::StrAppendFormat(out, "\\u%04x", c);
+        } else {
+          out->push_back(c);
+        }
+    }
+  }
+  out->push_back('"');
+}
+}  // namespace
+
+std::atomic<TraceRecorder *> TraceRecorder::active_ = nullptr;
+
+TraceRecorder::TraceRecorder(const TraceOptions &options)
+    : high_frequency_sampling_period_(
+          std::max(options.high_frequency_sampling_period(), 1)),
+      start_time_(absl::Now()) {
+  TraceRecorder *expected = nullptr;
+  CHECK(active_.compare_exchange_strong(expected, this))
+      << "Another TraceRecorder is active.";
+}
+
+TraceRecorder::~TraceRecorder() { active_.store(nullptr); }
+
+bool TraceRecorder::ShouldRecord(TraceSpanFrequency frequency) const {
+  if (frequency == TraceSpanFrequency::kLow) return true;
+  // Sample the first of every `high_frequency_sampling_period_` spans of the
+  // thread, so the sampled spans are spread over the run.
+  thread_local int64_t num_high_frequency_spans = 0;
+  return num_high_frequency_spans++ % high_frequency_sampling_period_ == 0;
+}
+
+void TraceRecorder::AddSpan(absl::string_view name, absl::string_view detail,
+                            TraceSpanFrequency frequency,
+                            absl::Time start_time, absl::Time end_time) {
+  Span span = {.name = std::string(name),
+               .detail = std::string(detail),
+               .frequency = frequency,
+               .thread_id = GetThreadId(),
+               .start_offset = start_time - start_time_,
+               .duration = end_time - start_time};
+  absl::MutexLock lock(&mutex_);
+  spans_.push_back(std::move(span));
+}
+
+int TraceRecorder::num_spans() const {
+  absl::MutexLock lock(&mutex_);
+  return spans_.size();
+}
+
+std::string TraceRecorder::ToJson() const {
+  absl::MutexLock lock(&mutex_);
+  std::string json = "{\"traceEvents\": [\n";
+  for (size_t i = 0; i < spans_.size(); ++i) {
+    const Span &span = spans_[i];
+    absl::StrAppend(&json, i == 0 ? "" : ",\n", "{\"name\": ");
+    AppendJsonString(&json, span.name);
+    absl::StrAppendFormat(
+        &json, ", \"ph\": \"X\", \"pid\": 1, \"tid\": %d, \"ts\": %.3f, "
+               "\"dur\": %.3f",
+        span.thread_id, absl::ToDoubleMicroseconds(span.start_offset),
+        absl::ToDoubleMicroseconds(span.duration));
+    std::vector<std::string> args;
+    if (!span.detail.empty()) {
+      std::string &arg = args.emplace_back("\"detail\": ");
+      AppendJsonString(&arg, span.detail);
+    }
+    if (span.frequency == TraceSpanFrequency::kHigh) {
+      args.push_back(absl::StrCat("\"sampling_period\": ",
+                                  high_frequency_sampling_period_));
+    }
+    if (!args.empty())
+      absl::StrAppend(&json, ", \"args\": {", absl::StrJoin(args, ", "), "}");
+    json.push_back('}');
+  }
+  json.append("\n], \"displayTimeUnit\": \"ms\"}\n");
+  return json;
+}
+
+absl::Status TraceRecorder::Write(absl::string_view file_name) const {
+  std::ofstream os{std::string(file_name), std::ios::binary};
+  if (!os) {
+    return absl::FailedPreconditionError(
+        absl::StrCat("Failed to open file: ", file_name));
+  }
+  const std::string json = ToJson();
+  os.write(json.data(), json.size());
+  return absl::OkStatus();
+}
+}  // namespace propeller
@@ -0,0 +1,134 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#ifndef PROPELLER_TRACE_RECORDER_H_
+#define PROPELLER_TRACE_RECORDER_H_
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#include "absl/base/nullability.h"
+#include "absl/base/thread_annotations.h"
+#include "absl/status/status.h"
+#include "absl/strings/string_view.h"
+#include "absl/synchronization/mutex.h"
+#include "absl/time/time.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+
+// How often a span is expected to occur.
+enum class TraceSpanFrequency {
+  // Spans which occur a few times per run or per perf file (e.g., stages).
+  kLow,
+  // Spans which occur per function or per cloning candidate. These are
+  // sampled by `TraceOptions::high_frequency_sampling_period`.
+  kHigh,
+};
+
+// Records spans of the process in the Chrome trace event format. At most one
+// recorder may be active at a time: it is active from its construction to its
+// destruction. Spans which start while no recorder is active are not
+// recorded, at the cost of one atomic load each.
+class TraceRecorder {
+ public:
+  explicit TraceRecorder(const TraceOptions &options);
+  TraceRecorder(const TraceRecorder &) = delete;
+  TraceRecorder &operator=(const TraceRecorder &) = delete;
+  ~TraceRecorder();
+
+  // Returns the active recorder, or `nullptr` if no recorder is active.
+  static TraceRecorder *absl_nullable Active() {
+    return active_.load(std::memory_order_acquire);
+  }
+
+  // Returns whether a span with `frequency` which starts now on the calling
+  // thread should be recorded.
+  bool ShouldRecord(TraceSpanFrequency frequency) const;
+
+  // Records the span `name` of the calling thread. `detail` is attached to the
+  // span as an argument if it's not empty.
+  void AddSpan(absl::string_view name, absl::string_view detail,
+               TraceSpanFrequency frequency, absl::Time start_time,
+               absl::Time end_time);
+
+  int num_spans() const;
+
+  // Returns the recorded spans as a Chrome trace JSON object.
+  std::string ToJson() const;
+
+  // Writes the trace JSON to `file_name`.
+  absl::Status Write(absl::string_view file_name) const;
+
+ private:
+  struct Span {
+    std::string name;
+    std::string detail;
+    TraceSpanFrequency frequency;
+    int thread_id;
+    absl::Duration start_offset;
+    absl::Duration duration;
+  };
+
+  static std::atomic<TraceRecorder *> active_;
+
+  const int high_frequency_sampling_period_;
+  const absl::Time start_time_;
+  mutable absl::Mutex mutex_;
+  std::vector<Span> spans_ ABSL_GUARDED_BY(mutex_);
+};
+
+// Records the span `name` from its construction to its destruction with the
+// active `TraceRecorder`, if any. `name` and `detail` must outlive the span.
+//
+// Example:
+// ```
+// ScopedTraceSpan span("BuildChains", cfg->GetPrimaryName(),
+//                      TraceSpanFrequency::kHigh);
+// ```
+class ScopedTraceSpan {
+ public:
+  explicit ScopedTraceSpan(
+      absl::string_view name, absl::string_view detail = "",
+      TraceSpanFrequency frequency = TraceSpanFrequency::kLow)
+      : recorder_(TraceRecorder::Active()) {
+    if (recorder_ == nullptr) return;
+    if (!recorder_->ShouldRecord(frequency)) {
+      recorder_ = nullptr;
+      return;
+    }
+    name_ = name;
+    detail_ = detail;
+    frequency_ = frequency;
+    start_time_ = absl::Now();
+  }
+  ScopedTraceSpan(const ScopedTraceSpan &) = delete;
+  ScopedTraceSpan &operator=(const ScopedTraceSpan &) = delete;
+  ~ScopedTraceSpan() {
+    if (recorder_ != nullptr)
+      recorder_->AddSpan(name_, detail_, frequency_, start_time_, absl::Now());
+  }
+
+ private:
+  TraceRecorder *absl_nullable recorder_;
+  absl::string_view name_;
+  absl::string_view detail_;
+  TraceSpanFrequency frequency_ = TraceSpanFrequency::kLow;
+  absl::Time start_time_;
+};
+}  // namespace propeller
+#endif  // PROPELLER_TRACE_RECORDER_H_
@@ -0,0 +1,91 @@
+// Copyright 2025 The Propeller Authors.
+//
+// Licensed under the Apache License, Version 2.0 (the "License");
+// you may not use this file except in compliance with the License.
+// You may obtain a copy of the License at
+//
+//     http://www.apache.org/licenses/LICENSE-2.0
+//
+// Unless required by applicable law or agreed to in writing, software
+// distributed under the License is distributed on an "AS IS" BASIS,
+// WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+// See the License for the specific language governing permissions and
+// limitations under the License.
+
+
+#include "propeller/trace_recorder.h"
+
+#include <cstddef>
+#include <string>
+#include <thread>
+
+#include "absl/strings/match.h"
+#include "gmock/gmock.h"
+#include "gtest/gtest.h"
+#include "propeller/propeller_options.pb.h"
+
+namespace propeller {
+namespace {
+using ::testing::HasSubstr;
+using ::testing::Not;
+
+TEST(TraceRecorderTest, DoesNotRecordWithoutActiveRecorder) {
+  EXPECT_EQ(TraceRecorder::Active(), nullptr);
+  { ScopedTraceSpan span("foo"); }
+  TraceRecorder recorder(TraceOptions{});
+  EXPECT_EQ(TraceRecorder::Active(), &recorder);
+  EXPECT_EQ(recorder.num_spans(), 0);
+}
+
+TEST(TraceRecorderTest, RecordsSpansAsChromeTraceEvents) {
+  std::string json;
+  {
+    TraceRecorder recorder(TraceOptions{});
+    {
+      ScopedTraceSpan span("AnalyzePerfData", "perf.\"data\"\n");
+    }
+    EXPECT_EQ(recorder.num_spans(), 1);
+    json = recorder.ToJson();
+  }
+  EXPECT_EQ(TraceRecorder::Active(), nullptr);
+  EXPECT_TRUE(absl::StartsWith(json, "{\"traceEvents\": [\n"));
+  EXPECT_THAT(json, HasSubstr("{\"name\": \"AnalyzePerfData\", \"ph\": \"X\", "
+                              "\"pid\": 1, \"tid\": "));
+  EXPECT_THAT(json, HasSubstr("\"args\": {\"detail\": "
+                              "\"perf.\\\"data\\\"\\u000a\"}"));
+}
+
+TEST(TraceRecorderTest, SamplesHighFrequencySpans) {
+  TraceOptions options;
+  options.set_high_frequency_sampling_period(10);
+  TraceRecorder recorder(options);
+  // Use a new thread so the sampling starts with its first span.
+  std::thread thread([] {
+    for (int i = 0; i < 25; ++i) {
+      ScopedTraceSpan span("BuildChains", "", TraceSpanFrequency::kHigh);
+    }
+    ScopedTraceSpan span("layout");
+  });
+  thread.join();
+  EXPECT_EQ(recorder.num_spans(), 4);
+  EXPECT_THAT(recorder.ToJson(), HasSubstr("\"sampling_period\": 10"));
+}
+
+TEST(TraceRecorderTest, RecordsThreadIds) {
+  TraceRecorder recorder(TraceOptions{});
+  { ScopedTraceSpan span("main"); }
+  std::thread thread([] { ScopedTraceSpan span("worker"); });
+  thread.join();
+  const std::string json = recorder.ToJson();
+  EXPECT_EQ(recorder.num_spans(), 2);
+  // The spans are recorded with different thread ids.
+  const size_t main_tid = json.find("\"tid\": ", json.find("\"main\""));
+  const size_t worker_tid = json.find("\"tid\": ", json.find("\"worker\""));
+  ASSERT_NE(main_tid, std::string::npos);
+  ASSERT_NE(worker_tid, std::string::npos);
+  EXPECT_NE(json.substr(main_tid, json.find(',', main_tid) - main_tid),
+            json.substr(worker_tid, json.find(',', worker_tid) - worker_tid));
+  EXPECT_THAT(json, Not(HasSubstr("\"args\"")));
+}
+}  // namespace
+}  // namespace propeller